@@ -31,6 +31,7 @@
 #include <grub/kernel.h>
 #include <grub/extcmd.h>
 #include <grub/verify.h>
+#include <grub/montgomery.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -156,6 +157,10 @@ dsa_pad (gcry_mpi_t *hmpi, grub_uint8_t *hval,
 static int
 rsa_pad (gcry_mpi_t *hmpi, grub_uint8_t *hval,
 	 const gcry_md_spec_t *hash, struct grub_public_subkey *sk);
+static int
+dsa_verify (gcry_mpi_t hmpi, gcry_mpi_t *sig, struct grub_public_subkey *sk);
+static int
+rsa_verify (gcry_mpi_t hmpi, gcry_mpi_t *sig, struct grub_public_subkey *sk);
 
 struct
 {
@@ -165,12 +170,17 @@ struct
   struct gcry_pk_spec **algo;
   int (*pad) (gcry_mpi_t *hmpi, grub_uint8_t *hval,
 	      const gcry_md_spec_t *hash, struct grub_public_subkey *sk);
+  /* Returns 0 for a good signature, 1 for a bad one and -1 if the
+     signature has to be checked by MODULE instead, e.g. when running out
+     of memory.  */
+  int (*verify) (gcry_mpi_t hmpi, gcry_mpi_t *sig,
+		 struct grub_public_subkey *sk);
   const char *module;
 } pkalgos[] = 
   {
-    [1] = { "rsa", 1, 2, &grub_crypto_pk_rsa, rsa_pad, "gcry_rsa" },
-    [3] = { "rsa", 1, 2, &grub_crypto_pk_rsa, rsa_pad, "gcry_rsa" },
-    [17] = { "dsa", 2, 4, &grub_crypto_pk_dsa, dsa_pad, "gcry_dsa" },
+    [1] = { "rsa", 1, 2, &grub_crypto_pk_rsa, rsa_pad, rsa_verify, "gcry_rsa" },
+    [3] = { "rsa", 1, 2, &grub_crypto_pk_rsa, rsa_pad, rsa_verify, "gcry_rsa" },
+    [17] = { "dsa", 2, 4, &grub_crypto_pk_dsa, dsa_pad, dsa_verify, "gcry_dsa" },
   };
 
 struct grub_public_key
@@ -185,8 +195,38 @@ struct grub_public_subkey
   grub_uint8_t type;
   grub_uint32_t fingerprint[5];
   gcry_mpi_t mpis[10];
+  /* Set up on first use and kept for further signatures by this key.  */
+  struct pk_mont *mont;
+};
+
+/* Precomputed Montgomery state of a public key.  */
+struct pk_mont
+{
+  /* Verifier this was set up by.  */
+  int (*verify) (gcry_mpi_t hmpi, gcry_mpi_t *sig,
+		 struct grub_public_subkey *sk);
+  grub_mont_ctx_t ctx;
+  grub_size_t modlen;
+  /* RSA public exponent.  */
+  grub_uint8_t *e;
+  grub_size_t elen;
+  /* Powers of the DSA generator and public value.  */
+  grub_mont_limb_t *g;
+  grub_mont_limb_t *y;
 };
 
+static void
+pk_mont_free (struct pk_mont *m)
+{
+  if (!m)
+    return;
+  grub_mont_ctx_free (m->ctx);
+  grub_free (m->e);
+  grub_free (m->g);
+  grub_free (m->y);
+  grub_free (m);
+}
+
 static void
 free_pk (struct grub_public_key *pk)
 {
@@ -197,6 +237,7 @@ free_pk (struct grub_public_key *pk)
       for (i = 0; i < ARRAY_SIZE (sk->mpis); i++)
 	if (sk->mpis[i])
 	  gcry_mpi_release (sk->mpis[i]);
+      pk_mont_free (sk->mont);
       nsk = sk->next;
       grub_free (sk);
     }
@@ -439,6 +480,229 @@ rsa_pad (gcry_mpi_t *hmpi, grub_uint8_t *hval,
   return ret;
 }
 
+/* Return A as a big-endian number in a new buffer.  */
+static grub_uint8_t *
+mpi_to_buf (gcry_mpi_t a, grub_size_t *len)
+{
+  grub_size_t size = (gcry_mpi_get_nbits (a) + 7) / 8;
+  grub_uint8_t *buf;
+  size_t written;
+
+  buf = grub_malloc (size ? size : 1);
+  if (!buf)
+    return NULL;
+  if (gcry_mpi_print (GCRYMPI_FMT_USG, buf, size, &written, a))
+    {
+      grub_free (buf);
+      return NULL;
+    }
+  *len = written;
+  return buf;
+}
+
+static grub_err_t
+mpi_to_mont (struct pk_mont *m, grub_mont_limb_t *out, gcry_mpi_t a)
+{
+  grub_uint8_t *buf;
+  grub_size_t len;
+  grub_err_t err;
+
+  buf = mpi_to_buf (a, &len);
+  if (!buf && grub_errno)
+    return grub_errno;
+  if (!buf)
+    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+  err = grub_mont_import (m->ctx, out, buf, len);
+  grub_free (buf);
+  return err;
+}
+
+static gcry_mpi_t
+mont_to_mpi (struct pk_mont *m, const grub_mont_limb_t *in)
+{
+  grub_uint8_t *buf;
+  gcry_mpi_t ret = NULL;
+
+  buf = grub_malloc (m->modlen);
+  if (!buf)
+    return NULL;
+  if (grub_mont_export (m->ctx, buf, m->modlen, in) == GRUB_ERR_NONE)
+    gcry_mpi_scan (&ret, GCRYMPI_FMT_USG, buf, m->modlen, 0);
+  grub_free (buf);
+  return ret;
+}
+
+/* Replace the cached state of SK with a new one for arithmetic modulo
+   MOD.  */
+static struct pk_mont *
+pk_mont_new (struct grub_public_subkey *sk,
+	     int (*verify) (gcry_mpi_t hmpi, gcry_mpi_t *sig,
+			    struct grub_public_subkey *sk),
+	     gcry_mpi_t mod)
+{
+  struct pk_mont *m;
+  grub_uint8_t *buf;
+
+  pk_mont_free (sk->mont);
+  sk->mont = NULL;
+
+  m = grub_zalloc (sizeof (*m));
+  if (!m)
+    return NULL;
+  m->verify = verify;
+  buf = mpi_to_buf (mod, &m->modlen);
+  if (buf)
+    m->ctx = grub_mont_ctx_new (buf, m->modlen);
+  grub_free (buf);
+  if (!m->ctx)
+    {
+      grub_free (m);
+      return NULL;
+    }
+  return m;
+}
+
+static struct pk_mont *
+rsa_mont (struct grub_public_subkey *sk)
+{
+  struct pk_mont *m;
+
+  if (sk->mont && sk->mont->verify == rsa_verify)
+    return sk->mont;
+
+  m = pk_mont_new (sk, rsa_verify, sk->mpis[0]);
+  if (!m)
+    return NULL;
+  m->e = mpi_to_buf (sk->mpis[1], &m->elen);
+  if (!m->e)
+    {
+      pk_mont_free (m);
+      return NULL;
+    }
+  sk->mont = m;
+  return m;
+}
+
+/* RSASSA-PKCS1-v1_5: S^E mod N has to be the padded hash.  */
+static int
+rsa_verify (gcry_mpi_t hmpi, gcry_mpi_t *sig, struct grub_public_subkey *sk)
+{
+  struct pk_mont *m;
+  grub_mont_limb_t *x;
+  gcry_mpi_t v;
+  grub_err_t err;
+  int ret = -1;
+
+  m = rsa_mont (sk);
+  if (!m)
+    return -1;
+
+  x = grub_mont_alloc (m->ctx, 1);
+  if (!x)
+    return -1;
+  err = mpi_to_mont (m, x, sig[0]);
+  if (err)
+    {
+      /* Unless out of memory, S is not smaller than N.  */
+      if (err != GRUB_ERR_OUT_OF_MEMORY)
+	ret = 1;
+      grub_errno = GRUB_ERR_NONE;
+    }
+  else if (grub_mont_powm (m->ctx, x, x, m->e, m->elen) == GRUB_ERR_NONE)
+    {
+      v = mont_to_mpi (m, x);
+      if (v)
+	{
+	  ret = gcry_mpi_cmp (v, hmpi) != 0;
+	  gcry_mpi_release (v);
+	}
+    }
+  grub_free (x);
+  return ret;
+}
+
+static struct pk_mont *
+dsa_mont (struct grub_public_subkey *sk)
+{
+  struct pk_mont *m;
+  grub_mont_limb_t *x;
+
+  if (sk->mont && sk->mont->verify == dsa_verify)
+    return sk->mont;
+
+  m = pk_mont_new (sk, dsa_verify, sk->mpis[0]);
+  if (!m)
+    return NULL;
+  x = grub_mont_alloc (m->ctx, 1);
+  if (!x
+      || mpi_to_mont (m, x, sk->mpis[2])
+      || !(m->g = grub_mont_table_new (m->ctx, x))
+      || mpi_to_mont (m, x, sk->mpis[3])
+      || !(m->y = grub_mont_table_new (m->ctx, x)))
+    {
+      grub_free (x);
+      pk_mont_free (m);
+      return NULL;
+    }
+  grub_free (x);
+  sk->mont = m;
+  return m;
+}
+
+/* DSA: with W = S^-1 mod Q, (G^(H * W) * Y^(R * W) mod P) mod Q has to
+   be R.  Both powers share their squarings.  */
+static int
+dsa_verify (gcry_mpi_t hmpi, gcry_mpi_t *sig, struct grub_public_subkey *sk)
+{
+  gcry_mpi_t q = sk->mpis[1], r = sig[0], s = sig[1];
+  gcry_mpi_t w = NULL, u1 = NULL, u2 = NULL, v = NULL;
+  grub_uint8_t *e1 = NULL, *e2 = NULL;
+  grub_size_t e1len, e2len;
+  grub_mont_limb_t *x = NULL;
+  struct pk_mont *m;
+  int ret = -1;
+
+  m = dsa_mont (sk);
+  if (!m)
+    return -1;
+
+  if (gcry_mpi_cmp_ui (r, 0) <= 0 || gcry_mpi_cmp (r, q) >= 0
+      || gcry_mpi_cmp_ui (s, 0) <= 0 || gcry_mpi_cmp (s, q) >= 0)
+    return 1;
+
+  w = gcry_mpi_new (0);
+  u1 = gcry_mpi_new (0);
+  u2 = gcry_mpi_new (0);
+  if (!w || !u1 || !u2)
+    goto out;
+  gcry_mpi_invm (w, s, q);
+  gcry_mpi_mulm (u1, hmpi, w, q);
+  gcry_mpi_mulm (u2, r, w, q);
+
+  e1 = mpi_to_buf (u1, &e1len);
+  e2 = mpi_to_buf (u2, &e2len);
+  x = grub_mont_alloc (m->ctx, 1);
+  if (!e1 || !e2 || !x)
+    goto out;
+  grub_mont_powm2 (m->ctx, x, m->g, e1, e1len, m->y, e2, e2len);
+
+  v = mont_to_mpi (m, x);
+  if (!v)
+    goto out;
+  gcry_mpi_mod (v, v, q);
+  ret = gcry_mpi_cmp (v, r) != 0;
+
+ out:
+  gcry_mpi_release (w);
+  gcry_mpi_release (u1);
+  gcry_mpi_release (u2);
+  gcry_mpi_release (v);
+  grub_free (e1);
+  grub_free (e2);
+  grub_free (x);
+  return ret;
+}
+
 struct grub_pubkey_context
 {
   grub_file_t sig;
@@ -640,6 +904,18 @@ grub_verify_signature_real (struct grub_pubkey_context *ctxt,
 
   if (pkalgos[pk].pad (&hmpi, hval, ctxt->hash, sk))
     goto fail;
+
+  switch (pkalgos[pk].verify (hmpi, mpis, sk))
+    {
+    case 0:
+      grub_free (readbuf);
+      return GRUB_ERR_NONE;
+    case 1:
+      goto fail;
+    }
+  /* Not a key we can do ourselves, use libgcrypt.  */
+  grub_errno = GRUB_ERR_NONE;
+
   if (!*pkalgos[pk].algo)
     {
       grub_dl_load (pkalgos[pk].module);
@@ -44,6 +44,9 @@ static const struct grub_arg_option options[] =
     {0, 0, 0, 0, 0, 0}
   };
 
+/* Number of sectors whose IVs are generated together.  */
+#define GRUB_CRYPTODISK_IV_BATCH 32
+
 /* Our irreducible polynom is x^128+x^7+x^2+x+1. Lowest byte of it is:  */
 #define GF_POLYNOM 0x87
 static inline int GF_PER_SECTOR (const struct grub_cryptodisk *dev)
@@ -54,21 +57,19 @@ static inline int GF_PER_SECTOR (const struct grub_cryptodisk *dev)
 static grub_cryptodisk_t cryptodisk_list = NULL;
 static grub_uint8_t last_cryptodisk_id = 0;
 
+/* G is a little-endian 128-bit number, so it can be shifted as two
+   64-bit halves instead of byte by byte.  */
 static void
 gf_mul_x (grub_uint8_t *g)
 {
-  int over = 0, over2 = 0;
-  unsigned j;
-
-  for (j = 0; j < GRUB_CRYPTODISK_GF_BYTES; j++)
-    {
-      over2 = !!(g[j] & 0x80);
-      g[j] <<= 1;
-      g[j] |= over;
-      over = over2;
-    }
-  if (over)
-    g[0] ^= GF_POLYNOM;
+  grub_uint64_t lo = grub_le_to_cpu64 (grub_get_unaligned64 (g));
+  grub_uint64_t hi = grub_le_to_cpu64 (grub_get_unaligned64 (g + 8));
+  grub_uint64_t over = hi >> 63;
+
+  hi = (hi << 1) | (lo >> 63);
+  lo = (lo << 1) ^ (over * GF_POLYNOM);
+  grub_set_unaligned64 (g, grub_cpu_to_le64 (lo));
+  grub_set_unaligned64 (g + 8, grub_cpu_to_le64 (hi));
 }
 
 
@@ -221,6 +222,82 @@ lrw_xor (const struct lrw_sector *sec,
 		   dev->lrw_precalc, sec->low_byte * GRUB_CRYPTODISK_GF_BYTES);
 }
 
+/* Fill IVS with the IVs of NSECTORS consecutive sectors starting at SECTOR.
+   Each IV is SZ words long.  */
+static gcry_err_code_t
+generate_ivs (struct grub_cryptodisk *dev, grub_uint32_t *ivs,
+	      grub_size_t nsectors, grub_disk_addr_t sector)
+{
+  grub_size_t blocksize = dev->cipher->cipher->blocksize;
+  grub_size_t sz = blocksize / sizeof (grub_uint32_t);
+  grub_size_t j;
+  grub_uint32_t *iv;
+
+  grub_memset (ivs, 0, nsectors * blocksize);
+  switch (dev->mode_iv)
+    {
+    case GRUB_CRYPTODISK_MODE_IV_NULL:
+      break;
+    case GRUB_CRYPTODISK_MODE_IV_BYTECOUNT64_HASH:
+      {
+	grub_uint64_t tmp;
+	void *ctx;
+
+	ctx = grub_zalloc (dev->iv_hash->contextsize);
+	if (!ctx)
+	  return GPG_ERR_OUT_OF_MEMORY;
+
+	for (j = 0, iv = ivs; j < nsectors; j++, iv += sz)
+	  {
+	    tmp = grub_cpu_to_le64 ((sector + j) << dev->log_sector_size);
+	    dev->iv_hash->init (ctx);
+	    dev->iv_hash->write (ctx, dev->iv_prefix, dev->iv_prefix_len);
+	    dev->iv_hash->write (ctx, &tmp, sizeof (tmp));
+	    dev->iv_hash->final (ctx);
+
+	    grub_memcpy (iv, dev->iv_hash->read (ctx), blocksize);
+	  }
+	grub_free (ctx);
+      }
+      break;
+    case GRUB_CRYPTODISK_MODE_IV_PLAIN64:
+      for (j = 0, iv = ivs; j < nsectors; j++, iv += sz)
+	{
+	  iv[1] = grub_cpu_to_le32 ((sector + j) >> 32);
+	  iv[0] = grub_cpu_to_le32 ((sector + j) & 0xFFFFFFFF);
+	}
+      break;
+    case GRUB_CRYPTODISK_MODE_IV_PLAIN:
+      for (j = 0, iv = ivs; j < nsectors; j++, iv += sz)
+	iv[0] = grub_cpu_to_le32 ((sector + j) & 0xFFFFFFFF);
+      break;
+    case GRUB_CRYPTODISK_MODE_IV_BYTECOUNT64:
+      for (j = 0, iv = ivs; j < nsectors; j++, iv += sz)
+	{
+	  iv[1] = grub_cpu_to_le32 ((sector + j)
+				    >> (32 - dev->log_sector_size));
+	  iv[0] = grub_cpu_to_le32 (((sector + j) << dev->log_sector_size)
+				    & 0xFFFFFFFF);
+	}
+      break;
+    case GRUB_CRYPTODISK_MODE_IV_BENBI:
+      for (j = 0, iv = ivs; j < nsectors; j++, iv += sz)
+	{
+	  grub_uint64_t num = ((sector + j) << dev->benbi_log) + 1;
+	  iv[sz - 2] = grub_cpu_to_be32 (num >> 32);
+	  iv[sz - 1] = grub_cpu_to_be32 (num & 0xFFFFFFFF);
+	}
+      break;
+    case GRUB_CRYPTODISK_MODE_IV_ESSIV:
+      for (j = 0, iv = ivs; j < nsectors; j++, iv += sz)
+	iv[0] = grub_cpu_to_le32 ((sector + j) & 0xFFFFFFFF);
+      /* One call for the whole run lets multi-block ciphers pipeline.  */
+      return grub_crypto_ecb_encrypt (dev->essiv_cipher, ivs, ivs,
+				      nsectors * blocksize);
+    }
+  return GPG_ERR_NO_ERROR;
+}
+
 static gcry_err_code_t
 grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 			   grub_uint8_t * data, grub_size_t len,
@@ -228,8 +305,14 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 {
   grub_size_t i;
   gcry_err_code_t err;
-
-  if (dev->cipher->cipher->blocksize > GRUB_CRYPTO_MAX_CIPHER_BLOCKSIZE)
+  grub_size_t blocksize = dev->cipher->cipher->blocksize;
+  grub_size_t sz = blocksize / sizeof (grub_uint32_t);
+  grub_uint32_t ivs[GRUB_CRYPTODISK_IV_BATCH
+		    * (GRUB_CRYPTO_MAX_CIPHER_BLOCKSIZE
+		       / sizeof (grub_uint32_t))];
+
+  if (blocksize > GRUB_CRYPTO_MAX_CIPHER_BLOCKSIZE
+      || blocksize % sizeof (grub_uint32_t) != 0)
     return GPG_ERR_INV_ARG;
 
   /* The only mode without IV.  */
@@ -237,16 +320,23 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
     return (do_encrypt ? grub_crypto_ecb_encrypt (dev->cipher, data, data, len)
 	    : grub_crypto_ecb_decrypt (dev->cipher, data, data, len));
 
-  for (i = 0; i < len; i += (1U << dev->log_sector_size))
+  /* IVs (and XTS tweaks) are generated for a run of sectors at once and the
+     run is then handed to the cipher.  */
+  for (i = 0; i < len; )
     {
-      grub_size_t sz = ((dev->cipher->cipher->blocksize
-			 + sizeof (grub_uint32_t) - 1)
-			/ sizeof (grub_uint32_t));
-      grub_uint32_t iv[(GRUB_CRYPTO_MAX_CIPHER_BLOCKSIZE + 3) / 4];
+      grub_size_t nsectors = (len - i) >> dev->log_sector_size;
+      grub_size_t j;
+      grub_uint32_t *iv;
+
+      if (nsectors > GRUB_CRYPTODISK_IV_BATCH)
+	nsectors = GRUB_CRYPTODISK_IV_BATCH;
+      if (nsectors == 0)
+	break;
 
       if (dev->rekey)
 	{
 	  grub_uint64_t zone = sector >> dev->rekey_shift;
+	  grub_disk_addr_t zone_end = (zone + 1) << dev->rekey_shift;
 	  if (zone != dev->last_rekey)
 	    {
 	      err = dev->rekey (dev, zone);
@@ -254,144 +344,118 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 		return err;
 	      dev->last_rekey = zone;
 	    }
+	  /* A run must not span two keys.  */
+	  if (sector + nsectors > zone_end)
+	    nsectors = zone_end - sector;
 	}
 
-      grub_memset (iv, 0, sizeof (iv));
-      switch (dev->mode_iv)
-	{
-	case GRUB_CRYPTODISK_MODE_IV_NULL:
-	  break;
-	case GRUB_CRYPTODISK_MODE_IV_BYTECOUNT64_HASH:
-	  {
-	    grub_uint64_t tmp;
-	    void *ctx;
-
-	    ctx = grub_zalloc (dev->iv_hash->contextsize);
-	    if (!ctx)
-	      return GPG_ERR_OUT_OF_MEMORY;
+      err = generate_ivs (dev, ivs, nsectors, sector);
+      if (err)
+	return err;
 
-	    tmp = grub_cpu_to_le64 (sector << dev->log_sector_size);
-	    dev->iv_hash->init (ctx);
-	    dev->iv_hash->write (ctx, dev->iv_prefix, dev->iv_prefix_len);
-	    dev->iv_hash->write (ctx, &tmp, sizeof (tmp));
-	    dev->iv_hash->final (ctx);
+      if (dev->mode == GRUB_CRYPTODISK_MODE_XTS)
+	{
+	  gcry_cipher_xts_t xts = (do_encrypt ? dev->cipher->cipher->xts_encrypt
+				   : dev->cipher->cipher->xts_decrypt);
 
-	    grub_memcpy (iv, dev->iv_hash->read (ctx), sizeof (iv));
-	    grub_free (ctx);
-	  }
-	  break;
-	case GRUB_CRYPTODISK_MODE_IV_PLAIN64:
-	  iv[1] = grub_cpu_to_le32 (sector >> 32);
-	  /* FALLTHROUGH */
-	case GRUB_CRYPTODISK_MODE_IV_PLAIN:
-	  iv[0] = grub_cpu_to_le32 (sector & 0xFFFFFFFF);
-	  break;
-	case GRUB_CRYPTODISK_MODE_IV_BYTECOUNT64:
-	  iv[1] = grub_cpu_to_le32 (sector >> (32 - dev->log_sector_size));
-	  iv[0] = grub_cpu_to_le32 ((sector << dev->log_sector_size)
-				    & 0xFFFFFFFF);
-	  break;
-	case GRUB_CRYPTODISK_MODE_IV_BENBI:
-	  {
-	    grub_uint64_t num = (sector << dev->benbi_log) + 1;
-	    iv[sz - 2] = grub_cpu_to_be32 (num >> 32);
-	    iv[sz - 1] = grub_cpu_to_be32 (num & 0xFFFFFFFF);
-	  }
-	  break;
-	case GRUB_CRYPTODISK_MODE_IV_ESSIV:
-	  iv[0] = grub_cpu_to_le32 (sector & 0xFFFFFFFF);
-	  err = grub_crypto_ecb_encrypt (dev->essiv_cipher, iv, iv,
-					 dev->cipher->cipher->blocksize);
+	  err = grub_crypto_ecb_encrypt (dev->secondary_cipher, ivs, ivs,
+					 nsectors * blocksize);
 	  if (err)
 	    return err;
+
+	  if (xts)
+	    {
+	      xts (dev->cipher->ctx, data + i, data + i, nsectors,
+		   (1U << dev->log_sector_size) / blocksize,
+		   (grub_uint8_t *) ivs);
+	      i += nsectors << dev->log_sector_size;
+	      sector += nsectors;
+	      continue;
+	    }
 	}
 
-      switch (dev->mode)
+      for (j = 0, iv = ivs; j < nsectors; j++, iv += sz)
 	{
-	case GRUB_CRYPTODISK_MODE_CBC:
-	  if (do_encrypt)
-	    err = grub_crypto_cbc_encrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size), iv);
-	  else
-	    err = grub_crypto_cbc_decrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size), iv);
-	  if (err)
-	    return err;
-	  break;
-
-	case GRUB_CRYPTODISK_MODE_PCBC:
-	  if (do_encrypt)
-	    err = grub_crypto_pcbc_encrypt (dev->cipher, data + i, data + i,
-					    (1U << dev->log_sector_size), iv);
-	  else
-	    err = grub_crypto_pcbc_decrypt (dev->cipher, data + i, data + i,
-					    (1U << dev->log_sector_size), iv);
-	  if (err)
-	    return err;
-	  break;
-	case GRUB_CRYPTODISK_MODE_XTS:
-	  {
-	    unsigned j;
-	    err = grub_crypto_ecb_encrypt (dev->secondary_cipher, iv, iv,
-					   dev->cipher->cipher->blocksize);
-	    if (err)
-	      return err;
-	    
-	    for (j = 0; j < (1U << dev->log_sector_size);
-		 j += dev->cipher->cipher->blocksize)
+	  switch (dev->mode)
+	    {
+	    case GRUB_CRYPTODISK_MODE_CBC:
+	      if (do_encrypt)
+		err = grub_crypto_cbc_encrypt (dev->cipher, data + i, data + i,
+					       (1U << dev->log_sector_size), iv);
+	      else
+		err = grub_crypto_cbc_decrypt (dev->cipher, data + i, data + i,
+					       (1U << dev->log_sector_size), iv);
+	      if (err)
+		return err;
+	      break;
+
+	    case GRUB_CRYPTODISK_MODE_PCBC:
+	      if (do_encrypt)
+		err = grub_crypto_pcbc_encrypt (dev->cipher, data + i, data + i,
+						(1U << dev->log_sector_size), iv);
+	      else
+		err = grub_crypto_pcbc_decrypt (dev->cipher, data + i, data + i,
+						(1U << dev->log_sector_size), iv);
+	      if (err)
+		return err;
+	      break;
+	    case GRUB_CRYPTODISK_MODE_XTS:
+	      {
+		unsigned k;
+
+		/* IV already holds the encrypted tweak.  */
+		for (k = 0; k < (1U << dev->log_sector_size); k += blocksize)
+		  {
+		    grub_crypto_xor (data + i + k, data + i + k, iv, blocksize);
+		    if (do_encrypt)
+		      err = grub_crypto_ecb_encrypt (dev->cipher, data + i + k,
+						     data + i + k, blocksize);
+		    else
+		      err = grub_crypto_ecb_decrypt (dev->cipher, data + i + k,
+						     data + i + k, blocksize);
+		    if (err)
+		      return err;
+		    grub_crypto_xor (data + i + k, data + i + k, iv, blocksize);
+		    gf_mul_x ((grub_uint8_t *) iv);
+		  }
+	      }
+	      break;
+	    case GRUB_CRYPTODISK_MODE_LRW:
 	      {
-		grub_crypto_xor (data + i + j, data + i + j, iv,
-				 dev->cipher->cipher->blocksize);
+		struct lrw_sector sec;
+
+		generate_lrw_sector (&sec, dev, (grub_uint8_t *) iv);
+		lrw_xor (&sec, dev, data + i);
+
 		if (do_encrypt)
-		  err = grub_crypto_ecb_encrypt (dev->cipher, data + i + j, 
-						 data + i + j,
-						 dev->cipher->cipher->blocksize);
+		  err = grub_crypto_ecb_encrypt (dev->cipher, data + i,
+						 data + i,
+						 (1U << dev->log_sector_size));
 		else
-		  err = grub_crypto_ecb_decrypt (dev->cipher, data + i + j, 
-						 data + i + j,
-						 dev->cipher->cipher->blocksize);
+		  err = grub_crypto_ecb_decrypt (dev->cipher, data + i,
+						 data + i,
+						 (1U << dev->log_sector_size));
 		if (err)
 		  return err;
-		grub_crypto_xor (data + i + j, data + i + j, iv,
-				 dev->cipher->cipher->blocksize);
-		gf_mul_x ((grub_uint8_t *) iv);
+		lrw_xor (&sec, dev, data + i);
 	      }
-	  }
-	  break;
-	case GRUB_CRYPTODISK_MODE_LRW:
-	  {
-	    struct lrw_sector sec;
-
-	    generate_lrw_sector (&sec, dev, (grub_uint8_t *) iv);
-	    lrw_xor (&sec, dev, data + i);
-
-	    if (do_encrypt)
-	      err = grub_crypto_ecb_encrypt (dev->cipher, data + i, 
-					     data + i,
-					     (1U << dev->log_sector_size));
-	    else
-	      err = grub_crypto_ecb_decrypt (dev->cipher, data + i, 
-					     data + i,
-					     (1U << dev->log_sector_size));
-	    if (err)
-	      return err;
-	    lrw_xor (&sec, dev, data + i);
-	  }
-	  break;
-	case GRUB_CRYPTODISK_MODE_ECB:
-	  if (do_encrypt)
-	    err = grub_crypto_ecb_encrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size));
-	  else
-	    err = grub_crypto_ecb_decrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size));
-	  if (err)
-	    return err;
-	  break;
-	default:
-	  return GPG_ERR_NOT_IMPLEMENTED;
+	      break;
+	    case GRUB_CRYPTODISK_MODE_ECB:
+	      if (do_encrypt)
+		err = grub_crypto_ecb_encrypt (dev->cipher, data + i, data + i,
+					       (1U << dev->log_sector_size));
+	      else
+		err = grub_crypto_ecb_decrypt (dev->cipher, data + i, data + i,
+					       (1U << dev->log_sector_size));
+	      if (err)
+		return err;
+	      break;
+	    default:
+	      return GPG_ERR_NOT_IMPLEMENTED;
+	    }
+	  i += (1U << dev->log_sector_size);
+	  sector++;
 	}
-      sector++;
     }
   return GPG_ERR_NO_ERROR;
 }
@@ -404,6 +468,25 @@ grub_cryptodisk_decrypt (struct grub_cryptodisk *dev,
   return grub_cryptodisk_endecrypt (dev, data, len, sector, 0);
 }
 
+static inline int
+is_aes (const char *name)
+{
+  return grub_strncasecmp (name, "aes", sizeof ("aes") - 1) == 0;
+}
+
+/* The generic AES satisfies a lookup by itself, so the AES-NI one would
+   never be autoloaded.  Give it a chance to register first.  */
+const gcry_cipher_spec_t *
+grub_cryptodisk_lookup_cipher (const char *name)
+{
+#if (defined (__i386__) || defined (__x86_64__)) && !defined (GRUB_UTIL) \
+  && !defined (GRUB_MACHINE_EMU)
+  if (is_aes (name) && !grub_dl_load ("aesni"))
+    grub_errno = GRUB_ERR_NONE;
+#endif
+  return grub_crypto_lookup_cipher_by_name (name);
+}
+
 grub_err_t
 grub_cryptodisk_setcipher (grub_cryptodisk_t crypt, const char *ciphername, const char *ciphermode)
 {
@@ -417,7 +500,7 @@ grub_cryptodisk_setcipher (grub_cryptodisk_t crypt, const char *ciphername, cons
   int benbi_log = 0;
   grub_err_t ret = GRUB_ERR_NONE;
 
-  ciph = grub_crypto_lookup_cipher_by_name (ciphername);
+  ciph = grub_cryptodisk_lookup_cipher (ciphername);
   if (!ciph)
     {
       ret = grub_error (GRUB_ERR_FILE_NOT_FOUND, "Cipher %s isn't available",
@@ -947,6 +1030,12 @@ grub_util_cryptodisk_get_abstraction (grub_disk_t disk,
 
   if (dev->cipher)
     cb (dev->cipher->cipher->modname, data);
+#if defined (__i386__) || defined (__x86_64__)
+  /* Otherwise nothing puts the AES-NI implementation in core.img, where
+     the disk is unlocked.  */
+  if (dev->cipher && is_aes (dev->cipher->cipher->name))
+    cb ("aesni", data);
+#endif
   if (dev->secondary_cipher)
     cb (dev->secondary_cipher->cipher->modname, data);
   if (dev->essiv_cipher)
@@ -575,6 +575,209 @@ validate_segment (struct grub_diskfilter_segment *seg)
 
 }
 
+/* Largest read issued to one member when merging chunks, in sectors.  */
+#define GRUB_DISKFILTER_MAX_TRANSFER 8192
+
+/* The chunks of a request read from one member at once.  */
+struct grub_diskfilter_transfer
+{
+  /* First and last chunk of the request, counted from 0.  */
+  grub_uint64_t first, last;
+  grub_uint64_t count;
+  grub_disk_addr_t start;
+  grub_size_t size;
+};
+
+/* Geometry of a request on a striped, mirrored or near-copy RAID10
+   segment when every chunk is read from copy COPY.  */
+struct grub_diskfilter_chunks
+{
+  struct grub_diskfilter_segment *seg;
+  grub_uint64_t first_chunk;
+  grub_uint64_t b;
+  grub_size_t size;
+  unsigned int near;
+  unsigned int copy;
+};
+
+/* Find where chunk K of the request is: return the member and store the
+   sector on it, the offset in the request and the length in sectors.  */
+static unsigned int
+locate_chunk (const struct grub_diskfilter_chunks *c, grub_uint64_t k,
+	      grub_disk_addr_t *sector, grub_size_t *ofs, grub_size_t *len)
+{
+  grub_uint64_t member, row;
+  grub_size_t stripe = c->seg->stripe_size;
+
+  row = grub_divmod64 ((c->first_chunk + k) * c->near + c->copy,
+		       c->seg->node_count, &member);
+  *sector = row * stripe;
+  if (k == 0)
+    {
+      *sector += c->b;
+      *ofs = 0;
+      *len = stripe - c->b;
+    }
+  else
+    {
+      *ofs = k * stripe - c->b;
+      *len = stripe;
+    }
+  if (*len > c->size - *ofs)
+    *len = c->size - *ofs;
+
+  return member;
+}
+
+/* Read the chunks in T from MEMBER and put them in place in BUF.  */
+static grub_err_t
+read_transfer (const struct grub_diskfilter_chunks *c, unsigned int member,
+	       struct grub_diskfilter_transfer *t, char *buf)
+{
+  struct grub_diskfilter_node *node = &c->seg->nodes[member];
+  grub_disk_addr_t sector;
+  grub_size_t ofs, len;
+  grub_uint64_t k;
+  grub_err_t err;
+  char *tmp;
+
+  locate_chunk (c, t->first, &sector, &ofs, &len);
+
+  /* Chunks following each other in the request are read in place.  */
+  if (t->last - t->first + 1 == t->count)
+    {
+      err = grub_diskfilter_read_node (node, t->start, t->size,
+				       buf + (ofs << GRUB_DISK_SECTOR_BITS));
+      if (!err)
+	node->next_sector = t->start + t->size;
+      t->size = 0;
+      return err;
+    }
+
+  tmp = grub_malloc (t->size << GRUB_DISK_SECTOR_BITS);
+  if (!tmp)
+    return grub_errno;
+
+  err = grub_diskfilter_read_node (node, t->start, t->size, tmp);
+  if (!err)
+    {
+      for (k = t->first; k <= t->last; k++)
+	if (locate_chunk (c, k, &sector, &ofs, &len) == member)
+	  grub_memcpy (buf + (ofs << GRUB_DISK_SECTOR_BITS),
+		       tmp + ((sector - t->start) << GRUB_DISK_SECTOR_BITS),
+		       len << GRUB_DISK_SECTOR_BITS);
+      node->next_sector = t->start + t->size;
+    }
+  grub_free (tmp);
+  t->size = 0;
+  return err;
+}
+
+/* Read SIZE sectors at SECTOR of a segment keeping NEAR copies of every
+   chunk on consecutive members, issuing the largest possible read to
+   every member instead of one per chunk.  Of the copies, the one whose
+   member last read closest to the request is used, spreading interleaved
+   sequential reads over mirrors.  Return GRUB_ERR_READ_ERROR without
+   setting grub_errno if the caller should retry chunk by chunk.  */
+static grub_err_t
+read_merged (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
+	     grub_size_t size, char *buf, unsigned int near)
+{
+  struct grub_diskfilter_chunks c;
+  struct grub_diskfilter_transfer *t;
+  grub_uint64_t k, nchunks, best = 0;
+  grub_err_t err = GRUB_ERR_NONE;
+  unsigned int i, best_copy = 0;
+  int found = 0;
+
+  c.seg = seg;
+  c.first_chunk = grub_divmod64 (sector, seg->stripe_size, &c.b);
+  c.size = size;
+  c.near = near;
+  c.copy = 0;
+  nchunks = grub_divmod64 (c.b + size + seg->stripe_size - 1,
+			   seg->stripe_size, NULL);
+
+  for (i = 0; i < near; i++)
+    {
+      grub_disk_addr_t start, next;
+      grub_size_t ofs, len;
+      grub_uint64_t dist;
+      unsigned int member;
+
+      c.copy = i;
+      member = locate_chunk (&c, 0, &start, &ofs, &len);
+      if (!is_node_readable (&seg->nodes[member], 1))
+	continue;
+
+      next = seg->nodes[member].next_sector;
+      dist = next > start ? next - start : start - next;
+      if (!found || dist < best)
+	{
+	  found = 1;
+	  best = dist;
+	  best_copy = i;
+	  if (!dist)
+	    break;
+	}
+    }
+  if (!found)
+    return GRUB_ERR_READ_ERROR;
+  c.copy = best_copy;
+
+  /* Being short of memory for the merged reads is no reason to fail.  */
+  t = grub_calloc (seg->node_count, sizeof (*t));
+  if (!t)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return GRUB_ERR_READ_ERROR;
+    }
+
+  for (k = 0; k < nchunks; k++)
+    {
+      grub_disk_addr_t start;
+      grub_size_t ofs, len;
+      unsigned int member;
+
+      member = locate_chunk (&c, k, &start, &ofs, &len);
+      if (t[member].size
+	  && (t[member].start + t[member].size != start
+	      || t[member].size + len > GRUB_DISKFILTER_MAX_TRANSFER))
+	{
+	  err = read_transfer (&c, member, &t[member], buf);
+	  if (err)
+	    goto fail;
+	}
+      if (!t[member].size)
+	{
+	  t[member].first = k;
+	  t[member].count = 0;
+	  t[member].start = start;
+	}
+      t[member].last = k;
+      t[member].count++;
+      t[member].size += len;
+    }
+
+  for (i = 0; i < seg->node_count; i++)
+    if (t[i].size)
+      {
+	err = read_transfer (&c, i, &t[i], buf);
+	if (err)
+	  goto fail;
+      }
+
+ fail:
+  grub_free (t);
+  if (err == GRUB_ERR_READ_ERROR || err == GRUB_ERR_UNKNOWN_DEVICE
+      || err == GRUB_ERR_OUT_OF_MEMORY)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return GRUB_ERR_READ_ERROR;
+    }
+  return err;
+}
+
 static grub_err_t
 read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 	      grub_size_t size, char *buf)
@@ -616,6 +819,16 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 	    far_ofs *= seg->stripe_size;
 	  }
 
+	/* The first copies of all chunks are laid out like RAID0 unless
+	   copies are offset within the members.  Only when that fails the
+	   other copies are tried chunk by chunk.  */
+	if (near && ofs == 1)
+	  {
+	    err = read_merged (seg, sector, size, buf, near);
+	    if (err != GRUB_ERR_READ_ERROR)
+	      return err;
+	  }
+
 	read_sector = grub_divmod64 (read_sector * near, 
 				     seg->node_count,
 				     &disknr);
@@ -319,7 +319,7 @@ configure_ciphers (grub_disk_t disk, const char *check_uuid,
     }
 
   ciphername = algorithms[grub_le_to_cpu16 (header.alg)];
-  ciph = grub_crypto_lookup_cipher_by_name (ciphername);
+  ciph = grub_cryptodisk_lookup_cipher (ciphername);
   if (!ciph)
     {
       grub_error (GRUB_ERR_FILE_NOT_FOUND, "Cipher %s isn't available",
@@ -27,12 +27,39 @@
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+/* Maximum number of extents remembered per device.  */
+#define GRUB_LOOPBACK_MAX_EXTENTS 16384
+
+/* Bytes of the backing file found at a byte address of the disk it is
+   stored on.  */
+struct grub_loopback_extent
+{
+  grub_off_t offset;
+  grub_uint64_t addr;
+  grub_uint64_t length;
+};
+
 struct grub_loopback
 {
   char *devname;
   grub_file_t file;
   struct grub_loopback *next;
   unsigned long id;
+
+  /* Where the parts of FILE read so far are on FILE's disk, sorted by
+     offset.  */
+  struct grub_loopback_extent *extents;
+  unsigned num_extents;
+};
+
+/* Context for grub_loopback_read_file.  */
+struct grub_loopback_map_ctx
+{
+  struct grub_loopback_extent *extents;
+  unsigned num_extents;
+  unsigned alloc_extents;
+  grub_off_t offset;
+  int failed;
 };
 
 static struct grub_loopback *loopback_list;
@@ -68,6 +95,7 @@ delete_loopback (const char *name)
 
   grub_free (dev->devname);
   grub_file_close (dev->file);
+  grub_free (dev->extents);
   grub_free (dev);
 
   return 0;
@@ -106,12 +134,15 @@ grub_cmd_loopback (grub_extcmd_context_t ctxt, int argc, char **args)
     {
       grub_file_close (newdev->file);
       newdev->file = file;
+      grub_free (newdev->extents);
+      newdev->extents = NULL;
+      newdev->num_extents = 0;
 
       return 0;
     }
 
   /* Unable to replace it, make a new entry.  */
-  newdev = grub_malloc (sizeof (struct grub_loopback));
+  newdev = grub_zalloc (sizeof (struct grub_loopback));
   if (! newdev)
     goto fail;
 
@@ -182,18 +213,284 @@ grub_loopback_open (const char *name, grub_disk_t disk)
   return 0;
 }
 
+/* Append LENGTH bytes at ADDR to EXTENTS, merging with the last entry
+   when they follow it on disk.  */
+static int
+grub_loopback_append (struct grub_loopback_extent **extents,
+		      unsigned *num, unsigned *alloc, grub_off_t offset,
+		      grub_uint64_t addr, grub_uint64_t length)
+{
+  struct grub_loopback_extent *last = *num ? *extents + *num - 1 : NULL;
+
+  if (last && last->offset + last->length == offset
+      && last->addr + last->length == addr)
+    {
+      last->length += length;
+      return 0;
+    }
+
+  if (*num == *alloc)
+    {
+      struct grub_loopback_extent *n;
+      unsigned new_alloc = *alloc ? *alloc * 2 : 16;
+
+      n = grub_realloc (*extents, new_alloc * sizeof (**extents));
+      if (!n)
+	return -1;
+      *extents = n;
+      *alloc = new_alloc;
+    }
+
+  (*extents)[*num].offset = offset;
+  (*extents)[*num].addr = addr;
+  (*extents)[*num].length = length;
+  (*num)++;
+  return 0;
+}
+
+/* Helper for grub_loopback_read_file.  */
+static void
+grub_loopback_map_hook (grub_disk_addr_t sector, unsigned offset,
+			unsigned length, void *data)
+{
+  struct grub_loopback_map_ctx *ctx = data;
+
+  if (ctx->failed)
+    return;
+
+  if (grub_loopback_append (&ctx->extents, &ctx->num_extents,
+			    &ctx->alloc_extents, ctx->offset,
+			    (sector << GRUB_DISK_SECTOR_BITS) + offset, length))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      ctx->failed = 1;
+    }
+  ctx->offset += length;
+}
+
+/* Return the index of the first extent of DEV ending after OFFSET.  */
+static unsigned
+grub_loopback_find (struct grub_loopback *dev, grub_off_t offset)
+{
+  unsigned lo = 0, hi = dev->num_extents;
+
+  while (lo < hi)
+    {
+      unsigned mid = (lo + hi) / 2;
+
+      if (dev->extents[mid].offset + dev->extents[mid].length <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo;
+}
+
+/* Add the extents in CTX to the map of DEV.  */
+static void
+grub_loopback_add_extents (struct grub_loopback *dev,
+			   struct grub_loopback_map_ctx *ctx)
+{
+  struct grub_loopback_extent *n;
+  unsigned i, first, last, num, alloc;
+
+  if (!ctx->num_extents)
+    return;
+
+  /* Everything from the first to the last extent overlapping the new
+     range is replaced.  */
+  first = grub_loopback_find (dev, ctx->extents[0].offset);
+  for (last = first; last < dev->num_extents; last++)
+    if (dev->extents[last].offset >= ctx->offset)
+      break;
+
+  /* Splitting an old extent around the new range adds up to two.  */
+  num = dev->num_extents - (last - first) + ctx->num_extents + 2;
+  if (num > GRUB_LOOPBACK_MAX_EXTENTS)
+    return;
+
+  n = grub_malloc (num * sizeof (*n));
+  if (!n)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  alloc = num;
+  num = 0;
+  for (i = 0; i < first; i++)
+    n[num++] = dev->extents[i];
+  /* Keep the part of an overlapping extent in front of the new range.  */
+  if (first < last && dev->extents[first].offset < ctx->extents[0].offset)
+    {
+      n[num] = dev->extents[first];
+      n[num++].length = ctx->extents[0].offset - dev->extents[first].offset;
+    }
+  for (i = 0; i < ctx->num_extents; i++)
+    grub_loopback_append (&n, &num, &alloc, ctx->extents[i].offset,
+			  ctx->extents[i].addr, ctx->extents[i].length);
+  /* And the part of one reaching past its end.  */
+  if (first < last && dev->extents[last - 1].offset
+      + dev->extents[last - 1].length > ctx->offset)
+    {
+      grub_uint64_t skip = ctx->offset - dev->extents[last - 1].offset;
+
+      grub_loopback_append (&n, &num, &alloc, ctx->offset,
+			    dev->extents[last - 1].addr + skip,
+			    dev->extents[last - 1].length - skip);
+    }
+  for (i = last; i < dev->num_extents; i++)
+    grub_loopback_append (&n, &num, &alloc, dev->extents[i].offset,
+			  dev->extents[i].addr, dev->extents[i].length);
+
+  grub_free (dev->extents);
+  dev->extents = n;
+  dev->num_extents = num;
+}
+
+/* Read SIZE bytes at POS through the filesystem holding the backing file
+   and remember where they came from.  */
+static grub_err_t
+grub_loopback_read_file (struct grub_loopback *dev, grub_off_t pos,
+			 grub_size_t size, char *buf)
+{
+  grub_file_t file = dev->file;
+  struct grub_loopback_map_ctx ctx = {
+    .extents = NULL,
+    .num_extents = 0,
+    .alloc_extents = 0,
+    .offset = pos,
+    .failed = 0
+  };
+  grub_ssize_t res;
+
+  grub_file_seek (file, pos);
+
+  if (file->device->disk)
+    {
+      file->read_hook = grub_loopback_map_hook;
+      file->read_hook_data = &ctx;
+    }
+  res = grub_file_read (file, buf, size);
+  file->read_hook = 0;
+  file->read_hook_data = 0;
+
+  /* Only trust the map if the filesystem reported exactly the data it
+     returned.  Compressed, embedded or cached data doesn't show up, or
+     shows up with different lengths.  */
+  if (!grub_errno && !ctx.failed && res > 0 && ctx.offset == pos + res)
+    grub_loopback_add_extents (dev, &ctx);
+  grub_free (ctx.extents);
+
+  return grub_errno;
+}
+
+/* Read SIZE bytes at POS straight from the disk holding the backing file
+   if the map covers them, return the number of bytes read or 0.  */
+static grub_size_t
+grub_loopback_read_mapped (struct grub_loopback *dev, grub_off_t pos,
+			   grub_size_t size, char *buf)
+{
+  grub_disk_t disk = dev->file->device->disk;
+  struct grub_loopback_extent *ext;
+  grub_uint64_t addr, len, mask, start, end, max;
+  char *tmp = NULL;
+  unsigned i;
+
+  i = grub_loopback_find (dev, pos);
+  if (i == dev->num_extents || dev->extents[i].offset > pos)
+    return 0;
+
+  ext = &dev->extents[i];
+  addr = ext->addr + (pos - ext->offset);
+  len = ext->offset + ext->length - pos;
+  if (len > size)
+    len = size;
+
+  /* Extents needn't be aligned to the sectors of the disk.  */
+  mask = ((grub_uint64_t) 1 << disk->log_sector_size) - 1;
+  start = addr & ~mask;
+
+  /* Stay within the largest transfer the disk takes, some firmware fails
+     bigger ones.  The caller comes back for the rest.  */
+  max = (grub_uint64_t) disk->max_agglomerate
+    << (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS);
+  if (max && addr - start + len > max)
+    len = max - (addr - start);
+  end = (addr + len + mask) & ~mask;
+  if (start != addr || end != addr + len)
+    {
+      tmp = grub_malloc (end - start);
+      if (!tmp)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return 0;
+	}
+    }
+
+  /* The disk is read bypassing its cache, the data is cached for the
+     loopback device already.  */
+  if ((disk->dev->disk_read) (disk, start >> disk->log_sector_size,
+			      (end - start) >> disk->log_sector_size,
+			      tmp ? tmp : buf))
+    {
+      grub_free (tmp);
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  if (tmp)
+    {
+      grub_memcpy (buf, tmp + (addr - start), len);
+      grub_free (tmp);
+    }
+
+  return len;
+}
+
 static grub_err_t
 grub_loopback_read (grub_disk_t disk, grub_disk_addr_t sector,
 		    grub_size_t size, char *buf)
 {
-  grub_file_t file = ((struct grub_loopback *) disk->data)->file;
+  struct grub_loopback *dev = disk->data;
+  grub_file_t file = dev->file;
   grub_off_t pos;
+  grub_size_t len;
 
-  grub_file_seek (file, sector << GRUB_DISK_SECTOR_BITS);
+  pos = sector << GRUB_DISK_SECTOR_BITS;
+  len = size << GRUB_DISK_SECTOR_BITS;
 
-  grub_file_read (file, buf, size << GRUB_DISK_SECTOR_BITS);
-  if (grub_errno)
-    return grub_errno;
+  /* Parts of the file already read once are read from the disk directly,
+     without going through the filesystem again.  */
+  while (len)
+    {
+      grub_size_t done, chunk;
+      unsigned i;
+
+      done = grub_loopback_read_mapped (dev, pos, len, buf);
+      if (done)
+	{
+	  pos += done;
+	  buf += done;
+	  len -= done;
+	  continue;
+	}
+
+      /* Read up to the next mapped extent through the filesystem.  */
+      chunk = len;
+      i = grub_loopback_find (dev, pos);
+      if (i < dev->num_extents && dev->extents[i].offset <= pos)
+	i++;
+      if (i < dev->num_extents && dev->extents[i].offset - pos < chunk)
+	chunk = dev->extents[i].offset - pos;
+
+      if (grub_loopback_read_file (dev, pos, chunk, buf))
+	return grub_errno;
+      pos += chunk;
+      buf += chunk;
+      len -= chunk;
+    }
 
   /* In case there is more data read than there is available, in case
      of files that are not a multiple of GRUB_DISK_SECTOR_SIZE, fill
@@ -202,7 +499,7 @@ grub_loopback_read (grub_disk_t disk, grub_disk_addr_t sector,
   if (pos > file->size)
     {
       grub_size_t amount = pos - file->size;
-      grub_memset (buf + (size << GRUB_DISK_SECTOR_BITS) - amount, 0, amount);
+      grub_memset (buf - amount, 0, amount);
     }
 
   return 0;
@@ -0,0 +1,427 @@
+/* raid_gf.c - GF(2^8) block operations for RAID5 and RAID6 recovery.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/disk.h>
+#include <grub/misc.h>
+#include <grub/diskfilter.h>
+/* Whether SSE is usable is read from the control registers, which only
+   works on the firmware platforms.  */
+#if (defined (__i386__) || defined (__x86_64__)) && !defined (GRUB_UTIL) \
+  && !defined (GRUB_MACHINE_EMU)
+#include <grub/i386/cpuid.h>
+#define RAID_GF_X86 1
+#endif
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* x**y.  */
+grub_uint8_t grub_raid_powx[255 * 2];
+/* Such an s that x**s = y */
+unsigned grub_raid_powx_inv[256];
+static const grub_uint8_t poly = 0x1d;
+
+static void
+grub_raid_init_table (void)
+{
+  unsigned i;
+
+  grub_uint8_t cur = 1;
+  for (i = 0; i < 255; i++)
+    {
+      grub_raid_powx[i] = cur;
+      grub_raid_powx[i + 255] = cur;
+      grub_raid_powx_inv[cur] = i;
+      if (cur & 0x80)
+	cur = (cur << 1) ^ poly;
+      else
+	cur <<= 1;
+    }
+}
+
+static grub_uint8_t
+gf_mul (grub_uint8_t a, grub_uint8_t b)
+{
+  if (!a || !b)
+    return 0;
+  return grub_raid_powx[grub_raid_powx_inv[a] + grub_raid_powx_inv[b]];
+}
+
+/* The reference implementation, one byte at a time through the tables.  */
+
+static void
+scalar_xor (char *dest, const char *src, grub_size_t size)
+{
+  grub_size_t i;
+
+  for (i = 0; i < size; i++)
+    dest[i] ^= src[i];
+}
+
+static void
+scalar_mul (grub_uint8_t coef, char *dest, const char *src, grub_size_t size)
+{
+  grub_size_t i;
+
+  for (i = 0; i < size; i++)
+    dest[i] = gf_mul (coef, src[i]);
+}
+
+static void
+scalar_mul_xor (grub_uint8_t coef, char *dest, const char *src,
+		grub_size_t size)
+{
+  grub_size_t i;
+
+  for (i = 0; i < size; i++)
+    dest[i] ^= gf_mul (coef, src[i]);
+}
+
+/* Eight bytes at a time in a 64-bit word.  Multiplying by x shifts every
+   byte left and reduces those which overflowed, any other constant is a
+   sum of such products.  */
+
+#define SWAR_HIGH 0x8080808080808080ULL
+#define SWAR_POLY 0x1d1d1d1d1d1d1d1dULL
+
+static grub_uint64_t
+swar_mulx (grub_uint64_t v)
+{
+  grub_uint64_t hi = v & SWAR_HIGH;
+
+  /* HI - (HI >> 7) is 0x7f in every byte which had its top bit set.  */
+  return ((v & ~SWAR_HIGH) << 1) ^ ((hi - (hi >> 7)) & SWAR_POLY);
+}
+
+static void
+swar_xor (char *dest, const char *src, grub_size_t size)
+{
+  grub_size_t i;
+
+  for (i = 0; i + 8 <= size; i += 8)
+    grub_set_unaligned64 (dest + i, grub_get_unaligned64 (dest + i)
+			  ^ grub_get_unaligned64 (src + i));
+  scalar_xor (dest + i, src + i, size - i);
+}
+
+/* Two words per step to overlap the chains of doublings.  */
+static void
+swar_mul_gen (grub_uint8_t coef, char *dest, const char *src,
+	      grub_size_t size, int accumulate)
+{
+  grub_size_t i;
+
+  for (i = 0; i + 16 <= size; i += 16)
+    {
+      grub_uint64_t v0 = grub_get_unaligned64 (src + i);
+      grub_uint64_t v1 = grub_get_unaligned64 (src + i + 8);
+      grub_uint64_t r0 = 0, r1 = 0;
+      grub_uint8_t c;
+
+      for (c = coef; c; c >>= 1)
+	{
+	  if (c & 1)
+	    {
+	      r0 ^= v0;
+	      r1 ^= v1;
+	    }
+	  v0 = swar_mulx (v0);
+	  v1 = swar_mulx (v1);
+	}
+      if (accumulate)
+	{
+	  r0 ^= grub_get_unaligned64 (dest + i);
+	  r1 ^= grub_get_unaligned64 (dest + i + 8);
+	}
+      grub_set_unaligned64 (dest + i, r0);
+      grub_set_unaligned64 (dest + i + 8, r1);
+    }
+  if (accumulate)
+    scalar_mul_xor (coef, dest + i, src + i, size - i);
+  else
+    scalar_mul (coef, dest + i, src + i, size - i);
+}
+
+static void
+swar_mul (grub_uint8_t coef, char *dest, const char *src, grub_size_t size)
+{
+  swar_mul_gen (coef, dest, src, size, 0);
+}
+
+static void
+swar_mul_xor (grub_uint8_t coef, char *dest, const char *src, grub_size_t size)
+{
+  swar_mul_gen (coef, dest, src, size, 1);
+}
+
+#ifdef RAID_GF_X86
+/* GRUB is otherwise built without SSE, so only these functions are
+   compiled for it.  The SSE2 versions work like the word ones above, 16
+   bytes at a time.  The SSSE3 ones look the products of the low and high
+   nibbles of every byte up with PSHUFB in two 16-entry tables.  */
+
+typedef char v16qi __attribute__ ((vector_size (16)));
+typedef unsigned char v16qu __attribute__ ((vector_size (16)));
+typedef unsigned char v16qu_u __attribute__ ((vector_size (16), aligned (1)));
+typedef unsigned short v8hu __attribute__ ((vector_size (16)));
+
+#define LOAD(p) (*(const v16qu_u *) (const void *) (p))
+#define STORE(p, v) (*(v16qu_u *) (void *) (p) = (v))
+
+/* Multiply every byte of V by x.  */
+#define V_MULX(v, polyv) (((v) + (v))					\
+			  ^ ((v16qu) ((v16qi) (v) < (v16qi) { 0 }) & (polyv)))
+
+static void __attribute__ ((target ("sse2")))
+sse2_xor (char *dest, const char *src, grub_size_t size)
+{
+  grub_size_t i;
+
+  for (i = 0; i + 64 <= size; i += 64)
+    {
+      STORE (dest + i, LOAD (dest + i) ^ LOAD (src + i));
+      STORE (dest + i + 16, LOAD (dest + i + 16) ^ LOAD (src + i + 16));
+      STORE (dest + i + 32, LOAD (dest + i + 32) ^ LOAD (src + i + 32));
+      STORE (dest + i + 48, LOAD (dest + i + 48) ^ LOAD (src + i + 48));
+    }
+  for (; i + 16 <= size; i += 16)
+    STORE (dest + i, LOAD (dest + i) ^ LOAD (src + i));
+  scalar_xor (dest + i, src + i, size - i);
+}
+
+static void __attribute__ ((target ("sse2")))
+sse2_mul_gen (grub_uint8_t coef, char *dest, const char *src, grub_size_t size,
+	      int accumulate)
+{
+  const v16qu polyv = { 0x1d, 0x1d, 0x1d, 0x1d, 0x1d, 0x1d, 0x1d, 0x1d,
+			0x1d, 0x1d, 0x1d, 0x1d, 0x1d, 0x1d, 0x1d, 0x1d };
+  grub_size_t i;
+
+  /* Four independent vectors per step hide the latency of the chain of
+     doublings.  */
+  for (i = 0; i + 64 <= size; i += 64)
+    {
+      v16qu v0 = LOAD (src + i), v1 = LOAD (src + i + 16);
+      v16qu v2 = LOAD (src + i + 32), v3 = LOAD (src + i + 48);
+      v16qu r0 = { 0 }, r1 = r0, r2 = r0, r3 = r0;
+      grub_uint8_t c;
+
+      for (c = coef; c; c >>= 1)
+	{
+	  if (c & 1)
+	    {
+	      r0 ^= v0;
+	      r1 ^= v1;
+	      r2 ^= v2;
+	      r3 ^= v3;
+	    }
+	  v0 = V_MULX (v0, polyv);
+	  v1 = V_MULX (v1, polyv);
+	  v2 = V_MULX (v2, polyv);
+	  v3 = V_MULX (v3, polyv);
+	}
+      if (accumulate)
+	{
+	  r0 ^= LOAD (dest + i);
+	  r1 ^= LOAD (dest + i + 16);
+	  r2 ^= LOAD (dest + i + 32);
+	  r3 ^= LOAD (dest + i + 48);
+	}
+      STORE (dest + i, r0);
+      STORE (dest + i + 16, r1);
+      STORE (dest + i + 32, r2);
+      STORE (dest + i + 48, r3);
+    }
+  if (accumulate)
+    scalar_mul_xor (coef, dest + i, src + i, size - i);
+  else
+    scalar_mul (coef, dest + i, src + i, size - i);
+}
+
+static void
+sse2_mul (grub_uint8_t coef, char *dest, const char *src, grub_size_t size)
+{
+  sse2_mul_gen (coef, dest, src, size, 0);
+}
+
+static void
+sse2_mul_xor (grub_uint8_t coef, char *dest, const char *src, grub_size_t size)
+{
+  sse2_mul_gen (coef, dest, src, size, 1);
+}
+
+static void __attribute__ ((target ("ssse3")))
+ssse3_mul_gen (grub_uint8_t coef, char *dest, const char *src,
+	       grub_size_t size, int accumulate)
+{
+  const v16qu mask = { 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f,
+		       0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f };
+  grub_uint8_t lo_tab[16], hi_tab[16];
+  v16qu lo, hi;
+  grub_size_t i;
+
+  for (i = 0; i < 16; i++)
+    {
+      lo_tab[i] = gf_mul (coef, i);
+      hi_tab[i] = gf_mul (coef, i << 4);
+    }
+  lo = LOAD (lo_tab);
+  hi = LOAD (hi_tab);
+
+  for (i = 0; i + 16 <= size; i += 16)
+    {
+      v16qu v = LOAD (src + i), r;
+
+      r = (v16qu) __builtin_ia32_pshufb128 ((v16qi) lo, (v16qi) (v & mask));
+      v = (v16qu) ((v8hu) v >> 4) & mask;
+      r ^= (v16qu) __builtin_ia32_pshufb128 ((v16qi) hi, (v16qi) v);
+      if (accumulate)
+	r ^= LOAD (dest + i);
+      STORE (dest + i, r);
+    }
+  if (accumulate)
+    scalar_mul_xor (coef, dest + i, src + i, size - i);
+  else
+    scalar_mul (coef, dest + i, src + i, size - i);
+}
+
+static void
+ssse3_mul (grub_uint8_t coef, char *dest, const char *src, grub_size_t size)
+{
+  ssse3_mul_gen (coef, dest, src, size, 0);
+}
+
+static void
+ssse3_mul_xor (grub_uint8_t coef, char *dest, const char *src,
+	       grub_size_t size)
+{
+  ssse3_mul_gen (coef, dest, src, size, 1);
+}
+
+/* Return the CPUID.01H:ECX bits if SSE2 is there and usable.  */
+static grub_uint32_t
+sse2_features (void)
+{
+  grub_uint32_t max_level, eax, ebx, ecx, edx;
+
+  if (!grub_cpu_is_cpuid_supported ())
+    return 0;
+
+  grub_cpuid (0, max_level, ebx, ecx, edx);
+  if (max_level < 1)
+    return 0;
+
+  /* CPUID.01H:EDX[26] is SSE2.  */
+  grub_cpuid (1, eax, ebx, ecx, edx);
+  if (!(edx & (1 << 26)) || !grub_cpu_is_sse_enabled ())
+    return 0;
+
+  return ecx | 1;
+}
+
+static int
+sse2_supported (void)
+{
+  return !!sse2_features ();
+}
+
+static int
+ssse3_supported (void)
+{
+  /* CPUID.01H:ECX[9] is SSSE3.  */
+  return !!(sse2_features () & (1 << 9));
+}
+#endif
+
+static int
+always_supported (void)
+{
+  return 1;
+}
+
+/* In order of preference.  The scalar version is the reference.  */
+const struct grub_raid_gf_impl grub_raid_gf_impls[] =
+  {
+#ifdef RAID_GF_X86
+    { "ssse3", ssse3_supported, sse2_xor, ssse3_mul, ssse3_mul_xor },
+    { "sse2", sse2_supported, sse2_xor, sse2_mul, sse2_mul_xor },
+#endif
+    { "swar", always_supported, swar_xor, swar_mul, swar_mul_xor },
+    { "scalar", always_supported, scalar_xor, scalar_mul, scalar_mul_xor },
+    { NULL, NULL, NULL, NULL, NULL }
+  };
+
+static const struct grub_raid_gf_impl *best;
+
+static const struct grub_raid_gf_impl *
+get_best (void)
+{
+  if (!best)
+    {
+      const struct grub_raid_gf_impl *impl;
+
+      for (impl = grub_raid_gf_impls; !impl->is_supported (); impl++);
+      best = impl;
+    }
+
+  return best;
+}
+
+void
+grub_raid_block_xor (char *dest, const char *src, grub_size_t size)
+{
+  get_best ()->block_xor (dest, src, size);
+}
+
+void
+grub_raid_block_mul (grub_uint8_t coef, char *dest, const char *src,
+		     grub_size_t size)
+{
+  if (coef == 1)
+    {
+      if (dest != src)
+	grub_memmove (dest, src, size);
+      return;
+    }
+  if (coef == 0)
+    {
+      grub_memset (dest, 0, size);
+      return;
+    }
+  get_best ()->mul (coef, dest, src, size);
+}
+
+void
+grub_raid_block_mul_xor (grub_uint8_t coef, char *dest, const char *src,
+			 grub_size_t size)
+{
+  if (coef == 1)
+    get_best ()->block_xor (dest, src, size);
+  else if (coef)
+    get_best ()->mul_xor (coef, dest, src, size);
+}
+
+GRUB_MOD_INIT(raidgf)
+{
+  grub_raid_init_table ();
+}
+
+GRUB_MOD_FINI(raidgf)
+{
+}
@@ -21,9 +21,48 @@
 #include <grub/fs.h>
 #include <grub/disk.h>
 #include <grub/dl.h>
+#include <grub/mm.h>
+#include <grub/partition.h>
+#include <grub/safemath.h>
+#include <grub/i18n.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+/* Number of archives whose name index is kept.  */
+#define ARCHELP_MAX_INDEXES 4
+
+struct grub_archelp_entry
+{
+  char *name;
+  grub_off_t hofs;
+  grub_int32_t mtime;
+  grub_uint32_t mode;
+  /* Next entry with the same hash, in archive order.  */
+  struct grub_archelp_entry *next;
+};
+
+struct grub_archelp_index
+{
+  struct grub_archelp_index *next;
+  /* Number of lookups using the index and whether it is still listed.  */
+  unsigned refs;
+  int dropped;
+  const struct grub_archelp_ops *ops;
+  enum grub_disk_dev_id dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t start;
+  /* What the disk looked like when it was indexed.  */
+  grub_uint64_t size;
+  grub_uint8_t head[GRUB_DISK_SECTOR_SIZE];
+  grub_size_t nentries;
+  struct grub_archelp_entry *entries;
+  grub_size_t nbuckets;
+  struct grub_archelp_entry **buckets;
+};
+
+/* Most recently used first.  */
+static struct grub_archelp_index *indexes;
+
 static inline void
 canonicalize (char *name)
 {
@@ -133,6 +172,355 @@ handle_symlink (struct grub_archelp_data *data,
   return GRUB_ERR_NONE;
 }
 
+static grub_size_t
+name_hash (const char *name, grub_size_t len)
+{
+  grub_uint32_t h = 2166136261U;
+
+  while (len--)
+    h = (h ^ (grub_uint8_t) *name++) * 16777619;
+  return h;
+}
+
+static void
+free_index (struct grub_archelp_index *idx)
+{
+  grub_size_t i;
+
+  for (i = 0; i < idx->nentries; i++)
+    grub_free (idx->entries[i].name);
+  grub_free (idx->entries);
+  grub_free (idx->buckets);
+  grub_free (idx);
+}
+
+/* Read every header of the archive once and record where it is.  */
+static struct grub_archelp_index *
+build_index (struct grub_archelp_data *data, struct grub_archelp_ops *arcops)
+{
+  struct grub_archelp_index *idx;
+  grub_size_t alloc = 64, i;
+
+  idx = grub_zalloc (sizeof (*idx));
+  if (!idx)
+    return NULL;
+  idx->entries = grub_calloc (alloc, sizeof (idx->entries[0]));
+  if (!idx->entries)
+    goto fail;
+
+  arcops->rewind (data);
+  while (1)
+    {
+      struct grub_archelp_entry *e;
+      grub_off_t hofs = arcops->tell (data);
+      grub_int32_t mtime;
+      grub_uint32_t mode;
+      char *name;
+
+      if (arcops->find_file (data, &name, &mtime, &mode))
+	goto fail;
+      if (mode == GRUB_ARCHELP_ATTR_END)
+	break;
+
+      if (idx->nentries == alloc)
+	{
+	  struct grub_archelp_entry *n;
+	  grub_size_t sz;
+
+	  if (grub_mul (alloc, 2 * sizeof (idx->entries[0]), &sz))
+	    {
+	      grub_free (name);
+	      grub_error (GRUB_ERR_OUT_OF_RANGE, N_("overflow is detected"));
+	      goto fail;
+	    }
+	  n = grub_realloc (idx->entries, sz);
+	  if (!n)
+	    {
+	      grub_free (name);
+	      goto fail;
+	    }
+	  idx->entries = n;
+	  alloc *= 2;
+	}
+
+      canonicalize (name);
+      e = &idx->entries[idx->nentries++];
+      e->name = name;
+      e->hofs = hofs;
+      e->mtime = mtime;
+      e->mode = mode;
+    }
+
+  for (idx->nbuckets = 16; idx->nbuckets < idx->nentries; idx->nbuckets <<= 1);
+  idx->buckets = grub_calloc (idx->nbuckets, sizeof (idx->buckets[0]));
+  if (!idx->buckets)
+    goto fail;
+  /* Fill backwards so that chains end up in archive order.  */
+  for (i = idx->nentries; i > 0; i--)
+    {
+      struct grub_archelp_entry *e = &idx->entries[i - 1];
+      grub_size_t b = name_hash (e->name, grub_strlen (e->name))
+	& (idx->nbuckets - 1);
+      e->next = idx->buckets[b];
+      idx->buckets[b] = e;
+    }
+
+  arcops->rewind (data);
+  return idx;
+
+ fail:
+  free_index (idx);
+  arcops->rewind (data);
+  return NULL;
+}
+
+static void
+unlink_index (struct grub_archelp_index *idx)
+{
+  struct grub_archelp_index **prev;
+
+  for (prev = &indexes; *prev; prev = &(*prev)->next)
+    if (*prev == idx)
+      {
+	*prev = idx->next;
+	break;
+      }
+}
+
+/* Take IDX off the list.  It is freed once nobody uses it anymore.  */
+static void
+drop_index (struct grub_archelp_index *idx)
+{
+  unlink_index (idx);
+  idx->dropped = 1;
+  if (!idx->refs)
+    free_index (idx);
+}
+
+static void
+release_index (struct grub_archelp_index *idx)
+{
+  if (idx && --idx->refs == 0 && idx->dropped)
+    free_index (idx);
+}
+
+/* Position DATA on entry E, as find_file would have left it, and check that
+   the header there still carries the indexed name.  */
+static grub_err_t
+read_entry (struct grub_archelp_data *data, struct grub_archelp_ops *arcops,
+	    const struct grub_archelp_entry *e, char **name,
+	    grub_int32_t *mtime, grub_uint32_t *mode)
+{
+  arcops->seek (data, e->hofs);
+  if (arcops->find_file (data, name, mtime, mode))
+    return grub_errno;
+  if (*mode == GRUB_ARCHELP_ATTR_END)
+    return grub_error (GRUB_ERR_BAD_FS, "archive changed since it was indexed");
+  canonicalize (*name);
+  if (grub_strcmp (*name, e->name) != 0)
+    {
+      grub_free (*name);
+      return grub_error (GRUB_ERR_BAD_FS,
+			 "archive changed since it was indexed");
+    }
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+load_entry (struct grub_archelp_data *data, struct grub_archelp_ops *arcops,
+	    const struct grub_archelp_entry *e)
+{
+  grub_int32_t mtime;
+  grub_uint32_t mode;
+  char *name;
+
+  if (read_entry (data, arcops, e, &name, &mtime, &mode))
+    return grub_errno;
+  grub_free (name);
+  return GRUB_ERR_NONE;
+}
+
+/* Return the name index of the archive, building it if needed, or NULL if
+   the archive has to be scanned sequentially.  The index has to be given
+   back with release_index.
+
+   The same disk may show other contents later on, e.g. a loopback set up
+   on another file or swapped media, so an index is only used again if the
+   disk size, the first sector and the last entry are unchanged.  Lookups
+   check the name of every entry they read as well.  */
+static struct grub_archelp_index *
+get_index (struct grub_archelp_data *data, struct grub_archelp_ops *arcops)
+{
+  struct grub_archelp_index *idx, *next;
+  grub_uint8_t head[GRUB_DISK_SECTOR_SIZE];
+  grub_disk_t disk;
+  grub_disk_addr_t start;
+  grub_uint64_t size;
+  unsigned n = 0;
+
+  if (!arcops->tell || !arcops->seek || !arcops->get_disk)
+    return NULL;
+
+  disk = arcops->get_disk (data);
+  start = grub_partition_get_start (disk->partition);
+  size = grub_disk_get_size (disk);
+  if (size == 0 || size == GRUB_DISK_SIZE_UNKNOWN)
+    return NULL;
+  if (grub_disk_read (disk, 0, 0, sizeof (head), head))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+
+  for (idx = indexes; idx; idx = idx->next)
+    if (idx->ops == arcops && idx->dev_id == disk->dev->id
+	&& idx->disk_id == disk->id && idx->start == start)
+      break;
+
+  if (idx)
+    {
+      int same = (idx->size == size
+		  && grub_memcmp (idx->head, head, sizeof (head)) == 0);
+
+      if (same && idx->nentries
+	  && load_entry (data, arcops, &idx->entries[idx->nentries - 1]))
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  same = 0;
+	}
+      arcops->rewind (data);
+      if (same)
+	{
+	  unlink_index (idx);
+	  idx->next = indexes;
+	  indexes = idx;
+	  idx->refs++;
+	  return idx;
+	}
+      drop_index (idx);
+    }
+
+  idx = build_index (data, arcops);
+  if (!idx)
+    {
+      /* Leave any problem to the sequential scan, which may well find the
+	 file before reaching it.  */
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+  idx->ops = arcops;
+  idx->dev_id = disk->dev->id;
+  idx->disk_id = disk->id;
+  idx->start = start;
+  idx->size = size;
+  grub_memcpy (idx->head, head, sizeof (head));
+  idx->refs = 1;
+  idx->next = indexes;
+  indexes = idx;
+
+  for (idx = indexes; idx; idx = next)
+    {
+      next = idx->next;
+      if (++n > ARCHELP_MAX_INDEXES)
+	drop_index (idx);
+    }
+
+  return indexes;
+}
+
+/* Walk the archive in order, from the index if there is one.  */
+struct archelp_iter
+{
+  struct grub_archelp_index *idx;
+  grub_size_t pos;
+};
+
+static grub_err_t
+iter_next (struct grub_archelp_data *data, struct grub_archelp_ops *arcops,
+	   struct archelp_iter *it, char **name, grub_int32_t *mtime,
+	   grub_uint32_t *mode)
+{
+  const struct grub_archelp_entry *e;
+
+  if (!it->idx)
+    {
+      if (arcops->find_file (data, name, mtime, mode))
+	return grub_errno;
+      if (*mode != GRUB_ARCHELP_ATTR_END)
+	canonicalize (*name);
+      return GRUB_ERR_NONE;
+    }
+
+  if (it->pos == it->idx->nentries)
+    {
+      *mode = GRUB_ARCHELP_ATTR_END;
+      return GRUB_ERR_NONE;
+    }
+  e = &it->idx->entries[it->pos++];
+  *name = grub_strdup (e->name);
+  if (!*name)
+    return grub_errno;
+  *mtime = e->mtime;
+  *mode = e->mode;
+  /* Symlink targets are read from the archive.  */
+  if ((e->mode & GRUB_ARCHELP_ATTR_TYPE) == GRUB_ARCHELP_ATTR_LNK
+      && arcops->get_link_target && load_entry (data, arcops, e))
+    {
+      grub_free (*name);
+      return grub_errno;
+    }
+  return GRUB_ERR_NONE;
+}
+
+static void
+iter_rewind (struct grub_archelp_data *data, struct grub_archelp_ops *arcops,
+	     struct archelp_iter *it)
+{
+  if (it->idx)
+    it->pos = 0;
+  else
+    arcops->rewind (data);
+}
+
+/* Return the first entry after AFTER, in archive order, that
+   grub_archelp_open has to look at for NAME: an entry called NAME or a
+   symlink on the way to it.  */
+static const struct grub_archelp_entry *
+index_candidate (const struct grub_archelp_index *idx,
+		 struct grub_archelp_ops *arcops, const char *name,
+		 const struct grub_archelp_entry *after)
+{
+  const struct grub_archelp_entry *best = NULL, *e;
+  grub_size_t len;
+
+  for (len = 0; ; len++)
+    {
+      if (name[len] != '/' && name[len] != 0)
+	continue;
+      for (e = idx->buckets[name_hash (name, len) & (idx->nbuckets - 1)];
+	   e; e = e->next)
+	{
+	  if (after && e <= after)
+	    continue;
+	  if (best && e >= best)
+	    break;
+	  if (grub_strncmp (e->name, name, len) != 0 || e->name[len] != 0)
+	    continue;
+	  if (name[len] == 0
+	      || (arcops->get_link_target
+		  && (e->mode & GRUB_ARCHELP_ATTR_TYPE)
+		  == GRUB_ARCHELP_ATTR_LNK))
+	    {
+	      best = e;
+	      break;
+	    }
+	}
+      if (name[len] == 0)
+	break;
+    }
+  return best;
+}
+
 grub_err_t
 grub_archelp_dir (struct grub_archelp_data *data,
 		  struct grub_archelp_ops *arcops,
@@ -142,6 +530,7 @@ grub_archelp_dir (struct grub_archelp_data *data,
   char *prev, *name, *path, *ptr;
   grub_size_t len;
   int symlinknest = 0;
+  struct archelp_iter it;
 
   path = grub_strdup (path_in + 1);
   if (!path)
@@ -151,6 +540,8 @@ grub_archelp_dir (struct grub_archelp_data *data,
     *ptr = 0;
 
   prev = 0;
+  it.idx = get_index (data, arcops);
+  it.pos = 0;
 
   len = grub_strlen (path);
   while (1)
@@ -159,14 +550,12 @@ grub_archelp_dir (struct grub_archelp_data *data,
       grub_uint32_t mode;
       grub_err_t err;
 
-      if (arcops->find_file (data, &name, &mtime, &mode))
+      if (iter_next (data, arcops, &it, &name, &mtime, &mode))
 	goto fail;
 
       if (mode == GRUB_ARCHELP_ATTR_END)
 	break;
 
-      canonicalize (name);
-
       if (grub_memcmp (path, name, len) == 0
 	  && (name[len] == 0 || name[len] == '/' || len == 0))
 	{
@@ -216,7 +605,7 @@ grub_archelp_dir (struct grub_archelp_data *data,
 				  N_("too deep nesting of symlinks"));
 		      goto fail;
 		    }
-		  arcops->rewind (data);
+		  iter_rewind (data, arcops, &it);
 		}
 	    }
 	}
@@ -226,6 +615,7 @@ grub_archelp_dir (struct grub_archelp_data *data,
 
 fail:
 
+  release_index (it.idx);
   grub_free (path);
   grub_free (prev);
 
@@ -240,19 +630,42 @@ grub_archelp_open (struct grub_archelp_data *data,
   char *fn;
   char *name = grub_strdup (name_in + 1);
   int symlinknest = 0;
+  struct grub_archelp_index *idx;
+  const struct grub_archelp_entry *cur = NULL;
 
   if (!name)
     return grub_errno;
 
   canonicalize (name);
 
+  idx = get_index (data, arcops);
+
   while (1)
     {
       grub_uint32_t mode;
       grub_int32_t mtime;
       int restart;
-      
-      if (arcops->find_file (data, &fn, &mtime, &mode))
+
+      if (idx)
+	{
+	  /* Only visit the entries the scan below would act on.  */
+	  cur = index_candidate (idx, arcops, name, cur);
+	  if (!cur)
+	    mode = GRUB_ARCHELP_ATTR_END;
+	  else if (read_entry (data, arcops, cur, &fn, &mtime, &mode))
+	    {
+	      /* The archive is not what was indexed, start over without
+		 the index.  */
+	      grub_errno = GRUB_ERR_NONE;
+	      drop_index (idx);
+	      release_index (idx);
+	      idx = NULL;
+	      cur = NULL;
+	      arcops->rewind (data);
+	      continue;
+	    }
+	}
+      else if (arcops->find_file (data, &fn, &mtime, &mode))
 	goto fail;
 
       if (mode == GRUB_ARCHELP_ATTR_END)
@@ -272,6 +685,7 @@ grub_archelp_open (struct grub_archelp_data *data,
       if (restart)
 	{
 	  arcops->rewind (data);
+	  cur = NULL;
 	  if (++symlinknest == 8)
 	    {
 	      grub_error (GRUB_ERR_SYMLINK_LOOP,
@@ -286,6 +700,7 @@ grub_archelp_open (struct grub_archelp_data *data,
 
       grub_free (fn);
       grub_free (name);
+      release_index (idx);
 
       return GRUB_ERR_NONE;
 
@@ -296,6 +711,17 @@ grub_archelp_open (struct grub_archelp_data *data,
 
 fail:
   grub_free (name);
+  release_index (idx);
 
   return grub_errno;
 }
+
+GRUB_MOD_FINI (archelp)
+{
+  while (indexes)
+    {
+      struct grub_archelp_index *next = indexes->next;
+      free_index (indexes);
+      indexes = next;
+    }
+}
@@ -81,7 +81,14 @@ struct grub_btrfs_superblock
   grub_uint64_t chunk_tree;
   grub_uint8_t dummy2[0x20];
   grub_uint64_t root_dir_objectid;
-  grub_uint8_t dummy3[0x41];
+  grub_uint64_t num_devices;
+  grub_uint32_t sectorsize;
+  grub_uint32_t nodesize;
+  grub_uint32_t leafsize;
+  grub_uint32_t stripesize;
+  grub_uint32_t sys_chunk_array_size;
+  grub_uint64_t chunk_root_generation;
+  grub_uint8_t dummy3[0x1d];
   struct grub_btrfs_device this_device;
   char label[0x100];
   grub_uint8_t dummy4[0x100];
@@ -93,7 +100,9 @@ struct btrfs_header
   grub_btrfs_checksum_t checksum;
   grub_btrfs_uuid_t uuid;
   grub_uint64_t bytenr;
-  grub_uint8_t dummy[0x28];
+  grub_uint8_t dummy[0x18];
+  grub_uint64_t generation;
+  grub_uint64_t owner;
   grub_uint32_t nitems;
   grub_uint8_t level;
 } GRUB_PACKED;
@@ -104,6 +113,41 @@ struct grub_btrfs_device_desc
   grub_uint64_t id;
 };
 
+/* A chunk item, with its stripes, mapping the logical addresses from
+   START on.  */
+struct grub_btrfs_chunk_map
+{
+  grub_uint64_t start;
+  grub_uint64_t size;
+  struct grub_btrfs_chunk_item *chunk;
+};
+
+#define GRUB_BTRFS_NODE_CACHE_SIZE 32
+
+/* Btrfs never makes compressed extents of more than 128 KiB.  */
+#define GRUB_BTRFS_DECOMP_CACHE_SIZE 4
+#define GRUB_BTRFS_DECOMP_CACHE_MAX 0x20000
+
+/* The decompressed contents of a compressed regular extent.  */
+struct grub_btrfs_decomp_cache
+{
+  grub_uint64_t laddr;
+  grub_uint64_t zsize;
+  grub_uint8_t compression;
+  grub_size_t size;
+  grub_uint64_t last_used;
+  char *buf;
+};
+
+/* A verified tree node of nodesize bytes.  */
+struct grub_btrfs_node_cache
+{
+  grub_disk_addr_t addr;
+  grub_uint64_t generation;
+  grub_uint64_t last_used;
+  struct btrfs_header *node;
+};
+
 struct grub_btrfs_data
 {
   struct grub_btrfs_superblock sblock;
@@ -121,6 +165,18 @@ struct grub_btrfs_data
   grub_uint64_t exttree;
   grub_size_t extsize;
   struct grub_btrfs_extent_data *extent;
+
+  /* All chunks of the chunk tree sorted by logical address.  */
+  struct grub_btrfs_chunk_map *chunks;
+  grub_size_t nchunks;
+
+  /* Recently used tree nodes.  */
+  struct grub_btrfs_node_cache node_cache[GRUB_BTRFS_NODE_CACHE_SIZE];
+  grub_uint64_t node_cache_clock;
+
+  /* Recently decompressed extents of the open file.  */
+  struct grub_btrfs_decomp_cache decomp_cache[GRUB_BTRFS_DECOMP_CACHE_SIZE];
+  grub_uint64_t decomp_cache_clock;
 };
 
 struct grub_btrfs_chunk_item
@@ -162,7 +218,7 @@ struct grub_btrfs_internal_node
 {
   struct grub_btrfs_key key;
   grub_uint64_t addr;
-  grub_uint64_t dummy;
+  grub_uint64_t generation;
 } GRUB_PACKED;
 
 struct grub_btrfs_dir_item
@@ -324,6 +380,69 @@ check_btrfs_header (struct grub_btrfs_data *data, struct btrfs_header *header,
   return GRUB_ERR_NONE;
 }
 
+/* Return the tree node at ADDR, verified and from the cache if possible.
+   GENERATION is the generation the parent node records for it, or 0 if
+   it isn't known.  The node stays valid until the next call.  */
+static struct btrfs_header *
+read_node (struct grub_btrfs_data *data, grub_disk_addr_t addr,
+	   grub_uint64_t generation, int recursion_depth)
+{
+  struct grub_btrfs_node_cache *e, *victim = NULL;
+  grub_uint32_t nodesize = grub_le_to_cpu32 (data->sblock.nodesize);
+  grub_size_t itemsize;
+  grub_err_t err;
+  unsigned i;
+
+  for (i = 0; i < GRUB_BTRFS_NODE_CACHE_SIZE; i++)
+    {
+      e = &data->node_cache[i];
+      if (e->node && e->addr == addr
+	  && (!generation || e->generation == generation))
+	{
+	  e->last_used = ++data->node_cache_clock;
+	  return e->node;
+	}
+      if (!victim || (victim->node && (!e->node
+				       || e->last_used < victim->last_used)))
+	victim = e;
+    }
+
+  if (!victim->node)
+    {
+      victim->node = grub_malloc (nodesize);
+      if (!victim->node)
+	return NULL;
+    }
+
+  /* Reading the node may need other nodes, keep them off this entry.  */
+  victim->addr = ~(grub_disk_addr_t) 0;
+  victim->last_used = ++data->node_cache_clock;
+
+  err = grub_btrfs_read_logical (data, addr, victim->node, nodesize,
+				 recursion_depth);
+  if (err)
+    return NULL;
+  if (check_btrfs_header (data, victim->node, addr))
+    return NULL;
+  if (generation && grub_le_to_cpu64 (victim->node->generation) != generation)
+    {
+      grub_error (GRUB_ERR_BAD_FS, "node generation doesn't match parent");
+      return NULL;
+    }
+  itemsize = victim->node->level ? sizeof (struct grub_btrfs_internal_node)
+    : sizeof (struct grub_btrfs_leaf_node);
+  if (grub_le_to_cpu32 (victim->node->nitems)
+      > (nodesize - sizeof (struct btrfs_header)) / itemsize)
+    {
+      grub_error (GRUB_ERR_BAD_FS, "too many items in node");
+      return NULL;
+    }
+
+  victim->addr = addr;
+  victim->generation = grub_le_to_cpu64 (victim->node->generation);
+  return victim->node;
+}
+
 static grub_err_t
 save_ref (struct grub_btrfs_leaf_descriptor *desc,
 	  grub_disk_addr_t addr, unsigned i, unsigned m, int l)
@@ -358,6 +477,7 @@ next (struct grub_btrfs_data *data,
 {
   grub_err_t err;
   struct grub_btrfs_leaf_node leaf;
+  struct btrfs_header *head;
 
   for (; desc->depth > 0; desc->depth--)
     {
@@ -371,32 +491,34 @@ next (struct grub_btrfs_data *data,
   while (!desc->data[desc->depth - 1].leaf)
     {
       struct grub_btrfs_internal_node node;
-      struct btrfs_header head;
 
-      err = grub_btrfs_read_logical (data, desc->data[desc->depth - 1].iter
-				     * sizeof (node)
-				     + sizeof (struct btrfs_header)
-				     + desc->data[desc->depth - 1].addr,
-				     &node, sizeof (node), 0);
+      head = read_node (data, desc->data[desc->depth - 1].addr, 0, 0);
+      if (!head)
+	return -grub_errno;
+      if (desc->data[desc->depth - 1].iter >= grub_le_to_cpu32 (head->nitems))
+	return -grub_error (GRUB_ERR_BAD_FS, "node changed");
+      grub_memcpy (&node, (grub_uint8_t *) (head + 1)
+		   + desc->data[desc->depth - 1].iter * sizeof (node),
+		   sizeof (node));
+
+      head = read_node (data, grub_le_to_cpu64 (node.addr),
+			grub_le_to_cpu64 (node.generation), 0);
+      if (!head)
+	return -grub_errno;
+
+      err = save_ref (desc, grub_le_to_cpu64 (node.addr), 0,
+		      grub_le_to_cpu32 (head->nitems), !head->level);
       if (err)
 	return -err;
-
-      err = grub_btrfs_read_logical (data, grub_le_to_cpu64 (node.addr),
-				     &head, sizeof (head), 0);
-      check_btrfs_header (data, &head, grub_le_to_cpu64 (node.addr));
-      if (err)
-	return -err;
-
-      save_ref (desc, grub_le_to_cpu64 (node.addr), 0,
-		grub_le_to_cpu32 (head.nitems), !head.level);
     }
-  err = grub_btrfs_read_logical (data, desc->data[desc->depth - 1].iter
-				 * sizeof (leaf)
-				 + sizeof (struct btrfs_header)
-				 + desc->data[desc->depth - 1].addr, &leaf,
-				 sizeof (leaf), 0);
-  if (err)
-    return -err;
+  head = read_node (data, desc->data[desc->depth - 1].addr, 0, 0);
+  if (!head)
+    return -grub_errno;
+  if (desc->data[desc->depth - 1].iter >= grub_le_to_cpu32 (head->nitems))
+    return -grub_error (GRUB_ERR_BAD_FS, "node changed");
+  grub_memcpy (&leaf, (grub_uint8_t *) (head + 1)
+	       + desc->data[desc->depth - 1].iter * sizeof (leaf),
+	       sizeof (leaf));
   *outsize = grub_le_to_cpu32 (leaf.size);
   *outaddr = desc->data[desc->depth - 1].addr + sizeof (struct btrfs_header)
     + grub_le_to_cpu32 (leaf.offset);
@@ -414,6 +536,7 @@ lower_bound (struct grub_btrfs_data *data,
 	     int recursion_depth)
 {
   grub_disk_addr_t addr = grub_le_to_cpu64 (root);
+  grub_uint64_t generation = 0;
   int depth = -1;
 
   if (desc)
@@ -438,30 +561,24 @@ lower_bound (struct grub_btrfs_data *data,
   while (1)
     {
       grub_err_t err;
-      struct btrfs_header head;
+      struct btrfs_header *head;
 
     reiter:
       depth++;
-      /* FIXME: preread few nodes into buffer. */
-      err = grub_btrfs_read_logical (data, addr, &head, sizeof (head),
-				     recursion_depth + 1);
-      check_btrfs_header (data, &head, addr);
-      if (err)
-	return err;
-      addr += sizeof (head);
-      if (head.level)
+      head = read_node (data, addr, generation, recursion_depth + 1);
+      if (!head)
+	return grub_errno;
+      addr += sizeof (*head);
+      if (head->level)
 	{
 	  unsigned i;
 	  struct grub_btrfs_internal_node node, node_last;
 	  int have_last = 0;
 	  grub_memset (&node_last, 0, sizeof (node_last));
-	  for (i = 0; i < grub_le_to_cpu32 (head.nitems); i++)
+	  for (i = 0; i < grub_le_to_cpu32 (head->nitems); i++)
 	    {
-	      err = grub_btrfs_read_logical (data, addr + i * sizeof (node),
-					     &node, sizeof (node),
-					     recursion_depth + 1);
-	      if (err)
-		return err;
+	      grub_memcpy (&node, (grub_uint8_t *) (head + 1)
+			   + i * sizeof (node), sizeof (node));
 
 	      grub_dprintf ("btrfs",
 			    "internal node (depth %d) %" PRIxGRUB_UINT64_T
@@ -473,11 +590,12 @@ lower_bound (struct grub_btrfs_data *data,
 		{
 		  err = GRUB_ERR_NONE;
 		  if (desc)
-		    err = save_ref (desc, addr - sizeof (head), i,
-				    grub_le_to_cpu32 (head.nitems), 0);
+		    err = save_ref (desc, addr - sizeof (*head), i,
+				    grub_le_to_cpu32 (head->nitems), 0);
 		  if (err)
 		    return err;
 		  addr = grub_le_to_cpu64 (node.addr);
+		  generation = grub_le_to_cpu64 (node.generation);
 		  goto reiter;
 		}
 	      if (key_cmp (&node.key, key_in) > 0)
@@ -489,32 +607,30 @@ lower_bound (struct grub_btrfs_data *data,
 	    {
 	      err = GRUB_ERR_NONE;
 	      if (desc)
-		err = save_ref (desc, addr - sizeof (head), i - 1,
-				grub_le_to_cpu32 (head.nitems), 0);
+		err = save_ref (desc, addr - sizeof (*head), i - 1,
+				grub_le_to_cpu32 (head->nitems), 0);
 	      if (err)
 		return err;
 	      addr = grub_le_to_cpu64 (node_last.addr);
+	      generation = grub_le_to_cpu64 (node_last.generation);
 	      goto reiter;
 	    }
 	  *outsize = 0;
 	  *outaddr = 0;
 	  grub_memset (key_out, 0, sizeof (*key_out));
 	  if (desc)
-	    return save_ref (desc, addr - sizeof (head), -1,
-			     grub_le_to_cpu32 (head.nitems), 0);
+	    return save_ref (desc, addr - sizeof (*head), -1,
+			     grub_le_to_cpu32 (head->nitems), 0);
 	  return GRUB_ERR_NONE;
 	}
       {
 	unsigned i;
 	struct grub_btrfs_leaf_node leaf, leaf_last;
 	int have_last = 0;
-	for (i = 0; i < grub_le_to_cpu32 (head.nitems); i++)
+	for (i = 0; i < grub_le_to_cpu32 (head->nitems); i++)
 	  {
-	    err = grub_btrfs_read_logical (data, addr + i * sizeof (leaf),
-					   &leaf, sizeof (leaf),
-					   recursion_depth + 1);
-	    if (err)
-	      return err;
+	    grub_memcpy (&leaf, (grub_uint8_t *) (head + 1)
+			 + i * sizeof (leaf), sizeof (leaf));
 
 	    grub_dprintf ("btrfs",
 			  "leaf (depth %d) %" PRIxGRUB_UINT64_T
@@ -527,8 +643,8 @@ lower_bound (struct grub_btrfs_data *data,
 		*outsize = grub_le_to_cpu32 (leaf.size);
 		*outaddr = addr + grub_le_to_cpu32 (leaf.offset);
 		if (desc)
-		  return save_ref (desc, addr - sizeof (head), i,
-				   grub_le_to_cpu32 (head.nitems), 1);
+		  return save_ref (desc, addr - sizeof (*head), i,
+				   grub_le_to_cpu32 (head->nitems), 1);
 		return GRUB_ERR_NONE;
 	      }
 
@@ -545,16 +661,16 @@ lower_bound (struct grub_btrfs_data *data,
 	    *outsize = grub_le_to_cpu32 (leaf_last.size);
 	    *outaddr = addr + grub_le_to_cpu32 (leaf_last.offset);
 	    if (desc)
-	      return save_ref (desc, addr - sizeof (head), i - 1,
-			       grub_le_to_cpu32 (head.nitems), 1);
+	      return save_ref (desc, addr - sizeof (*head), i - 1,
+			       grub_le_to_cpu32 (head->nitems), 1);
 	    return GRUB_ERR_NONE;
 	  }
 	*outsize = 0;
 	*outaddr = 0;
 	grub_memset (key_out, 0, sizeof (*key_out));
 	if (desc)
-	  return save_ref (desc, addr - sizeof (head), -1,
-			   grub_le_to_cpu32 (head.nitems), 1);
+	  return save_ref (desc, addr - sizeof (*head), -1,
+			   grub_le_to_cpu32 (head->nitems), 1);
 	return GRUB_ERR_NONE;
       }
     }
@@ -723,7 +839,7 @@ rebuild_raid5 (char *dest, struct raid56_buffer *buffers,
 	grub_memcpy(dest, buffers[i].buf, csize);
 	first = 0;
       } else
-	grub_crypto_xor (dest, dest, buffers[i].buf, csize);
+	grub_raid_block_xor (dest, buffers[i].buf, csize);
     }
 }
 
@@ -857,6 +973,26 @@ raid56_read_retry (struct grub_btrfs_data *data,
   return ret;
 }
 
+/* Return the chunk containing ADDR from the chunk map, if any.  */
+static struct grub_btrfs_chunk_map *
+find_chunk (struct grub_btrfs_data *data, grub_disk_addr_t addr)
+{
+  grub_size_t lo = 0, hi = data->nchunks;
+
+  while (lo < hi)
+    {
+      grub_size_t mid = lo + (hi - lo) / 2;
+
+      if (data->chunks[mid].start <= addr)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo == 0 || addr - data->chunks[lo - 1].start >= data->chunks[lo - 1].size)
+    return NULL;
+  return &data->chunks[lo - 1];
+}
+
 static grub_err_t
 grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			 void *buf, grub_size_t size, int recursion_depth)
@@ -876,6 +1012,20 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 
       grub_dprintf ("btrfs", "searching for laddr %" PRIxGRUB_UINT64_T "\n",
 		    addr);
+      if (data->nchunks)
+	{
+	  struct grub_btrfs_chunk_map *map = find_chunk (data, addr);
+
+	  if (map)
+	    {
+	      key_in.object_id = grub_cpu_to_le64_compile_time (GRUB_BTRFS_OBJECT_ID_CHUNK);
+	      key_in.type = GRUB_BTRFS_ITEM_TYPE_CHUNK;
+	      key_in.offset = grub_cpu_to_le64 (map->start);
+	      key = &key_in;
+	      chunk = map->chunk;
+	      goto chunk_found;
+	    }
+	}
       for (ptr = data->sblock.bootstrap_mapping;
 	   ptr < data->sblock.bootstrap_mapping
 	   + sizeof (data->sblock.bootstrap_mapping)
@@ -1170,10 +1320,119 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
   return GRUB_ERR_NONE;
 }
 
+static void
+free_chunk_map (struct grub_btrfs_chunk_map *chunks, grub_size_t nchunks)
+{
+  grub_size_t i;
+
+  for (i = 0; i < nchunks; i++)
+    grub_free (chunks[i].chunk);
+  grub_free (chunks);
+}
+
+/* Read all chunk items of the chunk tree into DATA->chunks so that
+   logical addresses no longer need a chunk tree walk each.  */
+static grub_err_t
+build_chunk_map (struct grub_btrfs_data *data)
+{
+  struct grub_btrfs_key key_in, key_out;
+  struct grub_btrfs_leaf_descriptor desc;
+  struct grub_btrfs_chunk_map *chunks = NULL;
+  grub_size_t nchunks = 0, allocated = 0;
+  grub_disk_addr_t elemaddr;
+  grub_size_t elemsize;
+  grub_err_t err;
+  int r = 0;
+
+  key_in.object_id = grub_cpu_to_le64_compile_time (GRUB_BTRFS_OBJECT_ID_CHUNK);
+  key_in.type = GRUB_BTRFS_ITEM_TYPE_CHUNK;
+  key_in.offset = 0;
+  err = lower_bound (data, &key_in, &key_out, data->sblock.chunk_tree,
+		     &elemaddr, &elemsize, &desc, 0);
+  if (err)
+    {
+      grub_free (desc.data);
+      return err;
+    }
+  if (key_out.object_id != key_in.object_id
+      || key_out.type != key_in.type)
+    r = next (data, &desc, &elemaddr, &elemsize, &key_out);
+  else
+    r = 1;
+
+  while (r > 0 && key_out.object_id == key_in.object_id
+	 && key_out.type == key_in.type)
+    {
+      struct grub_btrfs_chunk_item *chunk;
+      grub_uint64_t start = grub_le_to_cpu64 (key_out.offset);
+
+      if (elemsize < sizeof (*chunk))
+	{
+	  err = grub_error (GRUB_ERR_BAD_FS, "chunk item too small");
+	  break;
+	}
+      chunk = grub_malloc (elemsize);
+      if (!chunk)
+	{
+	  err = grub_errno;
+	  break;
+	}
+      err = grub_btrfs_read_logical (data, elemaddr, chunk, elemsize, 0);
+      if (!err && sizeof (*chunk) + grub_le_to_cpu16 (chunk->nstripes)
+	  * sizeof (struct grub_btrfs_chunk_stripe) > elemsize)
+	err = grub_error (GRUB_ERR_BAD_FS, "chunk item too small");
+      if (!err && nchunks
+	  && start - chunks[nchunks - 1].start < chunks[nchunks - 1].size)
+	err = grub_error (GRUB_ERR_BAD_FS, "overlapping chunks");
+      if (!err && nchunks == allocated)
+	{
+	  struct grub_btrfs_chunk_map *tmp;
+	  grub_size_t sz;
+
+	  allocated = allocated ? allocated * 2 : 16;
+	  if (grub_mul (allocated, sizeof (chunks[0]), &sz))
+	    err = grub_error (GRUB_ERR_OUT_OF_RANGE, "overflow is detected");
+	  else
+	    {
+	      tmp = grub_realloc (chunks, sz);
+	      if (!tmp)
+		err = grub_errno;
+	      else
+		chunks = tmp;
+	    }
+	}
+      if (err)
+	{
+	  grub_free (chunk);
+	  break;
+	}
+      chunks[nchunks].start = start;
+      chunks[nchunks].size = grub_le_to_cpu64 (chunk->size);
+      chunks[nchunks].chunk = chunk;
+      nchunks++;
+
+      r = next (data, &desc, &elemaddr, &elemsize, &key_out);
+    }
+  grub_free (desc.data);
+  if (!err && r < 0)
+    err = grub_errno;
+  if (err)
+    {
+      free_chunk_map (chunks, nchunks);
+      return err;
+    }
+
+  data->chunks = chunks;
+  data->nchunks = nchunks;
+  grub_dprintf ("btrfs", "%" PRIuGRUB_SIZE " chunks mapped\n", nchunks);
+  return GRUB_ERR_NONE;
+}
+
 static struct grub_btrfs_data *
 grub_btrfs_mount (grub_device_t dev)
 {
   struct grub_btrfs_data *data;
+  grub_uint32_t nodesize;
   grub_err_t err;
 
   if (!dev->disk)
@@ -1193,6 +1452,14 @@ grub_btrfs_mount (grub_device_t dev)
       return NULL;
     }
 
+  nodesize = grub_le_to_cpu32 (data->sblock.nodesize);
+  if (nodesize < 4096 || nodesize > 65536 || (nodesize & (nodesize - 1)))
+    {
+      grub_error (GRUB_ERR_BAD_FS, "invalid node size %u", nodesize);
+      grub_free (data);
+      return NULL;
+    }
+
   data->n_devices_allocated = 16;
   data->devices_attached = grub_malloc (sizeof (data->devices_attached[0])
 					* data->n_devices_allocated);
@@ -1205,6 +1472,14 @@ grub_btrfs_mount (grub_device_t dev)
   data->devices_attached[0].dev = dev;
   data->devices_attached[0].id = data->sblock.this_device.device_id;
 
+  /* The chunk tree is walked on every miss otherwise, so an incomplete
+     map is only a missed optimization.  */
+  if (build_chunk_map (data))
+    {
+      grub_dprintf ("btrfs", "no chunk map: %s\n", grub_errmsg);
+      grub_errno = GRUB_ERR_NONE;
+    }
+
   return data;
 }
 
@@ -1218,6 +1493,11 @@ grub_btrfs_unmount (struct grub_btrfs_data *data)
         grub_device_close (data->devices_attached[i].dev);
   grub_free (data->devices_attached);
   grub_free (data->extent);
+  free_chunk_map (data->chunks, data->nchunks);
+  for (i = 0; i < GRUB_BTRFS_NODE_CACHE_SIZE; i++)
+    grub_free (data->node_cache[i].node);
+  for (i = 0; i < GRUB_BTRFS_DECOMP_CACHE_SIZE; i++)
+    grub_free (data->decomp_cache[i].buf);
   grub_free (data);
 }
 
@@ -1429,6 +1709,95 @@ grub_btrfs_lzo_decompress(char *ibuf, grub_size_t isize, grub_off_t off,
   return ret;
 }
 
+/* Decompress OSIZE bytes from OFF on of the compressed regular extent
+   EXTENT into OBUF.  */
+static grub_ssize_t
+grub_btrfs_decompress_extent (struct grub_btrfs_data *data,
+			      struct grub_btrfs_extent_data *extent,
+			      grub_off_t off, char *obuf, grub_size_t osize)
+{
+  char *tmp;
+  grub_uint64_t zsize;
+  grub_ssize_t ret;
+  grub_err_t err;
+
+  zsize = grub_le_to_cpu64 (extent->compressed_size);
+  tmp = grub_malloc (zsize);
+  if (!tmp)
+    return -1;
+  err = grub_btrfs_read_logical (data, grub_le_to_cpu64 (extent->laddr),
+				 tmp, zsize, 0);
+  if (err)
+    {
+      grub_free (tmp);
+      return -1;
+    }
+
+  if (extent->compression == GRUB_BTRFS_COMPRESSION_ZLIB)
+    ret = grub_zlib_decompress (tmp, zsize, off, obuf, osize);
+  else if (extent->compression == GRUB_BTRFS_COMPRESSION_LZO)
+    ret = grub_btrfs_lzo_decompress (tmp, zsize, off, obuf, osize);
+  else if (extent->compression == GRUB_BTRFS_COMPRESSION_ZSTD)
+    ret = grub_btrfs_zstd_decompress (tmp, zsize, off, obuf, osize);
+  else
+    ret = -1;
+
+  grub_free (tmp);
+  return ret;
+}
+
+/* Return the decompressed contents of the compressed regular extent
+   EXTENT, decompressing it only if it isn't cached.  Only the first
+   SIZE bytes of the entry are valid if the compressed data ended
+   early.  */
+static struct grub_btrfs_decomp_cache *
+grub_btrfs_get_decompressed (struct grub_btrfs_data *data,
+			     struct grub_btrfs_extent_data *extent)
+{
+  struct grub_btrfs_decomp_cache *e, *victim = NULL;
+  grub_uint64_t laddr = grub_le_to_cpu64 (extent->laddr);
+  grub_uint64_t zsize = grub_le_to_cpu64 (extent->compressed_size);
+  grub_size_t ram_size = grub_le_to_cpu64 (extent->size);
+  grub_ssize_t ret;
+  char *tmp;
+  unsigned i;
+
+  for (i = 0; i < GRUB_BTRFS_DECOMP_CACHE_SIZE; i++)
+    {
+      e = &data->decomp_cache[i];
+      if (e->buf && e->laddr == laddr && e->zsize == zsize
+	  && e->compression == extent->compression)
+	{
+	  e->last_used = ++data->decomp_cache_clock;
+	  return e;
+	}
+      if (!victim || (victim->buf && (!e->buf
+				      || e->last_used < victim->last_used)))
+	victim = e;
+    }
+
+  tmp = grub_realloc (victim->buf, ram_size ? : 1);
+  if (!tmp)
+    return NULL;
+  victim->buf = tmp;
+  victim->laddr = ~(grub_uint64_t) 0;
+
+  ret = grub_btrfs_decompress_extent (data, extent, 0, victim->buf, ram_size);
+  if (ret < 0)
+    {
+      if (!grub_errno)
+	grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "premature end of compressed");
+      return NULL;
+    }
+
+  victim->laddr = laddr;
+  victim->zsize = zsize;
+  victim->compression = extent->compression;
+  victim->size = ret;
+  victim->last_used = ++data->decomp_cache_clock;
+  return victim;
+}
+
 static grub_ssize_t
 grub_btrfs_extent_read (struct grub_btrfs_data *data,
 			grub_uint64_t ino, grub_uint64_t tree,
@@ -1573,48 +1942,37 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 
 	  if (data->extent->compression != GRUB_BTRFS_COMPRESSION_NONE)
 	    {
-	      char *tmp;
-	      grub_uint64_t zsize;
+	      struct grub_btrfs_decomp_cache *cached;
+	      grub_uint64_t ram_size = grub_le_to_cpu64 (data->extent->size);
+	      grub_off_t zoff = extoff + grub_le_to_cpu64 (data->extent->offset);
 	      grub_ssize_t ret;
 
-	      zsize = grub_le_to_cpu64 (data->extent->compressed_size);
-	      tmp = grub_malloc (zsize);
-	      if (!tmp)
-		return -1;
-	      err = grub_btrfs_read_logical (data,
-					     grub_le_to_cpu64 (data->extent->laddr),
-					     tmp, zsize, 0);
-	      if (err)
+	      /* A read of the whole extent won't come back for more.  */
+	      if ((zoff == 0 && csize == ram_size)
+		  || ram_size > GRUB_BTRFS_DECOMP_CACHE_MAX)
 		{
-		  grub_free (tmp);
-		  return -1;
+		  ret = grub_btrfs_decompress_extent (data, data->extent, zoff,
+						      buf, csize);
+		  if (ret != (grub_ssize_t) csize)
+		    {
+		      if (!grub_errno)
+			grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+				    "premature end of compressed");
+		      return -1;
+		    }
+		  break;
 		}
 
-	      if (data->extent->compression == GRUB_BTRFS_COMPRESSION_ZLIB)
-		ret = grub_zlib_decompress (tmp, zsize, extoff
-				    + grub_le_to_cpu64 (data->extent->offset),
-				    buf, csize);
-	      else if (data->extent->compression == GRUB_BTRFS_COMPRESSION_LZO)
-		ret = grub_btrfs_lzo_decompress (tmp, zsize, extoff
-				    + grub_le_to_cpu64 (data->extent->offset),
-				    buf, csize);
-	      else if (data->extent->compression == GRUB_BTRFS_COMPRESSION_ZSTD)
-		ret = grub_btrfs_zstd_decompress (tmp, zsize, extoff
-				    + grub_le_to_cpu64 (data->extent->offset),
-				    buf, csize);
-	      else
-		ret = -1;
-
-	      grub_free (tmp);
-
-	      if (ret != (grub_ssize_t) csize)
+	      cached = grub_btrfs_get_decompressed (data, data->extent);
+	      if (!cached)
+		return -1;
+	      if (zoff > cached->size || csize > cached->size - zoff)
 		{
-		  if (!grub_errno)
-		    grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-				"premature end of compressed");
+		  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			      "premature end of compressed");
 		  return -1;
 		}
-
+	      grub_memcpy (buf, cached->buf + zoff, csize);
 	      break;
 	    }
 	  err = grub_btrfs_read_logical (data,
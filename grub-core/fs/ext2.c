@@ -21,6 +21,8 @@
 #define	EXT2_MAGIC		0xEF53
 /* Amount of indirect blocks in an inode.  */
 #define INDIRECT_BLOCKS		12
+/* Maximum depth of the indirect block tree.  */
+#define INDIRECT_LEVELS		3
 
 /* The good old revision and the default inode size.  */
 #define EXT2_GOOD_OLD_REVISION		0
@@ -142,7 +144,23 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define EXT3_JOURNAL_FLAG_LAST_TAG	8
 
 #define EXT4_ENCRYPT_FLAG              0x800
+#define EXT3_INDEX_FLAG			0x1000
 #define EXT4_EXTENTS_FLAG		0x80000
+#define EXT4_CASEFOLD_FLAG		0x40000000
+
+/* Superblock flags.  */
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
+
+/* Hash functions of indexed directories.  */
+#define EXT3_DX_HASH_LEGACY		0
+#define EXT3_DX_HASH_HALF_MD4		1
+#define EXT3_DX_HASH_TEA		2
+#define EXT3_DX_HASH_LEGACY_UNSIGNED	3
+#define EXT3_DX_HASH_HALF_MD4_UNSIGNED	4
+#define EXT3_DX_HASH_TEA_UNSIGNED	5
+
+/* Depth of the hash tree including the root, 3 with large_dir.  */
+#define EXT3_DX_MAX_LEVELS		3
 
 /* The ext2 superblock.  */
 struct grub_ext2_sblock
@@ -197,6 +215,12 @@ struct grub_ext2_sblock
   grub_uint32_t first_meta_bg;
   grub_uint32_t mkfs_time;
   grub_uint32_t jnl_blocks[17];
+  grub_uint32_t total_blocks_hi;
+  grub_uint32_t reserved_blocks_hi;
+  grub_uint32_t free_blocks_hi;
+  grub_uint16_t min_extra_isize;
+  grub_uint16_t want_extra_isize;
+  grub_uint32_t flags;
 };
 
 /* The ext2 blockgroup.  */
@@ -263,6 +287,25 @@ struct ext2_dirent
   grub_uint8_t filetype;
 };
 
+/* The root of the hash tree of an indexed directory, right behind the
+   entries of "." and "..".  */
+struct grub_ext3_dx_root_info
+{
+  grub_uint32_t reserved_zero;
+  grub_uint8_t hash_version;
+  grub_uint8_t info_length;
+  grub_uint8_t indirect_levels;
+  grub_uint8_t unused_flags;
+};
+
+/* The first entry of every hash tree node holds LIMIT and COUNT instead
+   of a hash.  */
+struct grub_ext3_dx_entry
+{
+  grub_uint32_t hash;
+  grub_uint32_t block;
+};
+
 struct grub_ext3_journal_header
 {
   grub_uint32_t magic;
@@ -294,6 +337,8 @@ struct grub_ext3_journal_sblock
 };
 
 #define EXT4_EXT_MAGIC		0xf30a
+/* Extents longer than this are uninitialized and read as zeroes.  */
+#define EXT4_EXT_INIT_MAX_LEN	32768
 
 struct grub_ext4_extent_header
 {
@@ -320,6 +365,14 @@ struct grub_ext4_extent_idx
   grub_uint16_t unused;
 };
 
+/* A run of file blocks mapped by one extent, or a hole if START is 0.  */
+struct grub_ext4_run
+{
+  grub_uint64_t block;
+  grub_uint64_t len;
+  grub_disk_addr_t start;
+};
+
 struct grub_fshelp_node
 {
   struct grub_ext2_data *data;
@@ -336,6 +389,17 @@ struct grub_ext2_data
   grub_disk_t disk;
   struct grub_ext2_inode *inode;
   struct grub_fshelp_node diropen;
+
+  /* Decoded extent leaves of the open file, sorted by file block.  */
+  int cache_runs;
+  struct grub_ext4_run *runs;
+  grub_size_t nruns;
+  grub_size_t runs_alloc;
+
+  /* The indirect block of the open file last read at every level,
+     counted from the data blocks up.  */
+  grub_uint32_t indir_block[INDIRECT_LEVELS];
+  grub_uint32_t *indir[INDIRECT_LEVELS];
 };
 
 static grub_dl_t my_mod;
@@ -407,14 +471,20 @@ grub_ext2_blockgroup (struct grub_ext2_data *data, grub_uint64_t group,
 			 sizeof (struct grub_ext2_block_group), blkgrp);
 }
 
+/* Find the leaf of the extent tree EXT_BLOCK that maps FILEBLOCK.  The
+   leaf is responsible for the file blocks from *FIRST up to *END.  */
 static struct grub_ext4_extent_header *
 grub_ext4_find_leaf (struct grub_ext2_data *data,
                      struct grub_ext4_extent_header *ext_block,
-                     grub_uint32_t fileblock)
+                     grub_uint32_t fileblock,
+                     grub_uint64_t *first, grub_uint64_t *end)
 {
   struct grub_ext4_extent_idx *index;
   void *buf = NULL;
 
+  *first = 0;
+  *end = 1ULL << 32;
+
   while (1)
     {
       int i;
@@ -428,14 +498,23 @@ grub_ext4_find_leaf (struct grub_ext2_data *data,
       if (ext_block->depth == 0)
         return ext_block;
 
+      if (ext_block->entries == 0)
+	goto fail;
+
       for (i = 0; i < grub_le_to_cpu16 (ext_block->entries); i++)
         {
           if (fileblock < grub_le_to_cpu32(index[i].block))
             break;
         }
 
-      if (--i < 0)
-	goto fail;
+      /* Blocks in front of the first index belong to it, like in Linux.  */
+      if (--i > 0 && grub_le_to_cpu32 (index[i].block) > *first)
+	*first = grub_le_to_cpu32 (index[i].block);
+      if (i < 0)
+	i = 0;
+      if (i + 1 < grub_le_to_cpu16 (ext_block->entries)
+	  && grub_le_to_cpu32 (index[i + 1].block) < *end)
+	*end = grub_le_to_cpu32 (index[i + 1].block);
 
       block = grub_le_to_cpu16 (index[i].leaf_hi);
       block = (block << 32) | grub_le_to_cpu32 (index[i].leaf);
@@ -455,69 +534,284 @@ grub_ext4_find_leaf (struct grub_ext2_data *data,
   return 0;
 }
 
+/* Decode the extents of LEAF, which maps the file blocks FIRST up to END,
+   into RUNS and fill the gaps between them with holes.  RUNS must have
+   room for twice the number of extents plus one.  Return the number of
+   runs or -1 if the leaf is corrupted.  */
+static grub_ssize_t
+grub_ext4_decode_leaf (struct grub_ext4_extent_header *leaf,
+		       grub_uint64_t first, grub_uint64_t end,
+		       struct grub_ext4_run *runs)
+{
+  struct grub_ext4_extent *ext = (struct grub_ext4_extent *) (leaf + 1);
+  grub_uint64_t next = first;
+  grub_ssize_t n = 0;
+  int i;
+
+  for (i = 0; i < grub_le_to_cpu16 (leaf->entries); i++)
+    {
+      grub_uint64_t block = grub_le_to_cpu32 (ext[i].block);
+      grub_uint64_t len = grub_le_to_cpu16 (ext[i].len);
+      grub_disk_addr_t start = 0;
+
+      if (len > EXT4_EXT_INIT_MAX_LEN)
+	len -= EXT4_EXT_INIT_MAX_LEN;
+      else
+	{
+	  start = grub_le_to_cpu16 (ext[i].start_hi);
+	  start = (start << 32) | grub_le_to_cpu32 (ext[i].start);
+	}
+
+      if (len == 0)
+	return -1;
+      if (block < first)
+	{
+	  if (block + len <= first)
+	    continue;
+	  if (start)
+	    start += first - block;
+	  len -= first - block;
+	  block = first;
+	}
+      if (block < next)
+	return -1;
+      if (block >= end)
+	break;
+      if (block + len > end)
+	len = end - block;
+
+      if (block > next)
+	{
+	  runs[n].block = next;
+	  runs[n].len = block - next;
+	  runs[n].start = 0;
+	  n++;
+	}
+      runs[n].block = block;
+      runs[n].len = len;
+      runs[n].start = start;
+      n++;
+      next = block + len;
+    }
+
+  if (next < end)
+    {
+      runs[n].block = next;
+      runs[n].len = end - next;
+      runs[n].start = 0;
+      n++;
+    }
+
+  return n;
+}
+
+/* Return the number of cached runs starting at or before FILEBLOCK.  */
+static grub_size_t
+grub_ext4_search_runs (struct grub_ext2_data *data, grub_uint64_t fileblock)
+{
+  grub_size_t lo = 0, hi = data->nruns;
+
+  while (lo < hi)
+    {
+      grub_size_t mid = lo + (hi - lo) / 2;
+
+      if (data->runs[mid].block <= fileblock)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo;
+}
+
+/* Add the N decoded runs of one leaf to the cache of DATA.  Failing to
+   do so is not an error, the leaf is simply decoded again next time.  */
+static void
+grub_ext4_cache_runs (struct grub_ext2_data *data,
+		      const struct grub_ext4_run *runs, grub_size_t n)
+{
+  grub_size_t pos;
+
+  pos = grub_ext4_search_runs (data, runs[0].block);
+
+  /* Leaves never overlap unless the tree is corrupted.  */
+  if (pos > 0 && (data->runs[pos - 1].block + data->runs[pos - 1].len
+		  > runs[0].block))
+    return;
+  if (pos < data->nruns
+      && data->runs[pos].block < runs[n - 1].block + runs[n - 1].len)
+    return;
+
+  if (data->nruns + n > data->runs_alloc)
+    {
+      struct grub_ext4_run *new_runs;
+      grub_size_t alloc, sz;
+
+      alloc = data->runs_alloc * 2;
+      if (alloc < data->nruns + n)
+	alloc = data->nruns + n;
+      if (grub_mul (alloc, sizeof (*new_runs), &sz))
+	return;
+      new_runs = grub_realloc (data->runs, sz);
+      if (!new_runs)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
+      data->runs = new_runs;
+      data->runs_alloc = alloc;
+    }
+
+  grub_memmove (data->runs + pos + n, data->runs + pos,
+		(data->nruns - pos) * sizeof (*runs));
+  grub_memcpy (data->runs + pos, runs, n * sizeof (*runs));
+  data->nruns += n;
+}
+
+/* Map FILEBLOCK of the extent mapped file NODE to a disk block and store
+   the number of blocks contiguous from there in *COUNT.  */
 static grub_disk_addr_t
-grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+grub_ext4_read_run (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		    grub_disk_addr_t *count)
 {
   struct grub_ext2_data *data = node->data;
-  struct grub_ext2_inode *inode = &node->inode;
-  unsigned int blksz = EXT2_BLOCK_SIZE (data);
-  grub_disk_addr_t blksz_quarter = blksz / 4;
-  int log2_blksz = LOG2_EXT2_BLOCK_SIZE (data);
-  int log_perblock = log2_blksz + 9 - 2;
-  grub_uint32_t indir;
-  int shift;
+  struct grub_ext4_extent_header *root, *leaf;
+  struct grub_ext4_run *runs;
+  const struct grub_ext4_run *run = NULL;
+  int cache = (node == &data->diropen && data->cache_runs);
+  grub_uint64_t first, end;
+  grub_ssize_t n = 0, i;
+  grub_disk_addr_t offset;
+
+  if (cache)
+    {
+      grub_size_t pos = grub_ext4_search_runs (data, fileblock);
+
+      if (pos > 0 && fileblock - data->runs[pos - 1].block
+	  < data->runs[pos - 1].len)
+	{
+	  run = &data->runs[pos - 1];
+	  offset = fileblock - run->block;
+	  *count = run->len - offset;
+	  return run->start ? run->start + offset : 0;
+	}
+    }
 
-  if (inode->flags & grub_cpu_to_le32_compile_time (EXT4_EXTENTS_FLAG))
+  /* Extents can't map blocks beyond 32 bits.  */
+  if (fileblock >= (1ULL << 32))
+    return 0;
+
+  root = (struct grub_ext4_extent_header *) node->inode.blocks.dir_blocks;
+  leaf = grub_ext4_find_leaf (data, root, fileblock, &first, &end);
+  if (! leaf)
     {
-      struct grub_ext4_extent_header *leaf;
-      struct grub_ext4_extent *ext;
-      int i;
-      grub_disk_addr_t ret;
+      grub_error (GRUB_ERR_BAD_FS, "invalid extent");
+      return -1;
+    }
 
-      leaf = grub_ext4_find_leaf (data, (struct grub_ext4_extent_header *) inode->blocks.dir_blocks, fileblock);
-      if (! leaf)
-        {
-          grub_error (GRUB_ERR_BAD_FS, "invalid extent");
-          return -1;
-        }
+  runs = grub_calloc (2 * grub_le_to_cpu16 (leaf->entries) + 1,
+		      sizeof (*runs));
+  if (runs)
+    n = grub_ext4_decode_leaf (leaf, first, end, runs);
 
-      ext = (struct grub_ext4_extent *) (leaf + 1);
-      for (i = 0; i < grub_le_to_cpu16 (leaf->entries); i++)
-        {
-          if (fileblock < grub_le_to_cpu32 (ext[i].block))
-            break;
-        }
+  if (leaf != root)
+    grub_free (leaf);
+  if (! runs)
+    return -1;
 
-      if (--i >= 0)
-        {
-          fileblock -= grub_le_to_cpu32 (ext[i].block);
-          if (fileblock >= grub_le_to_cpu16 (ext[i].len))
-	    ret = 0;
-          else
-            {
-              grub_disk_addr_t start;
-
-              start = grub_le_to_cpu16 (ext[i].start_hi);
-              start = (start << 32) + grub_le_to_cpu32 (ext[i].start);
-
-              ret = fileblock + start;
-            }
-        }
-      else
-        {
-          grub_error (GRUB_ERR_BAD_FS, "something wrong with extent");
-	  ret = -1;
-        }
+  for (i = 0; i < n; i++)
+    if (fileblock - runs[i].block < runs[i].len)
+      {
+	run = &runs[i];
+	break;
+      }
 
-      if (leaf != (struct grub_ext4_extent_header *) inode->blocks.dir_blocks)
-	grub_free (leaf);
+  if (! run)
+    {
+      grub_free (runs);
+      grub_error (GRUB_ERR_BAD_FS, "something wrong with extent");
+      return -1;
+    }
 
-      return ret;
+  offset = fileblock - run->block;
+  *count = run->len - offset;
+  offset = run->start ? run->start + offset : 0;
+
+  if (cache)
+    grub_ext4_cache_runs (data, runs, n);
+  grub_free (runs);
+
+  return offset;
+}
+
+/* Return the indirect block BLOCK, which is LEVEL levels above the data
+   blocks of the open file.  */
+static const grub_uint32_t *
+grub_ext2_get_indir (struct grub_ext2_data *data, int level,
+		     grub_uint32_t block)
+{
+  if (data->indir[level] && data->indir_block[level] == block)
+    return data->indir[level];
+
+  if (! data->indir[level])
+    {
+      data->indir[level] = grub_malloc (EXT2_BLOCK_SIZE (data));
+      if (! data->indir[level])
+	return NULL;
     }
 
+  if (grub_disk_read (data->disk,
+		      ((grub_disk_addr_t) block) << LOG2_EXT2_BLOCK_SIZE (data),
+		      0, EXT2_BLOCK_SIZE (data), data->indir[level]))
+    {
+      data->indir_block[level] = 0;
+      return NULL;
+    }
+  data->indir_block[level] = block;
+
+  return data->indir[level];
+}
+
+/* Return the number of the N block numbers in LIST that continue the
+   run started by the first one, either on disk or as a hole.  */
+static grub_disk_addr_t
+grub_ext2_count_run (const grub_uint32_t *list, grub_disk_addr_t n)
+{
+  grub_uint32_t first = grub_le_to_cpu32 (list[0]);
+  grub_disk_addr_t i;
+
+  for (i = 1; i < n; i++)
+    if (grub_le_to_cpu32 (list[i]) != (first ? first + i : 0))
+      break;
+
+  return i;
+}
+
+static grub_disk_addr_t
+grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		      grub_disk_addr_t *count)
+{
+  struct grub_ext2_data *data = node->data;
+  struct grub_ext2_inode *inode = &node->inode;
+  unsigned int blksz = EXT2_BLOCK_SIZE (data);
+  grub_disk_addr_t blksz_quarter = blksz / 4;
+  int log2_blksz = LOG2_EXT2_BLOCK_SIZE (data);
+  int log_perblock = log2_blksz + 9 - 2;
+  int cache = (node == &data->diropen && data->cache_runs);
+  const grub_uint32_t *list = NULL;
+  grub_uint32_t indir, index = 0;
+  grub_disk_addr_t span;
+  int shift;
+
+  *count = 1;
+
   /* Direct blocks.  */
   if (fileblock < INDIRECT_BLOCKS)
-    return grub_le_to_cpu32 (inode->blocks.dir_blocks[fileblock]);
+    {
+      *count = grub_ext2_count_run (&inode->blocks.dir_blocks[fileblock],
+				    INDIRECT_BLOCKS - fileblock);
+      return grub_le_to_cpu32 (inode->blocks.dir_blocks[fileblock]);
+    }
   fileblock -= INDIRECT_BLOCKS;
   /* Indirect.  */
   if (fileblock < blksz_quarter)
@@ -551,20 +845,44 @@ indirect:
     /* If the indirect block is zero, all child blocks are absent
        (i.e. filled with zeros.) */
     if (indir == 0)
-      return 0;
-    if (grub_disk_read (data->disk,
-			((grub_disk_addr_t) grub_le_to_cpu32 (indir))
-			<< log2_blksz,
-			((fileblock >> (log_perblock * shift))
-			 & ((1 << log_perblock) - 1))
-			* sizeof (indir),
-			sizeof (indir), &indir))
+      {
+	span = (grub_disk_addr_t) 1 << (log_perblock * (shift + 1));
+	*count = span - (fileblock & (span - 1));
+	return 0;
+      }
+    index = (fileblock >> (log_perblock * shift)) & ((1 << log_perblock) - 1);
+    if (cache)
+      {
+	list = grub_ext2_get_indir (data, shift, grub_le_to_cpu32 (indir));
+	if (! list)
+	  return -1;
+	indir = list[index];
+      }
+    else if (grub_disk_read (data->disk,
+			     ((grub_disk_addr_t) grub_le_to_cpu32 (indir))
+			     << log2_blksz,
+			     index * sizeof (indir),
+			     sizeof (indir), &indir))
       return -1;
   } while (shift--);
 
+  /* Only the open file keeps the whole block around to look further.  */
+  if (list)
+    *count = grub_ext2_count_run (&list[index], blksz_quarter - index);
+
   return grub_le_to_cpu32 (indir);
 }
 
+static grub_disk_addr_t
+grub_ext2_read_run (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		    grub_disk_addr_t *count)
+{
+  if (node->inode.flags & grub_cpu_to_le32_compile_time (EXT4_EXTENTS_FLAG))
+    return grub_ext4_read_run (node, fileblock, count);
+
+  return grub_ext2_read_block (node, fileblock, count);
+}
+
 /* Read LEN bytes from the file described by DATA starting with byte
    POS.  Return the amount of read bytes in READ.  */
 static grub_ssize_t
@@ -572,9 +890,9 @@ grub_ext2_read_file (grub_fshelp_node_t node,
 		     grub_disk_read_hook_t read_hook, void *read_hook_data,
 		     grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node,
-				read_hook, read_hook_data,
-				pos, len, buf, grub_ext2_read_block,
+  return grub_fshelp_read_file_runs (node->data->disk, node,
+				     read_hook, read_hook_data,
+				     pos, len, buf, grub_ext2_read_run,
 				grub_cpu_to_le32 (node->inode.size)
 				| (((grub_off_t) grub_cpu_to_le32 (node->inode.size_high)) << 32),
 				LOG2_EXT2_BLOCK_SIZE (node->data), 0);
@@ -678,6 +996,11 @@ grub_ext2_mount (grub_disk_t disk)
     data->log_group_desc_size = 5;
 
   data->disk = disk;
+  data->cache_runs = 0;
+  data->runs = NULL;
+  data->nruns = 0;
+  data->runs_alloc = 0;
+  grub_memset (data->indir, 0, sizeof (data->indir));
 
   data->diropen.data = data;
   data->diropen.ino = 2;
@@ -752,6 +1075,64 @@ grub_ext2_read_symlink (grub_fshelp_node_t node)
   return symlink;
 }
 
+/* Create the node for the entry DIRENT of the directory DIRO and store
+   its type in *TYPE.  */
+static struct grub_fshelp_node *
+grub_ext2_dirent_node (struct grub_fshelp_node *diro,
+		       const struct ext2_dirent *dirent,
+		       enum grub_fshelp_filetype *type)
+{
+  struct grub_fshelp_node *fdiro;
+
+  *type = GRUB_FSHELP_UNKNOWN;
+
+  fdiro = grub_malloc (sizeof (struct grub_fshelp_node));
+  if (! fdiro)
+    return 0;
+
+  fdiro->data = diro->data;
+  fdiro->ino = grub_le_to_cpu32 (dirent->inode);
+
+  if (dirent->filetype != FILETYPE_UNKNOWN)
+    {
+      fdiro->inode_read = 0;
+
+      if (dirent->filetype == FILETYPE_DIRECTORY)
+	*type = GRUB_FSHELP_DIR;
+      else if (dirent->filetype == FILETYPE_SYMLINK)
+	*type = GRUB_FSHELP_SYMLINK;
+      else if (dirent->filetype == FILETYPE_REG)
+	*type = GRUB_FSHELP_REG;
+    }
+  else
+    {
+      /* The filetype can not be read from the dirent, read
+	 the inode to get more information.  */
+      grub_ext2_read_inode (diro->data,
+			    grub_le_to_cpu32 (dirent->inode),
+			    &fdiro->inode);
+      if (grub_errno)
+	{
+	  grub_free (fdiro);
+	  return 0;
+	}
+
+      fdiro->inode_read = 1;
+
+      if ((grub_le_to_cpu16 (fdiro->inode.mode)
+	   & FILETYPE_INO_MASK) == FILETYPE_INO_DIRECTORY)
+	*type = GRUB_FSHELP_DIR;
+      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
+		& FILETYPE_INO_MASK) == FILETYPE_INO_SYMLINK)
+	*type = GRUB_FSHELP_SYMLINK;
+      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
+		& FILETYPE_INO_MASK) == FILETYPE_INO_REG)
+	*type = GRUB_FSHELP_REG;
+    }
+
+  return fdiro;
+}
+
 static int
 grub_ext2_iterate_dir (grub_fshelp_node_t dir,
 		       grub_fshelp_iterate_dir_hook_t hook, void *hook_data)
@@ -789,59 +1170,19 @@ grub_ext2_iterate_dir (grub_fshelp_node_t dir,
 	{
 	  char filename[MAX_NAMELEN + 1];
 	  struct grub_fshelp_node *fdiro;
-	  enum grub_fshelp_filetype type = GRUB_FSHELP_UNKNOWN;
+	  enum grub_fshelp_filetype type;
 
 	  grub_ext2_read_file (diro, 0, 0, fpos + sizeof (struct ext2_dirent),
 			       dirent.namelen, filename);
 	  if (grub_errno)
 	    return 0;
 
-	  fdiro = grub_malloc (sizeof (struct grub_fshelp_node));
+	  fdiro = grub_ext2_dirent_node (diro, &dirent, &type);
 	  if (! fdiro)
 	    return 0;
 
-	  fdiro->data = diro->data;
-	  fdiro->ino = grub_le_to_cpu32 (dirent.inode);
-
 	  filename[dirent.namelen] = '\0';
 
-	  if (dirent.filetype != FILETYPE_UNKNOWN)
-	    {
-	      fdiro->inode_read = 0;
-
-	      if (dirent.filetype == FILETYPE_DIRECTORY)
-		type = GRUB_FSHELP_DIR;
-	      else if (dirent.filetype == FILETYPE_SYMLINK)
-		type = GRUB_FSHELP_SYMLINK;
-	      else if (dirent.filetype == FILETYPE_REG)
-		type = GRUB_FSHELP_REG;
-	    }
-	  else
-	    {
-	      /* The filetype can not be read from the dirent, read
-		 the inode to get more information.  */
-	      grub_ext2_read_inode (diro->data,
-                                    grub_le_to_cpu32 (dirent.inode),
-				    &fdiro->inode);
-	      if (grub_errno)
-		{
-		  grub_free (fdiro);
-		  return 0;
-		}
-
-	      fdiro->inode_read = 1;
-
-	      if ((grub_le_to_cpu16 (fdiro->inode.mode)
-		   & FILETYPE_INO_MASK) == FILETYPE_INO_DIRECTORY)
-		type = GRUB_FSHELP_DIR;
-	      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
-			& FILETYPE_INO_MASK) == FILETYPE_INO_SYMLINK)
-		type = GRUB_FSHELP_SYMLINK;
-	      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
-			& FILETYPE_INO_MASK) == FILETYPE_INO_REG)
-		type = GRUB_FSHELP_REG;
-	    }
-
 	  if (hook (filename, type, fdiro, hook_data))
 	    return 1;
 	}
@@ -852,6 +1193,481 @@ grub_ext2_iterate_dir (grub_fshelp_node_t dir,
   return 0;
 }
 
+/* The hash functions are the same as in Linux, fs/ext4/hash.c.  */
+
+#define EXT3_DX_TEA_DELTA	0x9E3779B9
+
+static void
+grub_ext3_dx_tea_transform (grub_uint32_t buf[4], const grub_uint32_t in[4])
+{
+  grub_uint32_t sum = 0;
+  grub_uint32_t b0 = buf[0], b1 = buf[1];
+  grub_uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+  int n = 16;
+
+  do
+    {
+      sum += EXT3_DX_TEA_DELTA;
+      b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+      b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    }
+  while (--n);
+
+  buf[0] += b0;
+  buf[1] += b1;
+}
+
+#define EXT3_DX_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define EXT3_DX_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define EXT3_DX_H(x, y, z) ((x) ^ (y) ^ (z))
+
+#define EXT3_DX_ROUND(f, a, b, c, d, x, s)	\
+  (a += f (b, c, d) + (x), a = (a << (s)) | (a >> (32 - (s))))
+
+#define EXT3_DX_K2 013240474631U
+#define EXT3_DX_K3 015666365641U
+
+static void
+grub_ext3_dx_half_md4_transform (grub_uint32_t buf[4],
+				 const grub_uint32_t in[8])
+{
+  grub_uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+  EXT3_DX_ROUND (EXT3_DX_F, a, b, c, d, in[0], 3);
+  EXT3_DX_ROUND (EXT3_DX_F, d, a, b, c, in[1], 7);
+  EXT3_DX_ROUND (EXT3_DX_F, c, d, a, b, in[2], 11);
+  EXT3_DX_ROUND (EXT3_DX_F, b, c, d, a, in[3], 19);
+  EXT3_DX_ROUND (EXT3_DX_F, a, b, c, d, in[4], 3);
+  EXT3_DX_ROUND (EXT3_DX_F, d, a, b, c, in[5], 7);
+  EXT3_DX_ROUND (EXT3_DX_F, c, d, a, b, in[6], 11);
+  EXT3_DX_ROUND (EXT3_DX_F, b, c, d, a, in[7], 19);
+
+  EXT3_DX_ROUND (EXT3_DX_G, a, b, c, d, in[1] + EXT3_DX_K2, 3);
+  EXT3_DX_ROUND (EXT3_DX_G, d, a, b, c, in[3] + EXT3_DX_K2, 5);
+  EXT3_DX_ROUND (EXT3_DX_G, c, d, a, b, in[5] + EXT3_DX_K2, 9);
+  EXT3_DX_ROUND (EXT3_DX_G, b, c, d, a, in[7] + EXT3_DX_K2, 13);
+  EXT3_DX_ROUND (EXT3_DX_G, a, b, c, d, in[0] + EXT3_DX_K2, 3);
+  EXT3_DX_ROUND (EXT3_DX_G, d, a, b, c, in[2] + EXT3_DX_K2, 5);
+  EXT3_DX_ROUND (EXT3_DX_G, c, d, a, b, in[4] + EXT3_DX_K2, 9);
+  EXT3_DX_ROUND (EXT3_DX_G, b, c, d, a, in[6] + EXT3_DX_K2, 13);
+
+  EXT3_DX_ROUND (EXT3_DX_H, a, b, c, d, in[3] + EXT3_DX_K3, 3);
+  EXT3_DX_ROUND (EXT3_DX_H, d, a, b, c, in[7] + EXT3_DX_K3, 9);
+  EXT3_DX_ROUND (EXT3_DX_H, c, d, a, b, in[2] + EXT3_DX_K3, 11);
+  EXT3_DX_ROUND (EXT3_DX_H, b, c, d, a, in[6] + EXT3_DX_K3, 15);
+  EXT3_DX_ROUND (EXT3_DX_H, a, b, c, d, in[1] + EXT3_DX_K3, 3);
+  EXT3_DX_ROUND (EXT3_DX_H, d, a, b, c, in[5] + EXT3_DX_K3, 9);
+  EXT3_DX_ROUND (EXT3_DX_H, c, d, a, b, in[0] + EXT3_DX_K3, 11);
+  EXT3_DX_ROUND (EXT3_DX_H, b, c, d, a, in[4] + EXT3_DX_K3, 15);
+
+  buf[0] += a;
+  buf[1] += b;
+  buf[2] += c;
+  buf[3] += d;
+}
+
+/* Pack up to NUM * 4 bytes of NAME into BUF, padded with the length.  */
+static void
+grub_ext3_dx_str2hashbuf (const char *name, int len, grub_uint32_t *buf,
+			  int num, int is_unsigned)
+{
+  grub_uint32_t pad, val;
+  int i, c;
+
+  pad = (grub_uint32_t) len | ((grub_uint32_t) len << 8);
+  pad |= pad << 16;
+
+  val = pad;
+  if (len > num * 4)
+    len = num * 4;
+  for (i = 0; i < len; i++)
+    {
+      c = is_unsigned ? (int) (grub_uint8_t) name[i]
+	: (int) (grub_int8_t) name[i];
+      val = c + (val << 8);
+      if ((i % 4) == 3)
+	{
+	  *buf++ = val;
+	  val = pad;
+	  num--;
+	}
+    }
+  if (--num >= 0)
+    *buf++ = val;
+  while (--num >= 0)
+    *buf++ = pad;
+}
+
+static grub_uint32_t
+grub_ext3_dx_legacy_hash (const char *name, int len, int is_unsigned)
+{
+  grub_uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+  int c;
+
+  while (len--)
+    {
+      c = is_unsigned ? (int) (grub_uint8_t) *name
+	: (int) (grub_int8_t) *name;
+      name++;
+      hash = hash1 + (hash0 ^ (c * 7152373));
+
+      if (hash & 0x80000000)
+	hash -= 0x7fffffff;
+      hash1 = hash0;
+      hash0 = hash;
+    }
+  return hash0 << 1;
+}
+
+/* Compute the major hash of NAME, return 0 on success.  */
+static int
+grub_ext3_dx_hash (struct grub_ext2_data *data, int version,
+		   const char *name, int len, grub_uint32_t *hash)
+{
+  grub_uint32_t buf[4], in[8];
+  int i, is_unsigned = 0;
+
+  buf[0] = 0x67452301;
+  buf[1] = 0xefcdab89;
+  buf[2] = 0x98badcfe;
+  buf[3] = 0x10325476;
+
+  for (i = 0; i < 4; i++)
+    if (data->sblock.hash_seed[i])
+      break;
+  if (i < 4)
+    for (i = 0; i < 4; i++)
+      buf[i] = grub_le_to_cpu32 (data->sblock.hash_seed[i]);
+
+  switch (version)
+    {
+    case EXT3_DX_HASH_LEGACY_UNSIGNED:
+      is_unsigned = 1;
+      /* Fallthrough.  */
+    case EXT3_DX_HASH_LEGACY:
+      *hash = grub_ext3_dx_legacy_hash (name, len, is_unsigned);
+      break;
+
+    case EXT3_DX_HASH_HALF_MD4_UNSIGNED:
+      is_unsigned = 1;
+      /* Fallthrough.  */
+    case EXT3_DX_HASH_HALF_MD4:
+      for (; len > 0; len -= 32, name += 32)
+	{
+	  grub_ext3_dx_str2hashbuf (name, len, in, 8, is_unsigned);
+	  grub_ext3_dx_half_md4_transform (buf, in);
+	}
+      *hash = buf[1];
+      break;
+
+    case EXT3_DX_HASH_TEA_UNSIGNED:
+      is_unsigned = 1;
+      /* Fallthrough.  */
+    case EXT3_DX_HASH_TEA:
+      for (; len > 0; len -= 16, name += 16)
+	{
+	  grub_ext3_dx_str2hashbuf (name, len, in, 4, is_unsigned);
+	  grub_ext3_dx_tea_transform (buf, in);
+	}
+      *hash = buf[0];
+      break;
+
+    default:
+      return 1;
+    }
+
+  *hash &= ~1;
+  if (*hash == (0x7fffffffU << 1))
+    *hash = (0x7fffffffU - 1) << 1;
+
+  return 0;
+}
+
+/* Read the directory block BLOCK of DIRO into BUF.  Return 1 on success,
+   0 if the block is beyond the end of the directory and -1 on error.  */
+static int
+grub_ext3_dx_read_block (struct grub_fshelp_node *diro, grub_uint32_t block,
+			 char *buf)
+{
+  unsigned int blksz = EXT2_BLOCK_SIZE (diro->data);
+  grub_ssize_t len;
+
+  len = grub_ext2_read_file (diro, 0, 0,
+			     (grub_off_t) block << LOG2_BLOCK_SIZE (diro->data),
+			     blksz, buf);
+  if (len < 0)
+    return -1;
+  return len == (grub_ssize_t) blksz;
+}
+
+/* Look for NAME in the directory block BLOCK of DIRO.  Return 1 when it
+   was found, 0 if not and -1 on error.  */
+static int
+grub_ext3_dx_search_leaf (struct grub_fshelp_node *diro, grub_uint32_t block,
+			  const char *name, char *buf,
+			  grub_fshelp_node_t *foundnode,
+			  enum grub_fshelp_filetype *foundtype)
+{
+  unsigned int blksz = EXT2_BLOCK_SIZE (diro->data);
+  grub_size_t namelen = grub_strlen (name);
+  unsigned int pos = 0;
+  int ret;
+
+  ret = grub_ext3_dx_read_block (diro, block, buf);
+  if (ret <= 0)
+    return ret;
+
+  while (pos + sizeof (struct ext2_dirent) <= blksz)
+    {
+      struct ext2_dirent *dirent = (struct ext2_dirent *) (buf + pos);
+      grub_uint16_t direntlen = grub_le_to_cpu16 (dirent->direntlen);
+
+      if (direntlen < sizeof (struct ext2_dirent) || direntlen > blksz - pos)
+	return 0;
+
+      if (dirent->inode != 0 && dirent->namelen == namelen
+	  && sizeof (struct ext2_dirent) + namelen <= direntlen
+	  && grub_memcmp (dirent + 1, name, namelen) == 0)
+	{
+	  *foundnode = grub_ext2_dirent_node (diro, dirent, foundtype);
+	  if (! *foundnode)
+	    return -1;
+	  if (*foundtype == GRUB_FSHELP_UNKNOWN)
+	    {
+	      /* Same as the linear search, which skips these.  */
+	      grub_free (*foundnode);
+	      *foundnode = NULL;
+	    }
+	  return 1;
+	}
+
+      pos += direntlen;
+    }
+
+  return 0;
+}
+
+/* One node on the path from the root of a hash tree to a leaf.  */
+struct grub_ext3_dx_frame
+{
+  char *buf;
+  struct grub_ext3_dx_entry *entries;
+  struct grub_ext3_dx_entry *at;
+  grub_uint16_t count;
+};
+
+/* Set up FRAME for the node in its buffer with entries at OFFSET.  Return
+   0 if the node is corrupted.  */
+static int
+grub_ext3_dx_frame_init (struct grub_ext3_dx_frame *frame,
+			 unsigned int offset, unsigned int blksz)
+{
+  grub_uint16_t limit;
+
+  frame->entries = (struct grub_ext3_dx_entry *) (frame->buf + offset);
+  limit = grub_le_to_cpu16 (((grub_uint16_t *) frame->entries)[0]);
+  frame->count = grub_le_to_cpu16 (((grub_uint16_t *) frame->entries)[1]);
+  frame->at = frame->entries;
+
+  return (frame->count != 0 && frame->count <= limit
+	  && offset + limit * sizeof (struct grub_ext3_dx_entry) <= blksz);
+}
+
+/* Look NAME up in the hash tree of the indexed directory DIRO.  Return 1
+   when the answer in *FOUNDNODE is final, 0 when the tree can't be used
+   and -1 on error.  */
+static int
+grub_ext3_dx_lookup (struct grub_fshelp_node *diro, const char *name,
+		     grub_fshelp_node_t *foundnode,
+		     enum grub_fshelp_filetype *foundtype)
+{
+  struct grub_ext2_data *data = diro->data;
+  unsigned int blksz = EXT2_BLOCK_SIZE (data);
+  struct grub_ext3_dx_frame frames[EXT3_DX_MAX_LEVELS], *frame;
+  struct grub_ext3_dx_root_info *info;
+  grub_uint32_t hash;
+  int version, levels, level, ret = 0;
+  char *buf, *leaf;
+
+  buf = grub_malloc ((EXT3_DX_MAX_LEVELS + 1) * blksz);
+  if (! buf)
+    return -1;
+  for (level = 0; level < EXT3_DX_MAX_LEVELS; level++)
+    frames[level].buf = buf + level * blksz;
+  leaf = buf + EXT3_DX_MAX_LEVELS * blksz;
+
+  /* The root follows the 12 byte entry of "." and the one of "..".  */
+  ret = grub_ext3_dx_read_block (diro, 0, frames[0].buf);
+  if (ret <= 0)
+    goto out;
+  ret = 0;
+  info = (struct grub_ext3_dx_root_info *) (frames[0].buf + 24);
+  if (info->reserved_zero != 0 || info->unused_flags & 1
+      || info->indirect_levels >= EXT3_DX_MAX_LEVELS
+      || info->info_length < sizeof (*info)
+      || 24 + info->info_length + sizeof (struct grub_ext3_dx_entry) > blksz)
+    goto out;
+
+  version = info->hash_version;
+  if (version <= EXT3_DX_HASH_TEA
+      && (data->sblock.flags
+	  & grub_cpu_to_le32_compile_time (EXT2_FLAGS_UNSIGNED_HASH)))
+    version += EXT3_DX_HASH_LEGACY_UNSIGNED;
+  if (grub_ext3_dx_hash (data, version, name, grub_strlen (name), &hash))
+    goto out;
+
+  levels = info->indirect_levels;
+  if (! grub_ext3_dx_frame_init (&frames[0], 24 + info->info_length, blksz))
+    goto out;
+
+  for (level = 0; ; level++)
+    {
+      struct grub_ext3_dx_entry *p, *q, *m;
+
+      frame = &frames[level];
+
+      /* Find the last entry whose hash is not above HASH.  */
+      p = frame->entries + 1;
+      q = frame->entries + frame->count - 1;
+      while (p <= q)
+	{
+	  m = p + (q - p) / 2;
+	  if (grub_le_to_cpu32 (m->hash) > hash)
+	    q = m - 1;
+	  else
+	    p = m + 1;
+	}
+      frame->at = p - 1;
+
+      if (level == levels)
+	break;
+
+      /* Interior nodes start with an empty entry spanning the block.  */
+      ret = grub_ext3_dx_read_block (diro,
+				     grub_le_to_cpu32 (frame->at->block)
+				     & 0x0fffffff, frames[level + 1].buf);
+      if (ret <= 0)
+	goto out;
+      ret = 0;
+      if (! grub_ext3_dx_frame_init (&frames[level + 1],
+				     sizeof (struct ext2_dirent), blksz))
+	goto out;
+    }
+
+  while (1)
+    {
+      grub_uint32_t next;
+
+      ret = grub_ext3_dx_search_leaf (diro,
+				      grub_le_to_cpu32 (frames[levels].at->block)
+				      & 0x0fffffff, name, leaf,
+				      foundnode, foundtype);
+      if (ret != 0)
+	goto out;
+
+      /* Names whose hashes collide may continue in the following leaf,
+	 which is marked by the lowest bit of its hash.  */
+      for (level = levels; level >= 0; level--)
+	if (++frames[level].at < frames[level].entries + frames[level].count)
+	  break;
+      if (level < 0)
+	break;
+
+      next = grub_le_to_cpu32 (frames[level].at->hash);
+      if ((next & 1) == 0 || (next & ~1) != hash)
+	break;
+
+      for (; level < levels; level++)
+	{
+	  ret = grub_ext3_dx_read_block (diro,
+					 grub_le_to_cpu32 (frames[level].at->block)
+					 & 0x0fffffff, frames[level + 1].buf);
+	  if (ret <= 0)
+	    goto out;
+	  ret = 0;
+	  if (! grub_ext3_dx_frame_init (&frames[level + 1],
+					 sizeof (struct ext2_dirent), blksz))
+	    goto out;
+	}
+    }
+
+  /* Not in the directory.  */
+  ret = 1;
+
+ out:
+  grub_free (buf);
+  return ret;
+}
+
+/* Context for grub_ext2_lookup_file.  */
+struct grub_ext2_lookup_ctx
+{
+  const char *name;
+  grub_fshelp_node_t *foundnode;
+  enum grub_fshelp_filetype *foundtype;
+};
+
+/* Helper for grub_ext2_lookup_file.  */
+static int
+grub_ext2_lookup_iter (const char *filename,
+		       enum grub_fshelp_filetype filetype,
+		       grub_fshelp_node_t node, void *data)
+{
+  struct grub_ext2_lookup_ctx *ctx = data;
+
+  if (filetype == GRUB_FSHELP_UNKNOWN
+      || grub_strcmp (ctx->name, filename) != 0)
+    {
+      grub_free (node);
+      return 0;
+    }
+
+  *ctx->foundnode = node;
+  *ctx->foundtype = filetype;
+  return 1;
+}
+
+/* Find NAME in the directory DIR, through the hash tree if it has one.  */
+static grub_err_t
+grub_ext2_lookup_file (grub_fshelp_node_t dir, const char *name,
+		       grub_fshelp_node_t *foundnode,
+		       enum grub_fshelp_filetype *foundtype)
+{
+  struct grub_ext2_lookup_ctx ctx = {
+    .name = name,
+    .foundnode = foundnode,
+    .foundtype = foundtype
+  };
+  int ret;
+
+  *foundnode = NULL;
+
+  if (! dir->inode_read)
+    {
+      grub_ext2_read_inode (dir->data, dir->ino, &dir->inode);
+      if (grub_errno)
+	return grub_errno;
+      dir->inode_read = 1;
+    }
+
+  if ((dir->data->sblock.feature_compatibility
+       & grub_cpu_to_le32_compile_time (EXT2_FEATURE_COMPAT_DIR_INDEX))
+      && (dir->inode.flags & grub_cpu_to_le32_compile_time (EXT3_INDEX_FLAG))
+      && !(dir->inode.flags
+	   & grub_cpu_to_le32_compile_time (EXT4_ENCRYPT_FLAG
+					    | EXT4_CASEFOLD_FLAG)))
+    {
+      ret = grub_ext3_dx_lookup (dir, name, foundnode, foundtype);
+      if (ret < 0)
+	return grub_errno;
+      if (ret > 0)
+	return GRUB_ERR_NONE;
+    }
+
+  grub_ext2_iterate_dir (dir, grub_ext2_lookup_iter, &ctx);
+  return grub_errno;
+}
+
 /* Open a file named NAME and initialize FILE.  */
 static grub_err_t
 grub_ext2_open (struct grub_file *file, const char *name)
@@ -869,9 +1685,9 @@ grub_ext2_open (struct grub_file *file, const char *name)
       goto fail;
     }
 
-  err = grub_fshelp_find_file (name, &data->diropen, &fdiro,
-			       grub_ext2_iterate_dir,
-			       grub_ext2_read_symlink, GRUB_FSHELP_REG);
+  err = grub_fshelp_find_file_lookup (name, &data->diropen, &fdiro,
+				      grub_ext2_lookup_file,
+				      grub_ext2_read_symlink, GRUB_FSHELP_REG);
   if (err)
     goto fail;
 
@@ -891,6 +1707,9 @@ grub_ext2_open (struct grub_file *file, const char *name)
   grub_memcpy (data->inode, &fdiro->inode, sizeof (struct grub_ext2_inode));
   grub_free (fdiro);
 
+  /* From now on DIROPEN is the file and nothing else.  */
+  data->cache_runs = 1;
+
   file->size = grub_le_to_cpu32 (data->inode->size);
   file->size |= ((grub_off_t) grub_le_to_cpu32 (data->inode->size_high)) << 32;
   file->data = data;
@@ -911,7 +1730,13 @@ grub_ext2_open (struct grub_file *file, const char *name)
 static grub_err_t
 grub_ext2_close (grub_file_t file)
 {
-  grub_free (file->data);
+  struct grub_ext2_data *data = file->data;
+  int i;
+
+  grub_free (data->runs);
+  for (i = 0; i < INDIRECT_LEVELS; i++)
+    grub_free (data->indir[i]);
+  grub_free (data);
 
   grub_dl_unref (my_mod);
 
@@ -981,9 +1806,9 @@ grub_ext2_dir (grub_device_t device, const char *path, grub_fs_dir_hook_t hook,
   if (! ctx.data)
     goto fail;
 
-  grub_fshelp_find_file (path, &ctx.data->diropen, &fdiro,
-			 grub_ext2_iterate_dir, grub_ext2_read_symlink,
-			 GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_lookup (path, &ctx.data->diropen, &fdiro,
+				grub_ext2_lookup_file, grub_ext2_read_symlink,
+				GRUB_FSHELP_DIR);
   if (grub_errno)
     goto fail;
 
@@ -123,6 +123,13 @@ GRUB_MOD_LICENSE ("GPLv3+");
 
 #define MAX_VOLUME_NAME           512
 
+#define NULL_ADDR                 0
+#define NEW_ADDR                  ((grub_uint32_t) -1)
+
+/* Number of NAT and node blocks kept in memory per mount. */
+#define F2FS_NAT_CACHE_SIZE       8
+#define F2FS_NODE_CACHE_SIZE      16
+
 enum FILE_TYPE
 {
   F2FS_FT_UNKNOWN,
@@ -232,6 +239,13 @@ struct grub_f2fs_dentry_block {
   grub_uint8_t                    filename[NR_DENTRY_IN_BLOCK][F2FS_SLOT_LEN];
 } GRUB_PACKED;
 
+struct grub_f2fs_extent
+{
+  grub_uint32_t                   fofs;
+  grub_uint32_t                   blk_addr;
+  grub_uint32_t                   len;
+} GRUB_PACKED;
+
 struct grub_f2fs_inode
 {
   grub_uint16_t                   i_mode;
@@ -256,7 +270,7 @@ struct grub_f2fs_inode
   grub_uint32_t                   i_namelen;
   grub_uint8_t                    i_name[F2FS_NAME_LEN];
   grub_uint8_t                    i_dir_level;
-  grub_uint8_t                    i_ext[12];
+  struct grub_f2fs_extent         i_ext;
   grub_uint32_t                   i_addr[DEF_ADDRS_PER_INODE];
   grub_uint32_t                   i_nid[5];
 } GRUB_PACKED;
@@ -290,6 +304,20 @@ struct grub_fshelp_node
   int inode_read;
 };
 
+struct grub_f2fs_nat_cache
+{
+  grub_uint32_t                   block_off;
+  grub_uint32_t                   last_used;
+  struct grub_f2fs_nat_block      *nat_block;
+};
+
+struct grub_f2fs_node_cache
+{
+  grub_uint32_t                   nid;
+  grub_uint32_t                   last_used;
+  struct grub_f2fs_node           *node;
+};
+
 struct grub_f2fs_data
 {
   struct grub_f2fs_superblock     sblock;
@@ -303,6 +331,10 @@ struct grub_f2fs_data
   struct grub_f2fs_nat_journal    nat_j;
   char                            *nat_bitmap;
 
+  struct grub_f2fs_nat_cache      nat_cache[F2FS_NAT_CACHE_SIZE];
+  struct grub_f2fs_node_cache     node_cache[F2FS_NODE_CACHE_SIZE];
+  grub_uint32_t                   cache_clock;
+
   grub_disk_t                     disk;
   struct grub_f2fs_node           *inode;
   struct grub_fshelp_node         diropen;
@@ -399,6 +431,15 @@ get_node_id (struct grub_f2fs_node *rn, int off, int inode_block)
   return grub_le_to_cpu32 (rn->in.nid[off]);
 }
 
+static grub_uint32_t
+get_node_addr (struct grub_f2fs_node *rn, int inode_block, grub_uint32_t off)
+{
+  if (inode_block)
+    return grub_le_to_cpu32 (rn->i.i_addr[off]);
+
+  return grub_le_to_cpu32 (rn->dn.addr[off]);
+}
+
 static grub_err_t
 grub_f2fs_block_read (struct grub_f2fs_data *data, grub_uint32_t blkaddr,
                       void *buf)
@@ -654,22 +695,39 @@ get_blkaddr_from_nat_journal (struct grub_f2fs_data *data, grub_uint32_t nid)
 static grub_uint32_t
 get_node_blkaddr (struct grub_f2fs_data *data, grub_uint32_t nid)
 {
-  struct grub_f2fs_nat_block *nat_block;
+  struct grub_f2fs_nat_cache *c, *victim = NULL;
   grub_uint32_t seg_off, block_off, entry_off, block_addr;
   grub_uint32_t blkaddr;
   grub_err_t err;
+  int i;
 
   blkaddr = get_blkaddr_from_nat_journal (data, nid);
   if (blkaddr)
     return blkaddr;
 
-  nat_block = grub_malloc (F2FS_BLKSIZE);
-  if (!nat_block)
-    return 0;
-
   block_off = nid / NAT_ENTRY_PER_BLOCK;
   entry_off = nid % NAT_ENTRY_PER_BLOCK;
 
+  /* NAT blocks are cached as a whole, neighbouring nodes tend to be
+     looked up together. */
+  for (i = 0; i < F2FS_NAT_CACHE_SIZE; i++)
+    {
+      c = &data->nat_cache[i];
+      if (c->nat_block && c->block_off == block_off)
+        goto found;
+      if (!victim || (victim->nat_block
+                      && (!c->nat_block || c->last_used < victim->last_used)))
+        victim = c;
+    }
+
+  c = victim;
+  if (!c->nat_block)
+    {
+      c->nat_block = grub_malloc (F2FS_BLKSIZE);
+      if (!c->nat_block)
+        return 0;
+    }
+
   seg_off = block_off / data->blocks_per_seg;
   block_addr = data->nat_blkaddr +
         ((seg_off * data->blocks_per_seg) << 1) +
@@ -678,18 +736,19 @@ get_node_blkaddr (struct grub_f2fs_data *data, grub_uint32_t nid)
   if (grub_f2fs_test_bit (block_off, data->nat_bitmap))
     block_addr += data->blocks_per_seg;
 
-  err = grub_f2fs_block_read (data, block_addr, nat_block);
+  err = grub_f2fs_block_read (data, block_addr, c->nat_block);
   if (err)
     {
-      grub_free (nat_block);
+      grub_free (c->nat_block);
+      c->nat_block = NULL;
       return 0;
     }
+  c->block_off = block_off;
 
-  blkaddr = grub_le_to_cpu32 (nat_block->ne[entry_off].block_addr);
-
-  grub_free (nat_block);
+ found:
+  c->last_used = ++data->cache_clock;
 
-  return blkaddr;
+  return grub_le_to_cpu32 (c->nat_block->ne[entry_off].block_addr);
 }
 
 static int
@@ -793,13 +852,77 @@ grub_f2fs_read_node (struct grub_f2fs_data *data,
   return grub_f2fs_block_read (data, blkaddr, np);
 }
 
+/* Return the direct or indirect node NID.  The buffer belongs to the
+   node cache and stays valid until the next call. */
+static struct grub_f2fs_node *
+grub_f2fs_get_node (struct grub_f2fs_data *data, grub_uint32_t nid)
+{
+  struct grub_f2fs_node_cache *c, *victim = NULL;
+  grub_uint32_t blkaddr;
+  int i;
+
+  for (i = 0; i < F2FS_NODE_CACHE_SIZE; i++)
+    {
+      c = &data->node_cache[i];
+      if (c->node && c->nid == nid)
+        goto found;
+      if (!victim || (victim->node
+                      && (!c->node || c->last_used < victim->last_used)))
+        victim = c;
+    }
+
+  blkaddr = get_node_blkaddr (data, nid);
+  if (!blkaddr)
+    {
+      if (grub_errno == GRUB_ERR_NONE)
+        grub_error (GRUB_ERR_BAD_FS, "node %u not found", nid);
+      return NULL;
+    }
+
+  c = victim;
+  if (!c->node)
+    {
+      c->node = grub_malloc (F2FS_BLKSIZE);
+      if (!c->node)
+        return NULL;
+    }
+
+  if (grub_f2fs_block_read (data, blkaddr, c->node))
+    {
+      grub_free (c->node);
+      c->node = NULL;
+      return NULL;
+    }
+  c->nid = nid;
+
+ found:
+  c->last_used = ++data->cache_clock;
+
+  return c->node;
+}
+
+static void
+grub_f2fs_unmount (struct grub_f2fs_data *data)
+{
+  int i;
+
+  if (!data)
+    return;
+
+  for (i = 0; i < F2FS_NAT_CACHE_SIZE; i++)
+    grub_free (data->nat_cache[i].nat_block);
+  for (i = 0; i < F2FS_NODE_CACHE_SIZE; i++)
+    grub_free (data->node_cache[i].node);
+  grub_free (data);
+}
+
 static struct grub_f2fs_data *
 grub_f2fs_mount (grub_disk_t disk)
 {
   struct grub_f2fs_data *data;
   grub_err_t err;
 
-  data = grub_malloc (sizeof (*data));
+  data = grub_zalloc (sizeof (*data));
   if (!data)
     return NULL;
 
@@ -844,51 +967,81 @@ grub_f2fs_mount (grub_disk_t disk)
   return data;
 
  fail:
-  grub_free (data);
+  grub_f2fs_unmount (data);
 
   return NULL;
 }
 
 /* Guarantee inline_data was handled by caller. */
 static grub_disk_addr_t
-grub_f2fs_get_block (grub_fshelp_node_t node, grub_disk_addr_t block_ofs)
+grub_f2fs_get_block (grub_fshelp_node_t node, grub_disk_addr_t block_ofs,
+                     grub_disk_addr_t *count)
 {
   struct grub_f2fs_data *data = node->data;
   struct grub_f2fs_inode *inode = &node->inode.i;
-  grub_uint32_t offset[4], noffset[4], nids[4];
-  struct grub_f2fs_node *node_block;
-  grub_uint32_t block_addr = -1;
+  grub_uint32_t offset[4], noffset[4], nid;
+  struct grub_f2fs_node *node_block = NULL;
+  grub_uint32_t ext_fofs, ext_addr, ext_len;
+  grub_uint32_t naddrs, block_addr, next, n;
   int level, i;
 
+  /* The largest extent of the file needs no node lookups at all. */
+  ext_fofs = grub_le_to_cpu32 (inode->i_ext.fofs);
+  ext_addr = grub_le_to_cpu32 (inode->i_ext.blk_addr);
+  ext_len = grub_le_to_cpu32 (inode->i_ext.len);
+  if (ext_len && ext_addr >= grub_le_to_cpu32 (data->sblock.main_blkaddr)
+      && ext_addr + ext_len > ext_addr
+      && block_ofs >= ext_fofs && block_ofs - ext_fofs < ext_len)
+    {
+      *count = ext_len - (block_ofs - ext_fofs);
+      return ext_addr + (block_ofs - ext_fofs);
+    }
+
   level = grub_get_node_path (inode, block_ofs, offset, noffset);
 
   if (level < 0)
     return -1;
 
   if (level == 0)
-    return grub_le_to_cpu32 (inode->i_addr[offset[0]]);
-
-  node_block = grub_malloc (F2FS_BLKSIZE);
-  if (!node_block)
-    return -1;
+    {
+      node_block = &node->inode;
+      naddrs = DEF_ADDRS_PER_INODE;
+      if (inode->i_inline & F2FS_INLINE_XATTR)
+        naddrs -= F2FS_INLINE_XATTR_ADDRS;
+    }
+  else
+    {
+      nid = get_node_id (&node->inode, offset[0], 1);
 
-  nids[1] = get_node_id (&node->inode, offset[0], 1);
+      /* Get indirect or direct nodes. */
+      for (i = 1; i <= level; i++)
+        {
+          node_block = grub_f2fs_get_node (data, nid);
+          if (!node_block)
+            return -1;
 
-  /* Get indirect or direct nodes. */
-  for (i = 1; i <= level; i++)
-    {
-      grub_f2fs_read_node (data, nids[i], node_block);
-      if (grub_errno)
-        goto fail;
+          if (i < level)
+            nid = get_node_id (node_block, offset[i], 0);
+        }
 
-      if (i < level)
-        nids[i + 1] = get_node_id (node_block, offset[i], 0);
+      naddrs = ADDRS_PER_BLOCK;
     }
 
-  block_addr = grub_le_to_cpu32 (node_block->dn.addr[offset[level]]);
-
- fail:
-  grub_free (node_block);
+  /* Extend the run over the following addresses of the same node, either
+     contiguous blocks or holes. */
+  block_addr = get_node_addr (node_block, level == 0, offset[level]);
+  if (block_addr == NEW_ADDR)
+    block_addr = NULL_ADDR;
+  for (n = 1; offset[level] + n < naddrs; n++)
+    {
+      next = get_node_addr (node_block, level == 0, offset[level] + n);
+      if (next == NEW_ADDR)
+        next = NULL_ADDR;
+      if (block_addr == NULL_ADDR ? next != NULL_ADDR
+          : next != block_addr + n)
+        break;
+    }
+  *count = n;
 
   return block_addr;
 }
@@ -914,11 +1067,11 @@ grub_f2fs_read_file (grub_fshelp_node_t node,
       return len;
     }
 
-  return grub_fshelp_read_file (node->data->disk, node,
-                                read_hook, read_hook_data,
-                                pos, len, buf, grub_f2fs_get_block,
-                                filesize,
-                                F2FS_BLK_SEC_BITS, 0);
+  return grub_fshelp_read_file_runs (node->data->disk, node,
+                                     read_hook, read_hook_data,
+                                     pos, len, buf, grub_f2fs_get_block,
+                                     filesize,
+                                     F2FS_BLK_SEC_BITS, 0);
 }
 
 static char *
@@ -1141,7 +1294,7 @@ grub_f2fs_dir (grub_device_t device, const char *path,
  fail:
   if (fdiro != &ctx.data->diropen)
     grub_free (fdiro);
-  grub_free (ctx.data);
+  grub_f2fs_unmount (ctx.data);
   grub_dl_unref (my_mod);
 
   return grub_errno;
@@ -1190,7 +1343,7 @@ grub_f2fs_open (struct grub_file *file, const char *name)
  fail:
   if (fdiro != &data->diropen)
     grub_free (fdiro);
-  grub_free (data);
+  grub_f2fs_unmount (data);
 
   grub_dl_unref (my_mod);
 
@@ -1212,7 +1365,7 @@ grub_f2fs_close (grub_file_t file)
 {
   struct grub_f2fs_data *data = (struct grub_f2fs_data *) file->data;
 
-  grub_free (data);
+  grub_f2fs_unmount (data);
 
   grub_dl_unref (my_mod);
 
@@ -1259,7 +1412,7 @@ grub_f2fs_label (grub_device_t device, char **label)
   else
     *label = NULL;
 
-  grub_free (data);
+  grub_f2fs_unmount (data);
   grub_dl_unref (my_mod);
 
   return grub_errno;
@@ -1295,7 +1448,7 @@ grub_f2fs_uuid (grub_device_t device, char **uuid)
   else
     *uuid = NULL;
 
-  grub_free (data);
+  grub_f2fs_unmount (data);
   grub_dl_unref (my_mod);
 
   return grub_errno;
@@ -34,9 +34,13 @@
 #endif
 #include <grub/fshelp.h>
 #include <grub/i18n.h>
+#include <grub/safemath.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+/* Bytes of FAT read at once when following a cluster chain.  */
+#define GRUB_FAT_CACHE_SIZE 4096
+
 enum
   {
     GRUB_FAT_ATTR_READ_ONLY = 0x01,
@@ -183,6 +187,19 @@ struct grub_fat_data
   grub_uint32_t num_clusters;
 
   grub_uint32_t uuid;
+
+  /* Part of the FAT kept in memory while following cluster chains.  */
+  grub_uint32_t fat_cache_offset;
+  grub_uint32_t fat_cache_len;
+  grub_uint8_t fat_cache[GRUB_FAT_CACHE_SIZE];
+};
+
+/* Physically contiguous clusters of a file.  */
+struct grub_fat_run
+{
+  grub_uint32_t logical;
+  grub_uint32_t cluster;
+  grub_uint32_t count;
 };
 
 struct grub_fshelp_node {
@@ -202,6 +219,13 @@ struct grub_fshelp_node {
 #ifdef MODE_EXFAT
   int is_contiguous;
 #endif
+
+  /* Runs of a regular file found so far, in logical order.  Directories
+     are short and read sequentially, they just follow the chain.  */
+  struct grub_fat_run *runs;
+  grub_uint32_t num_runs;
+  grub_uint32_t alloc_runs;
+  int runs_complete;
 };
 
 static grub_dl_t my_mod;
@@ -462,6 +486,9 @@ grub_fat_mount (grub_disk_t disk)
   (void) magic;
 #endif
 
+  data->fat_cache_offset = 0;
+  data->fat_cache_len = 0;
+
   return data;
 
  fail:
@@ -471,6 +498,188 @@ grub_fat_mount (grub_disk_t disk)
   return 0;
 }
 
+/* Look up the FAT entry of CLUSTER.  */
+static grub_err_t
+grub_fat_next_cluster (grub_disk_t disk, struct grub_fat_data *data,
+		       grub_uint32_t cluster, grub_uint32_t *next)
+{
+  grub_uint32_t fat_offset;
+  grub_uint64_t fat_bytes;
+  unsigned entry_size = (data->fat_size + 7) >> 3;
+  grub_uint32_t next_cluster = 0;
+
+  switch (data->fat_size)
+    {
+    case 32:
+      fat_offset = cluster << 2;
+      break;
+    case 16:
+      fat_offset = cluster << 1;
+      break;
+    default:
+      /* case 12: */
+      fat_offset = cluster + (cluster >> 1);
+      break;
+    }
+
+  /* Reading the FAT a few bytes at a time is slow, keep a bigger part of
+     it around.  The window starts at the sector holding the entry, so a
+     FAT12 entry never straddles its end.  */
+  if (fat_offset < data->fat_cache_offset
+      || fat_offset + entry_size > data->fat_cache_offset + data->fat_cache_len)
+    {
+      fat_bytes = (grub_uint64_t) data->sectors_per_fat
+	<< GRUB_DISK_SECTOR_BITS;
+      data->fat_cache_len = 0;
+      data->fat_cache_offset = fat_offset & ~(GRUB_DISK_SECTOR_SIZE - 1);
+      if (data->fat_cache_offset >= fat_bytes)
+	return grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u", cluster);
+      if (fat_bytes - data->fat_cache_offset > GRUB_FAT_CACHE_SIZE)
+	data->fat_cache_len = GRUB_FAT_CACHE_SIZE;
+      else
+	data->fat_cache_len = fat_bytes - data->fat_cache_offset;
+      if (grub_disk_read (disk, data->fat_sector, data->fat_cache_offset,
+			  data->fat_cache_len, data->fat_cache))
+	{
+	  data->fat_cache_len = 0;
+	  return grub_errno;
+	}
+      if (fat_offset + entry_size
+	  > data->fat_cache_offset + data->fat_cache_len)
+	return grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u", cluster);
+    }
+
+  grub_memcpy (&next_cluster,
+	       data->fat_cache + (fat_offset - data->fat_cache_offset),
+	       entry_size);
+  next_cluster = grub_le_to_cpu32 (next_cluster);
+  switch (data->fat_size)
+    {
+    case 16:
+      next_cluster &= 0xFFFF;
+      break;
+    case 12:
+      if (cluster & 1)
+	next_cluster >>= 4;
+
+      next_cluster &= 0x0FFF;
+      break;
+    }
+
+  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
+		data->fat_size, next_cluster);
+
+  *next = next_cluster;
+  return GRUB_ERR_NONE;
+}
+
+/* Extend the run map of NODE until it covers LOGICAL_CLUSTER or the
+   chain ends.  */
+static grub_err_t
+grub_fat_extend_runs (grub_disk_t disk, grub_fshelp_node_t node,
+		      grub_uint32_t logical_cluster)
+{
+  struct grub_fat_run *last;
+
+  if (node->num_runs == 0)
+    {
+      if (node->file_cluster < 2
+	  || node->file_cluster >= node->data->num_clusters)
+	return grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
+			   node->file_cluster);
+      node->runs = grub_malloc (8 * sizeof (node->runs[0]));
+      if (!node->runs)
+	return grub_errno;
+      node->alloc_runs = 8;
+      node->runs[0].logical = 0;
+      node->runs[0].cluster = node->file_cluster;
+      node->runs[0].count = 1;
+      node->num_runs = 1;
+    }
+
+  last = &node->runs[node->num_runs - 1];
+  while (!node->runs_complete
+	 && last->logical + last->count <= logical_cluster)
+    {
+      grub_uint32_t cluster = last->cluster + last->count - 1;
+      grub_uint32_t next_cluster;
+
+      if (grub_fat_next_cluster (disk, node->data, cluster, &next_cluster))
+	return grub_errno;
+
+      /* Check the end.  */
+      if (next_cluster >= node->data->cluster_eof_mark)
+	{
+	  node->runs_complete = 1;
+	  break;
+	}
+
+      if (next_cluster < 2 || next_cluster >= node->data->num_clusters)
+	return grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
+			   next_cluster);
+
+      if (next_cluster == cluster + 1)
+	{
+	  last->count++;
+	  continue;
+	}
+
+      if (node->num_runs == node->alloc_runs)
+	{
+	  struct grub_fat_run *runs;
+	  grub_size_t sz;
+
+	  if (grub_mul (node->alloc_runs, 2 * sizeof (runs[0]), &sz))
+	    return grub_error (GRUB_ERR_OUT_OF_RANGE,
+			       N_("overflow is detected"));
+	  runs = grub_realloc (node->runs, sz);
+	  if (!runs)
+	    return grub_errno;
+	  node->runs = runs;
+	  node->alloc_runs *= 2;
+	}
+      node->runs[node->num_runs].logical = last->logical + last->count;
+      node->runs[node->num_runs].cluster = next_cluster;
+      node->runs[node->num_runs].count = 1;
+      last = &node->runs[node->num_runs++];
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+/* Return the run of NODE holding LOGICAL_CLUSTER, or NULL past the end of
+   the chain.  */
+static struct grub_fat_run *
+grub_fat_find_run (grub_disk_t disk, grub_fshelp_node_t node,
+		   grub_uint32_t logical_cluster)
+{
+  grub_uint32_t lo = 0, hi;
+  struct grub_fat_run *last;
+
+  if (node->num_runs == 0
+      || (!node->runs_complete
+	  && (node->runs[node->num_runs - 1].logical
+	      + node->runs[node->num_runs - 1].count) <= logical_cluster))
+    if (grub_fat_extend_runs (disk, node, logical_cluster))
+      return NULL;
+
+  last = &node->runs[node->num_runs - 1];
+  if (last->logical + last->count <= logical_cluster)
+    return NULL;
+
+  hi = node->num_runs - 1;
+  while (lo < hi)
+    {
+      grub_uint32_t mid = lo + (hi - lo + 1) / 2;
+
+      if (node->runs[mid].logical <= logical_cluster)
+	lo = mid;
+      else
+	hi = mid - 1;
+    }
+  return &node->runs[lo];
+}
+
 static grub_ssize_t
 grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
 		    grub_disk_read_hook_t read_hook, void *read_hook_data,
@@ -499,6 +708,7 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
 #endif
 
 #ifdef MODE_EXFAT
+  /* NoFatChain: the whole file is one run.  */
   if (node->is_contiguous)
     {
       /* Read the data here.  */
@@ -524,6 +734,47 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
   logical_cluster = offset >> logical_cluster_bits;
   offset &= (1ULL << logical_cluster_bits) - 1;
 
+  if (!(node->attr & GRUB_FAT_ATTR_DIRECTORY))
+    {
+      /* Regular files go through the run map, reading as many
+	 contiguous clusters at once as possible.  */
+      while (len)
+	{
+	  struct grub_fat_run *run;
+	  grub_uint64_t avail;
+	  grub_uint32_t skip;
+
+	  run = grub_fat_find_run (disk, node, logical_cluster);
+	  if (!run)
+	    return grub_errno ? -1 : ret;
+
+	  skip = logical_cluster - run->logical;
+	  sector = (node->data->cluster_sector
+		    + ((run->cluster + skip - 2)
+		       << node->data->cluster_bits));
+	  avail = ((grub_uint64_t) (run->count - skip) << logical_cluster_bits)
+	    - offset;
+	  size = len;
+	  if (size > avail)
+	    size = avail;
+
+	  disk->read_hook = read_hook;
+	  disk->read_hook_data = read_hook_data;
+	  grub_disk_read (disk, sector, offset, size, buf);
+	  disk->read_hook = 0;
+	  if (grub_errno)
+	    return -1;
+
+	  len -= size;
+	  buf += size;
+	  ret += size;
+	  logical_cluster += (offset + size) >> logical_cluster_bits;
+	  offset = (offset + size) & ((1ULL << logical_cluster_bits) - 1);
+	}
+
+      return ret;
+    }
+
   if (logical_cluster < node->cur_cluster_num)
     {
       node->cur_cluster_num = 0;
@@ -536,45 +787,11 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
 	{
 	  /* Find next cluster.  */
 	  grub_uint32_t next_cluster;
-	  grub_uint32_t fat_offset;
-
-	  switch (node->data->fat_size)
-	    {
-	    case 32:
-	      fat_offset = node->cur_cluster << 2;
-	      break;
-	    case 16:
-	      fat_offset = node->cur_cluster << 1;
-	      break;
-	    default:
-	      /* case 12: */
-	      fat_offset = node->cur_cluster + (node->cur_cluster >> 1);
-	      break;
-	    }
 
-	  /* Read the FAT.  */
-	  if (grub_disk_read (disk, node->data->fat_sector, fat_offset,
-			      (node->data->fat_size + 7) >> 3,
-			      (char *) &next_cluster))
+	  if (grub_fat_next_cluster (disk, node->data, node->cur_cluster,
+				     &next_cluster))
 	    return -1;
 
-	  next_cluster = grub_le_to_cpu32 (next_cluster);
-	  switch (node->data->fat_size)
-	    {
-	    case 16:
-	      next_cluster &= 0xFFFF;
-	      break;
-	    case 12:
-	      if (node->cur_cluster & 1)
-		next_cluster >>= 4;
-
-	      next_cluster &= 0x0FFF;
-	      break;
-	    }
-
-	  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
-			node->data->fat_size, next_cluster);
-
 	  /* Check the end.  */
 	  if (next_cluster >= node->data->cluster_eof_mark)
 	    return ret;
@@ -957,7 +1174,7 @@ static grub_err_t lookup_file (grub_fshelp_node_t node,
 
       if (grub_strcasecmp (name, ctxt.filename) == 0)
 	{
-	  *foundnode = grub_malloc (sizeof (struct grub_fshelp_node));
+	  *foundnode = grub_zalloc (sizeof (struct grub_fshelp_node));
 	  if (!*foundnode)
 	    return grub_errno;
 	  (*foundnode)->attr = ctxt.dir.attr;
@@ -1133,6 +1350,7 @@ grub_fat_close (grub_file_t file)
   grub_fshelp_node_t node = file->data;
 
   grub_free (node->data);
+  grub_free (node->runs);
   grub_free (node);
 
   grub_dl_unref (my_mod);
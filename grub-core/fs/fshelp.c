@@ -427,3 +427,83 @@ grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
 
   return len;
 }
+
+/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
+   beginning with the byte POS.  GET_RUN translates a file block to
+   a disk block and returns the number of blocks that are contiguous
+   on disk from there, each run is then read with one disk request.
+   The other arguments are the same as for grub_fshelp_read_file.  */
+grub_ssize_t
+grub_fshelp_read_file_runs (grub_disk_t disk, grub_fshelp_node_t node,
+			    grub_disk_read_hook_t read_hook,
+			    void *read_hook_data,
+			    grub_off_t pos, grub_size_t len, char *buf,
+			    grub_disk_addr_t (*get_run) (grub_fshelp_node_t node,
+							 grub_disk_addr_t block,
+							 grub_disk_addr_t *count),
+			    grub_off_t filesize, int log2blocksize,
+			    grub_disk_addr_t blocks_start)
+{
+  grub_disk_addr_t i, blockcnt;
+  int log2bytes = log2blocksize + GRUB_DISK_SECTOR_BITS;
+  grub_off_t blocksize = 1ULL << log2bytes;
+  grub_size_t skipfirst, remaining;
+
+  if (pos > filesize)
+    {
+      grub_error (GRUB_ERR_OUT_OF_RANGE,
+		  N_("attempt to read past the end of file"));
+      return -1;
+    }
+
+  /* Adjust LEN so it we can't read past the end of the file.  */
+  if (pos + len > filesize)
+    len = filesize - pos;
+
+  blockcnt = ((len + pos) + blocksize - 1) >> log2bytes;
+  i = pos >> log2bytes;
+  skipfirst = pos & (blocksize - 1);
+  remaining = len;
+
+  while (i < blockcnt && remaining)
+    {
+      grub_disk_addr_t blknr, count = 1;
+      grub_off_t size;
+
+      blknr = get_run (node, i, &count);
+      if (grub_errno)
+	return -1;
+
+      if (count == 0)
+	count = 1;
+      if (count > blockcnt - i)
+	count = blockcnt - i;
+
+      size = (count << log2bytes) - skipfirst;
+      if (size > remaining)
+	size = remaining;
+
+      /* If the block number is 0 this run is not stored on disk but
+	 is zero filled instead.  */
+      if (blknr)
+	{
+	  disk->read_hook = read_hook;
+	  disk->read_hook_data = read_hook_data;
+
+	  grub_disk_read (disk, (blknr << log2blocksize) + blocks_start,
+			  skipfirst, size, buf);
+	  disk->read_hook = 0;
+	  if (grub_errno)
+	    return -1;
+	}
+      else
+	grub_memset (buf, 0, size);
+
+      buf += size;
+      remaining -= size;
+      i += count;
+      skipfirst = 0;
+    }
+
+  return len;
+}
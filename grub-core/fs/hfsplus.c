@@ -209,6 +209,152 @@ grub_hfsplus_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 }
 
 
+/* Like grub_hfsplus_read_block, but also store in COUNT how many
+   blocks follow FILEBLOCK contiguously on disk.  */
+static grub_disk_addr_t
+grub_hfsplus_read_run (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		       grub_disk_addr_t *count)
+{
+  struct grub_hfsplus_run *run;
+  grub_size_t lo = 0, hi = node->nruns;
+
+  if (! node->runs)
+    {
+      *count = 1;
+      return grub_hfsplus_read_block (node, fileblock);
+    }
+
+  /* Find the last run starting at or before FILEBLOCK.  */
+  while (lo < hi)
+    {
+      grub_size_t mid = lo + (hi - lo) / 2;
+
+      if (node->runs[mid].fileblock <= fileblock)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  if (lo > 0)
+    {
+      run = &node->runs[lo - 1];
+      if (fileblock - run->fileblock < run->count)
+	{
+	  *count = run->count - (fileblock - run->fileblock);
+	  return (grub_disk_addr_t) run->start + (fileblock - run->fileblock);
+	}
+    }
+
+  grub_error (GRUB_ERR_READ_ERROR,
+	      "no block found for the file id 0x%x and the block offset 0x%"
+	      PRIxGRUB_UINT64_T, node->fileid, fileblock);
+  return -1;
+}
+
+/* Decode all extents of the fork of NODE that is read, following the
+   extent overflow file, so that mapping its blocks never has to search
+   a B+ tree again.  On failure NODE is left alone and its blocks are
+   looked up one by one as before.  */
+static void
+grub_hfsplus_load_runs (grub_fshelp_node_t node)
+{
+  struct grub_hfsplus_extent extents[8];
+  struct grub_hfsplus_run *runs = 0, *tmp;
+  grub_size_t nruns = 0, alloc = 0, sz;
+  grub_uint64_t size, nblocks, covered = 0, before;
+  unsigned int log2blksize = node->data->log2blksize;
+  int i, overflow = 0;
+
+  size = node->compressed ? node->resource_size : node->size;
+  nblocks = (size >> log2blksize)
+    + !!(size & ((1ULL << log2blksize) - 1));
+  if (nblocks == 0 || nblocks > 0xffffffff)
+    return;
+
+  grub_memcpy (extents, node->compressed ? node->resource_extents
+	       : node->extents, sizeof (extents));
+
+  while (1)
+    {
+      struct grub_hfsplus_key_internal extoverflow;
+      struct grub_hfsplus_btnode *nnode = 0;
+      struct grub_hfsplus_extkey *key;
+      grub_off_t ptr;
+
+      before = covered;
+      for (i = 0; i < 8 && covered < nblocks; i++)
+	{
+	  grub_uint32_t start = grub_be_to_cpu32 (extents[i].start);
+	  grub_uint32_t count = grub_be_to_cpu32 (extents[i].count);
+
+	  if (count == 0)
+	    continue;
+
+	  /* Merge extents that continue each other on disk.  */
+	  if (nruns && runs[nruns - 1].start + runs[nruns - 1].count == start
+	      && runs[nruns - 1].count + count > runs[nruns - 1].count)
+	    runs[nruns - 1].count += count;
+	  else
+	    {
+	      if (nruns == alloc)
+		{
+		  alloc = alloc ? alloc * 2 : 8;
+		  if (grub_mul (alloc, sizeof (runs[0]), &sz))
+		    goto fail;
+		  tmp = grub_realloc (runs, sz);
+		  if (! tmp)
+		    goto fail;
+		  runs = tmp;
+		}
+	      runs[nruns].fileblock = covered;
+	      runs[nruns].start = start;
+	      runs[nruns].count = count;
+	      nruns++;
+	    }
+	  covered += count;
+	}
+
+      if (covered >= nblocks)
+	break;
+
+      /* The extent overflow file can't have overflow extents, and a
+	 record that doesn't add anything means a corrupted tree.  */
+      if (node->fileid == GRUB_HFSPLUS_FILEID_OVERFLOW
+	  || (covered == before && overflow))
+	goto fail;
+
+      extoverflow.extkey.fileid = node->fileid;
+      extoverflow.extkey.type = node->compressed ? 0xff : 0;
+      extoverflow.extkey.start = covered;
+      if (grub_hfsplus_btree_search (&node->data->extoverflow_tree,
+				     &extoverflow,
+				     grub_hfsplus_cmp_extkey, &nnode, &ptr)
+	  || !nnode)
+	goto fail;
+
+      /* The extent overflow file has 8 extents right after the key.  */
+      key = (struct grub_hfsplus_extkey *)
+	grub_hfsplus_btree_recptr (&node->data->extoverflow_tree, nnode, ptr);
+      if ((char *) (key + 1) + sizeof (extents)
+	  > (char *) nnode + node->data->extoverflow_tree.nodesize)
+	{
+	  grub_free (nnode);
+	  goto fail;
+	}
+      grub_memcpy (extents, key + 1, sizeof (extents));
+      grub_free (nnode);
+      overflow = 1;
+    }
+
+  node->runs = runs;
+  node->nruns = nruns;
+  return;
+
+ fail:
+  grub_free (runs);
+  grub_errno = GRUB_ERR_NONE;
+}
+
 /* Read LEN bytes from the file described by DATA starting with byte
    POS.  Return the amount of read bytes in READ.  */
 grub_ssize_t
@@ -216,12 +362,81 @@ grub_hfsplus_read_file (grub_fshelp_node_t node,
 			grub_disk_read_hook_t read_hook, void *read_hook_data,
 			grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node,
-				read_hook, read_hook_data,
-				pos, len, buf, grub_hfsplus_read_block,
-				node->size,
-				node->data->log2blksize - GRUB_DISK_SECTOR_BITS,
-				node->data->embedded_offset);
+  return grub_fshelp_read_file_runs (node->data->disk, node,
+				     read_hook, read_hook_data,
+				     pos, len, buf, grub_hfsplus_read_run,
+				     node->size,
+				     node->data->log2blksize
+				     - GRUB_DISK_SECTOR_BITS,
+				     node->data->embedded_offset);
+}
+
+/* Read node NODENUM of BTREE into BUF, which has room for
+   BTREE->nodesize bytes.  Recently used nodes are kept in memory, as
+   every lookup walks down from the root again.  */
+static grub_err_t
+grub_hfsplus_read_node (struct grub_hfsplus_btree *btree,
+			grub_uint32_t nodenum, char *buf)
+{
+  struct grub_hfsplus_data *data = btree->file.data;
+  struct grub_hfsplus_node_cache *ent, *victim = 0;
+  int i;
+
+  for (i = 0; i < GRUB_HFSPLUS_NODE_CACHE_SIZE; i++)
+    {
+      ent = &data->node_cache[i];
+      if (ent->buf && ent->tree == btree && ent->node == nodenum)
+	{
+	  ent->last_used = ++data->node_clock;
+	  grub_memcpy (buf, ent->buf, btree->nodesize);
+	  return GRUB_ERR_NONE;
+	}
+      if (! victim || (victim->buf && (! ent->buf
+				       || ent->last_used < victim->last_used)))
+	victim = ent;
+    }
+
+  if (grub_hfsplus_read_file (&btree->file, 0, 0,
+			      (grub_disk_addr_t) nodenum * btree->nodesize,
+			      btree->nodesize, buf) <= 0)
+    return grub_errno ? grub_errno : GRUB_ERR_READ_ERROR;
+
+  if (victim->buf && victim->tree->nodesize != btree->nodesize)
+    {
+      grub_free (victim->buf);
+      victim->buf = 0;
+    }
+  if (! victim->buf)
+    victim->buf = grub_malloc (btree->nodesize);
+  if (! victim->buf)
+    {
+      /* Not being able to cache the node is not an error.  */
+      grub_errno = GRUB_ERR_NONE;
+      return GRUB_ERR_NONE;
+    }
+
+  grub_memcpy (victim->buf, buf, btree->nodesize);
+  victim->tree = btree;
+  victim->node = nodenum;
+  victim->last_used = ++data->node_clock;
+  return GRUB_ERR_NONE;
+}
+
+static void
+grub_hfsplus_unmount (struct grub_hfsplus_data *data)
+{
+  int i;
+
+  if (! data)
+    return;
+
+  for (i = 0; i < GRUB_HFSPLUS_NODE_CACHE_SIZE; i++)
+    grub_free (data->node_cache[i].buf);
+  grub_free (data->catalog_tree.file.runs);
+  grub_free (data->extoverflow_tree.file.runs);
+  grub_free (data->attr_tree.file.runs);
+  grub_free (data->opened_file.runs);
+  grub_free (data);
 }
 
 static struct grub_hfsplus_data *
@@ -236,7 +451,7 @@ grub_hfsplus_mount (grub_disk_t disk)
     struct grub_hfsplus_volheader hfsplus;
   } volheader;
 
-  data = grub_malloc (sizeof (*data));
+  data = grub_zalloc (sizeof (*data));
   if (!data)
     return 0;
 
@@ -374,6 +589,12 @@ grub_hfsplus_mount (grub_disk_t disk)
   data->dirroot.data = data;
   data->dirroot.fileid = GRUB_HFSPLUS_FILEID_ROOTDIR;
 
+  /* The extent overflow tree comes first as the others may need it.  */
+  grub_hfsplus_load_runs (&data->extoverflow_tree.file);
+  grub_hfsplus_load_runs (&data->catalog_tree.file);
+  if (data->attr_tree.nodesize)
+    grub_hfsplus_load_runs (&data->attr_tree.file);
+
   return data;
 
  fail:
@@ -381,7 +602,7 @@ grub_hfsplus_mount (grub_disk_t disk)
   if (grub_errno == GRUB_ERR_OUT_OF_RANGE)
     grub_error (GRUB_ERR_BAD_FS, "not a HFS+ filesystem");
 
-  grub_free (data);
+  grub_hfsplus_unmount (data);
   return 0;
 }
 
@@ -530,11 +751,8 @@ grub_hfsplus_btree_iterate_node (struct grub_hfsplus_btree *btree,
 	saved_node = first_node->next;
       node_count++;
 
-      if (grub_hfsplus_read_file (&btree->file, 0, 0,
-				  (((grub_disk_addr_t)
-				    grub_be_to_cpu32 (first_node->next))
-				   * btree->nodesize),
-				  btree->nodesize, cnode) <= 0)
+      if (grub_hfsplus_read_node (btree, grub_be_to_cpu32 (first_node->next),
+				  cnode))
 	return 1;
 
       /* Don't skip any record in the next iteration.  */
@@ -589,10 +807,7 @@ grub_hfsplus_btree_search (struct grub_hfsplus_btree *btree,
       node_count++;
 
       /* Read a node.  */
-      if (grub_hfsplus_read_file (&btree->file, 0, 0,
-				  (grub_disk_addr_t) currnode
-				  * (grub_disk_addr_t) btree->nodesize,
-				  btree->nodesize, (char *) node) <= 0)
+      if (grub_hfsplus_read_node (btree, currnode, node))
 	{
 	  grub_free (node);
 	  return grub_error (GRUB_ERR_BAD_FS, "couldn't read i-node");
@@ -711,6 +926,7 @@ list_nodes (void *record, void *hook_arg)
       node->data = ctx->dir->data;
       node->mtime = 0;
       node->size = 0;
+      node->runs = 0;
       node->fileid = grub_be_to_cpu32 (fileinfo->parentid);
 
       ctx->ret = ctx->hook ("..", GRUB_FSHELP_DIR, node, ctx->hook_data);
@@ -770,6 +986,7 @@ list_nodes (void *record, void *hook_arg)
   node->compressed = 0;
   node->cbuf = 0;
   node->compress_index = 0;
+  node->runs = 0;
 
   grub_memcpy (node->extents, fileinfo->data.extents,
 	       sizeof (node->extents));
@@ -863,6 +1080,7 @@ grub_hfsplus_open (struct grub_file *file, const char *name)
   file->size = fdiro->size;
   data->opened_file = *fdiro;
   grub_free (fdiro);
+  grub_hfsplus_load_runs (&data->opened_file);
 
   file->data = data;
   file->offset = 0;
@@ -872,7 +1090,7 @@ grub_hfsplus_open (struct grub_file *file, const char *name)
  fail:
   if (data && fdiro != &data->dirroot)
     grub_free (fdiro);
-  grub_free (data);
+  grub_hfsplus_unmount (data);
 
   grub_dl_unref (my_mod);
 
@@ -889,7 +1107,7 @@ grub_hfsplus_close (grub_file_t file)
   grub_free (data->opened_file.cbuf);
   grub_free (data->opened_file.compress_index);
 
-  grub_free (data);
+  grub_hfsplus_unmount (data);
 
   grub_dl_unref (my_mod);
 
@@ -968,7 +1186,7 @@ grub_hfsplus_dir (grub_device_t device, const char *path,
  fail:
   if (data && fdiro != &data->dirroot)
     grub_free (fdiro);
-  grub_free (data);
+  grub_hfsplus_unmount (data);
 
   grub_dl_unref (my_mod);
 
@@ -1004,7 +1222,7 @@ grub_hfsplus_label (grub_device_t device, char **label)
 				 grub_hfsplus_cmp_catkey_id, &node, &ptr)
       || !node)
     {
-      grub_free (data);
+      grub_hfsplus_unmount (data);
       return 0;
     }
 
@@ -1016,7 +1234,7 @@ grub_hfsplus_label (grub_device_t device, char **label)
   if (!label_name)
     {
       grub_free (node);
-      grub_free (data);
+      grub_hfsplus_unmount (data);
       return grub_errno;
     }
 
@@ -1029,7 +1247,7 @@ grub_hfsplus_label (grub_device_t device, char **label)
 	{
 	  grub_free (label_name);
 	  grub_free (node);
-	  grub_free (data);
+	  grub_hfsplus_unmount (data);
 	  return 0;
 	}
     }
@@ -1039,7 +1257,7 @@ grub_hfsplus_label (grub_device_t device, char **label)
     {
       grub_free (label_name);
       grub_free (node);
-      grub_free (data);
+      grub_hfsplus_unmount (data);
       return grub_errno;
     }
 
@@ -1048,7 +1266,7 @@ grub_hfsplus_label (grub_device_t device, char **label)
 
   grub_free (label_name);
   grub_free (node);
-  grub_free (data);
+  grub_hfsplus_unmount (data);
 
   return GRUB_ERR_NONE;
 }
@@ -1070,7 +1288,7 @@ grub_hfsplus_mtime (grub_device_t device, grub_int32_t *tm)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_hfsplus_unmount (data);
 
   return grub_errno;
 
@@ -1096,7 +1314,7 @@ grub_hfsplus_uuid (grub_device_t device, char **uuid)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_hfsplus_unmount (data);
 
   return grub_errno;
 }
@@ -29,6 +29,7 @@
 #include <grub/charset.h>
 #include <grub/datetime.h>
 #include <grub/safemath.h>
+#include <grub/partition.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -174,6 +175,44 @@ enum
     FLAG_MORE_EXTENTS = 0x80
   };
 
+/* An entry of a directory listing kept in memory.  */
+struct grub_iso9660_cached_ent
+{
+  char *name;
+  enum grub_fshelp_filetype type;
+  grub_size_t nodesize;
+  struct grub_fshelp_node *node;
+};
+
+/* The parsed listing of the directory stored at FIRST_SECTOR, with the
+   Rock Ridge names and types, so that looking up many files in one
+   directory doesn't read and parse it again every time.  */
+struct grub_iso9660_cached_dir
+{
+  struct grub_iso9660_cached_dir *next;
+  enum grub_disk_dev_id dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t start;
+  struct grub_iso9660_date modified;
+  int rockridge;
+  int joliet;
+  grub_uint32_t first_sector;
+  grub_size_t nents;
+  grub_size_t alloc;
+  struct grub_iso9660_cached_ent *ents;
+  grub_size_t size;
+};
+
+/* How much memory the cached listings may take in total.  */
+#define GRUB_ISO9660_DIR_CACHE_SIZE	(4 << 20)
+
+/* Bigger path tables are not used.  */
+#define GRUB_ISO9660_MAX_PATH_TABLE	(1 << 20)
+
+/* Most recently used first.  */
+static struct grub_iso9660_cached_dir *dir_cache;
+static grub_size_t dir_cache_size;
+
 static grub_dl_t my_mod;
 
 
@@ -683,8 +722,8 @@ susp_iterate_dir (struct grub_iso9660_susp_entry *entry,
 }
 
 static int
-grub_iso9660_iterate_dir (grub_fshelp_node_t dir,
-			  grub_fshelp_iterate_dir_hook_t hook, void *hook_data)
+grub_iso9660_read_dir (grub_fshelp_node_t dir,
+		       grub_fshelp_iterate_dir_hook_t hook, void *hook_data)
 {
   struct grub_iso9660_dir dirent;
   grub_off_t offset = 0;
@@ -874,6 +913,323 @@ grub_iso9660_iterate_dir (grub_fshelp_node_t dir,
 }
 
 
+/* Return how many bytes of NODE are in use.  */
+static grub_size_t
+get_node_alloc (grub_fshelp_node_t node)
+{
+  grub_size_t ret;
+
+  ret = ((char *) &node->dirents[node->have_dirents] - (char *) node);
+  if (node->have_symlink)
+    ret += grub_strlen ((char *) &node->dirents[node->have_dirents]) + 1;
+  if (ret < sizeof (*node))
+    ret = sizeof (*node);
+  return ret;
+}
+
+static void
+free_cached_dir (struct grub_iso9660_cached_dir *cdir)
+{
+  grub_size_t i;
+
+  for (i = 0; i < cdir->nents; i++)
+    {
+      grub_free (cdir->ents[i].name);
+      grub_free (cdir->ents[i].node);
+    }
+  grub_free (cdir->ents);
+  grub_free (cdir);
+}
+
+/* Helper for get_cached_dir.  */
+static int
+cache_dir_iter (const char *filename, enum grub_fshelp_filetype filetype,
+		grub_fshelp_node_t node, void *data)
+{
+  struct grub_iso9660_cached_dir *cdir = data;
+  struct grub_iso9660_cached_ent *ent;
+
+  if (cdir->nents == cdir->alloc)
+    {
+      struct grub_iso9660_cached_ent *new_ents;
+      grub_size_t sz;
+
+      if (grub_mul (cdir->alloc ? cdir->alloc : 16, 2, &cdir->alloc)
+	  || grub_mul (cdir->alloc, sizeof (cdir->ents[0]), &sz))
+	goto fail;
+      new_ents = grub_realloc (cdir->ents, sz);
+      if (!new_ents)
+	goto fail;
+      cdir->ents = new_ents;
+    }
+
+  ent = &cdir->ents[cdir->nents];
+  ent->name = grub_strdup (filename);
+  if (!ent->name)
+    goto fail;
+  ent->type = filetype;
+  ent->node = node;
+  ent->nodesize = get_node_alloc (node);
+  cdir->nents++;
+
+  cdir->size += sizeof (*ent) + grub_strlen (filename) + 1 + ent->nodesize;
+  return cdir->size > GRUB_ISO9660_DIR_CACHE_SIZE;
+
+ fail:
+  grub_free (node);
+  return 1;
+}
+
+/* Return the listing of the directory DIR, reading it if it is not
+   cached yet.  Return NULL if the directory has to be read directly.  */
+static struct grub_iso9660_cached_dir *
+get_cached_dir (grub_fshelp_node_t dir)
+{
+  struct grub_iso9660_data *data = dir->data;
+  struct grub_iso9660_cached_dir *cdir, **prev;
+  grub_disk_addr_t start;
+  grub_uint32_t first_sector;
+
+  /* Directories are never split into several extents.  */
+  if (dir->have_dirents != 1)
+    return NULL;
+
+  first_sector = grub_le_to_cpu32 (dir->dirents[0].first_sector);
+  start = grub_partition_get_start (data->disk->partition);
+
+  for (prev = &dir_cache; *prev; prev = &(*prev)->next)
+    {
+      cdir = *prev;
+      if (cdir->first_sector == first_sector
+	  && cdir->dev_id == data->disk->dev->id
+	  && cdir->disk_id == data->disk->id
+	  && cdir->start == start
+	  && cdir->rockridge == data->rockridge
+	  && cdir->joliet == data->joliet
+	  && grub_memcmp (&cdir->modified, &data->voldesc.modified,
+			  sizeof (cdir->modified)) == 0)
+	{
+	  *prev = cdir->next;
+	  cdir->next = dir_cache;
+	  dir_cache = cdir;
+	  return cdir;
+	}
+    }
+
+  cdir = grub_zalloc (sizeof (*cdir));
+  if (!cdir)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+
+  /* Leave any problem, including a directory too big to be cached, to
+     reading the directory directly.  */
+  if (grub_iso9660_read_dir (dir, cache_dir_iter, cdir) || grub_errno)
+    {
+      free_cached_dir (cdir);
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+
+  cdir->dev_id = data->disk->dev->id;
+  cdir->disk_id = data->disk->id;
+  cdir->start = start;
+  cdir->modified = data->voldesc.modified;
+  cdir->rockridge = data->rockridge;
+  cdir->joliet = data->joliet;
+  cdir->first_sector = first_sector;
+  cdir->next = dir_cache;
+  dir_cache = cdir;
+  dir_cache_size += cdir->size;
+
+  /* Drop the least recently used listings that don't fit anymore.  */
+  for (prev = &dir_cache->next; *prev; )
+    if (dir_cache_size > GRUB_ISO9660_DIR_CACHE_SIZE)
+      {
+	struct grub_iso9660_cached_dir *old = *prev;
+
+	*prev = old->next;
+	dir_cache_size -= old->size;
+	free_cached_dir (old);
+      }
+    else
+      prev = &(*prev)->next;
+
+  return cdir;
+}
+
+static int
+grub_iso9660_iterate_dir (grub_fshelp_node_t dir,
+			  grub_fshelp_iterate_dir_hook_t hook, void *hook_data)
+{
+  struct grub_iso9660_cached_dir *cdir;
+  grub_size_t i;
+
+  cdir = get_cached_dir (dir);
+  if (!cdir)
+    return grub_iso9660_read_dir (dir, hook, hook_data);
+
+  for (i = 0; i < cdir->nents; i++)
+    {
+      struct grub_fshelp_node *node;
+
+      node = grub_malloc (cdir->ents[i].nodesize);
+      if (!node)
+	return 0;
+      grub_memcpy (node, cdir->ents[i].node, cdir->ents[i].nodesize);
+      node->data = dir->data;
+
+      if (hook (cdir->ents[i].name, cdir->ents[i].type, node, hook_data))
+	return 1;
+    }
+
+  return 0;
+}
+
+/* Check whether the path table entry named NAME of LEN bytes is the
+   path component COMP of COMPLEN bytes.  */
+static int
+path_name_matches (struct grub_iso9660_data *data, grub_uint8_t *name,
+		   grub_size_t len, const char *comp, grub_size_t complen)
+{
+  char *utf8;
+  int ret;
+
+  /* Plain ISO 9660 names are compared case insensitively, as
+     grub_iso9660_read_dir marks them.  */
+  if (!data->joliet)
+    return len == complen && grub_strncasecmp ((char *) name, comp, len) == 0;
+
+  utf8 = grub_iso9660_convert_string (name, len >> 1);
+  if (!utf8)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+  ret = (grub_strlen (utf8) == complen
+	 && grub_memcmp (utf8, comp, complen) == 0);
+  grub_free (utf8);
+  return ret;
+}
+
+/* Look up the directory holding the last component of *PATH in the path
+   table, which lists all directories of the volume, instead of reading
+   every directory on the way.  On success make *PATH point to the last
+   component and return the directory.  The path table only has the
+   plain ISO 9660 or Joliet names, so this is not done with Rock Ridge.
+   Return NULL if the directory has to be found the usual way.  */
+static struct grub_fshelp_node *
+grub_iso9660_find_dir (struct grub_iso9660_data *data, const char **path)
+{
+  grub_uint32_t size = grub_le_to_cpu32 (data->voldesc.path_table_size);
+  const char *end, *comp, *next;
+  grub_size_t complen, pos;
+  grub_uint32_t idx, cur = 1, sector = 0;
+  grub_uint8_t *table;
+  struct grub_iso9660_dir dirent;
+  struct grub_fshelp_node *node;
+
+  if (data->rockridge || size == 0 || size > GRUB_ISO9660_MAX_PATH_TABLE)
+    return NULL;
+
+  end = grub_strrchr (*path, '/');
+  if (!end || end == *path)
+    return NULL;
+
+  /* The path table can't follow "." and "..".  */
+  for (comp = *path; *comp; comp = next)
+    {
+      while (*comp == '/')
+	comp++;
+      for (next = comp; *next && *next != '/'; next++);
+      if ((next - comp == 1 && comp[0] == '.')
+	  || (next - comp == 2 && comp[0] == '.' && comp[1] == '.'))
+	return NULL;
+    }
+
+  /* Nothing but slashes before the last component, as in "//x".  */
+  for (comp = *path; *comp == '/'; comp++);
+  if (comp >= end)
+    return NULL;
+  for (next = comp; *next && *next != '/'; next++);
+  complen = next - comp;
+
+  table = grub_malloc (size);
+  if (!table)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+  if (grub_disk_read (data->disk,
+		      ((grub_disk_addr_t) grub_le_to_cpu32 (data->voldesc.path_table))
+		      << GRUB_ISO9660_LOG2_BLKSZ, 0, size, table))
+    {
+      grub_free (table);
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+
+  /* Directories are listed level by level, so every directory comes
+     after its parent and a single pass finds all components.  */
+  for (pos = 0, idx = 1; pos + sizeof (struct grub_iso9660_path) < size
+	 && idx <= 0xffff; idx++)
+    {
+      struct grub_iso9660_path *rec;
+
+      rec = (struct grub_iso9660_path *) (table + pos);
+      if (rec->len == 0 || pos + sizeof (*rec) + rec->len > size)
+	break;
+
+      if (grub_le_to_cpu16 (rec->parentdir) == cur
+	  && path_name_matches (data, rec->name, rec->len, comp, complen))
+	{
+	  cur = idx;
+	  sector = grub_le_to_cpu32 (rec->first_sector);
+
+	  for (comp = next; comp < end && *comp == '/'; comp++);
+	  if (comp >= end)
+	    break;
+	  for (next = comp; *next && *next != '/'; next++);
+	  complen = next - comp;
+	}
+
+      pos += sizeof (*rec) + rec->len + (rec->len & 1);
+    }
+  grub_free (table);
+
+  if (comp < end || !sector)
+    return NULL;
+
+  /* The size of the directory is only found in its "." entry.  */
+  if (grub_disk_read (data->disk,
+		      (grub_disk_addr_t) sector << GRUB_ISO9660_LOG2_BLKSZ, 0,
+		      sizeof (dirent), &dirent))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+  if (dirent.len < sizeof (dirent) + 1 || dirent.namelen != 1
+      || (dirent.flags & FLAG_TYPE) != FLAG_TYPE_DIR
+      || grub_le_to_cpu32 (dirent.first_sector) != sector)
+    return NULL;
+
+  node = grub_malloc (sizeof (*node));
+  if (!node)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+  node->data = data;
+  node->alloc_dirents = ARRAY_SIZE (node->dirents);
+  node->have_dirents = 1;
+  node->have_symlink = 0;
+  node->dirents[0] = dirent;
+
+  *path = end;
+  return node;
+}
+
 
 /* Context for grub_iso9660_dir.  */
 struct grub_iso9660_dir_ctx
@@ -906,7 +1262,7 @@ grub_iso9660_dir (grub_device_t device, const char *path,
   struct grub_iso9660_dir_ctx ctx = { hook, hook_data };
   struct grub_iso9660_data *data = 0;
   struct grub_fshelp_node rootnode;
-  struct grub_fshelp_node *foundnode;
+  struct grub_fshelp_node *foundnode, *startnode;
 
   grub_dl_ref (my_mod);
 
@@ -920,13 +1276,20 @@ grub_iso9660_dir (grub_device_t device, const char *path,
   rootnode.have_symlink = 0;
   rootnode.dirents[0] = data->voldesc.rootdir;
 
+  startnode = grub_iso9660_find_dir (data, &path);
+
   /* Use the fshelp function to traverse the path.  */
-  if (grub_fshelp_find_file (path, &rootnode,
+  if (grub_fshelp_find_file (path, startnode ? startnode : &rootnode,
 			     &foundnode,
 			     grub_iso9660_iterate_dir,
 			     grub_iso9660_read_symlink,
 			     GRUB_FSHELP_DIR))
-    goto fail;
+    {
+      grub_free (startnode);
+      goto fail;
+    }
+  if (foundnode != startnode)
+    grub_free (startnode);
 
   /* List the files in the directory.  */
   grub_iso9660_iterate_dir (foundnode, grub_iso9660_dir_iter, &ctx);
@@ -949,7 +1312,7 @@ grub_iso9660_open (struct grub_file *file, const char *name)
 {
   struct grub_iso9660_data *data;
   struct grub_fshelp_node rootnode;
-  struct grub_fshelp_node *foundnode;
+  struct grub_fshelp_node *foundnode, *startnode;
 
   grub_dl_ref (my_mod);
 
@@ -963,13 +1326,20 @@ grub_iso9660_open (struct grub_file *file, const char *name)
   rootnode.have_symlink = 0;
   rootnode.dirents[0] = data->voldesc.rootdir;
 
+  startnode = grub_iso9660_find_dir (data, &name);
+
   /* Use the fshelp function to traverse the path.  */
-  if (grub_fshelp_find_file (name, &rootnode,
+  if (grub_fshelp_find_file (name, startnode ? startnode : &rootnode,
 			     &foundnode,
 			     grub_iso9660_iterate_dir,
 			     grub_iso9660_read_symlink,
 			     GRUB_FSHELP_REG))
-    goto fail;
+    {
+      grub_free (startnode);
+      goto fail;
+    }
+  if (foundnode != startnode)
+    grub_free (startnode);
 
   data->node = foundnode;
   file->data = data;
@@ -1159,4 +1529,13 @@ GRUB_MOD_INIT(iso9660)
 GRUB_MOD_FINI(iso9660)
 {
   grub_fs_unregister (&grub_iso9660_fs);
+
+  while (dir_cache)
+    {
+      struct grub_iso9660_cached_dir *next = dir_cache->next;
+
+      free_cached_dir (dir_cache);
+      dir_cache = next;
+    }
+  dir_cache_size = 0;
 }
@@ -30,6 +30,8 @@
 GRUB_MOD_LICENSE ("GPLv3+");
 
 #define GRUB_JFS_MAX_SYMLNK_CNT	8
+/* Maximum number of pages below the inode in an extent tree.  */
+#define GRUB_JFS_TREE_MAX_DEPTH	8
 #define GRUB_JFS_FILETYPE_MASK	0170000
 #define GRUB_JFS_FILETYPE_REG	0100000
 #define GRUB_JFS_FILETYPE_LNK	0120000
@@ -109,6 +111,13 @@ struct grub_jfs_tree_extent
   struct grub_jfs_extent extent;
 } GRUB_PACKED;
 
+/* A page of the tree used to find extents.  */
+struct grub_jfs_tree_page
+{
+  struct grub_jfs_treehead treehead;
+  struct grub_jfs_tree_extent extents[254];
+} GRUB_PACKED;
+
 /* The tree of directory entries.  */
 struct grub_jfs_tree_dir
 {
@@ -226,6 +235,10 @@ struct grub_jfs_data
   int pos;
   int linknest;
   int namecomponentlen;
+
+  /* The extent tree page last read at every depth.  */
+  grub_uint64_t tree_blk[GRUB_JFS_TREE_MAX_DEPTH];
+  struct grub_jfs_tree_page *tree[GRUB_JFS_TREE_MAX_DEPTH];
 } GRUB_PACKED;
 
 struct grub_jfs_diropen
@@ -258,26 +271,83 @@ static grub_dl_t my_mod;
 
 static grub_err_t grub_jfs_lookup_symlink (struct grub_jfs_data *data, grub_uint32_t ino);
 
+static void
+grub_jfs_unmount (struct grub_jfs_data *data)
+{
+  int i;
+
+  if (!data)
+    return;
+
+  for (i = 0; i < GRUB_JFS_TREE_MAX_DEPTH; i++)
+    grub_free (data->tree[i]);
+  grub_free (data);
+}
+
+/* Return the extent tree page at BLK, which is DEPTH pages below the
+   inode.  */
+static struct grub_jfs_tree_page *
+grub_jfs_read_tree (struct grub_jfs_data *data, int depth, grub_uint64_t blk)
+{
+  if (depth >= GRUB_JFS_TREE_MAX_DEPTH)
+    {
+      grub_error (GRUB_ERR_BAD_FS, "extent tree too deep");
+      return NULL;
+    }
+
+  if (data->tree[depth] && data->tree_blk[depth] == blk)
+    return data->tree[depth];
+
+  if (!data->tree[depth])
+    {
+      data->tree[depth] = grub_malloc (sizeof (struct grub_jfs_tree_page));
+      if (!data->tree[depth])
+	return NULL;
+    }
+
+  if (grub_disk_read (data->disk,
+		      blk << (grub_le_to_cpu16 (data->sblock.log2_blksz)
+			      - GRUB_DISK_SECTOR_BITS), 0,
+		      sizeof (struct grub_jfs_tree_page), data->tree[depth]))
+    {
+      grub_free (data->tree[depth]);
+      data->tree[depth] = NULL;
+      return NULL;
+    }
+  data->tree_blk[depth] = blk;
+
+  return data->tree[depth];
+}
+
+/* Map BLK through the extent tree page TREEHEAD, DEPTH pages below the
+   inode, and store the number of blocks left in its extent in *COUNT.  */
 static grub_int64_t
 getblk (struct grub_jfs_treehead *treehead,
 	struct grub_jfs_tree_extent *extents,
 	struct grub_jfs_data *data,
-	grub_uint64_t blk)
+	grub_uint64_t blk, int depth, grub_uint64_t *count)
 {
   int found = -1;
   int i;
 
+  *count = 1;
+
   for (i = 0; i < grub_le_to_cpu16 (treehead->count) - 2; i++)
     {
       if (treehead->flags & GRUB_JFS_TREE_LEAF)
 	{
+	  grub_uint64_t end;
+
 	  /* Read the leafnode.  */
-	  if (grub_le_to_cpu32 (extents[i].offset2) <= blk
-	      && ((grub_le_to_cpu16 (extents[i].extent.length))
-		  + (extents[i].extent.length2 << 16)
-		  + grub_le_to_cpu32 (extents[i].offset2)) > blk)
-	    return (blk - grub_le_to_cpu32 (extents[i].offset2)
-		    + grub_le_to_cpu32 (extents[i].extent.blk2));
+	  end = ((grub_le_to_cpu16 (extents[i].extent.length))
+		 + (extents[i].extent.length2 << 16)
+		 + grub_le_to_cpu32 (extents[i].offset2));
+	  if (grub_le_to_cpu32 (extents[i].offset2) <= blk && end > blk)
+	    {
+	      *count = end - blk;
+	      return (blk - grub_le_to_cpu32 (extents[i].offset2)
+		      + grub_le_to_cpu32 (extents[i].extent.blk2));
+	    }
 	}
       else
 	if (blk >= grub_le_to_cpu32 (extents[i].offset2))
@@ -286,37 +356,29 @@ getblk (struct grub_jfs_treehead *treehead,
 
   if (found != -1)
     {
-      grub_int64_t ret = -1;
-      struct
-      {
-	struct grub_jfs_treehead treehead;
-	struct grub_jfs_tree_extent extents[254];
-      } *tree;
+      struct grub_jfs_tree_page *tree;
 
-      tree = grub_zalloc (sizeof (*tree));
+      tree = grub_jfs_read_tree (data, depth,
+				 grub_le_to_cpu32 (extents[found].extent.blk2));
       if (!tree)
 	return -1;
 
-      if (!grub_disk_read (data->disk,
-			   ((grub_disk_addr_t) grub_le_to_cpu32 (extents[found].extent.blk2))
-			   << (grub_le_to_cpu16 (data->sblock.log2_blksz)
-			       - GRUB_DISK_SECTOR_BITS), 0,
-			   sizeof (*tree), (char *) tree))
-	ret = getblk (&tree->treehead, &tree->extents[0], data, blk);
-      grub_free (tree);
-      return ret;
+      return getblk (&tree->treehead, &tree->extents[0], data, blk,
+		     depth + 1, count);
     }
 
   return -1;
 }
 
 /* Get the block number for the block BLK in the node INODE in the
-   mounted filesystem DATA.  */
+   mounted filesystem DATA, and the number of blocks contiguous from
+   there in *COUNT.  */
 static grub_int64_t
 grub_jfs_blkno (struct grub_jfs_data *data, struct grub_jfs_inode *inode,
-		grub_uint64_t blk)
+		grub_uint64_t blk, grub_uint64_t *count)
 {
-  return getblk (&inode->file.tree, &inode->file.extents[0], data, blk);
+  return getblk (&inode->file.tree, &inode->file.extents[0], data, blk,
+		 0, count);
 }
 
 
@@ -330,8 +392,9 @@ grub_jfs_read_inode (struct grub_jfs_data *data, grub_uint32_t ino,
   unsigned inonum = (ino % 4096) % 32;
   grub_uint64_t iagblk;
   grub_uint64_t inoblk;
+  grub_uint64_t count;
 
-  iagblk = grub_jfs_blkno (data, &data->fileset, iagnum + 1);
+  iagblk = grub_jfs_blkno (data, &data->fileset, iagnum + 1, &count);
   if (grub_errno)
     return grub_errno;
 
@@ -361,7 +424,7 @@ grub_jfs_mount (grub_disk_t disk)
 {
   struct grub_jfs_data *data = 0;
 
-  data = grub_malloc (sizeof (struct grub_jfs_data));
+  data = grub_zalloc (sizeof (struct grub_jfs_data));
   if (!data)
     return 0;
 
@@ -407,7 +470,7 @@ grub_jfs_mount (grub_disk_t disk)
   return data;
 
  fail:
-  grub_free (data);
+  grub_jfs_unmount (data);
 
   if (grub_errno == GRUB_ERR_OUT_OF_RANGE)
     grub_error (GRUB_ERR_BAD_FS, "not a JFS filesystem");
@@ -599,30 +662,33 @@ grub_jfs_read_file (struct grub_jfs_data *data,
 {
   grub_off_t i;
   grub_off_t blockcnt;
+  grub_uint64_t count;
 
   blockcnt = (len + pos + grub_le_to_cpu32 (data->sblock.blksz) - 1)
     >> grub_le_to_cpu16 (data->sblock.log2_blksz);
 
-  for (i = pos >> grub_le_to_cpu16 (data->sblock.log2_blksz); i < blockcnt; i++)
+  for (i = pos >> grub_le_to_cpu16 (data->sblock.log2_blksz); i < blockcnt;
+       i += count)
     {
       grub_disk_addr_t blknr;
       grub_uint32_t blockoff = pos & (grub_le_to_cpu32 (data->sblock.blksz) - 1);
-      grub_uint32_t blockend = grub_le_to_cpu32 (data->sblock.blksz);
+      grub_size_t blockend;
+      grub_uint32_t end;
 
       grub_uint64_t skipfirst = 0;
 
-      blknr = grub_jfs_blkno (data, &data->currinode, i);
+      blknr = grub_jfs_blkno (data, &data->currinode, i, &count);
       if (grub_errno)
 	return -1;
 
-      /* Last block.  */
-      if (i == blockcnt - 1)
-	{
-	  blockend = (len + pos) & (grub_le_to_cpu32 (data->sblock.blksz) - 1);
+      if (count > blockcnt - i)
+	count = blockcnt - i;
+      blockend = count << grub_le_to_cpu16 (data->sblock.log2_blksz);
 
-	  if (!blockend)
-	    blockend = grub_le_to_cpu32 (data->sblock.blksz);
-	}
+      /* Last block.  */
+      end = (len + pos) & (grub_le_to_cpu32 (data->sblock.blksz) - 1);
+      if (i + count == blockcnt && end)
+	blockend -= grub_le_to_cpu32 (data->sblock.blksz) - end;
 
       /* First block.  */
       if (i == (pos >> grub_le_to_cpu16 (data->sblock.log2_blksz)))
@@ -642,7 +708,7 @@ grub_jfs_read_file (struct grub_jfs_data *data,
       if (grub_errno)
 	return -1;
 
-      buf += grub_le_to_cpu32 (data->sblock.blksz) - skipfirst;
+      buf += blockend;
     }
 
   return len;
@@ -804,7 +870,7 @@ grub_jfs_dir (grub_device_t device, const char *path,
 
  fail:
   grub_jfs_closedir (diro);
-  grub_free (data);
+  grub_jfs_unmount (data);
 
   grub_dl_unref (my_mod);
 
@@ -845,7 +911,7 @@ grub_jfs_open (struct grub_file *file, const char *name)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_jfs_unmount (data);
 
   return grub_errno;
 }
@@ -865,7 +931,7 @@ grub_jfs_read (grub_file_t file, char *buf, grub_size_t len)
 static grub_err_t
 grub_jfs_close (grub_file_t file)
 {
-  grub_free (file->data);
+  grub_jfs_unmount (file->data);
 
   grub_dl_unref (my_mod);
 
@@ -899,7 +965,7 @@ grub_jfs_uuid (grub_device_t device, char **uuid)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_jfs_unmount (data);
 
   return grub_errno;
 }
@@ -928,7 +994,7 @@ grub_jfs_label (grub_device_t device, char **label)
   else
     *label = 0;
 
-  grub_free (data);
+  grub_jfs_unmount (data);
 
   return grub_errno;
 }
@@ -39,6 +39,9 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #endif
 
 #define GRUB_MINIX_INODE_DIR_BLOCKS	7
+#define GRUB_MINIX_INDIR_LEVELS	3
+/* Indirect zones bigger than this are not cached.  */
+#define GRUB_MINIX_MAX_CACHED_ZONE	65536
 #define GRUB_MINIX_LOG2_BSIZE	1
 #define GRUB_MINIX_ROOT_INODE	1
 #define GRUB_MINIX_MAX_SYMLNK_CNT	8
@@ -164,6 +167,11 @@ struct grub_minix_data
   grub_disk_t disk;
   int filename_size;
   grub_size_t block_size;
+
+  /* The indirect zone last read at every level, counted from the data
+     zones up.  */
+  grub_minix_uintn_t indir_zone[GRUB_MINIX_INDIR_LEVELS];
+  grub_minix_uintn_t *indir[GRUB_MINIX_INDIR_LEVELS];
 };
 
 static grub_dl_t my_mod;
@@ -188,13 +196,66 @@ grub_minix_zone2sect (struct grub_minix_data *data, grub_minix_uintn_t zone)
 #endif
 
 
+static void
+grub_minix_unmount (struct grub_minix_data *data)
+{
+  int i;
+
+  if (!data)
+    return;
+
+  for (i = 0; i < GRUB_MINIX_INDIR_LEVELS; i++)
+    grub_free (data->indir[i]);
+  grub_free (data);
+}
+
+/* Return the indirect zone ZONE, which is LEVEL levels above the data
+   zones, or NULL if it is too big to be kept.  */
+static const grub_minix_uintn_t *
+grub_minix_get_indir_zone (struct grub_minix_data *data, int level,
+			   grub_minix_uintn_t zone)
+{
+  grub_size_t size = data->block_per_zone * sizeof (grub_minix_uintn_t);
+
+  if (size > GRUB_MINIX_MAX_CACHED_ZONE)
+    return NULL;
+
+  if (data->indir[level] && data->indir_zone[level] == zone)
+    return data->indir[level];
+
+  if (!data->indir[level])
+    {
+      data->indir[level] = grub_malloc (size);
+      if (!data->indir[level])
+	return NULL;
+    }
+
+  if (grub_disk_read (data->disk, grub_minix_zone2sect (data, zone),
+		      0, size, data->indir[level]))
+    {
+      data->indir_zone[level] = 0;
+      return NULL;
+    }
+  data->indir_zone[level] = zone;
+
+  return data->indir[level];
+}
+
   /* Read the block pointer in ZONE, on the offset NUM.  */
 static grub_minix_uintn_t
-grub_get_indir (struct grub_minix_data *data,
+grub_get_indir (struct grub_minix_data *data, int level,
 		 grub_minix_uintn_t zone,
 		 grub_minix_uintn_t num)
 {
+  const grub_minix_uintn_t *indir;
   grub_minix_uintn_t indirn;
+
+  indir = grub_minix_get_indir_zone (data, level, zone);
+  if (indir)
+    return grub_minix_to_cpu_n (indir[num]);
+  if (grub_errno)
+    return 0;
+
   grub_disk_read (data->disk,
 		  grub_minix_zone2sect(data, zone),
 		  sizeof (grub_minix_uintn_t) * num,
@@ -202,33 +263,47 @@ grub_get_indir (struct grub_minix_data *data,
   return grub_minix_to_cpu_n (indirn);
 }
 
+/* Return the zone of block BLK and store in *COUNT how many blocks
+   continue from there on disk.  */
 static grub_minix_uintn_t
-grub_minix_get_file_block (struct grub_minix_data *data, unsigned int blk)
+grub_minix_get_file_block (struct grub_minix_data *data, unsigned int blk,
+			   grub_uint32_t *count)
 {
+  const grub_minix_uintn_t *list = NULL;
   grub_minix_uintn_t indir;
+  grub_uint32_t n = 1, nlist = 0;
+
+  *count = 1;
 
   /* Direct block.  */
   if (blk < GRUB_MINIX_INODE_DIR_BLOCKS)
-    return GRUB_MINIX_INODE_DIR_ZONES (data, blk);
+    {
+      indir = GRUB_MINIX_INODE_DIR_ZONES (data, blk);
+      if (indir)
+	while (blk + n < GRUB_MINIX_INODE_DIR_BLOCKS
+	       && GRUB_MINIX_INODE_DIR_ZONES (data, blk + n) == indir + n)
+	  n++;
+      goto run;
+    }
 
   /* Indirect block.  */
   blk -= GRUB_MINIX_INODE_DIR_BLOCKS;
   if (blk < data->block_per_zone)
     {
-      indir = grub_get_indir (data, GRUB_MINIX_INODE_INDIR_ZONE (data), blk);
-      return indir;
+      indir = grub_get_indir (data, 0, GRUB_MINIX_INODE_INDIR_ZONE (data), blk);
+      goto indirect;
     }
 
   /* Double indirect block.  */
   blk -= data->block_per_zone;
   if (blk < (grub_uint64_t) data->block_per_zone * (grub_uint64_t) data->block_per_zone)
     {
-      indir = grub_get_indir (data, GRUB_MINIX_INODE_DINDIR_ZONE (data),
+      indir = grub_get_indir (data, 1, GRUB_MINIX_INODE_DINDIR_ZONE (data),
 			      blk / data->block_per_zone);
 
-      indir = grub_get_indir (data, indir, blk % data->block_per_zone);
+      indir = grub_get_indir (data, 0, indir, blk % data->block_per_zone);
 
-      return indir;
+      goto indirect;
     }
 
 #if defined (MODE_MINIX3) || defined (MODE_MINIX2)
@@ -236,12 +311,12 @@ grub_minix_get_file_block (struct grub_minix_data *data, unsigned int blk)
   if (blk < ((grub_uint64_t) data->block_per_zone * (grub_uint64_t) data->block_per_zone
 	     * (grub_uint64_t) data->block_per_zone))
     {
-      indir = grub_get_indir (data, grub_minix_to_cpu_n (data->inode.triple_indir_zone),
+      indir = grub_get_indir (data, 2, grub_minix_to_cpu_n (data->inode.triple_indir_zone),
 			      (blk / data->block_per_zone) / data->block_per_zone);
-      indir = grub_get_indir (data, indir, (blk / data->block_per_zone) % data->block_per_zone);
-      indir = grub_get_indir (data, indir, blk % data->block_per_zone);
+      indir = grub_get_indir (data, 1, indir, (blk / data->block_per_zone) % data->block_per_zone);
+      indir = grub_get_indir (data, 0, indir, blk % data->block_per_zone);
 
-      return indir;
+      goto indirect;
     }
 #endif
 
@@ -249,8 +324,25 @@ grub_minix_get_file_block (struct grub_minix_data *data, unsigned int blk)
   grub_error (GRUB_ERR_OUT_OF_RANGE, "file bigger than maximum size");
 
   return 0;
-}
 
+ indirect:
+  /* The last indirect zone read is still cached unless it was too big.  */
+  blk %= data->block_per_zone;
+  if (indir && data->indir[0])
+    {
+      list = data->indir[0] + blk;
+      nlist = data->block_per_zone - blk;
+    }
+  while (n < nlist && grub_minix_to_cpu_n (list[n]) == indir + n)
+    n++;
+
+ run:
+  /* Zones and blocks only line up if they have the same size.  */
+  if (grub_minix_zone2sect (data, 1) == data->block_size)
+    *count = n;
+
+  return indir;
+}
 
 /* Read LEN bytes from the file described by DATA starting with byte
    POS.  Return the amount of read bytes in READ.  */
@@ -263,6 +355,7 @@ grub_minix_read_file (struct grub_minix_data *data,
   grub_uint32_t blockcnt;
   grub_uint32_t posblock;
   grub_uint32_t blockoff;
+  grub_uint32_t count;
 
   if (pos > GRUB_MINIX_INODE_SIZE (data))
     {
@@ -285,25 +378,30 @@ grub_minix_read_file (struct grub_minix_data *data,
   blockoff = (((grub_uint32_t) pos)
 	      % (data->block_size << GRUB_DISK_SECTOR_BITS));
 
-  for (i = posblock; i < blockcnt; i++)
+  for (i = posblock; i < blockcnt; i += count)
     {
       grub_minix_uintn_t blknr;
-      grub_uint64_t blockend = data->block_size << GRUB_DISK_SECTOR_BITS;
+      grub_uint64_t blockend;
       grub_off_t skipfirst = 0;
 
-      blknr = grub_minix_get_file_block (data, i);
+      blknr = grub_minix_get_file_block (data, i, &count);
       if (grub_errno)
 	return -1;
 
+      if (count > blockcnt - i)
+	count = blockcnt - i;
+      blockend = ((grub_uint64_t) count * data->block_size)
+	<< GRUB_DISK_SECTOR_BITS;
+
       /* Last block.  */
-      if (i == blockcnt - 1)
+      if (i + count == blockcnt)
 	{
 	  /* len + pos < 4G (checked above), so it doesn't overflow.  */
-	  blockend = (((grub_uint32_t) (len + pos))
-		      % (data->block_size << GRUB_DISK_SECTOR_BITS));
+	  grub_uint32_t end = (((grub_uint32_t) (len + pos))
+			       % (data->block_size << GRUB_DISK_SECTOR_BITS));
 
-	  if (!blockend)
-	    blockend = data->block_size << GRUB_DISK_SECTOR_BITS;
+	  if (end)
+	    blockend -= (data->block_size << GRUB_DISK_SECTOR_BITS) - end;
 	}
 
       /* First block.  */
@@ -322,7 +420,7 @@ grub_minix_read_file (struct grub_minix_data *data,
       if (grub_errno)
 	return -1;
 
-      buf += (data->block_size << GRUB_DISK_SECTOR_BITS) - skipfirst;
+      buf += blockend;
     }
 
   return len;
@@ -468,7 +566,7 @@ grub_minix_mount (grub_disk_t disk)
 {
   struct grub_minix_data *data;
 
-  data = grub_malloc (sizeof (struct grub_minix_data));
+  data = grub_zalloc (sizeof (struct grub_minix_data));
   if (!data)
     return 0;
 
@@ -527,7 +625,7 @@ grub_minix_mount (grub_disk_t disk)
   return data;
 
  fail:
-  grub_free (data);
+  grub_minix_unmount (data);
 #if defined(MODE_MINIX3)
   grub_error (GRUB_ERR_BAD_FS, "not a minix3 filesystem");
 #elif defined(MODE_MINIX2)
@@ -603,7 +701,7 @@ grub_minix_dir (grub_device_t device, const char *path,
     }
 
  fail:
-  grub_free (data);
+  grub_minix_unmount (data);
   return grub_errno;
 }
 
@@ -621,7 +719,7 @@ grub_minix_open (struct grub_file *file, const char *name)
   grub_minix_read_inode (data, GRUB_MINIX_ROOT_INODE);
   if (grub_errno)
     {
-      grub_free (data);
+      grub_minix_unmount (data);
       return grub_errno;
     }
 
@@ -636,7 +734,7 @@ grub_minix_open (struct grub_file *file, const char *name)
   grub_minix_find_file (data, name);
   if (grub_errno)
     {
-      grub_free (data);
+      grub_minix_unmount (data);
       return grub_errno;
     }
 
@@ -661,7 +759,7 @@ grub_minix_read (grub_file_t file, char *buf, grub_size_t len)
 static grub_err_t
 grub_minix_close (grub_file_t file)
 {
-  grub_free (file->data);
+  grub_minix_unmount (file->data);
 
   return GRUB_ERR_NONE;
 }
@@ -27,6 +27,7 @@
 #include <grub/fshelp.h>
 #include <grub/ntfs.h>
 #include <grub/charset.h>
+#include <grub/safemath.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -108,6 +109,8 @@ init_attr (struct grub_ntfs_attr *at, struct grub_ntfs_file *mft)
   at->flags = (mft == &mft->data->mmft) ? GRUB_NTFS_AF_MMFT : 0;
   at->attr_nxt = mft->buf + u16at (mft->buf, 0x14);
   at->attr_end = at->emft_buf = at->edat_buf = at->sbuf = NULL;
+  at->runs = NULL;
+  at->nruns = at->runs_alloc = 0;
 }
 
 static void
@@ -116,6 +119,7 @@ free_attr (struct grub_ntfs_attr *at)
   grub_free (at->emft_buf);
   grub_free (at->edat_buf);
   grub_free (at->sbuf);
+  grub_free (at->runs);
 }
 
 static grub_uint8_t *
@@ -362,6 +366,87 @@ grub_ntfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t block)
 					 ctx->curr_vcn + ctx->curr_lcn);
 }
 
+static grub_disk_addr_t
+grub_ntfs_read_run (grub_fshelp_node_t node, grub_disk_addr_t block,
+		    grub_disk_addr_t *count)
+{
+  struct grub_ntfs_attr *at = (struct grub_ntfs_attr *) node;
+  grub_size_t lo = 0, hi = at->nruns;
+
+  while (lo < hi)
+    {
+      grub_size_t mid = lo + (hi - lo) / 2;
+
+      if (at->runs[mid].next_vcn <= block)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo == at->nruns || at->runs[lo].vcn > block)
+    {
+      grub_error (GRUB_ERR_BAD_FS, "run list overflown");
+      return -1;
+    }
+
+  *count = at->runs[lo].next_vcn - block;
+  if (!at->runs[lo].lcn)
+    return 0;
+  return at->runs[lo].lcn + block - at->runs[lo].vcn;
+}
+
+/* Make sure the runs of the non-resident attribute PA up to LAST_VCN
+   are in the run cache of AT, decoding them with CTX from the start of
+   PA if they aren't.  */
+static grub_err_t
+cache_runs (struct grub_ntfs_attr *at, grub_uint8_t *pa,
+	    struct grub_ntfs_rlst *ctx, grub_disk_addr_t last_vcn)
+{
+  grub_disk_addr_t end;
+
+  if (at->nruns && (at->run_type != *pa || ctx->next_vcn < at->runs[0].vcn
+		    || ctx->next_vcn > at->runs[at->nruns - 1].next_vcn))
+    at->nruns = 0;
+  at->run_type = *pa;
+
+  if (at->nruns && at->runs[at->nruns - 1].next_vcn > last_vcn)
+    return GRUB_ERR_NONE;
+
+  end = at->nruns ? at->runs[at->nruns - 1].next_vcn : ctx->next_vcn;
+  while (ctx->next_vcn <= last_vcn)
+    {
+      if (grub_ntfs_read_run_list (ctx))
+	return grub_errno;
+      if (ctx->next_vcn <= ctx->curr_vcn)
+	return grub_error (GRUB_ERR_BAD_FS, "invalid run list");
+      if (ctx->next_vcn <= end)
+	continue;
+      if (ctx->curr_vcn != end)
+	return grub_error (GRUB_ERR_BAD_FS, "run list changed");
+
+      if (at->nruns == at->runs_alloc)
+	{
+	  struct grub_ntfs_run *tmp;
+	  grub_size_t sz;
+
+	  if (grub_mul (at->runs_alloc ? at->runs_alloc * 2 : 16,
+			sizeof (at->runs[0]), &sz))
+	    return grub_error (GRUB_ERR_OUT_OF_RANGE, "overflow is detected");
+	  tmp = grub_realloc (at->runs, sz);
+	  if (!tmp)
+	    return grub_errno;
+	  at->runs = tmp;
+	  at->runs_alloc = sz / sizeof (at->runs[0]);
+	}
+      at->runs[at->nruns].vcn = ctx->curr_vcn;
+      at->runs[at->nruns].next_vcn = ctx->next_vcn;
+      at->runs[at->nruns].lcn = (ctx->flags & GRUB_NTFS_RF_BLNK)
+	? 0 : ctx->curr_lcn;
+      at->nruns++;
+      end = ctx->next_vcn;
+    }
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 read_data (struct grub_ntfs_attr *at, grub_uint8_t *pa, grub_uint8_t *dest,
 	   grub_disk_addr_t ofs, grub_size_t len, int cached,
@@ -405,6 +490,21 @@ read_data (struct grub_ntfs_attr *at, grub_uint8_t *pa, grub_uint8_t *dest,
 		      "ntfscomp");
     }
 
+  /* Regular reads go through the run cache.  The attribute list is read
+     with the same AT and isn't worth caching.  */
+  if (!(at->flags & GRUB_NTFS_AF_GPOS)
+      && *pa != GRUB_NTFS_AT_ATTRIBUTE_LIST)
+    {
+      if (cache_runs (at, pa, ctx, (ofs + len - 1)
+		      >> (GRUB_NTFS_BLK_SHR + ctx->comp.log_spc)))
+	return grub_errno;
+      grub_fshelp_read_file_runs (ctx->comp.disk, (grub_fshelp_node_t) at,
+				  read_hook, read_hook_data, ofs, len,
+				  (char *) dest, grub_ntfs_read_run, ofs + len,
+				  ctx->comp.log_spc, 0);
+      return grub_errno;
+    }
+
   ctx->target_vcn = ofs >> (GRUB_NTFS_BLK_SHR + ctx->comp.log_spc);
   while (ctx->next_vcn <= ctx->target_vcn)
     {
@@ -493,11 +593,43 @@ read_attr (struct grub_ntfs_attr *at, grub_uint8_t *dest, grub_disk_addr_t ofs,
 static grub_err_t
 read_mft (struct grub_ntfs_data *data, grub_uint8_t *buf, grub_uint64_t mftno)
 {
+  grub_size_t size = data->mft_size << GRUB_NTFS_BLK_SHR;
+  struct grub_ntfs_mft_cache *e, *victim = NULL;
+  unsigned i;
+
+  for (i = 0; i < GRUB_NTFS_MFT_CACHE_SIZE; i++)
+    {
+      e = &data->mft_cache[i];
+      if (e->buf && e->mftno == mftno)
+	{
+	  e->last_used = ++data->mft_cache_clock;
+	  grub_memcpy (buf, e->buf, size);
+	  return GRUB_ERR_NONE;
+	}
+      if (!victim || (victim->buf && (!e->buf
+				      || e->last_used < victim->last_used)))
+	victim = e;
+    }
+
   if (read_attr
       (&data->mmft.attr, buf, mftno * ((grub_disk_addr_t) data->mft_size << GRUB_NTFS_BLK_SHR),
        data->mft_size << GRUB_NTFS_BLK_SHR, 0, 0, 0))
     return grub_error (GRUB_ERR_BAD_FS, "read MFT 0x%llx fails", (unsigned long long) mftno);
-  return fixup (buf, data->mft_size, (const grub_uint8_t *) "FILE");
+  if (fixup (buf, data->mft_size, (const grub_uint8_t *) "FILE"))
+    return grub_errno;
+
+  /* Callers modify their copy, so keep one of our own.  */
+  if (!victim->buf)
+    victim->buf = grub_malloc (size);
+  if (victim->buf)
+    {
+      grub_memcpy (victim->buf, buf, size);
+      victim->mftno = mftno;
+      victim->last_used = ++data->mft_cache_clock;
+    }
+  else
+    grub_errno = GRUB_ERR_NONE;
+  return GRUB_ERR_NONE;
 }
 
 static grub_err_t
@@ -549,6 +681,19 @@ free_file (struct grub_ntfs_file *mft)
   grub_free (mft->buf);
 }
 
+static void
+free_data (struct grub_ntfs_data *data)
+{
+  unsigned i;
+
+  free_file (&data->mmft);
+  free_file (&data->cmft);
+  for (i = 0; i < GRUB_NTFS_MFT_CACHE_SIZE; i++)
+    grub_free (data->mft_cache[i].buf);
+  grub_free (data->upcase);
+  grub_free (data);
+}
+
 static char *
 get_utf8 (grub_uint8_t *in, grub_size_t len)
 {
@@ -571,6 +716,35 @@ get_utf8 (grub_uint8_t *in, grub_size_t len)
   return (char *) buf;
 }
 
+/* Make a node for the file of the index entry POS in DIRO.  */
+static struct grub_ntfs_file *
+entry_node (struct grub_ntfs_file *diro, grub_uint8_t *pos,
+	    enum grub_fshelp_filetype *type)
+{
+  struct grub_ntfs_file *fdiro;
+  grub_uint32_t attr;
+
+  attr = u32at (pos, 0x48);
+  if (attr & GRUB_NTFS_ATTR_REPARSE)
+    *type = GRUB_FSHELP_SYMLINK;
+  else if (attr & GRUB_NTFS_ATTR_DIRECTORY)
+    *type = GRUB_FSHELP_DIR;
+  else
+    *type = GRUB_FSHELP_REG;
+  /* Only POSIX names are case sensitive.  */
+  if (pos[0x51])
+    *type |= GRUB_FSHELP_CASE_INSENSITIVE;
+
+  fdiro = grub_zalloc (sizeof (struct grub_ntfs_file));
+  if (!fdiro)
+    return NULL;
+
+  fdiro->data = diro->data;
+  fdiro->ino = u64at (pos, 0) & 0xffffffffffffULL;
+  fdiro->mtime = u64at (pos, 0x20);
+  return fdiro;
+}
+
 static int
 list_file (struct grub_ntfs_file *diro, grub_uint8_t *pos,
 	   grub_fshelp_iterate_dir_hook_t hook, void *hook_data)
@@ -583,7 +757,7 @@ list_file (struct grub_ntfs_file *diro, grub_uint8_t *pos,
       grub_uint8_t namespace;
       char *ustr;
 
-      if (pos[0xC] & 2)		/* end signature */
+      if (pos[0xC] & GRUB_NTFS_IE_END)	/* end signature */
 	break;
 
       np = pos + 0x50;
@@ -598,32 +772,17 @@ list_file (struct grub_ntfs_file *diro, grub_uint8_t *pos,
 	{
 	  enum grub_fshelp_filetype type;
 	  struct grub_ntfs_file *fdiro;
-	  grub_uint32_t attr;
 
-	  attr = u32at (pos, 0x48);
-	  if (attr & GRUB_NTFS_ATTR_REPARSE)
-	    type = GRUB_FSHELP_SYMLINK;
-	  else if (attr & GRUB_NTFS_ATTR_DIRECTORY)
-	    type = GRUB_FSHELP_DIR;
-	  else
-	    type = GRUB_FSHELP_REG;
-
-	  fdiro = grub_zalloc (sizeof (struct grub_ntfs_file));
+	  fdiro = entry_node (diro, pos, &type);
 	  if (!fdiro)
 	    return 0;
 
-	  fdiro->data = diro->data;
-	  fdiro->ino = u64at (pos, 0) & 0xffffffffffffULL;
-	  fdiro->mtime = u64at (pos, 0x20);
-
 	  ustr = get_utf8 (np, ns);
 	  if (ustr == NULL)
 	    {
 	      grub_free (fdiro);
 	      return 0;
 	    }
-          if (namespace)
-            type |= GRUB_FSHELP_CASE_INSENSITIVE;
 
 	  if (hook (ustr, type, fdiro, hook_data))
 	    {
@@ -883,6 +1042,365 @@ done:
   return ret;
 }
 
+/* Read $UpCase for the index lookups.  */
+static grub_err_t
+read_upcase (struct grub_ntfs_data *data)
+{
+  struct grub_ntfs_file mft;
+  grub_size_t i;
+
+  data->upcase_read = 1;
+
+  grub_memset (&mft, 0, sizeof (mft));
+  mft.data = data;
+  mft.ino = GRUB_NTFS_FILE_UPCASE;
+  if (init_file (&mft, GRUB_NTFS_FILE_UPCASE))
+    goto fail;
+  if (mft.size < 2 || mft.size > 0x10000 * sizeof (data->upcase[0]))
+    {
+      grub_error (GRUB_ERR_BAD_FS, "invalid $UpCase size");
+      goto fail;
+    }
+
+  data->upcase = grub_malloc (mft.size);
+  if (!data->upcase)
+    goto fail;
+  if (read_attr (&mft.attr, (grub_uint8_t *) data->upcase, 0, mft.size,
+		 1, 0, 0))
+    goto fail;
+  data->upcase_len = mft.size / sizeof (data->upcase[0]);
+  for (i = 0; i < data->upcase_len; i++)
+    data->upcase[i] = grub_le_to_cpu16 (data->upcase[i]);
+
+  free_file (&mft);
+  return GRUB_ERR_NONE;
+
+ fail:
+  grub_free (data->upcase);
+  data->upcase = NULL;
+  free_file (&mft);
+  return grub_errno;
+}
+
+/* Context for grub_ntfs_lookup_file.  */
+struct grub_ntfs_lookup_ctx
+{
+  struct grub_ntfs_file *dir;
+  const char *name;
+  grub_uint16_t *name16;
+  grub_size_t name16_len;
+  struct grub_ntfs_attr alloc;
+  int alloc_located;
+  grub_fshelp_node_t *foundnode;
+  enum grub_fshelp_filetype *foundtype;
+};
+
+static inline grub_uint16_t
+upcase (struct grub_ntfs_data *data, grub_uint16_t c)
+{
+  return (c < data->upcase_len) ? data->upcase[c] : c;
+}
+
+/* Compare the looked up name with the name of the index entry POS the
+   way $I30 is sorted, ignoring case.  */
+static int
+collate_name (struct grub_ntfs_lookup_ctx *ctx, grub_uint8_t *pos)
+{
+  grub_size_t len = pos[0x50], i;
+
+  for (i = 0; i < ctx->name16_len && i < len; i++)
+    {
+      grub_uint16_t a = upcase (ctx->dir->data, ctx->name16[i]);
+      grub_uint16_t b = upcase (ctx->dir->data, u16at (pos, 0x52 + 2 * i));
+
+      if (a != b)
+	return (a < b) ? -1 : 1;
+    }
+  if (ctx->name16_len != len)
+    return (ctx->name16_len < len) ? -1 : 1;
+  return 0;
+}
+
+/* Whether the entry POS, equal to the looked up name but for case, is a
+   match.  DOS names are skipped as when listing and POSIX names are case
+   sensitive.  */
+static int
+entry_matches (struct grub_ntfs_lookup_ctx *ctx, grub_uint8_t *pos)
+{
+  grub_size_t i;
+
+  if (pos[0x51] == 2)
+    return 0;
+  if (pos[0x51])
+    return 1;
+  for (i = 0; i < ctx->name16_len; i++)
+    if (ctx->name16[i] != u16at (pos, 0x52 + 2 * i))
+      return 0;
+  return 1;
+}
+
+static int
+lookup_node (struct grub_ntfs_lookup_ctx *ctx, grub_disk_addr_t vcn,
+	     int depth);
+
+/* Look the name up in the index entries from POS to END and in the
+   subnodes before them, in collation order.  Return 1 if it was found,
+   0 if it wasn't and -1 on error.  */
+static int
+lookup_entries (struct grub_ntfs_lookup_ctx *ctx, grub_uint8_t *pos,
+		grub_uint8_t *end, int depth)
+{
+  while (1)
+    {
+      grub_size_t elen;
+      int cmp = -1;
+      int r;
+
+      if (end - pos < 0x10 || (elen = u16at (pos, 8)) < 0x10
+	  || elen > (grub_size_t) (end - pos))
+	{
+	  grub_error (GRUB_ERR_BAD_FS, "invalid index entry");
+	  return -1;
+	}
+
+      /* The end entry sorts after everything.  */
+      if (!(pos[0xC] & GRUB_NTFS_IE_END))
+	{
+	  if (elen < 0x52 || 0x52 + 2 * (grub_size_t) pos[0x50] > elen)
+	    {
+	      grub_error (GRUB_ERR_BAD_FS, "invalid index entry");
+	      return -1;
+	    }
+	  cmp = collate_name (ctx, pos);
+	}
+
+      if (cmp <= 0 && (pos[0xC] & GRUB_NTFS_IE_NODE))
+	{
+	  if (elen < 0x18)
+	    {
+	      grub_error (GRUB_ERR_BAD_FS, "invalid index entry");
+	      return -1;
+	    }
+	  r = lookup_node (ctx, u64at (pos, elen - 8), depth + 1);
+	  if (r)
+	    return r;
+	}
+
+      if (pos[0xC] & GRUB_NTFS_IE_END)
+	return 0;
+      if (cmp == 0 && entry_matches (ctx, pos))
+	{
+	  *ctx->foundnode = entry_node (ctx->dir, pos, ctx->foundtype);
+	  return *ctx->foundnode ? 1 : -1;
+	}
+      if (cmp < 0)
+	return 0;
+      pos += elen;
+    }
+}
+
+/* Look the name up in the index block VCN of $INDEX_ALLOCATION.  */
+static int
+lookup_node (struct grub_ntfs_lookup_ctx *ctx, grub_disk_addr_t vcn,
+	     int depth)
+{
+  struct grub_ntfs_data *data = ctx->dir->data;
+  grub_size_t size = data->idx_size << GRUB_NTFS_BLK_SHR;
+  grub_uint32_t start, end;
+  grub_disk_addr_t ofs;
+  grub_uint8_t *indx;
+  int r;
+
+  if (depth > GRUB_NTFS_MAX_INDEX_DEPTH)
+    {
+      grub_error (GRUB_ERR_BAD_FS, "index too deep");
+      return -1;
+    }
+
+  if (!ctx->alloc_located)
+    {
+      grub_uint8_t *cur_pos;
+
+      ctx->alloc_located = 1;
+      cur_pos = locate_attr (&ctx->alloc, ctx->dir,
+			     GRUB_NTFS_AT_INDEX_ALLOCATION);
+      while (cur_pos != NULL)
+	{
+	  /* Non-resident, Namelen=4, Offset=0x40, Flags=0, Name="$I30" */
+	  if ((u32at (cur_pos, 8) == 0x400401) &&
+	      (u32at (cur_pos, 0x40) == 0x490024) &&
+	      (u32at (cur_pos, 0x44) == 0x300033))
+	    break;
+	  cur_pos = find_attr (&ctx->alloc, GRUB_NTFS_AT_INDEX_ALLOCATION);
+	}
+      if (!cur_pos)
+	{
+	  grub_error (GRUB_ERR_BAD_FS, "no $INDEX_ALLOCATION");
+	  return -1;
+	}
+    }
+
+  /* Index blocks smaller than a cluster are addressed in sectors.  */
+  if (data->idx_size >= (1ULL << data->log_spc))
+    ofs = vcn << (data->log_spc + GRUB_NTFS_BLK_SHR);
+  else
+    ofs = vcn << GRUB_NTFS_BLK_SHR;
+
+  indx = grub_malloc (size);
+  if (!indx)
+    return -1;
+  if (read_attr (&ctx->alloc, indx, ofs, size, 0, 0, 0)
+      || fixup (indx, data->idx_size, (const grub_uint8_t *) "INDX"))
+    {
+      grub_free (indx);
+      return -1;
+    }
+
+  start = 0x18 + u32at (indx, 0x18);
+  end = 0x18 + u32at (indx, 0x1C);
+  if (start >= end || end > size)
+    {
+      grub_free (indx);
+      grub_error (GRUB_ERR_BAD_FS, "invalid index block");
+      return -1;
+    }
+
+  r = lookup_entries (ctx, indx + start, indx + end, depth);
+  grub_free (indx);
+  return r;
+}
+
+/* Search the sorted $I30 index of the directory CTX->dir.  Return 1 if
+   that gave a definite answer, 0 if the directory has to be listed
+   instead and -1 on error.  */
+static int
+lookup_index (struct grub_ntfs_lookup_ctx *ctx)
+{
+  struct grub_ntfs_data *data = ctx->dir->data;
+  struct grub_ntfs_attr attr;
+  grub_uint8_t *pa, *hdr;
+  grub_uint32_t vlen, start, end;
+  grub_size_t len;
+  int r = 0;
+
+  init_attr (&attr, ctx->dir);
+  while (1)
+    {
+      pa = find_attr (&attr, GRUB_NTFS_AT_INDEX_ROOT);
+      if (pa == NULL)
+	goto done;
+
+      /* Resident, Namelen=4, Offset=0x18, Flags=0x00, Name="$I30" */
+      if ((u32at (pa, 8) == 0x180400) &&
+	  (u32at (pa, 0x18) == 0x490024) &&
+	  (u32at (pa, 0x1C) == 0x300033))
+	break;
+    }
+
+  /* Small directories have all of their entries in the index root, so
+     listing them costs nothing more.  */
+  vlen = u32at (pa, 0x10);
+  hdr = pa + u16at (pa, 0x14);
+  if (vlen < 0x20 || u32at (hdr, 0) != GRUB_NTFS_AT_FILENAME
+      || u32at (hdr, 4) != GRUB_NTFS_COLLATION_FILE_NAME
+      || !(hdr[0x1C] & GRUB_NTFS_LARGE_INDEX))
+    goto done;
+  hdr += 0x10;
+  start = u32at (hdr, 0);
+  end = u32at (hdr, 4);
+  if (start >= end || end > vlen - 0x10)
+    goto done;
+
+  if (!data->upcase_read && read_upcase (data))
+    {
+      grub_dprintf ("ntfs", "no $UpCase: %s\n", grub_errmsg);
+      grub_errno = GRUB_ERR_NONE;
+    }
+  if (!data->upcase)
+    goto done;
+
+  len = grub_strlen (ctx->name);
+  ctx->name16 = grub_calloc (len + 1, sizeof (ctx->name16[0]));
+  if (!ctx->name16)
+    {
+      r = -1;
+      goto done;
+    }
+  ctx->name16_len = grub_utf8_to_utf16 (ctx->name16, len,
+					(const grub_uint8_t *) ctx->name, len,
+					NULL);
+  /* No entry has a longer name.  */
+  if (ctx->name16_len > 255)
+    r = 1;
+  else
+    r = lookup_entries (ctx, hdr + start, hdr + end, 0);
+  if (r == 0)
+    r = 1;
+
+ done:
+  free_attr (&attr);
+  return r;
+}
+
+/* Helper for grub_ntfs_lookup_file.  */
+static int
+grub_ntfs_lookup_iter (const char *filename,
+		       enum grub_fshelp_filetype filetype,
+		       grub_fshelp_node_t node, void *data)
+{
+  struct grub_ntfs_lookup_ctx *ctx = data;
+
+  if ((filetype & GRUB_FSHELP_CASE_INSENSITIVE)
+      ? grub_strcasecmp (ctx->name, filename)
+      : grub_strcmp (ctx->name, filename))
+    {
+      grub_free (node);
+      return 0;
+    }
+
+  *ctx->foundnode = node;
+  *ctx->foundtype = filetype;
+  return 1;
+}
+
+/* Find NAME in the directory DIR through its $I30 index, or by listing
+   it if the index can't be used.  */
+static grub_err_t
+grub_ntfs_lookup_file (grub_fshelp_node_t dir, const char *name,
+		       grub_fshelp_node_t *foundnode,
+		       enum grub_fshelp_filetype *foundtype)
+{
+  struct grub_ntfs_lookup_ctx ctx;
+  int r;
+
+  grub_memset (&ctx, 0, sizeof (ctx));
+  ctx.dir = dir;
+  ctx.name = name;
+  ctx.foundnode = foundnode;
+  ctx.foundtype = foundtype;
+  *foundnode = NULL;
+
+  if (!dir->inode_read)
+    {
+      if (init_file (dir, dir->ino))
+	return grub_errno;
+    }
+
+  r = lookup_index (&ctx);
+  if (ctx.alloc_located)
+    free_attr (&ctx.alloc);
+  grub_free (ctx.name16);
+  if (r > 0)
+    return GRUB_ERR_NONE;
+  if (r < 0)
+    grub_dprintf ("ntfs", "index lookup of %s failed: %s\n", name,
+		  grub_errmsg);
+  grub_errno = GRUB_ERR_NONE;
+
+  grub_ntfs_iterate_dir (dir, grub_ntfs_lookup_iter, &ctx);
+  return grub_errno;
+}
+
 static struct grub_ntfs_data *
 grub_ntfs_mount (grub_disk_t disk)
 {
@@ -967,9 +1485,7 @@ fail:
 
   if (data)
     {
-      free_file (&data->mmft);
-      free_file (&data->cmft);
-      grub_free (data);
+      free_data (data);
     }
   return 0;
 }
@@ -1013,8 +1529,9 @@ grub_ntfs_dir (grub_device_t device, const char *path,
   if (!data)
     goto fail;
 
-  grub_fshelp_find_file (path, &data->cmft, &fdiro, grub_ntfs_iterate_dir,
-			 grub_ntfs_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_lookup (path, &data->cmft, &fdiro,
+				grub_ntfs_lookup_file, grub_ntfs_read_symlink,
+				GRUB_FSHELP_DIR);
 
   if (grub_errno)
     goto fail;
@@ -1029,9 +1546,7 @@ fail:
     }
   if (data)
     {
-      free_file (&data->mmft);
-      free_file (&data->cmft);
-      grub_free (data);
+      free_data (data);
     }
 
   grub_dl_unref (my_mod);
@@ -1051,8 +1566,9 @@ grub_ntfs_open (grub_file_t file, const char *name)
   if (!data)
     goto fail;
 
-  grub_fshelp_find_file (name, &data->cmft, &mft, grub_ntfs_iterate_dir,
-			 grub_ntfs_read_symlink, GRUB_FSHELP_REG);
+  grub_fshelp_find_file_lookup (name, &data->cmft, &mft,
+				grub_ntfs_lookup_file, grub_ntfs_read_symlink,
+				GRUB_FSHELP_REG);
 
   if (grub_errno)
     goto fail;
@@ -1078,9 +1594,7 @@ grub_ntfs_open (grub_file_t file, const char *name)
 fail:
   if (data)
     {
-      free_file (&data->mmft);
-      free_file (&data->cmft);
-      grub_free (data);
+      free_data (data);
     }
 
   grub_dl_unref (my_mod);
@@ -1111,9 +1625,7 @@ grub_ntfs_close (grub_file_t file)
 
   if (data)
     {
-      free_file (&data->mmft);
-      free_file (&data->cmft);
-      grub_free (data);
+      free_data (data);
     }
 
   grub_dl_unref (my_mod);
@@ -1171,9 +1683,7 @@ fail:
     }
   if (data)
     {
-      free_file (&data->mmft);
-      free_file (&data->cmft);
-      grub_free (data);
+      free_data (data);
     }
 
   grub_dl_unref (my_mod);
@@ -1197,9 +1707,7 @@ grub_ntfs_uuid (grub_device_t device, char **uuid)
       if (*uuid)
 	for (ptr = *uuid; *ptr; ptr++)
 	  *ptr = grub_toupper (*ptr);
-      free_file (&data->mmft);
-      free_file (&data->cmft);
-      grub_free (data);
+      free_data (data);
     }
   else
     *uuid = NULL;
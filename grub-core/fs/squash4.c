@@ -27,6 +27,7 @@
 #include <grub/fshelp.h>
 #include <grub/deflate.h>
 #include <grub/safemath.h>
+#include <grub/env.h>
 #include <minilzo.h>
 
 #include "xz.h"
@@ -190,6 +191,22 @@ enum
 #define SQUASH_CHUNK_SIZE 0x2000
 #define XZBUFSIZ 0x2000
 
+/* Decompressed metadata chunks and fragment blocks are kept in a small LRU
+   cache keyed by their on-disk offset.  Its size in bytes may be set with
+   the squash4_cache_size variable.  */
+#define SQUASH_CACHE_ENTRIES 64
+#define SQUASH_CACHE_DEFAULT_SIZE 0x200000
+
+struct grub_squash_cache_ent
+{
+  grub_disk_addr_t start;
+  grub_size_t csize;
+  grub_size_t len;
+  grub_size_t alloc;
+  grub_uint64_t last_used;
+  char *buf;
+};
+
 struct grub_squash_data
 {
   grub_disk_t disk;
@@ -203,6 +220,10 @@ struct grub_squash_data
 			      struct grub_squash_data *data);
   struct xz_dec *xzdec;
   char *xzbuf;
+  struct grub_squash_cache_ent cache[SQUASH_CACHE_ENTRIES];
+  grub_uint64_t cache_clock;
+  grub_size_t cache_size;
+  grub_size_t cache_used;
 };
 
 struct grub_fshelp_node
@@ -217,6 +238,89 @@ struct grub_fshelp_node
   } stack[1];
 };
 
+/* Return the contents of the compressed block of CSIZE bytes at disk offset
+   START, which expands to at most USIZE bytes.  *LEN receives the actual
+   decompressed size.  The buffer belongs to the cache and is only valid
+   until the next call.  */
+static const char *
+get_block (struct grub_squash_data *data, grub_disk_addr_t start,
+	   grub_size_t csize, grub_size_t usize, grub_size_t *len)
+{
+  struct grub_squash_cache_ent *e, *slot, *victim;
+  grub_ssize_t ret;
+  char *tmp;
+  unsigned i;
+
+  for (i = 0; i < SQUASH_CACHE_ENTRIES; i++)
+    {
+      e = &data->cache[i];
+      if (e->buf && e->start == start && e->csize == csize
+	  && e->alloc >= usize)
+	{
+	  e->last_used = ++data->cache_clock;
+	  *len = e->len;
+	  return e->buf;
+	}
+    }
+
+  /* Make room for the new block.  The block just requested is always
+     kept, even if it alone exceeds the budget.  */
+  while (1)
+    {
+      slot = NULL;
+      victim = NULL;
+      for (i = 0; i < SQUASH_CACHE_ENTRIES; i++)
+	{
+	  e = &data->cache[i];
+	  if (!e->buf)
+	    {
+	      if (!slot)
+		slot = e;
+	    }
+	  else if (!victim || e->last_used < victim->last_used)
+	    victim = e;
+	}
+      if (slot && (!victim || data->cache_used + usize <= data->cache_size))
+	break;
+      data->cache_used -= victim->alloc;
+      grub_free (victim->buf);
+      victim->buf = NULL;
+    }
+
+  tmp = grub_malloc (csize);
+  if (!tmp)
+    return NULL;
+  slot->buf = grub_malloc (usize);
+  if (!slot->buf)
+    {
+      grub_free (tmp);
+      return NULL;
+    }
+  if (grub_disk_read (data->disk, start >> GRUB_DISK_SECTOR_BITS,
+		      start & (GRUB_DISK_SECTOR_SIZE - 1), csize, tmp))
+    ret = -1;
+  else
+    ret = data->decompress (tmp, csize, 0, slot->buf, usize, data);
+  grub_free (tmp);
+  if (ret < 0)
+    {
+      grub_free (slot->buf);
+      slot->buf = NULL;
+      if (!grub_errno)
+	grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
+      return NULL;
+    }
+
+  slot->start = start;
+  slot->csize = csize;
+  slot->len = ret;
+  slot->alloc = usize;
+  slot->last_used = ++data->cache_clock;
+  data->cache_used += usize;
+  *len = ret;
+  return slot->buf;
+}
+
 static grub_err_t
 read_chunk (struct grub_squash_data *data, void *buf, grub_size_t len,
 	    grub_uint64_t chunk_start, grub_off_t offset)
@@ -255,29 +359,17 @@ read_chunk (struct grub_squash_data *data, void *buf, grub_size_t len,
 	}
       else
 	{
-	  char *tmp;
+	  const char *chunk;
 	  grub_size_t bsize = grub_le_to_cpu16 (d) & ~SQUASH_CHUNK_FLAGS; 
-	  grub_disk_addr_t a = chunk_start + 2;
-	  tmp = grub_malloc (bsize);
-	  if (!tmp)
-	    return grub_errno;
-	  /* FIXME: buffer uncompressed data.  */
-	  err = grub_disk_read (data->disk, (a >> GRUB_DISK_SECTOR_BITS),
-				a & (GRUB_DISK_SECTOR_SIZE - 1),
-				bsize, tmp);
-	  if (err)
-	    {
-	      grub_free (tmp);
-	      return err;
-	    }
+	  grub_size_t clen;
 
-	  if (data->decompress (tmp, bsize, offset,
-				buf, csize, data) < 0)
-	    {
-	      grub_free (tmp);
-	      return grub_errno;
-	    }
-	  grub_free (tmp);
+	  chunk = get_block (data, chunk_start + 2, bsize, SQUASH_CHUNK_SIZE,
+			     &clen);
+	  if (!chunk)
+	    return grub_errno;
+	  if (offset + csize > clen)
+	    return grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
+	  grub_memcpy (buf, chunk + offset, csize);
 	}
       len -= csize;
       offset += csize;
@@ -385,6 +477,7 @@ squash_mount (grub_disk_t disk)
   grub_err_t err;
   struct grub_squash_data *data;
   grub_uint64_t frag;
+  const char *env;
 
   err = grub_disk_read (disk, 0, 0, sizeof (sb), &sb);
   if (grub_errno == GRUB_ERR_OUT_OF_RANGE)
@@ -416,6 +509,17 @@ squash_mount (grub_disk_t disk)
   data->disk = disk;
   data->fragments = grub_le_to_cpu64 (frag);
 
+  env = grub_env_get ("squash4_cache_size");
+  data->cache_size = SQUASH_CACHE_DEFAULT_SIZE;
+  if (env)
+    {
+      const char *end;
+      unsigned long size = grub_strtoul (env, &end, 0);
+      if (grub_errno == GRUB_ERR_NONE && *end == '\0')
+	data->cache_size = size;
+      grub_errno = GRUB_ERR_NONE;
+    }
+
   switch (sb.compression)
     {
     case grub_cpu_to_le16_compile_time (COMPRESSION_ZLIB):
@@ -651,6 +755,10 @@ make_root_node (struct grub_squash_data *data, struct grub_fshelp_node *root)
 static void
 squash_unmount (struct grub_squash_data *data)
 {
+  unsigned i;
+
+  for (i = 0; i < SQUASH_CACHE_ENTRIES; i++)
+    grub_free (data->cache[i].buf);
   if (data->xzdec)
     xz_dec_end (data->xzdec);
   grub_free (data->xzbuf);
@@ -958,32 +1066,21 @@ grub_squash_read (grub_file_t file, char *buf, grub_size_t len)
   else
     b = grub_le_to_cpu32 (ino->ino.file.offset) + off;
   
-  /* FIXME: cache uncompressed chunks.  */
   if (compressed)
     {
-      char *block;
-      block = grub_malloc (grub_le_to_cpu32 (frag.size));
+      const char *block;
+      grub_size_t blen;
+
+      block = get_block (data, a, grub_le_to_cpu32 (frag.size),
+			 data->blksz, &blen);
       if (!block)
 	return -1;
-      err = grub_disk_read (data->disk,
-			    a >> GRUB_DISK_SECTOR_BITS,
-			    a & (GRUB_DISK_SECTOR_SIZE - 1),
-			    grub_le_to_cpu32 (frag.size), block);
-      if (err)
-	{
-	  grub_free (block);
-	  return -1;
-	}
-      if (data->decompress (block, grub_le_to_cpu32 (frag.size),
-			    b, buf, len, data)
-	  != (grub_ssize_t) len)
+      if (b > blen || len > blen - b)
 	{
-	  grub_free (block);
-	  if (!grub_errno)
-	    grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
+	  grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
 	  return -1;
 	}
-      grub_free (block);
+      grub_memcpy (buf, block + b, len);
     }
   else
     {
@@ -372,6 +372,29 @@ struct grub_udf_aed
   grub_uint32_t ae_len;
 } GRUB_PACKED;
 
+/* LENGTH bytes of a file starting at byte OFFSET, stored from block
+   START on, or not stored at all if START is 0.  */
+struct grub_udf_cached_extent
+{
+  grub_uint64_t offset;
+  grub_uint64_t length;
+  grub_uint32_t start;
+};
+
+/* The decoded allocation descriptors of the file entry at ICB_BLOCK.
+   EXTENTS is NULL if they couldn't be decoded.  */
+struct grub_udf_extent_cache
+{
+  int used;
+  grub_uint16_t part_ref;
+  grub_uint32_t icb_block;
+  grub_uint32_t last_used;
+  grub_size_t nextents;
+  struct grub_udf_cached_extent *extents;
+};
+
+#define GRUB_UDF_EXTENT_CACHE_SIZE	8
+
 struct grub_udf_data
 {
   grub_disk_t disk;
@@ -381,12 +404,15 @@ struct grub_udf_data
   struct grub_udf_partmap *pms[GRUB_UDF_MAX_PMS];
   struct grub_udf_long_ad root_icb;
   int npd, npm, lbshift;
+  struct grub_udf_extent_cache extent_cache[GRUB_UDF_EXTENT_CACHE_SIZE];
+  grub_uint32_t extent_clock;
 };
 
 struct grub_fshelp_node
 {
   struct grub_udf_data *data;
   int part_ref;
+  grub_uint32_t icb_block;
   union
   {
     struct grub_udf_file_entry fe;
@@ -447,6 +473,7 @@ grub_udf_read_icb (struct grub_udf_data *data,
     return grub_error (GRUB_ERR_BAD_FS, "invalid fe/efe descriptor");
 
   node->part_ref = icb->block.part_ref;
+  node->icb_block = icb->block.block_num;
   node->data = data;
   return 0;
 }
@@ -592,6 +619,252 @@ fail:
   return 0;
 }
 
+/* Decode the allocation descriptors of NODE, following the allocation
+   extent descriptors, into the sorted extent list of the mount.  Return
+   NULL if they couldn't be decoded and have to be walked for every
+   block instead.  */
+static struct grub_udf_extent_cache *
+grub_udf_load_extents (grub_fshelp_node_t node)
+{
+  struct grub_udf_data *data = node->data;
+  struct grub_udf_extent_cache *c, *victim = NULL;
+  struct grub_udf_cached_extent *extents = NULL, *tmp;
+  grub_size_t nextents = 0, alloc, adsize, sz;
+  grub_uint64_t offset = 0, filesize = U64 (node->block.fe.file_size);
+  grub_uint32_t bsize = U32 (data->lvd.bsize);
+  unsigned int idle = 0;
+  char *ptr, *buf = NULL;
+  grub_ssize_t len;
+  int i, is_short;
+
+  for (i = 0; i < GRUB_UDF_EXTENT_CACHE_SIZE; i++)
+    {
+      c = &data->extent_cache[i];
+      if (c->used && c->part_ref == node->part_ref
+	  && c->icb_block == node->icb_block)
+	{
+	  c->last_used = ++data->extent_clock;
+	  return c->extents ? c : NULL;
+	}
+      if (!victim || (victim->used && (!c->used
+				       || c->last_used < victim->last_used)))
+	victim = c;
+    }
+
+  /* Remember failures as well, so that the descriptors are not read
+     again for every block.  */
+  grub_free (victim->extents);
+  victim->used = 1;
+  victim->part_ref = node->part_ref;
+  victim->icb_block = node->icb_block;
+  victim->last_used = ++data->extent_clock;
+  victim->nextents = 0;
+  victim->extents = NULL;
+
+  switch (U16 (node->block.fe.tag.tag_ident))
+    {
+    case GRUB_UDF_TAG_IDENT_FE:
+      ptr = (char *) &node->block.fe.ext_attr[0] + U32 (node->block.fe.ext_attr_length);
+      len = U32 (node->block.fe.alloc_descs_length);
+      break;
+
+    case GRUB_UDF_TAG_IDENT_EFE:
+      ptr = (char *) &node->block.efe.ext_attr[0] + U32 (node->block.efe.ext_attr_length);
+      len = U32 (node->block.efe.alloc_descs_length);
+      break;
+
+    default:
+      return NULL;
+    }
+
+  /* Make sure there is something to keep, even for an empty file.  */
+  alloc = 16;
+  extents = grub_malloc (alloc * sizeof (extents[0]));
+  if (!extents)
+    goto fail;
+
+  if (ptr < node->block.raw || len < 0
+      || ptr + len > node->block.raw + (1 << (GRUB_DISK_SECTOR_BITS
+					      + data->lbshift)))
+    goto fail;
+
+  is_short = ((U16 (node->block.fe.icbtag.flags) & GRUB_UDF_ICBTAG_FLAG_AD_MASK)
+	      == GRUB_UDF_ICBTAG_FLAG_AD_SHORT);
+  adsize = is_short ? sizeof (struct grub_udf_short_ad)
+    : sizeof (struct grub_udf_long_ad);
+
+  while (offset < filesize && len >= (grub_ssize_t) adsize)
+    {
+      grub_uint32_t adlen, adtype, position;
+      grub_uint16_t part_ref;
+
+      if (is_short)
+	{
+	  struct grub_udf_short_ad *ad = (struct grub_udf_short_ad *) ptr;
+
+	  adlen = U32 (ad->length) & 0x3fffffff;
+	  adtype = U32 (ad->length) >> 30;
+	  position = ad->position;
+	  part_ref = node->part_ref;
+	}
+      else
+	{
+	  struct grub_udf_long_ad *ad = (struct grub_udf_long_ad *) ptr;
+
+	  adlen = U32 (ad->length) & 0x3fffffff;
+	  adtype = U32 (ad->length) >> 30;
+	  position = ad->block.block_num;
+	  part_ref = ad->block.part_ref;
+	}
+
+      if (adtype == 3)
+	{
+	  struct grub_udf_aed *extension;
+	  grub_disk_addr_t sec;
+
+	  /* Don't follow a chain of descriptors that leads nowhere.  */
+	  if (++idle > 16 || adlen < sizeof (*extension) || adlen > bsize)
+	    goto fail;
+
+	  sec = grub_udf_get_block (data, part_ref, position);
+	  if (grub_errno)
+	    goto fail;
+	  if (!buf)
+	    {
+	      buf = grub_malloc (bsize);
+	      if (!buf)
+		goto fail;
+	    }
+	  if (grub_disk_read (data->disk, sec << data->lbshift, 0, adlen, buf))
+	    goto fail;
+
+	  extension = (struct grub_udf_aed *) buf;
+	  if (U16 (extension->tag.tag_ident) != GRUB_UDF_TAG_IDENT_AED
+	      || U32 (extension->ae_len) > adlen - sizeof (*extension))
+	    goto fail;
+
+	  len = U32 (extension->ae_len);
+	  ptr = buf + sizeof (*extension);
+	  continue;
+	}
+
+      ptr += adsize;
+      len -= adsize;
+      if (!adlen)
+	continue;
+      idle = 0;
+
+      if (nextents == alloc)
+	{
+	  alloc *= 2;
+	  if (grub_mul (alloc, sizeof (extents[0]), &sz))
+	    goto fail;
+	  tmp = grub_realloc (extents, sz);
+	  if (!tmp)
+	    goto fail;
+	  extents = tmp;
+	}
+
+      extents[nextents].offset = offset;
+      extents[nextents].length = adlen;
+      if (U32 (position) & GRUB_UDF_EXT_MASK)
+	extents[nextents].start = 0;
+      else
+	{
+	  extents[nextents].start = grub_udf_get_block (data, part_ref,
+							position);
+	  if (grub_errno)
+	    goto fail;
+	}
+
+      /* Merge extents that continue each other on disk.  */
+      if (nextents && extents[nextents].start
+	  && extents[nextents - 1].start
+	  && (extents[nextents - 1].length & (bsize - 1)) == 0
+	  && (extents[nextents - 1].start
+	      + (extents[nextents - 1].length >> (GRUB_DISK_SECTOR_BITS
+						  + data->lbshift))
+	      == extents[nextents].start))
+	extents[nextents - 1].length += adlen;
+      else
+	nextents++;
+
+      offset += adlen;
+    }
+
+  grub_free (buf);
+
+  victim->nextents = nextents;
+  victim->extents = extents;
+  return victim;
+
+ fail:
+  grub_free (buf);
+  grub_free (extents);
+  grub_errno = GRUB_ERR_NONE;
+  return NULL;
+}
+
+/* Like grub_udf_read_block, but also store in COUNT how many blocks
+   follow FILEBLOCK contiguously on disk.  */
+static grub_disk_addr_t
+grub_udf_read_run (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		   grub_disk_addr_t *count)
+{
+  struct grub_udf_extent_cache *c;
+  struct grub_udf_cached_extent *e;
+  grub_uint32_t bsize = U32 (node->data->lvd.bsize);
+  grub_uint64_t filebytes, rel;
+  grub_size_t lo = 0, hi;
+
+  c = grub_udf_load_extents (node);
+  if (!c)
+    {
+      *count = 1;
+      return grub_udf_read_block (node, fileblock);
+    }
+
+  /* Find the last extent starting at or before FILEBLOCK.  */
+  filebytes = fileblock * bsize;
+  hi = c->nextents;
+  while (lo < hi)
+    {
+      grub_size_t mid = lo + (hi - lo) / 2;
+
+      if (c->extents[mid].offset <= filebytes)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  *count = 1;
+  if (lo == 0)
+    return 0;
+
+  e = &c->extents[lo - 1];
+  rel = filebytes - e->offset;
+  if (rel >= e->length)
+    return 0;
+
+  *count = (e->length - rel + bsize - 1) / bsize;
+  if (!e->start)
+    return 0;
+  return e->start + (rel >> (GRUB_DISK_SECTOR_BITS + node->data->lbshift));
+}
+
+static void
+grub_udf_unmount (struct grub_udf_data *data)
+{
+  int i;
+
+  if (!data)
+    return;
+
+  for (i = 0; i < GRUB_UDF_EXTENT_CACHE_SIZE; i++)
+    grub_free (data->extent_cache[i].extents);
+  grub_free (data);
+}
+
 static grub_ssize_t
 grub_udf_read_file (grub_fshelp_node_t node,
 		    grub_disk_read_hook_t read_hook, void *read_hook_data,
@@ -619,11 +892,11 @@ grub_udf_read_file (grub_fshelp_node_t node,
       return 0;
     }
 
-  return grub_fshelp_read_file (node->data->disk, node,
-				read_hook, read_hook_data,
-				pos, len, buf, grub_udf_read_block,
-				U64 (node->block.fe.file_size),
-				node->data->lbshift, 0);
+  return grub_fshelp_read_file_runs (node->data->disk, node,
+				     read_hook, read_hook_data,
+				     pos, len, buf, grub_udf_read_run,
+				     U64 (node->block.fe.file_size),
+				     node->data->lbshift, 0);
 }
 
 static unsigned sblocklist[] = { 256, 512, 0 };
@@ -637,7 +910,7 @@ grub_udf_mount (grub_disk_t disk)
   grub_uint32_t block, vblock;
   int i, lbshift;
 
-  data = grub_malloc (sizeof (struct grub_udf_data));
+  data = grub_zalloc (sizeof (struct grub_udf_data));
   if (!data)
     return 0;
 
@@ -836,7 +1109,7 @@ grub_udf_mount (grub_disk_t disk)
   return data;
 
 fail:
-  grub_free (data);
+  grub_udf_unmount (data);
   return 0;
 }
 
@@ -853,7 +1126,7 @@ grub_udf_get_cluster_sector (grub_disk_t disk, grub_uint64_t *sec_per_lcn)
 
   ret = U32 (data->pds[data->pms[0]->type1.part_num].start);
   *sec_per_lcn = 1ULL << data->lbshift;
-  grub_free (data);
+  grub_udf_unmount (data);
   return ret;
 }
 #endif
@@ -1192,7 +1465,7 @@ grub_udf_dir (grub_device_t device, const char *path,
 fail:
   grub_free (rootnode);
 
-  grub_free (data);
+  grub_udf_unmount (data);
 
   grub_dl_unref (my_mod);
 
@@ -1236,7 +1509,7 @@ grub_udf_open (struct grub_file *file, const char *name)
 fail:
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_udf_unmount (data);
   grub_free (rootnode);
 
   return grub_errno;
@@ -1258,7 +1531,7 @@ grub_udf_close (grub_file_t file)
     {
       struct grub_fshelp_node *node = (struct grub_fshelp_node *) file->data;
 
-      grub_free (node->data);
+      grub_udf_unmount (node->data);
       grub_free (node);
     }
 
@@ -1276,7 +1549,7 @@ grub_udf_label (grub_device_t device, char **label)
   if (data)
     {
       *label = read_dstring (data->lvd.ident, sizeof (data->lvd.ident));
-      grub_free (data);
+      grub_udf_unmount (data);
     }
   else
     *label = 0;
@@ -1357,7 +1630,7 @@ grub_udf_uuid (grub_device_t device, char **uuid)
         }
       else
         *uuid = 0;
-      grub_free (data);
+      grub_udf_unmount (data);
     }
   else
     *uuid = 0;
@@ -245,6 +245,11 @@ struct grub_ufs_data
   int ino;
   int linknest;
   int log2_blksz;
+
+  /* The indirect block last read at every level, counted from the data
+     blocks up.  */
+  grub_disk_addr_t indir_blk[GRUB_UFS_INDIRBLKS];
+  grub_ufs_blk_t *indir[GRUB_UFS_INDIRBLKS];
 };
 
 static grub_dl_t my_mod;
@@ -254,82 +259,127 @@ static grub_err_t grub_ufs_find_file (struct grub_ufs_data *data,
 				      const char *path);
 
 
+static void
+grub_ufs_unmount (struct grub_ufs_data *data)
+{
+  int i;
+
+  if (!data)
+    return;
+
+  for (i = 0; i < GRUB_UFS_INDIRBLKS; i++)
+    grub_free (data->indir[i]);
+  grub_free (data);
+}
+
+/* Return the indirect block BLK, which is LEVEL levels above the data
+   blocks.  */
+static const grub_ufs_blk_t *
+grub_ufs_get_indir (struct grub_ufs_data *data, int level,
+		    grub_disk_addr_t blk)
+{
+  struct grub_ufs_sblock *sblock = &data->sblock;
+
+  if (data->indir[level] && data->indir_blk[level] == blk)
+    return data->indir[level];
+
+  if (!data->indir[level])
+    {
+      data->indir[level] = grub_malloc (UFS_BLKSZ (sblock));
+      if (!data->indir[level])
+	return NULL;
+    }
+
+  if (grub_disk_read (data->disk,
+		      blk << grub_ufs_to_cpu32 (data->sblock.log2_blksz),
+		      0, UFS_BLKSZ (sblock), data->indir[level]))
+    {
+      data->indir_blk[level] = 0;
+      return NULL;
+    }
+  data->indir_blk[level] = blk;
+
+  return data->indir[level];
+}
+
+/* Map the file block BLK to a disk block and store in *COUNT how many
+   blocks continue from there, on disk or as a hole.  Block numbers count
+   fragments, so consecutive blocks are FRAGS apart.  */
 static grub_disk_addr_t
-grub_ufs_get_file_block (struct grub_ufs_data *data, grub_disk_addr_t blk)
+grub_ufs_get_file_block (struct grub_ufs_data *data, grub_disk_addr_t blk,
+			 grub_disk_addr_t *count)
 {
-  unsigned long indirsz;
-  int log2_blksz, log_indirsz;
+  struct grub_ufs_sblock *sblock = &data->sblock;
+  grub_disk_addr_t frags, ptr, span, n;
+  const grub_ufs_blk_t *indir = NULL;
+  unsigned long indirsz, idx = 0;
+  int log_indirsz, level;
+
+  *count = 1;
+
+  frags = UFS_BLKSZ (sblock) >> (grub_ufs_to_cpu32 (sblock->log2_blksz)
+				  + GRUB_DISK_SECTOR_BITS);
+  if (!frags)
+    frags = 1;
 
   /* Direct.  */
   if (blk < GRUB_UFS_DIRBLKS)
-    return INODE_DIRBLOCKS (data, blk);
-
-  log2_blksz = grub_ufs_to_cpu32 (data->sblock.log2_blksz);
+    {
+      ptr = INODE_DIRBLOCKS (data, blk);
+      for (n = 1; blk + n < GRUB_UFS_DIRBLKS; n++)
+	if (INODE_DIRBLOCKS (data, blk + n) != (ptr ? ptr + n * frags : 0))
+	  break;
+      *count = n;
+      return ptr;
+    }
 
   blk -= GRUB_UFS_DIRBLKS;
 
   log_indirsz = data->log2_blksz - LOG_INODE_BLKSZ;
   indirsz = 1 << log_indirsz;
 
-  /* Single indirect block.  */
-  if (blk < indirsz)
+  /* Find out whether the single, double or triple indirect block maps
+     BLK.  */
+  for (level = 0; level < GRUB_UFS_INDIRBLKS; level++)
     {
-      grub_ufs_blk_t indir;
-      grub_disk_read (data->disk,
-		      ((grub_disk_addr_t) INODE_INDIRBLOCKS (data, 0))
-		      << log2_blksz,
-		      blk * sizeof (indir), sizeof (indir), &indir);
-      return indir;
+      span = (grub_disk_addr_t) 1 << (log_indirsz * (level + 1));
+      if (blk < span)
+	break;
+      blk -= span;
     }
-  blk -= indirsz;
 
-  /* Double indirect block.  */
-  if (blk < (grub_disk_addr_t) indirsz * (grub_disk_addr_t) indirsz)
+  if (level == GRUB_UFS_INDIRBLKS)
     {
-      grub_ufs_blk_t indir;
-
-      grub_disk_read (data->disk,
-		      ((grub_disk_addr_t) INODE_INDIRBLOCKS (data, 1))
-		      << log2_blksz,
-		      (blk >> log_indirsz) * sizeof (indir),
-		      sizeof (indir), &indir);
-      grub_disk_read (data->disk,
-		      grub_ufs_to_cpu_blk (indir) << log2_blksz,
-		      (blk & ((1 << log_indirsz) - 1)) * sizeof (indir),
-		      sizeof (indir), &indir);
-
-      return indir;
+      grub_error (GRUB_ERR_BAD_FS,
+		  "ufs does not support quadruple indirect blocks");
+      return 0;
     }
 
-  blk -= (grub_disk_addr_t) indirsz * (grub_disk_addr_t) indirsz;
-
-  /* Triple indirect block.  */
-  if (!(blk >> (3 * log_indirsz)))
+  ptr = INODE_INDIRBLOCKS (data, level);
+  for (; level >= 0; level--)
     {
-      grub_ufs_blk_t indir;
-
-      grub_disk_read (data->disk,
-		      ((grub_disk_addr_t) INODE_INDIRBLOCKS (data, 2))
-		      << log2_blksz,
-		      (blk >> (2 * log_indirsz)) * sizeof (indir),
-		      sizeof (indir), &indir);
-      grub_disk_read (data->disk,
-		      grub_ufs_to_cpu_blk (indir) << log2_blksz,
-		      ((blk >> log_indirsz)
-		       & ((1 << log_indirsz) - 1)) * sizeof (indir),
-		      sizeof (indir), &indir);
-
-      grub_disk_read (data->disk,
-		      grub_ufs_to_cpu_blk (indir) << log2_blksz,
-		      (blk & ((1 << log_indirsz) - 1)) * sizeof (indir),
-		      sizeof (indir), &indir);
-
-      return indir;
+      /* Everything below a missing indirect block is a hole.  */
+      if (!ptr)
+	{
+	  span = (grub_disk_addr_t) 1 << (log_indirsz * (level + 1));
+	  *count = span - (blk & (span - 1));
+	  return 0;
+	}
+
+      indir = grub_ufs_get_indir (data, level, ptr);
+      if (!indir)
+	return 0;
+
+      idx = (blk >> (log_indirsz * level)) & (indirsz - 1);
+      ptr = grub_ufs_to_cpu_blk (indir[idx]);
     }
 
-  grub_error (GRUB_ERR_BAD_FS,
-	      "ufs does not support quadruple indirect blocks");
-  return 0;
+  for (n = 1; idx + n < indirsz; n++)
+    if (grub_ufs_to_cpu_blk (indir[idx + n]) != (ptr ? ptr + n * frags : 0))
+      break;
+  *count = n;
+
+  return ptr;
 }
 
 
@@ -343,6 +393,7 @@ grub_ufs_read_file (struct grub_ufs_data *data,
   struct grub_ufs_sblock *sblock = &data->sblock;
   grub_off_t i;
   grub_off_t blockcnt;
+  grub_disk_addr_t count;
 
   /* Adjust len so it we can't read past the end of the file.  */
   if (len + pos > INODE_SIZE (data))
@@ -350,27 +401,31 @@ grub_ufs_read_file (struct grub_ufs_data *data,
 
   blockcnt = (len + pos + UFS_BLKSZ (sblock) - 1) >> UFS_LOG_BLKSZ (sblock);
 
-  for (i = pos >> UFS_LOG_BLKSZ (sblock); i < blockcnt; i++)
+  for (i = pos >> UFS_LOG_BLKSZ (sblock); i < blockcnt; i += count)
     {
       grub_disk_addr_t blknr;
       grub_off_t blockoff;
-      grub_off_t blockend = UFS_BLKSZ (sblock);
+      grub_off_t blockend;
 
       int skipfirst = 0;
 
       blockoff = pos & (UFS_BLKSZ (sblock) - 1);
 
-      blknr = grub_ufs_get_file_block (data, i);
+      blknr = grub_ufs_get_file_block (data, i, &count);
       if (grub_errno)
 	return -1;
 
+      if (count > blockcnt - i)
+	count = blockcnt - i;
+      blockend = count << UFS_LOG_BLKSZ (sblock);
+
       /* Last block.  */
-      if (i == blockcnt - 1)
+      if (i + count == blockcnt)
 	{
-	  blockend = (len + pos) & (UFS_BLKSZ (sblock) - 1);
+	  grub_off_t end = (len + pos) & (UFS_BLKSZ (sblock) - 1);
 
-	  if (!blockend)
-	    blockend = UFS_BLKSZ (sblock);
+	  if (end)
+	    blockend -= UFS_BLKSZ (sblock) - end;
 	}
 
       /* First block.  */
@@ -396,7 +451,7 @@ grub_ufs_read_file (struct grub_ufs_data *data,
       else
 	grub_memset (buf, 0, blockend);
 
-      buf += UFS_BLKSZ (sblock) - skipfirst;
+      buf += blockend;
     }
 
   return len;
@@ -594,7 +649,7 @@ grub_ufs_mount (grub_disk_t disk)
   struct grub_ufs_data *data;
   int *sblklist = sblocklist;
 
-  data = grub_malloc (sizeof (struct grub_ufs_data));
+  data = grub_zalloc (sizeof (struct grub_ufs_data));
   if (!data)
     return 0;
 
@@ -635,7 +690,7 @@ grub_ufs_mount (grub_disk_t disk)
 #endif
     }
 
-  grub_free (data);
+  grub_ufs_unmount (data);
 
   return 0;
 }
@@ -730,7 +785,7 @@ grub_ufs_dir (grub_device_t device, const char *path,
     }
 
  fail:
-  grub_free (data);
+  grub_ufs_unmount (data);
 
   return grub_errno;
 }
@@ -748,7 +803,7 @@ grub_ufs_open (struct grub_file *file, const char *name)
   grub_ufs_read_inode (data, 2, 0);
   if (grub_errno)
     {
-      grub_free (data);
+      grub_ufs_unmount (data);
       return grub_errno;
     }
 
@@ -761,7 +816,7 @@ grub_ufs_open (struct grub_file *file, const char *name)
   grub_ufs_find_file (data, name);
   if (grub_errno)
     {
-      grub_free (data);
+      grub_ufs_unmount (data);
       return grub_errno;
     }
 
@@ -786,7 +841,7 @@ grub_ufs_read (grub_file_t file, char *buf, grub_size_t len)
 static grub_err_t
 grub_ufs_close (grub_file_t file)
 {
-  grub_free (file->data);
+  grub_ufs_unmount (file->data);
 
   return GRUB_ERR_NONE;
 }
@@ -806,7 +861,7 @@ grub_ufs_label (grub_device_t device, char **label)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_ufs_unmount (data);
 
   return grub_errno;
 }
@@ -829,7 +884,7 @@ grub_ufs_uuid (grub_device_t device, char **uuid)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_ufs_unmount (data);
 
   return grub_errno;
 }
@@ -857,7 +912,7 @@ grub_ufs_mtime (grub_device_t device, grub_int32_t *tm)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_ufs_unmount (data);
 
   return grub_errno;
 }
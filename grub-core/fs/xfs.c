@@ -211,6 +211,14 @@ struct grub_xfs_dirblock_tail
   grub_uint32_t leaf_stale;
 } GRUB_PACKED;
 
+/* An extent of a file, decoded.  START is a disk block, not an FSB.  */
+struct grub_xfs_cached_extent
+{
+  grub_uint64_t offset;
+  grub_uint64_t size;
+  grub_disk_addr_t start;
+};
+
 struct grub_fshelp_node
 {
   struct grub_xfs_data *data;
@@ -228,6 +236,12 @@ struct grub_xfs_data
   grub_uint32_t agsize;
   unsigned int hasftype:1;
   unsigned int hascrc:1;
+  /* Extent list of the open file, loaded on its first read.  */
+  unsigned int cache_extents:1;
+  unsigned int extents_loaded:1;
+  struct grub_xfs_cached_extent *extents;
+  grub_size_t nextents;
+  /* Must be last, the inode is followed by the rest of its fork.  */
   struct grub_fshelp_node diropen;
 };
 
@@ -615,6 +629,219 @@ grub_xfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 }
 
 
+/* Append the NREC extents at EXTS to the extent list of DATA, which has
+   room for ALLOC of them.  Return 0 if they don't fit or are out of
+   order.  */
+static int
+grub_xfs_add_extents (struct grub_xfs_data *data, grub_size_t alloc,
+		      struct grub_xfs_extent *exts, int nrec)
+{
+  int ex;
+
+  if ((grub_size_t) nrec > alloc - data->nextents)
+    return 0;
+
+  for (ex = 0; ex < nrec; ex++)
+    {
+      struct grub_xfs_cached_extent *e = &data->extents[data->nextents];
+
+      e->offset = GRUB_XFS_EXTENT_OFFSET (exts, ex);
+      e->size = GRUB_XFS_EXTENT_SIZE (exts, ex);
+      e->start = GRUB_XFS_FSB_TO_BLOCK (data, GRUB_XFS_EXTENT_BLOCK (exts, ex));
+
+      if (data->nextents
+	  && e->offset < e[-1].offset + e[-1].size)
+	return 0;
+      data->nextents++;
+    }
+
+  return 1;
+}
+
+/* Decode all extents of the open file into DATA->extents, walking the
+   leaves of the bmap btree from left to right.  If the file can't be
+   described this way DATA->extents stays NULL and blocks are mapped
+   one by one.  */
+static grub_err_t
+grub_xfs_load_extents (struct grub_xfs_data *data)
+{
+  struct grub_fshelp_node *node = &data->diropen;
+  struct grub_xfs_btree_node *leaf = NULL;
+  grub_size_t alloc;
+  int ok = 0;
+
+  data->extents_loaded = 1;
+
+  alloc = grub_be_to_cpu32 (node->inode.nextents);
+  if (alloc == 0)
+    return GRUB_ERR_NONE;
+
+  /* Extents kept in the inode have to fit into its data fork, anything
+     else is left to the per-block lookup.  */
+  if (node->inode.format == XFS_INODE_FORMAT_EXT)
+    {
+      grub_size_t fork_size;
+
+      fork_size = grub_xfs_inode_size (data)
+	- (grub_xfs_inode_data (&node->inode) - (char *) &node->inode);
+      if (node->inode.fork_offset
+	  && ((grub_size_t) node->inode.fork_offset << 3) < fork_size)
+	fork_size = (grub_size_t) node->inode.fork_offset << 3;
+      if (alloc > fork_size / sizeof (struct grub_xfs_extent))
+	return GRUB_ERR_NONE;
+    }
+
+  data->extents = grub_calloc (alloc, sizeof (*data->extents));
+  if (! data->extents)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return GRUB_ERR_NONE;
+    }
+  data->nextents = 0;
+
+  if (node->inode.format == XFS_INODE_FORMAT_EXT)
+    ok = grub_xfs_add_extents (data, alloc, (struct grub_xfs_extent *)
+			       grub_xfs_inode_data (&node->inode), alloc);
+  else if (node->inode.format == XFS_INODE_FORMAT_BTREE)
+    {
+      struct grub_xfs_btree_root *root;
+      const char *keys;
+      int recoffset;
+      grub_uint64_t fsb;
+
+      leaf = grub_malloc (data->bsize);
+      if (! leaf)
+	goto out;
+
+      root = (struct grub_xfs_btree_root *) grub_xfs_inode_data (&node->inode);
+      keys = (char *) &root->keys[0];
+      if (node->inode.fork_offset)
+	recoffset = (node->inode.fork_offset - 1) / 2;
+      else
+	recoffset = (grub_xfs_inode_size (data)
+		     - ((char *) keys - (char *) &node->inode))
+	  / (2 * sizeof (grub_uint64_t));
+      if (root->numrecs == 0)
+	goto out;
+
+      /* Go down the leftmost path.  */
+      fsb = get_fsb (keys, recoffset);
+      while (1)
+	{
+	  if (grub_disk_read (data->disk,
+			      GRUB_XFS_FSB_TO_BLOCK (data, fsb)
+			      << (data->sblock.log2_bsize - GRUB_DISK_SECTOR_BITS),
+			      0, data->bsize, leaf))
+	    goto out;
+
+	  if ((!data->hascrc &&
+	       grub_strncmp ((char *) leaf->magic, "BMAP", 4)) ||
+	      (data->hascrc &&
+	       grub_strncmp ((char *) leaf->magic, "BMA3", 4)))
+	    goto out;
+
+	  keys = grub_xfs_btree_keys (data, leaf);
+	  if (leaf->level == 0)
+	    break;
+	  if (leaf->numrecs == 0)
+	    goto out;
+	  recoffset = ((data->bsize - ((char *) keys - (char *) leaf))
+		       / (2 * sizeof (grub_uint64_t)));
+	  fsb = get_fsb (keys, recoffset);
+	}
+
+      /* Then follow the sibling pointers.  */
+      while (1)
+	{
+	  if (! grub_xfs_add_extents (data, alloc,
+				      (struct grub_xfs_extent *) keys,
+				      grub_be_to_cpu16 (leaf->numrecs)))
+	    goto out;
+
+	  fsb = grub_be_to_cpu64 (leaf->right);
+	  if (fsb == ~(grub_uint64_t) 0)
+	    break;
+
+	  if (grub_disk_read (data->disk,
+			      GRUB_XFS_FSB_TO_BLOCK (data, fsb)
+			      << (data->sblock.log2_bsize - GRUB_DISK_SECTOR_BITS),
+			      0, data->bsize, leaf))
+	    goto out;
+
+	  if ((!data->hascrc &&
+	       grub_strncmp ((char *) leaf->magic, "BMAP", 4)) ||
+	      (data->hascrc &&
+	       grub_strncmp ((char *) leaf->magic, "BMA3", 4))
+	      || leaf->level != 0)
+	    goto out;
+	}
+      ok = 1;
+    }
+
+ out:
+  grub_free (leaf);
+  if (! ok)
+    {
+      grub_free (data->extents);
+      data->extents = NULL;
+      data->nextents = 0;
+    }
+  return grub_errno;
+}
+
+/* Map FILEBLOCK of NODE to a disk block and store the number of blocks
+   contiguous from there in *COUNT.  */
+static grub_disk_addr_t
+grub_xfs_read_run (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		   grub_disk_addr_t *count)
+{
+  struct grub_xfs_data *data = node->data;
+  struct grub_xfs_cached_extent *e;
+  grub_size_t lo = 0, hi;
+
+  if (node != &data->diropen || ! data->cache_extents)
+    goto single;
+
+  if (! data->extents_loaded && grub_xfs_load_extents (data))
+    return 0;
+  if (! data->extents)
+    goto single;
+
+  /* Find the last extent starting at or before FILEBLOCK.  */
+  hi = data->nextents;
+  while (lo < hi)
+    {
+      grub_size_t mid = lo + (hi - lo) / 2;
+
+      if (data->extents[mid].offset <= fileblock)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  if (lo > 0)
+    {
+      e = &data->extents[lo - 1];
+      if (fileblock - e->offset < e->size)
+	{
+	  *count = e->size - (fileblock - e->offset);
+	  return e->start + (fileblock - e->offset);
+	}
+    }
+
+  /* Sparse up to the next extent.  */
+  if (lo < data->nextents)
+    *count = data->extents[lo].offset - fileblock;
+  else
+    *count = ~(grub_disk_addr_t) 0;
+  return 0;
+
+ single:
+  *count = 1;
+  return grub_xfs_read_block (node, fileblock);
+}
+
+
 /* Read LEN bytes from the file described by DATA starting with byte
    POS.  Return the amount of read bytes in READ.  */
 static grub_ssize_t
@@ -622,9 +849,9 @@ grub_xfs_read_file (grub_fshelp_node_t node,
 		    grub_disk_read_hook_t read_hook, void *read_hook_data,
 		    grub_off_t pos, grub_size_t len, char *buf, grub_uint32_t header_size)
 {
-  return grub_fshelp_read_file (node->data->disk, node,
-				read_hook, read_hook_data,
-				pos, len, buf, grub_xfs_read_block,
+  return grub_fshelp_read_file_runs (node->data->disk, node,
+				     read_hook, read_hook_data,
+				     pos, len, buf, grub_xfs_read_run,
 				grub_be_to_cpu64 (node->inode.size) + header_size,
 				node->data->sblock.log2_bsize
 				- GRUB_DISK_SECTOR_BITS, 0);
@@ -1042,6 +1269,8 @@ grub_xfs_open (struct grub_file *file, const char *name)
       grub_free (fdiro);
     }
 
+  data->cache_extents = 1;
+
   file->size = grub_be_to_cpu64 (data->diropen.inode.size);
   file->data = data;
   file->offset = 0;
@@ -1075,7 +1304,10 @@ grub_xfs_read (grub_file_t file, char *buf, grub_size_t len)
 static grub_err_t
 grub_xfs_close (grub_file_t file)
 {
-  grub_free (file->data);
+  struct grub_xfs_data *data = file->data;
+
+  grub_free (data->extents);
+  grub_free (data);
 
   grub_dl_unref (my_mod);
 
@@ -238,6 +238,9 @@ struct grub_zfs_data
   grub_uint64_t file_start;
   grub_uint64_t file_end;
 
+  /* first block of the open file not yet covered by read-ahead */
+  grub_uint64_t prefetch_end;
+
   /* cache for a dnode block */
   dnode_phys_t *dnode_buf;
   dnode_phys_t *dnode_mdn;
@@ -259,6 +262,37 @@ struct grub_zfs_data
   grub_uint64_t guid;
 };
 
+/*
+ * Verified and decompressed blocks are kept in an LRU cache shared by all
+ * mounts, so that indirect blocks and metadata read by one open are still
+ * around for the next one.  A block is identified by the pool it belongs
+ * to together with its first DVA, birth txg and checksum.  Encrypted
+ * blocks are never cached so that every read of them goes through the
+ * keyring of the dataset asking for it.
+ */
+#define ZFS_CACHE_ENTRIES 256
+#define ZFS_CACHE_SIZE (8 << 20)
+
+/* Sequential reads pull in up to this much of the following file blocks
+   with a single device read.  */
+#define ZFS_PREFETCH_BLOCKS 16
+#define ZFS_PREFETCH_SIZE (2 << 20)
+
+struct zfs_cache_ent
+{
+  grub_uint64_t guid;
+  dva_t dva;
+  grub_uint64_t birth;
+  zio_cksum_t cksum;
+  grub_size_t size;
+  grub_uint64_t last_used;
+  void *buf;
+};
+
+static struct zfs_cache_ent zfs_cache[ZFS_CACHE_ENTRIES];
+static grub_uint64_t zfs_cache_clock;
+static grub_size_t zfs_cache_used;
+
 /* Context for grub_zfs_dir.  */
 struct grub_zfs_dir_ctx
 {
@@ -1845,13 +1879,94 @@ decode_embedded_bp_compressed(const blkptr_t *bp, void *buf)
   return GRUB_ERR_NONE;
 }
 
+static struct zfs_cache_ent *
+zfs_cache_find (const blkptr_t *bp, grub_size_t size,
+		struct grub_zfs_data *data)
+{
+  unsigned i;
+
+  for (i = 0; i < ZFS_CACHE_ENTRIES; i++)
+    {
+      struct zfs_cache_ent *e = &zfs_cache[i];
+      if (e->buf && e->size == size && e->guid == data->guid
+	  && e->birth == bp->blk_birth
+	  && grub_memcmp (&e->dva, &bp->blk_dva[0], sizeof (e->dva)) == 0
+	  && grub_memcmp (&e->cksum, &bp->blk_cksum, sizeof (e->cksum)) == 0)
+	return e;
+    }
+  return NULL;
+}
+
+static void
+zfs_cache_insert (const blkptr_t *bp, const void *buf, grub_size_t size,
+		  struct grub_zfs_data *data)
+{
+  struct zfs_cache_ent *slot, *victim;
+  unsigned i;
+
+  if (size > ZFS_CACHE_SIZE / 4 || zfs_cache_find (bp, size, data))
+    return;
+
+  while (1)
+    {
+      slot = NULL;
+      victim = NULL;
+      for (i = 0; i < ZFS_CACHE_ENTRIES; i++)
+	{
+	  struct zfs_cache_ent *e = &zfs_cache[i];
+	  if (!e->buf)
+	    {
+	      if (!slot)
+		slot = e;
+	    }
+	  else if (!victim || e->last_used < victim->last_used)
+	    victim = e;
+	}
+      if (slot && zfs_cache_used + size <= ZFS_CACHE_SIZE)
+	break;
+      zfs_cache_used -= victim->size;
+      grub_free (victim->buf);
+      victim->buf = NULL;
+    }
+
+  slot->buf = grub_malloc (size);
+  if (!slot->buf)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  grub_memcpy (slot->buf, buf, size);
+  slot->guid = data->guid;
+  slot->dva = bp->blk_dva[0];
+  slot->birth = bp->blk_birth;
+  slot->cksum = bp->blk_cksum;
+  slot->size = size;
+  slot->last_used = ++zfs_cache_clock;
+  zfs_cache_used += size;
+}
+
+static void
+zfs_cache_free (void)
+{
+  unsigned i;
+
+  for (i = 0; i < ZFS_CACHE_ENTRIES; i++)
+    {
+      grub_free (zfs_cache[i].buf);
+      zfs_cache[i].buf = NULL;
+    }
+  zfs_cache_used = 0;
+}
+
 /*
  * Read in a block of data, verify its checksum, decompress if needed,
- * and put the uncompressed data in buf.
+ * and put the uncompressed data in buf.  If raw isn't NULL it holds the
+ * block as stored on disk and no device is read.
  */
 static grub_err_t
-zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf, 
-	  grub_size_t *size, struct grub_zfs_data *data)
+zio_read_common (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
+		 grub_size_t *size, struct grub_zfs_data *data,
+		 const void *raw)
 {
   grub_size_t lsize, psize;
   unsigned int comp, encrypted;
@@ -1895,6 +2010,20 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
     return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
 		       "compression algorithm %s not supported\n", decomp_table[comp].name);
 
+  if (!BP_IS_EMBEDDED(bp) && !encrypted && lsize)
+    {
+      struct zfs_cache_ent *e = zfs_cache_find (bp, lsize, data);
+      if (e)
+	{
+	  *buf = grub_malloc (lsize);
+	  if (!*buf)
+	    return grub_errno;
+	  grub_memcpy (*buf, e->buf, lsize);
+	  e->last_used = ++zfs_cache_clock;
+	  return GRUB_ERR_NONE;
+	}
+    }
+
   if (comp != ZIO_COMPRESS_OFF)
     /* It's not really necessary to align to 16, just for safety.  */
     compbuf = grub_malloc (ALIGN_UP (psize, 16));
@@ -1908,7 +2037,13 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
     err = decode_embedded_bp_compressed(bp, compbuf);
   else
     {
-      err = zio_read_data (bp, endian, compbuf, data);
+      if (raw)
+	{
+	  grub_memcpy (compbuf, raw, psize);
+	  err = GRUB_ERR_NONE;
+	}
+      else
+	err = zio_read_data (bp, endian, compbuf, data);
       /* FIXME is it really necessary? */
       if (comp != ZIO_COMPRESS_OFF)
 	grub_memset (compbuf + psize, 0, ALIGN_UP (psize, 16) - psize);
@@ -1999,9 +2134,19 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
 	}
     }
 
+  if (!BP_IS_EMBEDDED(bp) && !encrypted && lsize)
+    zfs_cache_insert (bp, *buf, lsize, data);
+
   return GRUB_ERR_NONE;
 }
 
+static grub_err_t
+zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
+	  grub_size_t *size, struct grub_zfs_data *data)
+{
+  return zio_read_common (bp, endian, buf, size, data, NULL);
+}
+
 /*
  * Get the block from a block id.
  * push the block onto the stack.
@@ -2074,6 +2219,139 @@ dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf,
   return err;
 }
 
+/*
+ * Pull the level 0 blocks of dn starting at blkid into the block cache.
+ * Blocks that follow each other on the same non-RAIDZ vdev are fetched
+ * with a single device read.  Anything unusual is left for dmu_read.
+ * Returns the first block id not covered.
+ */
+static grub_uint64_t
+dmu_prefetch (dnode_end_t * dn, grub_uint64_t blkid,
+	      struct grub_zfs_data *data)
+{
+  int level;
+  int epbs = dn->dn.dn_indblkshift - SPA_BLKPTRSHIFT;
+  blkptr_t *bp_array = dn->dn.dn_blkptr;
+  blkptr_t bp;
+  void *tmpbuf;
+  grub_zfs_endian_t endian = dn->endian;
+  struct grub_zfs_device_desc *desc = NULL;
+  grub_uint64_t idx, nbps, first, start = 0, end = 0;
+  grub_uint64_t vdev = 0;
+  char *raw;
+  unsigned i, n;
+  grub_err_t err;
+
+  for (level = dn->dn.dn_nlevels - 1; level > 0; level--)
+    {
+      bp = bp_array[(blkid >> (epbs * level)) & ((1 << epbs) - 1)];
+      if (bp_array != dn->dn.dn_blkptr)
+	grub_free (bp_array);
+      bp_array = dn->dn.dn_blkptr;
+      if (BP_IS_HOLE (&bp))
+	return blkid + 1;
+      err = zio_read (&bp, endian, &tmpbuf, 0, data);
+      endian = (grub_zfs_to_cpu64 (bp.blk_prop, endian) >> 63) & 1;
+      if (err)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return blkid + 1;
+	}
+      bp_array = tmpbuf;
+    }
+
+  if (dn->dn.dn_nlevels > 1)
+    {
+      idx = blkid & ((1 << epbs) - 1);
+      nbps = 1ULL << epbs;
+    }
+  else
+    {
+      idx = blkid;
+      nbps = dn->dn.dn_nblkptr;
+    }
+
+  /* Find the run of adjacent blocks.  */
+  for (first = idx; idx < nbps && idx - first < ZFS_PREFETCH_BLOCKS; idx++)
+    {
+      const dva_t *dva = &bp_array[idx].blk_dva[0];
+      grub_uint64_t w0 = grub_zfs_to_cpu64 (dva->dva_word[0], endian);
+      grub_uint64_t offset = dva_get_offset (dva, endian);
+      grub_uint64_t asize = BF64_GET_SB (w0, 0, 24, SPA_MINBLOCKSHIFT, 0);
+      grub_size_t psize = get_psize (&bp_array[idx], endian);
+
+      if (BP_IS_HOLE (&bp_array[idx]) || BP_IS_EMBEDDED (&bp_array[idx])
+	  || ((grub_zfs_to_cpu64 (bp_array[idx].blk_prop, endian) >> 60) & 3)
+	  || (grub_zfs_to_cpu64 (dva->dva_word[1], endian) >> 63)
+	  || psize > asize)
+	break;
+      if (idx == first)
+	{
+	  vdev = w0 >> 32;
+	  for (i = 0; i < data->n_devices_attached; i++)
+	    if (data->devices_attached[i].id == vdev)
+	      desc = &data->devices_attached[i];
+	  if (!desc || desc->type == DEVICE_RAIDZ)
+	    break;
+	  start = offset;
+	}
+      else if ((w0 >> 32) != vdev || offset != end)
+	break;
+      if (offset + psize - start > ZFS_PREFETCH_SIZE)
+	break;
+      if (zfs_cache_find (&bp_array[idx],
+			  (((grub_zfs_to_cpu64 (bp_array[idx].blk_prop, endian)
+			     & 0xffff) + 1) << SPA_MINBLOCKSHIFT), data))
+	break;
+      end = offset + asize;
+    }
+
+  n = idx - first;
+  if (n < 2)
+    {
+      if (bp_array != dn->dn.dn_blkptr)
+	grub_free (bp_array);
+      return blkid + 1;
+    }
+
+  /* The last block only needs its physical size.  */
+  end -= BF64_GET_SB (grub_zfs_to_cpu64 (bp_array[first + n - 1]
+					 .blk_dva[0].dva_word[0], endian),
+		      0, 24, SPA_MINBLOCKSHIFT, 0);
+  end += get_psize (&bp_array[first + n - 1], endian);
+
+  raw = grub_malloc (end - start);
+  if (!raw || read_device (start, desc, end - start, raw))
+    {
+      grub_free (raw);
+      if (bp_array != dn->dn.dn_blkptr)
+	grub_free (bp_array);
+      grub_errno = GRUB_ERR_NONE;
+      return blkid + 1;
+    }
+
+  /* Decoding puts every block into the cache; verification failures are
+     retried by dmu_read through the normal path.  */
+  for (i = 0; i < n; i++)
+    {
+      blkptr_t *cur = &bp_array[first + i];
+      err = zio_read_common (cur, endian, &tmpbuf, 0, data,
+			     raw + (dva_get_offset (&cur->blk_dva[0], endian)
+				    - start));
+      if (err)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  break;
+	}
+      grub_free (tmpbuf);
+    }
+
+  grub_free (raw);
+  if (bp_array != dn->dn.dn_blkptr)
+    grub_free (bp_array);
+  return blkid + (i ? i : 1);
+}
+
 /*
  * mzap_lookup: Looks up property described by "name" and returns the value
  * in "value".
@@ -3905,6 +4183,12 @@ grub_zfs_read (grub_file_t file, char *buf, grub_size_t len)
        * Find requested blkid and the offset within that block.
        */
       grub_uint64_t blkid = grub_divmod64 (file->offset + read, blksz, 0);
+
+      /* Read ahead once the file is being read sequentially.  */
+      if (data->file_end && data->file_end == blkid * blksz
+	  && blkid >= data->prefetch_end)
+	data->prefetch_end = dmu_prefetch (&(data->dnode), blkid, data);
+
       grub_free (data->file_buf);
       data->file_buf = 0;
 
@@ -4386,4 +4670,5 @@ GRUB_MOD_INIT (zfs)
 GRUB_MOD_FINI (zfs)
 {
   grub_fs_unregister (&grub_zfs_fs);
+  zfs_cache_free ();
 }
@@ -37,6 +37,9 @@
 #include <grub/zfs/dmu_objset.h>
 #include <grub/zfs/dsl_dir.h>
 #include <grub/zfs/dsl_dataset.h>
+#if defined (__x86_64__) && defined (GRUB_MACHINE_EFI)
+#include <grub/i386/cpuid.h>
+#endif
 
 void
 fletcher_2(const void *buf, grub_uint64_t size, grub_zfs_endian_t endian, 
@@ -60,25 +63,301 @@ fletcher_2(const void *buf, grub_uint64_t size, grub_zfs_endian_t endian,
   zcp->zc_word[3] = grub_cpu_to_zfs64 (b1, endian);
 }
 
-void
-fletcher_4 (const void *buf, grub_uint64_t size, grub_zfs_endian_t endian, 
-	    zio_cksum_t *zcp)
+/*
+ * Fletcher-4 is inherently serial, but the input can be split into N
+ * interleaved streams, stream j summing words j, j + N, j + 2N and so on.
+ * The partial sums of the streams are then weighted and added up to give
+ * exactly the serial result.  This lets every implementation below keep
+ * N independent accumulator sets busy; the leftover words are handled by
+ * continuing the serial loop from the combined sums.
+ */
+
+struct fletcher_4_sums
+{
+  grub_uint64_t a, b, c, d;
+};
+
+static void
+fletcher_4_update (struct fletcher_4_sums *s, const grub_uint32_t *ip,
+		   const grub_uint32_t *ipend, grub_zfs_endian_t endian)
+{
+  grub_uint64_t a = s->a, b = s->b, c = s->c, d = s->d;
+
+  for (; ip < ipend; ip++)
+    {
+      a += grub_zfs_to_cpu32 (ip[0], endian);
+      b += a;
+      c += b;
+      d += c;
+    }
+
+  s->a = a;
+  s->b = b;
+  s->c = c;
+  s->d = d;
+}
+
+static void
+fletcher_4_finish (const struct fletcher_4_sums *s, grub_zfs_endian_t endian,
+		   zio_cksum_t *zcp)
+{
+  zcp->zc_word[0] = grub_cpu_to_zfs64 (s->a, endian);
+  zcp->zc_word[1] = grub_cpu_to_zfs64 (s->b, endian);
+  zcp->zc_word[2] = grub_cpu_to_zfs64 (s->c, endian);
+  zcp->zc_word[3] = grub_cpu_to_zfs64 (s->d, endian);
+}
+
+#if defined (__x86_64__) && defined (GRUB_MACHINE_EFI)
+static void
+fletcher_4_combine2 (struct fletcher_4_sums *s, const grub_uint64_t a[2],
+		     const grub_uint64_t b[2], const grub_uint64_t c[2],
+		     const grub_uint64_t d[2])
+{
+  s->a = a[0] + a[1];
+  s->b = 2 * b[0] + 2 * b[1] - a[1];
+  s->c = 4 * c[0] - b[0] + 4 * c[1] - 3 * b[1];
+  s->d = 8 * d[0] - 4 * c[0] + 8 * d[1] - 8 * c[1] + b[1];
+}
+#endif
+
+static void
+fletcher_4_combine4 (struct fletcher_4_sums *s, const grub_uint64_t a[4],
+		     const grub_uint64_t b[4], const grub_uint64_t c[4],
+		     const grub_uint64_t d[4])
+{
+  s->a = a[0] + a[1] + a[2] + a[3];
+  s->b = 4 * (b[0] + b[1] + b[2] + b[3]) - a[1] - 2 * a[2] - 3 * a[3];
+  s->c = 16 * (c[0] + c[1] + c[2] + c[3])
+    - 6 * b[0] - 10 * b[1] - 14 * b[2] - 18 * b[3] + a[2] + 3 * a[3];
+  s->d = 64 * (d[0] + d[1] + d[2] + d[3])
+    - 48 * c[0] - 64 * c[1] - 80 * c[2] - 96 * c[3]
+    + 4 * b[0] + 10 * b[1] + 20 * b[2] + 34 * b[3] - a[3];
+}
+
+static void
+fletcher_4_scalar (const void *buf, grub_uint64_t size,
+		   grub_zfs_endian_t endian, zio_cksum_t *zcp)
+{
+  const grub_uint32_t *ip = buf;
+  struct fletcher_4_sums s = { 0, 0, 0, 0 };
+
+  fletcher_4_update (&s, ip, ip + (size / sizeof (grub_uint32_t)), endian);
+  fletcher_4_finish (&s, endian, zcp);
+}
+
+/* Four streams in general purpose registers.  */
+static void
+fletcher_4_superscalar4 (const void *buf, grub_uint64_t size,
+			 grub_zfs_endian_t endian, zio_cksum_t *zcp)
 {
   const grub_uint32_t *ip = buf;
   const grub_uint32_t *ipend = ip + (size / sizeof (grub_uint32_t));
-  grub_uint64_t a, b, c, d;
-  
-  for (a = b = c = d = 0; ip < ipend; ip++) 
+  const grub_uint32_t *ipvend = ip + (size / 16) * 4;
+  grub_uint64_t a0 = 0, a1 = 0, a2 = 0, a3 = 0, b0 = 0, b1 = 0, b2 = 0;
+  grub_uint64_t b3 = 0, c0 = 0, c1 = 0, c2 = 0, c3 = 0, d0 = 0, d1 = 0;
+  grub_uint64_t d2 = 0, d3 = 0;
+  struct fletcher_4_sums s;
+
+  for (; ip < ipvend; ip += 4)
     {
-      a += grub_zfs_to_cpu32 (ip[0], endian);;
+      a0 += grub_zfs_to_cpu32 (ip[0], endian);
+      a1 += grub_zfs_to_cpu32 (ip[1], endian);
+      a2 += grub_zfs_to_cpu32 (ip[2], endian);
+      a3 += grub_zfs_to_cpu32 (ip[3], endian);
+      b0 += a0;
+      b1 += a1;
+      b2 += a2;
+      b3 += a3;
+      c0 += b0;
+      c1 += b1;
+      c2 += b2;
+      c3 += b3;
+      d0 += c0;
+      d1 += c1;
+      d2 += c2;
+      d3 += c3;
+    }
+
+  {
+    const grub_uint64_t a[4] = { a0, a1, a2, a3 }, b[4] = { b0, b1, b2, b3 };
+    const grub_uint64_t c[4] = { c0, c1, c2, c3 }, d[4] = { d0, d1, d2, d3 };
+    fletcher_4_combine4 (&s, a, b, c, d);
+  }
+  fletcher_4_update (&s, ip, ipend, endian);
+  fletcher_4_finish (&s, endian, zcp);
+}
+
+#if defined (__x86_64__) && defined (GRUB_MACHINE_EFI)
+/* SSE2 is architecturally enabled on x86_64 EFI, AVX2 has to be checked
+   for.  GRUB is otherwise built without SSE, so only these functions are
+   compiled for it.  Every 16 bytes of input are widened to 64-bit lanes:
+   two steps of two streams for SSE2, one step of four streams for AVX2.  */
+
+typedef unsigned int v4su __attribute__ ((vector_size (16)));
+typedef int v4si __attribute__ ((vector_size (16)));
+typedef unsigned int v4su_u __attribute__ ((vector_size (16), aligned (1)));
+typedef unsigned long long v2du __attribute__ ((vector_size (16)));
+typedef unsigned long long v4du __attribute__ ((vector_size (32)));
+
+#define V_BSWAP32(v) (((v) << 24) | (((v) & 0xff00) << 8)		\
+		      | (((v) >> 8) & 0xff00) | ((v) >> 24))
+
+/* Zero-extend the low or high two words of V, or all four of them.  */
+#ifdef __clang__
+#define V_ZEXT_LO(v, zero) ((v2du) __builtin_shufflevector ((v), (zero),	\
+							    0, 4, 1, 4))
+#define V_ZEXT_HI(v, zero) ((v2du) __builtin_shufflevector ((v), (zero),	\
+							    2, 4, 3, 4))
+#define V_ZEXT4(v) (__builtin_convertvector ((v), v4du))
+#else
+#define V_ZEXT_LO(v, zero) ((v2du) __builtin_shuffle ((v), (zero),		\
+						      (v4su) { 0, 4, 1, 4 }))
+#define V_ZEXT_HI(v, zero) ((v2du) __builtin_shuffle ((v), (zero),		\
+						      (v4su) { 2, 4, 3, 4 }))
+#define V_ZEXT4(v) ((v4du) __builtin_ia32_pmovzxdq256 ((v4si) (v)))
+#endif
+
+static void __attribute__ ((target ("sse2")))
+fletcher_4_sse2 (const void *buf, grub_uint64_t size,
+		 grub_zfs_endian_t endian, zio_cksum_t *zcp)
+{
+  const v4su_u *vp = buf;
+  const v4su zero = { 0, 0, 0, 0 };
+  v2du a = { 0, 0 }, b = a, c = a, d = a;
+  grub_uint64_t la[2], lb[2], lc[2], ld[2];
+  grub_uint64_t i, n = size / 16;
+  int swap = (endian == GRUB_ZFS_BIG_ENDIAN);
+  struct fletcher_4_sums s;
+  const grub_uint32_t *ip;
+
+  for (i = 0; i < n; i++)
+    {
+      v4su v = vp[i];
+      if (swap)
+	v = V_BSWAP32 (v);
+      a += V_ZEXT_LO (v, zero);
+      b += a;
+      c += b;
+      d += c;
+      a += V_ZEXT_HI (v, zero);
+      b += a;
+      c += b;
+      d += c;
+    }
+
+  for (i = 0; i < 2; i++)
+    {
+      la[i] = a[i];
+      lb[i] = b[i];
+      lc[i] = c[i];
+      ld[i] = d[i];
+    }
+  fletcher_4_combine2 (&s, la, lb, lc, ld);
+  ip = (const grub_uint32_t *) buf + n * 4;
+  fletcher_4_update (&s, ip, (const grub_uint32_t *) buf
+		     + size / sizeof (grub_uint32_t), endian);
+  fletcher_4_finish (&s, endian, zcp);
+}
+
+static void __attribute__ ((target ("avx2")))
+fletcher_4_avx2 (const void *buf, grub_uint64_t size,
+		 grub_zfs_endian_t endian, zio_cksum_t *zcp)
+{
+  const v4su_u *vp = buf;
+  v4du a = { 0, 0, 0, 0 }, b = a, c = a, d = a;
+  grub_uint64_t la[4], lb[4], lc[4], ld[4];
+  grub_uint64_t i, n = size / 16;
+  int swap = (endian == GRUB_ZFS_BIG_ENDIAN);
+  struct fletcher_4_sums s;
+  const grub_uint32_t *ip;
+
+  for (i = 0; i < n; i++)
+    {
+      v4su v = vp[i];
+      if (swap)
+	v = V_BSWAP32 (v);
+      a += V_ZEXT4 (v);
       b += a;
       c += b;
       d += c;
     }
 
-  zcp->zc_word[0] = grub_cpu_to_zfs64 (a, endian);
-  zcp->zc_word[1] = grub_cpu_to_zfs64 (b, endian);
-  zcp->zc_word[2] = grub_cpu_to_zfs64 (c, endian);
-  zcp->zc_word[3] = grub_cpu_to_zfs64 (d, endian);
+  for (i = 0; i < 4; i++)
+    {
+      la[i] = a[i];
+      lb[i] = b[i];
+      lc[i] = c[i];
+      ld[i] = d[i];
+    }
+  fletcher_4_combine4 (&s, la, lb, lc, ld);
+  ip = (const grub_uint32_t *) buf + n * 4;
+  fletcher_4_update (&s, ip, (const grub_uint32_t *) buf
+		     + size / sizeof (grub_uint32_t), endian);
+  fletcher_4_finish (&s, endian, zcp);
+}
+
+static int
+fletcher_4_sse2_supported (void)
+{
+  return 1;
+}
+
+static int
+fletcher_4_avx2_supported (void)
+{
+  grub_uint32_t max_level, eax, ebx, ecx, edx, xcr0, xcr0_high;
+
+  grub_cpuid (0, max_level, ebx, ecx, edx);
+  if (max_level < 7)
+    return 0;
+
+  /* CPUID.01H:ECX[27] is OSXSAVE, CPUID.01H:ECX[28] is AVX.  The firmware
+     must also have enabled the SSE and AVX state in XCR0.  */
+  grub_cpuid (1, eax, ebx, ecx, edx);
+  if ((ecx & (3 << 27)) != (3 << 27))
+    return 0;
+  __asm__ __volatile__ ("xgetbv" : "=a" (xcr0), "=d" (xcr0_high) : "c" (0));
+  if ((xcr0 & 6) != 6)
+    return 0;
+
+  /* CPUID.(EAX=07H,ECX=0):EBX[5] is AVX2.  */
+  grub_cpuid_count (7, 0, eax, ebx, ecx, edx);
+  return !!(ebx & (1 << 5));
+}
+#endif
+
+static int
+fletcher_4_always_supported (void)
+{
+  return 1;
 }
 
+/* In order of preference.  The scalar version is the reference.  */
+const struct fletcher_4_impl fletcher_4_impls[] =
+  {
+#if defined (__x86_64__) && defined (GRUB_MACHINE_EFI)
+    { "avx2", fletcher_4_avx2_supported, fletcher_4_avx2 },
+    { "sse2", fletcher_4_sse2_supported, fletcher_4_sse2 },
+#endif
+    { "superscalar4", fletcher_4_always_supported, fletcher_4_superscalar4 },
+    { "scalar", fletcher_4_always_supported, fletcher_4_scalar },
+    { NULL, NULL, NULL }
+  };
+
+static void (*fletcher_4_best) (const void *, grub_uint64_t,
+				grub_zfs_endian_t, zio_cksum_t *);
+
+void
+fletcher_4 (const void *buf, grub_uint64_t size, grub_zfs_endian_t endian, 
+	    zio_cksum_t *zcp)
+{
+  if (!fletcher_4_best)
+    {
+      const struct fletcher_4_impl *impl;
+
+      for (impl = fletcher_4_impls; !impl->is_supported (); impl++);
+      fletcher_4_best = impl->compute;
+    }
+
+  fletcher_4_best (buf, size, endian, zcp);
+}
@@ -0,0 +1,706 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Argon2 (RFC 9106, version 0x13) and the BLAKE2b (RFC 7693) hash it is
+   built on.  */
+
+#include <grub/crypto.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/dl.h>
+#ifdef GRUB_MACHINE_EFI
+#include <grub/efi/efi.h>
+#include <grub/efi/memory.h>
+#endif
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define BLAKE2B_BLOCKBYTES 128
+#define BLAKE2B_OUTBYTES 64
+
+struct blake2b_state
+{
+  grub_uint64_t h[8];
+  grub_uint64_t t[2];
+  grub_uint8_t buf[BLAKE2B_BLOCKBYTES];
+  grub_size_t buflen;
+  grub_size_t outlen;
+};
+
+static const grub_uint64_t blake2b_iv[8] =
+  {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+  };
+
+static const grub_uint8_t blake2b_sigma[12][16] =
+  {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+  };
+
+static inline grub_uint64_t
+rotr64 (grub_uint64_t x, unsigned n)
+{
+  return (x >> n) | (x << (64 - n));
+}
+
+#define BLAKE2B_G(a, b, c, d, x, y)		\
+  do						\
+    {						\
+      a = a + b + (x);				\
+      d = rotr64 (d ^ a, 32);			\
+      c = c + d;				\
+      b = rotr64 (b ^ c, 24);			\
+      a = a + b + (y);				\
+      d = rotr64 (d ^ a, 16);			\
+      c = c + d;				\
+      b = rotr64 (b ^ c, 63);			\
+    }						\
+  while (0)
+
+static void
+blake2b_compress (struct blake2b_state *S, const grub_uint8_t *block,
+		  int last)
+{
+  grub_uint64_t m[16], v[16];
+  unsigned i, r;
+
+  for (i = 0; i < 16; i++)
+    m[i] = grub_le_to_cpu64 (grub_get_unaligned64 (block + 8 * i));
+  for (i = 0; i < 8; i++)
+    {
+      v[i] = S->h[i];
+      v[i + 8] = blake2b_iv[i];
+    }
+  v[12] ^= S->t[0];
+  v[13] ^= S->t[1];
+  if (last)
+    v[14] = ~v[14];
+
+  for (r = 0; r < 12; r++)
+    {
+      const grub_uint8_t *s = blake2b_sigma[r];
+
+      BLAKE2B_G (v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+      BLAKE2B_G (v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+      BLAKE2B_G (v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+      BLAKE2B_G (v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+      BLAKE2B_G (v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+      BLAKE2B_G (v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+      BLAKE2B_G (v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+      BLAKE2B_G (v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+  for (i = 0; i < 8; i++)
+    S->h[i] ^= v[i] ^ v[i + 8];
+}
+
+static void
+blake2b_init (struct blake2b_state *S, grub_size_t outlen)
+{
+  grub_memset (S, 0, sizeof (*S));
+  grub_memcpy (S->h, blake2b_iv, sizeof (S->h));
+  /* Parameter block: digest length, no key, fanout 1, depth 1.  */
+  S->h[0] ^= 0x01010000ULL ^ outlen;
+  S->outlen = outlen;
+}
+
+static void
+blake2b_increment (struct blake2b_state *S, grub_size_t inc)
+{
+  S->t[0] += inc;
+  if (S->t[0] < inc)
+    S->t[1]++;
+}
+
+static void
+blake2b_update (struct blake2b_state *S, const void *in, grub_size_t inlen)
+{
+  const grub_uint8_t *p = in;
+
+  while (inlen)
+    {
+      grub_size_t n;
+
+      /* The final block is compressed by blake2b_final, so only flush a
+	 full buffer once more data follows.  */
+      if (S->buflen == BLAKE2B_BLOCKBYTES)
+	{
+	  blake2b_increment (S, BLAKE2B_BLOCKBYTES);
+	  blake2b_compress (S, S->buf, 0);
+	  S->buflen = 0;
+	}
+      n = BLAKE2B_BLOCKBYTES - S->buflen;
+      if (n > inlen)
+	n = inlen;
+      grub_memcpy (S->buf + S->buflen, p, n);
+      S->buflen += n;
+      p += n;
+      inlen -= n;
+    }
+}
+
+static void
+blake2b_final (struct blake2b_state *S, grub_uint8_t *out)
+{
+  grub_uint8_t buf[BLAKE2B_OUTBYTES];
+  unsigned i;
+
+  blake2b_increment (S, S->buflen);
+  grub_memset (S->buf + S->buflen, 0, BLAKE2B_BLOCKBYTES - S->buflen);
+  blake2b_compress (S, S->buf, 1);
+
+  for (i = 0; i < 8; i++)
+    grub_set_unaligned64 (buf + 8 * i, grub_cpu_to_le64 (S->h[i]));
+  grub_memcpy (out, buf, S->outlen);
+  grub_memset (buf, 0, sizeof (buf));
+  grub_memset (S, 0, sizeof (*S));
+}
+
+static void
+blake2b_update_le32 (struct blake2b_state *S, grub_uint32_t val)
+{
+  grub_uint32_t le = grub_cpu_to_le32 (val);
+
+  blake2b_update (S, &le, sizeof (le));
+}
+
+/* H' of RFC 9106 3.3: BLAKE2b extended to arbitrary output lengths.  */
+static void
+blake2b_long (grub_uint8_t *out, grub_size_t outlen,
+	      const void *in, grub_size_t inlen)
+{
+  struct blake2b_state S;
+  grub_uint8_t v[BLAKE2B_OUTBYTES];
+
+  if (outlen <= BLAKE2B_OUTBYTES)
+    {
+      blake2b_init (&S, outlen);
+      blake2b_update_le32 (&S, outlen);
+      blake2b_update (&S, in, inlen);
+      blake2b_final (&S, out);
+      return;
+    }
+
+  blake2b_init (&S, BLAKE2B_OUTBYTES);
+  blake2b_update_le32 (&S, outlen);
+  blake2b_update (&S, in, inlen);
+  blake2b_final (&S, v);
+  grub_memcpy (out, v, BLAKE2B_OUTBYTES / 2);
+  out += BLAKE2B_OUTBYTES / 2;
+  outlen -= BLAKE2B_OUTBYTES / 2;
+
+  while (outlen > BLAKE2B_OUTBYTES)
+    {
+      blake2b_init (&S, BLAKE2B_OUTBYTES);
+      blake2b_update (&S, v, BLAKE2B_OUTBYTES);
+      blake2b_final (&S, v);
+      grub_memcpy (out, v, BLAKE2B_OUTBYTES / 2);
+      out += BLAKE2B_OUTBYTES / 2;
+      outlen -= BLAKE2B_OUTBYTES / 2;
+    }
+
+  blake2b_init (&S, outlen);
+  blake2b_update (&S, v, BLAKE2B_OUTBYTES);
+  blake2b_final (&S, out);
+  grub_memset (v, 0, sizeof (v));
+}
+
+#define ARGON2_VERSION 0x13
+#define ARGON2_BLOCK_SIZE 1024
+#define ARGON2_QWORDS_IN_BLOCK (ARGON2_BLOCK_SIZE / 8)
+#define ARGON2_SYNC_POINTS 4
+#define ARGON2_PREHASH_DIGEST_LENGTH 64
+#define ARGON2_PREHASH_SEED_LENGTH (ARGON2_PREHASH_DIGEST_LENGTH + 8)
+
+struct argon2_block
+{
+  grub_uint64_t v[ARGON2_QWORDS_IN_BLOCK];
+};
+
+struct argon2_instance
+{
+  struct argon2_block *memory;
+  grub_size_t memory_size;
+  int memory_from_firmware;
+  grub_uint32_t passes;
+  grub_uint32_t memory_blocks;
+  grub_uint32_t segment_length;
+  grub_uint32_t lane_length;
+  grub_uint32_t lanes;
+  grub_crypto_argon2_type_t type;
+};
+
+#if defined (__x86_64__) && defined (GRUB_MACHINE_EFI)
+/* SSE2 is architecturally enabled on x86_64 EFI.  GRUB is otherwise built
+   without SSE, so only this function is compiled for it.  Every vector
+   holds two adjacent words of the block, a round works on 8 of them.  */
+
+typedef unsigned long long v2du __attribute__ ((vector_size (16)));
+typedef long long v2di __attribute__ ((vector_size (16)));
+typedef int v4si __attribute__ ((vector_size (16)));
+typedef unsigned long long v2du_u __attribute__ ((vector_size (16),
+						   aligned (1)));
+
+#define V_BLAMKA(x, y)							\
+  ((x) + (y) + ((v2du) __builtin_ia32_pmuludq128 ((v4si) (x),		\
+						  (v4si) (y)) << 1))
+#define V_ROTR(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+/* (a[1], b[0]) */
+#ifdef __clang__
+#define V_ALIGNR(a, b) (__builtin_shufflevector ((a), (b), 1, 2))
+#else
+#define V_ALIGNR(a, b) (__builtin_shuffle ((a), (b), (v2di) { 1, 2 }))
+#endif
+
+#define V_G(a0, b0, c0, d0, a1, b1, c1, d1)		\
+  do							\
+    {							\
+      a0 = V_BLAMKA (a0, b0);				\
+      a1 = V_BLAMKA (a1, b1);				\
+      d0 = V_ROTR (d0 ^ a0, 32);			\
+      d1 = V_ROTR (d1 ^ a1, 32);			\
+      c0 = V_BLAMKA (c0, d0);				\
+      c1 = V_BLAMKA (c1, d1);				\
+      b0 = V_ROTR (b0 ^ c0, 24);			\
+      b1 = V_ROTR (b1 ^ c1, 24);			\
+      a0 = V_BLAMKA (a0, b0);				\
+      a1 = V_BLAMKA (a1, b1);				\
+      d0 = V_ROTR (d0 ^ a0, 16);			\
+      d1 = V_ROTR (d1 ^ a1, 16);			\
+      c0 = V_BLAMKA (c0, d0);				\
+      c1 = V_BLAMKA (c1, d1);				\
+      b0 = V_ROTR (b0 ^ c0, 63);			\
+      b1 = V_ROTR (b1 ^ c1, 63);			\
+    }							\
+  while (0)
+
+/* Same as BLAMKA_ROUND with A0 = (v0, v1), A1 = (v2, v3), B0 = (v4, v5)
+   and so on.  The diagonal step rotates B and D by one word and swaps
+   the C halves.  */
+#define V_ROUND(a0, a1, b0, b1, c0, c1, d0, d1)			\
+  do								\
+    {								\
+      v2du t0, t1;						\
+      V_G (a0, b0, c0, d0, a1, b1, c1, d1);			\
+      t0 = V_ALIGNR (b0, b1);					\
+      t1 = V_ALIGNR (b1, b0);					\
+      b0 = t0;							\
+      b1 = t1;							\
+      t0 = c0;							\
+      c0 = c1;							\
+      c1 = t0;							\
+      t0 = V_ALIGNR (d1, d0);					\
+      t1 = V_ALIGNR (d0, d1);					\
+      d0 = t0;							\
+      d1 = t1;							\
+      V_G (a0, b0, c0, d0, a1, b1, c1, d1);			\
+      t0 = V_ALIGNR (b1, b0);					\
+      t1 = V_ALIGNR (b0, b1);					\
+      b0 = t0;							\
+      b1 = t1;							\
+      t0 = c0;							\
+      c0 = c1;							\
+      c1 = t0;							\
+      t0 = V_ALIGNR (d0, d1);					\
+      t1 = V_ALIGNR (d1, d0);					\
+      d0 = t0;							\
+      d1 = t1;							\
+    }								\
+  while (0)
+
+static void __attribute__ ((target ("sse2")))
+fill_block_sse2 (const struct argon2_block *prev,
+		 const struct argon2_block *ref,
+		 struct argon2_block *next, int with_xor)
+{
+  v2du s[64], tmp[64];
+  const v2du_u *p = (const v2du_u *) prev->v, *r = (const v2du_u *) ref->v;
+  v2du_u *n = (v2du_u *) next->v;
+  unsigned i;
+
+  for (i = 0; i < 64; i++)
+    {
+      s[i] = p[i] ^ r[i];
+      tmp[i] = with_xor ? s[i] ^ n[i] : s[i];
+    }
+
+  for (i = 0; i < 8; i++)
+    V_ROUND (s[8 * i], s[8 * i + 1], s[8 * i + 2], s[8 * i + 3],
+	     s[8 * i + 4], s[8 * i + 5], s[8 * i + 6], s[8 * i + 7]);
+
+  for (i = 0; i < 8; i++)
+    V_ROUND (s[i], s[i + 8], s[i + 16], s[i + 24],
+	     s[i + 32], s[i + 40], s[i + 48], s[i + 56]);
+
+  for (i = 0; i < 64; i++)
+    n[i] = tmp[i] ^ s[i];
+}
+
+#define fill_block fill_block_sse2
+#else
+static inline grub_uint64_t
+blamka (grub_uint64_t x, grub_uint64_t y)
+{
+  const grub_uint64_t m = 0xffffffffULL;
+
+  return x + y + 2 * ((x & m) * (y & m));
+}
+
+#define BLAMKA_G(a, b, c, d)			\
+  do						\
+    {						\
+      a = blamka (a, b);			\
+      d = rotr64 (d ^ a, 32);			\
+      c = blamka (c, d);			\
+      b = rotr64 (b ^ c, 24);			\
+      a = blamka (a, b);			\
+      d = rotr64 (d ^ a, 16);			\
+      c = blamka (c, d);			\
+      b = rotr64 (b ^ c, 63);			\
+    }						\
+  while (0)
+
+#define BLAMKA_ROUND(v0, v1, v2, v3, v4, v5, v6, v7,			\
+		     v8, v9, v10, v11, v12, v13, v14, v15)		\
+  do									\
+    {									\
+      BLAMKA_G (v0, v4, v8, v12);					\
+      BLAMKA_G (v1, v5, v9, v13);					\
+      BLAMKA_G (v2, v6, v10, v14);					\
+      BLAMKA_G (v3, v7, v11, v15);					\
+      BLAMKA_G (v0, v5, v10, v15);					\
+      BLAMKA_G (v1, v6, v11, v12);					\
+      BLAMKA_G (v2, v7, v8, v13);					\
+      BLAMKA_G (v3, v4, v9, v14);					\
+    }									\
+  while (0)
+
+/* The compression function G of RFC 9106 3.5: NEXT = P (PREV ^ REF)
+   ^ PREV ^ REF, additionally XORed with the old NEXT on later passes.  */
+static void
+fill_block_generic (const struct argon2_block *prev,
+		    const struct argon2_block *ref,
+		    struct argon2_block *next, int with_xor)
+{
+  struct argon2_block r, tmp;
+  grub_uint64_t *v = r.v;
+  unsigned i;
+
+  for (i = 0; i < ARGON2_QWORDS_IN_BLOCK; i++)
+    r.v[i] = prev->v[i] ^ ref->v[i];
+  tmp = r;
+  if (with_xor)
+    for (i = 0; i < ARGON2_QWORDS_IN_BLOCK; i++)
+      tmp.v[i] ^= next->v[i];
+
+  /* Rows of 16 words.  */
+  for (i = 0; i < 8; i++)
+    BLAMKA_ROUND (v[16 * i], v[16 * i + 1], v[16 * i + 2], v[16 * i + 3],
+		  v[16 * i + 4], v[16 * i + 5], v[16 * i + 6], v[16 * i + 7],
+		  v[16 * i + 8], v[16 * i + 9], v[16 * i + 10], v[16 * i + 11],
+		  v[16 * i + 12], v[16 * i + 13], v[16 * i + 14],
+		  v[16 * i + 15]);
+
+  /* Columns of 8 word pairs.  */
+  for (i = 0; i < 8; i++)
+    BLAMKA_ROUND (v[2 * i], v[2 * i + 1], v[2 * i + 16], v[2 * i + 17],
+		  v[2 * i + 32], v[2 * i + 33], v[2 * i + 48], v[2 * i + 49],
+		  v[2 * i + 64], v[2 * i + 65], v[2 * i + 80], v[2 * i + 81],
+		  v[2 * i + 96], v[2 * i + 97], v[2 * i + 112],
+		  v[2 * i + 113]);
+
+  for (i = 0; i < ARGON2_QWORDS_IN_BLOCK; i++)
+    next->v[i] = tmp.v[i] ^ r.v[i];
+}
+
+#define fill_block fill_block_generic
+#endif
+
+/* Generate the next block of reference addresses for data-independent
+   addressing.  INPUT holds the position and a counter.  */
+static void
+next_addresses (struct argon2_block *address, struct argon2_block *input,
+		const struct argon2_block *zero)
+{
+  input->v[6]++;
+  fill_block (zero, input, address, 0);
+  fill_block (zero, address, address, 0);
+}
+
+static grub_uint32_t
+index_alpha (const struct argon2_instance *instance, grub_uint32_t pass,
+	     grub_uint32_t slice, grub_uint32_t index,
+	     grub_uint32_t pseudo_rand, int same_lane)
+{
+  grub_uint32_t area_size, start = 0;
+  grub_uint64_t rel;
+
+  if (pass == 0)
+    {
+      if (slice == 0)
+	area_size = index - 1;
+      else if (same_lane)
+	area_size = slice * instance->segment_length + index - 1;
+      else
+	area_size = slice * instance->segment_length + (index == 0 ? -1 : 0);
+    }
+  else
+    {
+      if (same_lane)
+	area_size = instance->lane_length - instance->segment_length
+	  + index - 1;
+      else
+	area_size = instance->lane_length - instance->segment_length
+	  + (index == 0 ? -1 : 0);
+      if (slice != ARGON2_SYNC_POINTS - 1)
+	start = (slice + 1) * instance->segment_length;
+    }
+
+  /* Non-uniform mapping favouring recent blocks.  */
+  rel = pseudo_rand;
+  rel = (rel * rel) >> 32;
+  rel = area_size - 1 - ((area_size * rel) >> 32);
+
+  return (start + rel) % instance->lane_length;
+}
+
+static void
+fill_segment (const struct argon2_instance *instance, grub_uint32_t pass,
+	      grub_uint32_t lane, grub_uint32_t slice)
+{
+  struct argon2_block address, input, zero;
+  grub_uint32_t start = 0, i, curr, prev;
+  int data_independent;
+
+  data_independent = (instance->type == GRUB_CRYPTO_ARGON2I
+		      || (instance->type == GRUB_CRYPTO_ARGON2ID
+			  && pass == 0 && slice < ARGON2_SYNC_POINTS / 2));
+
+  if (data_independent)
+    {
+      grub_memset (&zero, 0, sizeof (zero));
+      grub_memset (&input, 0, sizeof (input));
+      grub_memset (&address, 0, sizeof (address));
+      input.v[0] = pass;
+      input.v[1] = lane;
+      input.v[2] = slice;
+      input.v[3] = instance->memory_blocks;
+      input.v[4] = instance->passes;
+      input.v[5] = instance->type;
+    }
+
+  /* The first two blocks of each lane come from the prehash.  */
+  if (pass == 0 && slice == 0)
+    {
+      start = 2;
+      if (data_independent)
+	next_addresses (&address, &input, &zero);
+    }
+
+  curr = lane * instance->lane_length + slice * instance->segment_length
+    + start;
+  if (curr % instance->lane_length == 0)
+    prev = curr + instance->lane_length - 1;
+  else
+    prev = curr - 1;
+
+  for (i = start; i < instance->segment_length; i++, curr++, prev++)
+    {
+      grub_uint64_t pseudo_rand;
+      grub_uint32_t ref_lane, ref_index;
+
+      if (curr % instance->lane_length == 1)
+	prev = curr - 1;
+
+      if (data_independent)
+	{
+	  if (i % ARGON2_QWORDS_IN_BLOCK == 0)
+	    next_addresses (&address, &input, &zero);
+	  pseudo_rand = address.v[i % ARGON2_QWORDS_IN_BLOCK];
+	}
+      else
+	pseudo_rand = instance->memory[prev].v[0];
+
+      if (pass == 0 && slice == 0)
+	ref_lane = lane;
+      else
+	ref_lane = (pseudo_rand >> 32) % instance->lanes;
+
+      ref_index = index_alpha (instance, pass, slice, i,
+			       pseudo_rand & 0xffffffff, ref_lane == lane);
+
+      fill_block (instance->memory + prev,
+		  instance->memory
+		  + (grub_size_t) instance->lane_length * ref_lane + ref_index,
+		  instance->memory + curr, pass != 0);
+    }
+}
+
+/* The matrix is large (cryptsetup defaults to up to 1GiB), so on EFI take
+   it straight from the firmware page allocator instead of growing the
+   heap.  */
+static void
+argon2_alloc (struct argon2_instance *instance)
+{
+#ifdef GRUB_MACHINE_EFI
+  grub_efi_uintn_t pages = GRUB_EFI_BYTES_TO_PAGES (instance->memory_size);
+
+#endif
+  instance->memory_from_firmware = 0;
+#ifdef GRUB_MACHINE_EFI
+  instance->memory = grub_efi_allocate_any_pages (pages);
+  if (instance->memory)
+    {
+      instance->memory_from_firmware = 1;
+      return;
+    }
+#endif
+  instance->memory = grub_malloc (instance->memory_size);
+}
+
+static void
+argon2_free (struct argon2_instance *instance)
+{
+  grub_memset (instance->memory, 0, instance->memory_size);
+#ifdef GRUB_MACHINE_EFI
+  if (instance->memory_from_firmware)
+    {
+      grub_efi_free_pages ((grub_addr_t) instance->memory,
+			   GRUB_EFI_BYTES_TO_PAGES (instance->memory_size));
+      return;
+    }
+#endif
+  grub_free (instance->memory);
+}
+
+gcry_err_code_t
+grub_crypto_argon2 (grub_crypto_argon2_type_t type,
+		    const grub_uint8_t *P, grub_size_t Plen,
+		    const grub_uint8_t *S, grub_size_t Slen,
+		    grub_uint32_t t_cost, grub_uint32_t m_cost,
+		    grub_uint32_t parallelism,
+		    grub_uint8_t *DK, grub_size_t dkLen)
+{
+  struct argon2_instance instance;
+  struct blake2b_state H;
+  grub_uint8_t seed[ARGON2_PREHASH_SEED_LENGTH];
+  grub_uint8_t block[ARGON2_BLOCK_SIZE];
+  struct argon2_block final;
+  grub_uint32_t pass, slice, lane, i;
+
+  if (type != GRUB_CRYPTO_ARGON2D && type != GRUB_CRYPTO_ARGON2I
+      && type != GRUB_CRYPTO_ARGON2ID)
+    return GPG_ERR_INV_ARG;
+  if (t_cost == 0 || parallelism == 0 || parallelism > 0xffffff
+      || dkLen < 4 || dkLen > 0xffffffff || Plen > 0xffffffff
+      || Slen < 8 || Slen > 0xffffffff)
+    return GPG_ERR_INV_ARG;
+  if (m_cost < 8 * parallelism)
+    return GPG_ERR_INV_ARG;
+
+  /* The number of blocks is rounded down to a multiple of 4 * lanes.  */
+  instance.passes = t_cost;
+  instance.lanes = parallelism;
+  instance.type = type;
+  instance.segment_length = m_cost / (parallelism * ARGON2_SYNC_POINTS);
+  instance.lane_length = instance.segment_length * ARGON2_SYNC_POINTS;
+  instance.memory_blocks = instance.lane_length * parallelism;
+  instance.memory_size = (grub_size_t) instance.memory_blocks
+    * ARGON2_BLOCK_SIZE;
+  if (instance.memory_size / ARGON2_BLOCK_SIZE != instance.memory_blocks)
+    return GPG_ERR_OUT_OF_MEMORY;
+
+  argon2_alloc (&instance);
+  if (!instance.memory)
+    return GPG_ERR_OUT_OF_MEMORY;
+
+  /* H0 of RFC 9106 3.2.  No secret value and no associated data.  */
+  blake2b_init (&H, ARGON2_PREHASH_DIGEST_LENGTH);
+  blake2b_update_le32 (&H, parallelism);
+  blake2b_update_le32 (&H, dkLen);
+  blake2b_update_le32 (&H, m_cost);
+  blake2b_update_le32 (&H, t_cost);
+  blake2b_update_le32 (&H, ARGON2_VERSION);
+  blake2b_update_le32 (&H, type);
+  blake2b_update_le32 (&H, Plen);
+  blake2b_update (&H, P, Plen);
+  blake2b_update_le32 (&H, Slen);
+  blake2b_update (&H, S, Slen);
+  blake2b_update_le32 (&H, 0);
+  blake2b_update_le32 (&H, 0);
+  blake2b_final (&H, seed);
+
+  for (lane = 0; lane < parallelism; lane++)
+    for (i = 0; i < 2; i++)
+      {
+	struct argon2_block *b = instance.memory
+	  + (grub_size_t) lane * instance.lane_length + i;
+	unsigned j;
+
+	grub_set_unaligned32 (seed + ARGON2_PREHASH_DIGEST_LENGTH,
+			      grub_cpu_to_le32 (i));
+	grub_set_unaligned32 (seed + ARGON2_PREHASH_DIGEST_LENGTH + 4,
+			      grub_cpu_to_le32 (lane));
+	blake2b_long (block, ARGON2_BLOCK_SIZE, seed, sizeof (seed));
+	for (j = 0; j < ARGON2_QWORDS_IN_BLOCK; j++)
+	  b->v[j] = grub_le_to_cpu64 (grub_get_unaligned64 (block + 8 * j));
+      }
+
+  /* GRUB runs on one CPU, so the lanes of a slice are simply filled one
+     after the other.  Each segment is a contiguous run of memory.  */
+  for (pass = 0; pass < t_cost; pass++)
+    for (slice = 0; slice < ARGON2_SYNC_POINTS; slice++)
+      for (lane = 0; lane < parallelism; lane++)
+	fill_segment (&instance, pass, lane, slice);
+
+  final = instance.memory[instance.lane_length - 1];
+  for (lane = 1; lane < parallelism; lane++)
+    {
+      const struct argon2_block *last = instance.memory
+	+ (grub_size_t) lane * instance.lane_length
+	+ instance.lane_length - 1;
+
+      for (i = 0; i < ARGON2_QWORDS_IN_BLOCK; i++)
+	final.v[i] ^= last->v[i];
+    }
+
+  for (i = 0; i < ARGON2_QWORDS_IN_BLOCK; i++)
+    grub_set_unaligned64 (block + 8 * i, grub_cpu_to_le64 (final.v[i]));
+  blake2b_long (DK, dkLen, block, ARGON2_BLOCK_SIZE);
+
+  grub_memset (seed, 0, sizeof (seed));
+  grub_memset (block, 0, sizeof (block));
+  grub_memset (&final, 0, sizeof (final));
+  argon2_free (&instance);
+
+  return GPG_ERR_NO_ERROR;
+}
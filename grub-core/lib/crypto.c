@@ -86,8 +86,16 @@ void _gcry_log_error (const char *fmt, ...)
 void 
 grub_cipher_register (gcry_cipher_spec_t *cipher)
 {
-  cipher->next = grub_ciphers;
-  grub_ciphers = cipher;
+  gcry_cipher_spec_t **ciph = &grub_ciphers;
+
+  /* Lookups return the first match, so keep ciphers with multi-block
+     implementations (e.g. CPU accelerated ones) ahead of generic ones
+     regardless of the module load order.  */
+  if (!cipher->ecb_decrypt)
+    while (*ciph && (*ciph)->ecb_decrypt)
+      ciph = &((*ciph)->next);
+  cipher->next = *ciph;
+  *ciph = cipher;
 }
 
 void
@@ -212,6 +220,11 @@ grub_crypto_ecb_decrypt (grub_crypto_cipher_handle_t cipher,
   if (blocksize == 0 || (((blocksize - 1) & blocksize) != 0)
       || ((size & (blocksize - 1)) != 0))
     return GPG_ERR_INV_ARG;
+  if (cipher->cipher->ecb_decrypt)
+    {
+      cipher->cipher->ecb_decrypt (cipher->ctx, out, in, size / blocksize);
+      return GPG_ERR_NO_ERROR;
+    }
   end = (const grub_uint8_t *) in + size;
   for (inptr = in, outptr = out; inptr < end;
        inptr += blocksize, outptr += blocksize)
@@ -232,6 +245,11 @@ grub_crypto_ecb_encrypt (grub_crypto_cipher_handle_t cipher,
   if (blocksize == 0 || (((blocksize - 1) & blocksize) != 0)
       || ((size & (blocksize - 1)) != 0))
     return GPG_ERR_INV_ARG;
+  if (cipher->cipher->ecb_encrypt)
+    {
+      cipher->cipher->ecb_encrypt (cipher->ctx, out, in, size / blocksize);
+      return GPG_ERR_NO_ERROR;
+    }
   end = (const grub_uint8_t *) in + size;
   for (inptr = in, outptr = out; inptr < end;
        inptr += blocksize, outptr += blocksize)
@@ -284,6 +302,11 @@ grub_crypto_cbc_decrypt (grub_crypto_cipher_handle_t cipher,
     return GPG_ERR_INV_ARG;
   if (blocksize > GRUB_CRYPTO_MAX_CIPHER_BLOCKSIZE)
     return GPG_ERR_INV_ARG;
+  if (cipher->cipher->cbc_decrypt)
+    {
+      cipher->cipher->cbc_decrypt (cipher->ctx, out, in, size / blocksize, iv);
+      return GPG_ERR_NO_ERROR;
+    }
   end = (const grub_uint8_t *) in + size;
   for (inptr = in, outptr = out; inptr < end;
        inptr += blocksize, outptr += blocksize)
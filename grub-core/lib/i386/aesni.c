@@ -0,0 +1,436 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* AES using the AES-NI instructions.  Registered in front of the generic
+   gcry_rijndael implementation when the CPU supports it.  */
+
+#include <grub/types.h>
+#include <grub/crypto.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/i386/cpuid.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+typedef long long v2di __attribute__ ((vector_size (16)));
+typedef int v4si __attribute__ ((vector_size (16)));
+/* Used to access possibly unaligned blocks and round keys.  */
+typedef long long v2di_u __attribute__ ((vector_size (16), aligned (1),
+					  may_alias));
+
+/* The module is built without SSE like the rest of GRUB and SSE must not
+   be used before aesni_is_supported has checked that it is enabled, so
+   only the functions below are compiled for it.  */
+#define AESNI_TARGET __attribute__ ((target ("sse2,aes")))
+
+#define LOAD(p) (*(const v2di_u *) (const void *) (p))
+#define STORE(p, v) (*(v2di_u *) (void *) (p) = (v))
+
+/* Blocks processed in parallel to hide the AESENC/AESDEC latency.  */
+#define AESNI_WIDTH 4
+
+#define AESNI_MAX_ROUNDS 14
+
+struct aesni_context
+{
+  grub_uint32_t ekey[4 * (AESNI_MAX_ROUNDS + 1)];
+  grub_uint32_t dkey[4 * (AESNI_MAX_ROUNDS + 1)];
+  int rounds;
+};
+
+static const grub_uint8_t rcon[] =
+  { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+
+/* Apply the S-box to every byte of W.  AESKEYGENASSIST returns
+   SubWord (X[1]) in its lowest dword.  */
+static grub_uint32_t AESNI_TARGET
+sub_word (grub_uint32_t w)
+{
+  v4si v = { 0, (int) w, 0, 0 };
+
+  v = (v4si) __builtin_ia32_aeskeygenassist128 ((v2di) v, 0);
+  return (grub_uint32_t) v[0];
+}
+
+static gcry_err_code_t AESNI_TARGET
+aesni_setkey (void *context, const unsigned char *key, unsigned keylen)
+{
+  struct aesni_context *ctx = context;
+  unsigned nk = keylen / 4, i;
+  int r;
+
+  if (keylen != 16 && keylen != 24 && keylen != 32)
+    return GPG_ERR_INV_KEYLEN;
+
+  /* FIPS-197 key expansion.  Words are kept in memory order, so RotWord
+     is a rotation by 8 bits on a little-endian word.  */
+  ctx->rounds = nk + 6;
+  for (i = 0; i < nk; i++)
+    ctx->ekey[i] = grub_get_unaligned32 (key + 4 * i);
+  for (; i < 4 * ((unsigned) ctx->rounds + 1); i++)
+    {
+      grub_uint32_t t = ctx->ekey[i - 1];
+
+      if (i % nk == 0)
+	{
+	  t = sub_word (t);
+	  t = ((t >> 8) | (t << 24)) ^ rcon[i / nk - 1];
+	}
+      else if (nk > 6 && i % nk == 4)
+	t = sub_word (t);
+      ctx->ekey[i] = ctx->ekey[i - nk] ^ t;
+    }
+
+  /* Equivalent inverse cipher round keys for AESDEC.  */
+  STORE (ctx->dkey, LOAD (ctx->ekey + 4 * ctx->rounds));
+  for (r = 1; r < ctx->rounds; r++)
+    STORE (ctx->dkey + 4 * r,
+	   __builtin_ia32_aesimc128 (LOAD (ctx->ekey + 4 * (ctx->rounds - r))));
+  STORE (ctx->dkey + 4 * ctx->rounds, LOAD (ctx->ekey));
+
+  return GPG_ERR_NO_ERROR;
+}
+
+static inline v2di AESNI_TARGET
+encrypt1 (const struct aesni_context *ctx, v2di b)
+{
+  int r;
+
+  b ^= LOAD (ctx->ekey);
+  for (r = 1; r < ctx->rounds; r++)
+    b = __builtin_ia32_aesenc128 (b, LOAD (ctx->ekey + 4 * r));
+  return __builtin_ia32_aesenclast128 (b, LOAD (ctx->ekey + 4 * r));
+}
+
+static inline v2di AESNI_TARGET
+decrypt1 (const struct aesni_context *ctx, v2di b)
+{
+  int r;
+
+  b ^= LOAD (ctx->dkey);
+  for (r = 1; r < ctx->rounds; r++)
+    b = __builtin_ia32_aesdec128 (b, LOAD (ctx->dkey + 4 * r));
+  return __builtin_ia32_aesdeclast128 (b, LOAD (ctx->dkey + 4 * r));
+}
+
+static inline void AESNI_TARGET
+encrypt_wide (const struct aesni_context *ctx, v2di *b)
+{
+  v2di k = LOAD (ctx->ekey);
+  int r, j;
+
+  for (j = 0; j < AESNI_WIDTH; j++)
+    b[j] ^= k;
+  for (r = 1; r < ctx->rounds; r++)
+    {
+      k = LOAD (ctx->ekey + 4 * r);
+      for (j = 0; j < AESNI_WIDTH; j++)
+	b[j] = __builtin_ia32_aesenc128 (b[j], k);
+    }
+  k = LOAD (ctx->ekey + 4 * r);
+  for (j = 0; j < AESNI_WIDTH; j++)
+    b[j] = __builtin_ia32_aesenclast128 (b[j], k);
+}
+
+static inline void AESNI_TARGET
+decrypt_wide (const struct aesni_context *ctx, v2di *b)
+{
+  v2di k = LOAD (ctx->dkey);
+  int r, j;
+
+  for (j = 0; j < AESNI_WIDTH; j++)
+    b[j] ^= k;
+  for (r = 1; r < ctx->rounds; r++)
+    {
+      k = LOAD (ctx->dkey + 4 * r);
+      for (j = 0; j < AESNI_WIDTH; j++)
+	b[j] = __builtin_ia32_aesdec128 (b[j], k);
+    }
+  k = LOAD (ctx->dkey + 4 * r);
+  for (j = 0; j < AESNI_WIDTH; j++)
+    b[j] = __builtin_ia32_aesdeclast128 (b[j], k);
+}
+
+/* Multiply the XTS tweak by x in GF(2^128): shift every dword left by one,
+   carrying the top bits into the next dword and reducing the top bit of
+   the last one with x^7+x^2+x+1.  */
+static inline v2di AESNI_TARGET
+xts_mul_x (v2di t)
+{
+  const v4si poly = { 0x87, 1, 1, 1 };
+  v4si top = (v4si) t >> 31;
+#ifdef __clang__
+  v4si carry = __builtin_shufflevector (top, top, 3, 0, 1, 2);
+#else
+  v4si carry = __builtin_shuffle (top, (v4si) { 3, 0, 1, 2 });
+#endif
+
+  return (v2di) (((v4si) t << 1) ^ (carry & poly));
+}
+
+static void AESNI_TARGET
+aesni_encrypt (void *context, unsigned char *out, const unsigned char *in)
+{
+  STORE (out, encrypt1 (context, LOAD (in)));
+}
+
+static void AESNI_TARGET
+aesni_decrypt (void *context, unsigned char *out, const unsigned char *in)
+{
+  STORE (out, decrypt1 (context, LOAD (in)));
+}
+
+static void AESNI_TARGET
+aesni_ecb_encrypt (void *context, unsigned char *out,
+		   const unsigned char *in, grub_size_t nblocks)
+{
+  const struct aesni_context *ctx = context;
+  v2di b[AESNI_WIDTH];
+  int j;
+
+  for (; nblocks >= AESNI_WIDTH;
+       nblocks -= AESNI_WIDTH, in += 16 * AESNI_WIDTH, out += 16 * AESNI_WIDTH)
+    {
+      for (j = 0; j < AESNI_WIDTH; j++)
+	b[j] = LOAD (in + 16 * j);
+      encrypt_wide (ctx, b);
+      for (j = 0; j < AESNI_WIDTH; j++)
+	STORE (out + 16 * j, b[j]);
+    }
+  for (; nblocks; nblocks--, in += 16, out += 16)
+    STORE (out, encrypt1 (ctx, LOAD (in)));
+}
+
+static void AESNI_TARGET
+aesni_ecb_decrypt (void *context, unsigned char *out,
+		   const unsigned char *in, grub_size_t nblocks)
+{
+  const struct aesni_context *ctx = context;
+  v2di b[AESNI_WIDTH];
+  int j;
+
+  for (; nblocks >= AESNI_WIDTH;
+       nblocks -= AESNI_WIDTH, in += 16 * AESNI_WIDTH, out += 16 * AESNI_WIDTH)
+    {
+      for (j = 0; j < AESNI_WIDTH; j++)
+	b[j] = LOAD (in + 16 * j);
+      decrypt_wide (ctx, b);
+      for (j = 0; j < AESNI_WIDTH; j++)
+	STORE (out + 16 * j, b[j]);
+    }
+  for (; nblocks; nblocks--, in += 16, out += 16)
+    STORE (out, decrypt1 (ctx, LOAD (in)));
+}
+
+static void AESNI_TARGET
+aesni_cbc_decrypt (void *context, unsigned char *out,
+		   const unsigned char *in, grub_size_t nblocks,
+		   unsigned char *ivp)
+{
+  const struct aesni_context *ctx = context;
+  v2di iv = LOAD (ivp), c[AESNI_WIDTH], b[AESNI_WIDTH];
+  int j;
+
+  /* Ciphertext is loaded before anything is stored so that in-place
+     operation works.  */
+  for (; nblocks >= AESNI_WIDTH;
+       nblocks -= AESNI_WIDTH, in += 16 * AESNI_WIDTH, out += 16 * AESNI_WIDTH)
+    {
+      for (j = 0; j < AESNI_WIDTH; j++)
+	b[j] = c[j] = LOAD (in + 16 * j);
+      decrypt_wide (ctx, b);
+      STORE (out, b[0] ^ iv);
+      for (j = 1; j < AESNI_WIDTH; j++)
+	STORE (out + 16 * j, b[j] ^ c[j - 1]);
+      iv = c[AESNI_WIDTH - 1];
+    }
+  for (; nblocks; nblocks--, in += 16, out += 16)
+    {
+      c[0] = LOAD (in);
+      STORE (out, decrypt1 (ctx, c[0]) ^ iv);
+      iv = c[0];
+    }
+  STORE (ivp, iv);
+}
+
+/* The tweak sequence restarts from the next entry of TWEAKS at every
+   sector boundary, so batches run across sectors.  */
+#define XTS_NEXT_TWEAK()					\
+  do								\
+    {								\
+      if (--left)						\
+	t = xts_mul_x (t);					\
+      else if (--nsectors)					\
+	{							\
+	  tweaks += 16;						\
+	  t = LOAD (tweaks);					\
+	  left = sector_blocks;					\
+	}							\
+    }								\
+  while (0)
+
+static void AESNI_TARGET
+aesni_xts_encrypt (void *context, unsigned char *out,
+		   const unsigned char *in, grub_size_t nsectors,
+		   grub_size_t sector_blocks, const unsigned char *tweaks)
+{
+  const struct aesni_context *ctx = context;
+  grub_size_t nblocks = nsectors * sector_blocks, left = sector_blocks;
+  v2di t = LOAD (tweaks), tw[AESNI_WIDTH], b[AESNI_WIDTH];
+  int j;
+
+  for (; nblocks >= AESNI_WIDTH;
+       nblocks -= AESNI_WIDTH, in += 16 * AESNI_WIDTH, out += 16 * AESNI_WIDTH)
+    {
+      for (j = 0; j < AESNI_WIDTH; j++)
+	{
+	  tw[j] = t;
+	  b[j] = LOAD (in + 16 * j) ^ t;
+	  XTS_NEXT_TWEAK ();
+	}
+      encrypt_wide (ctx, b);
+      for (j = 0; j < AESNI_WIDTH; j++)
+	STORE (out + 16 * j, b[j] ^ tw[j]);
+    }
+  for (; nblocks; nblocks--, in += 16, out += 16)
+    {
+      STORE (out, encrypt1 (ctx, LOAD (in) ^ t) ^ t);
+      XTS_NEXT_TWEAK ();
+    }
+}
+
+static void AESNI_TARGET
+aesni_xts_decrypt (void *context, unsigned char *out,
+		   const unsigned char *in, grub_size_t nsectors,
+		   grub_size_t sector_blocks, const unsigned char *tweaks)
+{
+  const struct aesni_context *ctx = context;
+  grub_size_t nblocks = nsectors * sector_blocks, left = sector_blocks;
+  v2di t = LOAD (tweaks), tw[AESNI_WIDTH], b[AESNI_WIDTH];
+  int j;
+
+  for (; nblocks >= AESNI_WIDTH;
+       nblocks -= AESNI_WIDTH, in += 16 * AESNI_WIDTH, out += 16 * AESNI_WIDTH)
+    {
+      for (j = 0; j < AESNI_WIDTH; j++)
+	{
+	  tw[j] = t;
+	  b[j] = LOAD (in + 16 * j) ^ t;
+	  XTS_NEXT_TWEAK ();
+	}
+      decrypt_wide (ctx, b);
+      for (j = 0; j < AESNI_WIDTH; j++)
+	STORE (out + 16 * j, b[j] ^ tw[j]);
+    }
+  for (; nblocks; nblocks--, in += 16, out += 16)
+    {
+      STORE (out, decrypt1 (ctx, LOAD (in) ^ t) ^ t);
+      XTS_NEXT_TWEAK ();
+    }
+}
+
+static const char *aesni_names[] =
+  {
+    "RIJNDAEL",
+    "AES128",
+    "AES-128",
+    NULL
+  };
+
+static const char *aesni192_names[] =
+  {
+    "RIJNDAEL192",
+    "AES-192",
+    NULL
+  };
+
+static const char *aesni256_names[] =
+  {
+    "RIJNDAEL256",
+    "AES-256",
+    NULL
+  };
+
+#define AESNI_SPEC(n, a, k)						\
+  {									\
+    .name = n,								\
+    .aliases = a,							\
+    .blocksize = 16,							\
+    .keylen = k,							\
+    .contextsize = sizeof (struct aesni_context),			\
+    .setkey = aesni_setkey,						\
+    .encrypt = aesni_encrypt,						\
+    .decrypt = aesni_decrypt,						\
+    .ecb_encrypt = aesni_ecb_encrypt,					\
+    .ecb_decrypt = aesni_ecb_decrypt,					\
+    .cbc_decrypt = aesni_cbc_decrypt,					\
+    .xts_encrypt = aesni_xts_encrypt,					\
+    .xts_decrypt = aesni_xts_decrypt,					\
+  }
+
+static gcry_cipher_spec_t aesni_specs[] =
+  {
+    AESNI_SPEC ("AES", aesni_names, 128),
+    AESNI_SPEC ("AES192", aesni192_names, 192),
+    AESNI_SPEC ("AES256", aesni256_names, 256)
+  };
+
+static int registered;
+
+static int
+aesni_is_supported (void)
+{
+  grub_uint32_t max_level, eax, ebx, ecx, edx;
+
+  if (!grub_cpu_is_cpuid_supported ())
+    return 0;
+
+  grub_cpuid (0, max_level, ebx, ecx, edx);
+  if (max_level < 1)
+    return 0;
+
+  /* CPUID.01H:EDX[26] is SSE2, CPUID.01H:ECX[25] is AES.  */
+  grub_cpuid (1, eax, ebx, ecx, edx);
+  if (!(edx & (1 << 26)) || !(ecx & (1 << 25)))
+    return 0;
+
+  return grub_cpu_is_sse_enabled ();
+}
+
+GRUB_MOD_INIT(aesni)
+{
+  unsigned i;
+
+  if (!aesni_is_supported ())
+    return;
+
+  for (i = 0; i < ARRAY_SIZE (aesni_specs); i++)
+    grub_cipher_register (&aesni_specs[i]);
+  registered = 1;
+}
+
+GRUB_MOD_FINI(aesni)
+{
+  unsigned i;
+
+  if (!registered)
+    return;
+
+  for (i = 0; i < ARRAY_SIZE (aesni_specs); i++)
+    grub_cipher_unregister (&aesni_specs[i]);
+}
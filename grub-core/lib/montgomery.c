@@ -0,0 +1,416 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/montgomery.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/dl.h>
+#include <grub/i18n.h>
+#include <grub/safemath.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Both x86_64 and arm64 produce the high half of a 64x64 multiplication
+   in one instruction, so use full registers there.  */
+#if defined (__x86_64__) || defined (__aarch64__)
+typedef unsigned __int128 grub_mont_dlimb_t;
+#else
+typedef grub_uint64_t grub_mont_dlimb_t;
+#endif
+
+#define LIMB_BYTES (sizeof (grub_mont_limb_t))
+#define LIMB_BITS (8 * LIMB_BYTES)
+
+struct grub_mont_ctx
+{
+  /* Size of the modulus in limbs.  */
+  grub_size_t n;
+  /* -MOD^-1 mod 2^LIMB_BITS.  */
+  grub_mont_limb_t n0inv;
+  /* All numbers are N limbs, least significant first.  */
+  grub_mont_limb_t *mod;
+  /* R mod MOD, i.e. 1 in Montgomery form, with R = 2^(N * LIMB_BITS).  */
+  grub_mont_limb_t *one;
+  /* R^2 mod MOD, used for converting into Montgomery form.  */
+  grub_mont_limb_t *rr;
+  /* N + 2 limbs of scratch space for grub_mont_mul.  */
+  grub_mont_limb_t *tmp;
+};
+
+static int
+from_bytes (grub_mont_limb_t *out, grub_size_t n,
+	    const grub_uint8_t *in, grub_size_t inlen)
+{
+  grub_size_t i;
+
+  while (inlen && *in == 0)
+    {
+      in++;
+      inlen--;
+    }
+  if (inlen > n * LIMB_BYTES)
+    return 0;
+
+  grub_memset (out, 0, n * LIMB_BYTES);
+  for (i = 0; i < inlen; i++)
+    out[i / LIMB_BYTES] |= ((grub_mont_limb_t) in[inlen - 1 - i]
+			    << (8 * (i % LIMB_BYTES)));
+  return 1;
+}
+
+static int
+cmp (const grub_mont_limb_t *a, const grub_mont_limb_t *b, grub_size_t n)
+{
+  while (n--)
+    if (a[n] != b[n])
+      return a[n] > b[n] ? 1 : -1;
+  return 0;
+}
+
+/* OUT = A - B, returning the borrow.  */
+static grub_mont_limb_t
+sub (grub_mont_limb_t *out, const grub_mont_limb_t *a,
+     const grub_mont_limb_t *b, grub_size_t n)
+{
+  grub_mont_limb_t borrow = 0;
+  grub_size_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      grub_mont_limb_t d = a[i] - b[i];
+      grub_mont_limb_t nb = (a[i] < b[i]) | (d < borrow);
+
+      out[i] = d - borrow;
+      borrow = nb;
+    }
+  return borrow;
+}
+
+/* X = 2 * X mod MOD.  */
+static void
+mod_double (grub_mont_ctx_t ctx, grub_mont_limb_t *x)
+{
+  grub_mont_limb_t carry = 0;
+  grub_size_t i;
+
+  for (i = 0; i < ctx->n; i++)
+    {
+      grub_mont_limb_t top = x[i] >> (LIMB_BITS - 1);
+
+      x[i] = (x[i] << 1) | carry;
+      carry = top;
+    }
+  if (carry || cmp (x, ctx->mod, ctx->n) >= 0)
+    sub (x, x, ctx->mod, ctx->n);
+}
+
+grub_mont_limb_t *
+grub_mont_alloc (grub_mont_ctx_t ctx, grub_size_t count)
+{
+  grub_size_t sz;
+
+  if (grub_mul (ctx->n * LIMB_BYTES, count, &sz))
+    {
+      grub_error (GRUB_ERR_OUT_OF_RANGE, N_("overflow is detected"));
+      return NULL;
+    }
+  return grub_malloc (sz);
+}
+
+grub_mont_ctx_t
+grub_mont_ctx_new (const grub_uint8_t *mod, grub_size_t modlen)
+{
+  grub_mont_ctx_t ctx;
+  grub_mont_limb_t x;
+  grub_size_t n, i;
+
+  while (modlen && *mod == 0)
+    {
+      mod++;
+      modlen--;
+    }
+  if (modlen == 0 || !(mod[modlen - 1] & 1))
+    {
+      grub_error (GRUB_ERR_BAD_ARGUMENT, "modulus must be odd");
+      return NULL;
+    }
+  n = (modlen + LIMB_BYTES - 1) / LIMB_BYTES;
+
+  ctx = grub_zalloc (sizeof (*ctx));
+  if (!ctx)
+    return NULL;
+  ctx->n = n;
+  ctx->mod = grub_calloc (4 * n + 2, LIMB_BYTES);
+  if (!ctx->mod)
+    {
+      grub_free (ctx);
+      return NULL;
+    }
+  ctx->one = ctx->mod + n;
+  ctx->rr = ctx->one + n;
+  ctx->tmp = ctx->rr + n;
+  from_bytes (ctx->mod, n, mod, modlen);
+
+  /* Newton iteration, each step doubles the number of correct bits.  An
+     odd number is its own inverse modulo 8.  */
+  x = ctx->mod[0];
+  for (i = 0; i < 5; i++)
+    x *= 2 - ctx->mod[0] * x;
+  ctx->n0inv = -x;
+
+  /* This is done once per key, so simple doubling is good enough.  */
+  grub_memset (ctx->one, 0, n * LIMB_BYTES);
+  ctx->one[0] = 1;
+  if (cmp (ctx->one, ctx->mod, n) >= 0)
+    ctx->one[0] = 0;
+  for (i = 0; i < n * LIMB_BITS; i++)
+    mod_double (ctx, ctx->one);
+  grub_memcpy (ctx->rr, ctx->one, n * LIMB_BYTES);
+  for (i = 0; i < n * LIMB_BITS; i++)
+    mod_double (ctx, ctx->rr);
+
+  return ctx;
+}
+
+void
+grub_mont_ctx_free (grub_mont_ctx_t ctx)
+{
+  if (!ctx)
+    return;
+  grub_free (ctx->mod);
+  grub_free (ctx);
+}
+
+/* Coarsely integrated operand scanning: interleave the multiplication
+   with the reduction so the intermediate result never exceeds N + 2
+   limbs.  */
+void
+grub_mont_mul (grub_mont_ctx_t ctx, grub_mont_limb_t *out,
+	       const grub_mont_limb_t *a, const grub_mont_limb_t *b)
+{
+  grub_mont_limb_t *t = ctx->tmp;
+  const grub_mont_limb_t *mod = ctx->mod;
+  grub_size_t n = ctx->n, i, j;
+
+  grub_memset (t, 0, (n + 1) * LIMB_BYTES);
+
+  for (i = 0; i < n; i++)
+    {
+      grub_mont_limb_t carry = 0, m, bi = b[i];
+      grub_mont_dlimb_t p;
+
+      for (j = 0; j < n; j++)
+	{
+	  p = (grub_mont_dlimb_t) a[j] * bi + t[j] + carry;
+	  t[j] = (grub_mont_limb_t) p;
+	  carry = p >> LIMB_BITS;
+	}
+      p = (grub_mont_dlimb_t) t[n] + carry;
+      t[n] = (grub_mont_limb_t) p;
+      t[n + 1] = p >> LIMB_BITS;
+
+      /* Add M * MOD, which clears the lowest limb, and shift it out.  */
+      m = t[0] * ctx->n0inv;
+      p = (grub_mont_dlimb_t) m * mod[0] + t[0];
+      carry = p >> LIMB_BITS;
+      for (j = 1; j < n; j++)
+	{
+	  p = (grub_mont_dlimb_t) m * mod[j] + t[j] + carry;
+	  t[j - 1] = (grub_mont_limb_t) p;
+	  carry = p >> LIMB_BITS;
+	}
+      p = (grub_mont_dlimb_t) t[n] + carry;
+      t[n - 1] = (grub_mont_limb_t) p;
+      t[n] = t[n + 1] + (grub_mont_limb_t) (p >> LIMB_BITS);
+    }
+
+  if (t[n] || cmp (t, mod, n) >= 0)
+    sub (out, t, mod, n);
+  else
+    grub_memcpy (out, t, n * LIMB_BYTES);
+}
+
+grub_err_t
+grub_mont_import (grub_mont_ctx_t ctx, grub_mont_limb_t *out,
+		  const grub_uint8_t *in, grub_size_t inlen)
+{
+  if (!from_bytes (out, ctx->n, in, inlen)
+      || cmp (out, ctx->mod, ctx->n) >= 0)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "number exceeds modulus");
+
+  grub_mont_mul (ctx, out, out, ctx->rr);
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+grub_mont_export (grub_mont_ctx_t ctx, grub_uint8_t *out, grub_size_t outlen,
+		  const grub_mont_limb_t *in)
+{
+  grub_mont_limb_t *x;
+  grub_size_t i;
+
+  x = grub_mont_alloc (ctx, 2);
+  if (!x)
+    return grub_errno;
+
+  /* Multiplying by a plain 1 divides by R.  */
+  grub_memset (x + ctx->n, 0, ctx->n * LIMB_BYTES);
+  x[ctx->n] = 1;
+  grub_mont_mul (ctx, x, in, x + ctx->n);
+
+  for (i = 0; i < ctx->n * LIMB_BYTES; i++)
+    {
+      grub_uint8_t c = x[i / LIMB_BYTES] >> (8 * (i % LIMB_BYTES));
+
+      if (i < outlen)
+	out[outlen - 1 - i] = c;
+      else if (c)
+	{
+	  grub_free (x);
+	  return grub_error (GRUB_ERR_OUT_OF_RANGE, "buffer too small");
+	}
+    }
+  if (outlen > ctx->n * LIMB_BYTES)
+    grub_memset (out, 0, outlen - ctx->n * LIMB_BYTES);
+
+  grub_free (x);
+  return GRUB_ERR_NONE;
+}
+
+grub_mont_limb_t *
+grub_mont_table_new (grub_mont_ctx_t ctx, const grub_mont_limb_t *base)
+{
+  grub_mont_limb_t *table;
+  grub_size_t n = ctx->n, i;
+
+  table = grub_mont_alloc (ctx, GRUB_MONT_TABLE_SIZE);
+  if (!table)
+    return NULL;
+
+  grub_memcpy (table, ctx->one, n * LIMB_BYTES);
+  grub_memcpy (table + n, base, n * LIMB_BYTES);
+  for (i = 2; i < GRUB_MONT_TABLE_SIZE; i++)
+    grub_mont_mul (ctx, table + i * n, table + (i - 1) * n, base);
+
+  return table;
+}
+
+/* Window I of EXP, counting from the most significant one, with EXP
+   zero-extended to LEN bytes.  */
+static inline unsigned
+window (const grub_uint8_t *exp, grub_size_t explen, grub_size_t len,
+	grub_size_t i)
+{
+  grub_size_t pos = i / 2;
+  grub_uint8_t b;
+
+  if (pos < len - explen)
+    return 0;
+  b = exp[pos - (len - explen)];
+  return (i & 1) ? (b & 0xf) : (b >> 4);
+}
+
+void
+grub_mont_powm2 (grub_mont_ctx_t ctx, grub_mont_limb_t *out,
+		 const grub_mont_limb_t *tablea,
+		 const grub_uint8_t *expa, grub_size_t expalen,
+		 const grub_mont_limb_t *tableb,
+		 const grub_uint8_t *expb, grub_size_t expblen)
+{
+  grub_size_t n = ctx->n, len, i;
+  int started = 0;
+
+  if (!tableb)
+    expblen = 0;
+  len = expalen > expblen ? expalen : expblen;
+
+  grub_memcpy (out, ctx->one, n * LIMB_BYTES);
+  for (i = 0; i < 2 * len; i++)
+    {
+      unsigned wa, wb, k;
+
+      /* Squaring 1 is pointless, skip it until the first nonzero
+	 window.  */
+      if (started)
+	for (k = 0; k < GRUB_MONT_WINDOW_BITS; k++)
+	  grub_mont_mul (ctx, out, out, out);
+
+      wa = window (expa, expalen, len, i);
+      if (wa)
+	{
+	  grub_mont_mul (ctx, out, out, tablea + wa * n);
+	  started = 1;
+	}
+      if (expblen)
+	{
+	  wb = window (expb, expblen, len, i);
+	  if (wb)
+	    {
+	      grub_mont_mul (ctx, out, out, tableb + wb * n);
+	      started = 1;
+	    }
+	}
+    }
+}
+
+grub_err_t
+grub_mont_powm (grub_mont_ctx_t ctx, grub_mont_limb_t *out,
+		const grub_mont_limb_t *base,
+		const grub_uint8_t *exp, grub_size_t explen)
+{
+  grub_mont_limb_t *b;
+  grub_size_t i;
+
+  while (explen && *exp == 0)
+    {
+      exp++;
+      explen--;
+    }
+
+  /* Typical RSA exponents like 65537 are too short for the table to pay
+     off, use plain square and multiply for them.  */
+  if (explen <= 4)
+    {
+      int started = 0;
+
+      b = grub_mont_alloc (ctx, 1);
+      if (!b)
+	return grub_errno;
+      grub_memcpy (b, base, ctx->n * LIMB_BYTES);
+      grub_memcpy (out, ctx->one, ctx->n * LIMB_BYTES);
+      for (i = 0; i < 8 * explen; i++)
+	{
+	  if (started)
+	    grub_mont_mul (ctx, out, out, out);
+	  if (exp[i / 8] & (0x80 >> (i % 8)))
+	    {
+	      grub_mont_mul (ctx, out, out, b);
+	      started = 1;
+	    }
+	}
+      grub_free (b);
+      return GRUB_ERR_NONE;
+    }
+
+  b = grub_mont_table_new (ctx, base);
+  if (!b)
+    return grub_errno;
+  grub_mont_powm2 (ctx, out, b, exp, explen, NULL, NULL, 0);
+  grub_free (b);
+  return GRUB_ERR_NONE;
+}
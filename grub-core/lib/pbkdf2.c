@@ -25,6 +25,27 @@
 
 GRUB_MOD_LICENSE ("GPLv2+");
 
+/* HMAC of DATA using the states INNER and OUTER reached after hashing the
+   ipad and opad key blocks.  The pad blocks are only hashed once per key,
+   so every iteration costs two compression function calls (for digests
+   whose block is larger than the message) instead of four.  */
+static void
+hmac_precomputed (const struct gcry_md_spec *md,
+		  const void *inner, const void *outer, void *ctx,
+		  const grub_uint8_t *data, grub_size_t datalen,
+		  grub_uint8_t *out)
+{
+  grub_memcpy (ctx, inner, md->contextsize);
+  md->write (ctx, data, datalen);
+  md->final (ctx);
+  grub_memcpy (out, md->read (ctx), md->mdlen);
+
+  grub_memcpy (ctx, outer, md->contextsize);
+  md->write (ctx, out, md->mdlen);
+  md->final (ctx);
+  grub_memcpy (out, md->read (ctx), md->mdlen);
+}
+
 /* Implement PKCS#5 PBKDF2 as per RFC 2898.  The PRF to use is HMAC variant
    of digest supplied by MD.  Inputs are the password P of length PLEN,
    the salt S of length SLEN, the iteration counter C (> 0), and the
@@ -42,18 +63,23 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   unsigned int hLen = md->mdlen;
   grub_uint8_t U[GRUB_CRYPTO_MAX_MDLEN];
   grub_uint8_t T[GRUB_CRYPTO_MAX_MDLEN];
+  grub_uint8_t key[GRUB_CRYPTO_MAX_MDLEN];
   unsigned int u;
   unsigned int l;
   unsigned int r;
   unsigned int i;
   unsigned int k;
-  gcry_err_code_t rc;
-  grub_uint8_t *tmp;
+  gcry_err_code_t rc = GPG_ERR_NO_ERROR;
+  grub_uint8_t *tmp = NULL, *pad = NULL;
+  void *inner = NULL, *outer = NULL, *ctx = NULL;
   grub_size_t tmplen = Slen + 4;
 
   if (md->mdlen > GRUB_CRYPTO_MAX_MDLEN || md->mdlen == 0)
     return GPG_ERR_INV_ARG;
 
+  if (md->mdlen > md->blocksize)
+    return GPG_ERR_INV_ARG;
+
   if (c == 0)
     return GPG_ERR_INV_ARG;
 
@@ -67,43 +93,75 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   r = dkLen - (l - 1) * hLen;
 
   tmp = grub_malloc (tmplen);
-  if (tmp == NULL)
-    return GPG_ERR_OUT_OF_MEMORY;
+  pad = grub_malloc (md->blocksize);
+  inner = grub_malloc (md->contextsize);
+  outer = grub_malloc (md->contextsize);
+  ctx = grub_malloc (md->contextsize);
+  if (!tmp || !pad || !inner || !outer || !ctx)
+    {
+      rc = GPG_ERR_OUT_OF_MEMORY;
+      goto out;
+    }
+
+  /* Keys longer than a block are replaced by their digest.  */
+  if (Plen > md->blocksize)
+    {
+      grub_crypto_hash (md, key, P, Plen);
+      P = key;
+      Plen = hLen;
+    }
+
+  grub_memset (pad, 0x36, md->blocksize);
+  for (k = 0; k < Plen; k++)
+    pad[k] ^= P[k];
+  md->init (inner);
+  md->write (inner, pad, md->blocksize);
+
+  grub_memset (pad, 0x5c, md->blocksize);
+  for (k = 0; k < Plen; k++)
+    pad[k] ^= P[k];
+  md->init (outer);
+  md->write (outer, pad, md->blocksize);
 
   grub_memcpy (tmp, S, Slen);
 
   for (i = 1; i - 1 < l; i++)
     {
-      grub_memset (T, 0, hLen);
+      tmp[Slen + 0] = (i & 0xff000000) >> 24;
+      tmp[Slen + 1] = (i & 0x00ff0000) >> 16;
+      tmp[Slen + 2] = (i & 0x0000ff00) >> 8;
+      tmp[Slen + 3] = (i & 0x000000ff) >> 0;
+
+      hmac_precomputed (md, inner, outer, ctx, tmp, tmplen, U);
+      grub_memcpy (T, U, hLen);
 
-      for (u = 0; u < c; u++)
+      for (u = 1; u < c; u++)
 	{
-	  if (u == 0)
-	    {
-	      tmp[Slen + 0] = (i & 0xff000000) >> 24;
-	      tmp[Slen + 1] = (i & 0x00ff0000) >> 16;
-	      tmp[Slen + 2] = (i & 0x0000ff00) >> 8;
-	      tmp[Slen + 3] = (i & 0x000000ff) >> 0;
-
-	      rc = grub_crypto_hmac_buffer (md, P, Plen, tmp, tmplen, U);
-	    }
-	  else
-	    rc = grub_crypto_hmac_buffer (md, P, Plen, U, hLen, U);
-
-	  if (rc != GPG_ERR_NO_ERROR)
-	    {
-	      grub_free (tmp);
-	      return rc;
-	    }
-
-	  for (k = 0; k < hLen; k++)
-	    T[k] ^= U[k];
+	  hmac_precomputed (md, inner, outer, ctx, U, hLen, U);
+	  grub_crypto_xor (T, T, U, hLen);
 	}
 
       grub_memcpy (DK + (i - 1) * hLen, T, i == l ? r : hLen);
     }
 
+ out:
+  /* Everything but the salt is derived from the password.  */
+  if (pad)
+    grub_memset (pad, 0, md->blocksize);
+  if (inner)
+    grub_memset (inner, 0, md->contextsize);
+  if (outer)
+    grub_memset (outer, 0, md->contextsize);
+  if (ctx)
+    grub_memset (ctx, 0, md->contextsize);
+  grub_memset (key, 0, sizeof (key));
+  grub_memset (U, 0, sizeof (U));
+  grub_memset (T, 0, sizeof (T));
   grub_free (tmp);
+  grub_free (pad);
+  grub_free (inner);
+  grub_free (outer);
+  grub_free (ctx);
 
-  return GPG_ERR_NO_ERROR;
+  return rc;
 }
@@ -0,0 +1,160 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/crypto.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* FIPS-197, appendix C.  */
+static const grub_uint8_t plaintext[16] =
+  "\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xaa\xbb\xcc\xdd\xee\xff";
+
+static const grub_uint8_t key[32] =
+  "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+  "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f";
+
+static struct
+{
+  unsigned keylen;
+  const char *ciphertext;
+} vectors[] = {
+  { 16, "\x69\xc4\xe0\xd8\x6a\x7b\x04\x30\xd8\xcd\xb7\x80\x70\xb4\xc5\x5a" },
+  { 24, "\xdd\xa9\x7c\xa4\x86\x4c\xdf\xe0\x6e\xaf\x70\xa0\xec\x0d\x71\x91" },
+  { 32, "\x8e\xa2\xb7\xca\x51\x67\x45\xbf\xea\xfc\x49\x90\x4b\x49\x60\x89" }
+};
+
+/* More than one multi-block batch plus a tail.  */
+#define NBLOCKS 11
+
+/* Sectors shorter than a batch, so batches straddle sector boundaries.  */
+#define XTS_SECTORS 3
+#define XTS_SECTOR_BLOCKS 3
+
+/* Multiply the XTS tweak T by x, IEEE 1619 5.2.  */
+static void
+xts_mul_x (grub_uint8_t *t)
+{
+  grub_uint8_t carry = t[15] >> 7;
+  int i;
+
+  for (i = 15; i > 0; i--)
+    t[i] = (t[i] << 1) | (t[i - 1] >> 7);
+  t[0] = (t[0] << 1) ^ (carry ? 0x87 : 0);
+}
+
+static void
+aesni_test (void)
+{
+  const gcry_cipher_spec_t *aes;
+  grub_crypto_cipher_handle_t cipher;
+  grub_uint8_t buf[16 * NBLOCKS], ref[16 * NBLOCKS], orig[16 * NBLOCKS];
+  grub_uint8_t iv[16], iv2[16], t[16];
+  grub_uint8_t tweaks[16 * XTS_SECTORS];
+  grub_size_t i, j;
+
+  /* The generic AES would pass as well, make sure it isn't what gets
+     tested.  aesni doesn't register anything on CPUs without AES-NI.  */
+  grub_dl_load ("aesni");
+  grub_errno = GRUB_ERR_NONE;
+  aes = grub_crypto_lookup_cipher_by_name ("AES");
+  if (!aes || !aes->xts_encrypt)
+    {
+      grub_printf ("AES-NI is not supported, skipping the test\n");
+      return;
+    }
+
+  cipher = grub_crypto_cipher_open (aes);
+  grub_test_assert (cipher != NULL, "cipher open failed");
+  if (!cipher)
+    return;
+
+  for (i = 0; i < ARRAY_SIZE (vectors); i++)
+    {
+      gcry_err_code_t err;
+
+      err = grub_crypto_cipher_set_key (cipher, key, vectors[i].keylen);
+      grub_test_assert (err == 0, "gcry error %d", err);
+
+      for (j = 0; j < NBLOCKS; j++)
+	grub_memcpy (buf + 16 * j, plaintext, 16);
+      err = grub_crypto_ecb_encrypt (cipher, buf, buf, sizeof (buf));
+      grub_test_assert (err == 0, "gcry error %d", err);
+      for (j = 0; j < NBLOCKS; j++)
+	grub_test_assert (grub_memcmp (buf + 16 * j, vectors[i].ciphertext,
+				       16) == 0,
+			  "AES-%u encryption mismatch in block %"
+			  PRIuGRUB_SIZE, vectors[i].keylen * 8, j);
+
+      err = grub_crypto_ecb_decrypt (cipher, buf, buf, sizeof (buf));
+      grub_test_assert (err == 0, "gcry error %d", err);
+      for (j = 0; j < NBLOCKS; j++)
+	grub_test_assert (grub_memcmp (buf + 16 * j, plaintext, 16) == 0,
+			  "AES-%u decryption mismatch in block %"
+			  PRIuGRUB_SIZE, vectors[i].keylen * 8, j);
+
+      /* CBC decryption has to match the block-by-block definition.  */
+      for (j = 0; j < sizeof (buf); j++)
+	buf[j] = j * 7 + 3;
+      for (j = 0; j < sizeof (iv); j++)
+	iv[j] = iv2[j] = 0xa5 ^ j;
+      for (j = 0; j < NBLOCKS; j++)
+	{
+	  aes->decrypt (cipher->ctx, ref + 16 * j, buf + 16 * j);
+	  grub_crypto_xor (ref + 16 * j, ref + 16 * j,
+			   j ? buf + 16 * (j - 1) : iv2, 16);
+	}
+      err = grub_crypto_cbc_decrypt (cipher, buf, buf, sizeof (buf), iv);
+      grub_test_assert (err == 0, "gcry error %d", err);
+      grub_test_assert (grub_memcmp (buf, ref, sizeof (buf)) == 0,
+			"AES-%u CBC mismatch", vectors[i].keylen * 8);
+
+      /* XTS has to match the block-by-block definition too, with the
+	 tweak restarting from TWEAKS at every sector.  */
+      for (j = 0; j < sizeof (tweaks); j++)
+	tweaks[j] = j * 13 + 1;
+      for (j = 0; j < XTS_SECTORS * XTS_SECTOR_BLOCKS; j++)
+	{
+	  if (j % XTS_SECTOR_BLOCKS == 0)
+	    grub_memcpy (t, tweaks + 16 * (j / XTS_SECTOR_BLOCKS), 16);
+	  grub_crypto_xor (ref + 16 * j, buf + 16 * j, t, 16);
+	  aes->encrypt (cipher->ctx, ref + 16 * j, ref + 16 * j);
+	  grub_crypto_xor (ref + 16 * j, ref + 16 * j, t, 16);
+	  xts_mul_x (t);
+	}
+      grub_memcpy (orig, buf, sizeof (buf));
+      aes->xts_encrypt (cipher->ctx, buf, buf, XTS_SECTORS,
+			XTS_SECTOR_BLOCKS, tweaks);
+      grub_test_assert (grub_memcmp (buf, ref,
+				     16 * XTS_SECTORS * XTS_SECTOR_BLOCKS) == 0,
+			"AES-%u XTS encryption mismatch",
+			vectors[i].keylen * 8);
+      aes->xts_decrypt (cipher->ctx, buf, buf, XTS_SECTORS,
+			XTS_SECTOR_BLOCKS, tweaks);
+      grub_test_assert (grub_memcmp (buf, orig, sizeof (buf)) == 0,
+			"AES-%u XTS decryption mismatch",
+			vectors[i].keylen * 8);
+    }
+
+  grub_crypto_cipher_close (cipher);
+}
+
+/* Register aesni_test method as a functional test.  */
+GRUB_FUNCTIONAL_TEST (aesni_test, aesni_test);
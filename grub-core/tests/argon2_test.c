@@ -0,0 +1,139 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/time.h>
+#include <grub/crypto.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Generated with the reference implementation (phc-winner-argon2).  */
+static struct
+{
+  grub_crypto_argon2_type_t type;
+  const char *P;
+  grub_size_t Plen;
+  const char *S;
+  grub_size_t Slen;
+  grub_uint32_t t_cost;
+  grub_uint32_t m_cost;
+  grub_uint32_t parallelism;
+  grub_size_t dkLen;
+  const char *DK;
+} vectors[] = {
+  {
+    GRUB_CRYPTO_ARGON2D,
+    "password", 8,
+    "somesalt", 8,
+    2, 64, 2, 32,
+    "\xd6\xaf\x1b\x80\x3d\x31\x62\x22\xb7\xb0\xc0\xad\xfe\xe2\x2b\xca"
+    "\xbe\xe3\x3f\x48\x34\xe1\xfb\x3d\x40\xe2\x13\x7a\xc0\xbb\x33\xcf"
+  },
+  {
+    GRUB_CRYPTO_ARGON2I,
+    "password", 8,
+    "somesalt", 8,
+    2, 64, 2, 32,
+    "\xbb\x71\x02\xd9\x0a\x58\x0d\x2a\xa1\xc1\xa8\x38\x17\xf2\x4a\xb1"
+    "\x8c\x7c\xc8\x10\xcc\xd2\xc2\xa0\xd0\xc8\x0c\x94\xad\x29\x91\x67"
+  },
+  {
+    GRUB_CRYPTO_ARGON2ID,
+    "password", 8,
+    "somesalt", 8,
+    2, 64, 2, 32,
+    "\x94\x38\x74\x15\xdf\xb8\x4e\xd1\x97\x74\x65\xa1\xe8\x62\x60\x73"
+    "\xad\xf4\x2b\xd4\xee\xae\x1f\xaa\x1d\xd4\xe2\x3a\x1f\xf6\x85\x9f"
+  },
+  /* Four lanes at the minimum memory cost.  */
+  {
+    GRUB_CRYPTO_ARGON2ID,
+    "\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01"
+    "\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01", 32,
+    "\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02", 16,
+    3, 32, 4, 32,
+    "\x03\xaa\xb9\x65\xc1\x20\x01\xc9\xd7\xd0\xd2\xde\x33\x19\x2c\x04"
+    "\x94\xb6\x84\xbb\x14\x81\x96\xd7\x3c\x1d\xf1\xac\xaf\x6d\x0c\x2e"
+  },
+  /* Output longer than one BLAKE2b digest.  */
+  {
+    GRUB_CRYPTO_ARGON2ID,
+    "password", 8,
+    "somesalt", 8,
+    1, 256, 1, 100,
+    "\x31\x97\x82\xa7\xb8\xf8\xfb\x39\xe7\xfc\x7e\xb5\x1e\x4a\x22\x63"
+    "\x9f\x1d\x2a\x3c\x6c\xf8\x26\x74\x11\xba\x23\x11\x67\xce\x0d\x8d"
+    "\x41\xe6\xbb\x1b\x20\xbb\xb0\x28\x6b\x32\x4a\xd0\x26\x61\x57\xd8"
+    "\xd8\xd4\x6a\x9e\x76\x92\x8b\x8f\xe8\x86\xd9\x72\xaa\x63\xb4\x03"
+    "\xb0\x84\x3b\x84\x9c\x7f\x2a\xa5\x22\x6e\xe8\x29\x05\x03\x0f\x73"
+    "\xa1\xfe\x55\x8f\x53\xe8\x11\x66\xc8\xf7\xdd\xe0\xe6\x13\x0d\xf8"
+    "\xbf\x6f\x52\xec"
+  }
+};
+
+/* 8 MiB, one pass.  */
+static const grub_uint8_t bench_dk[32] =
+  "\x07\x20\x04\x54\xa4\xc2\x36\x9a\x89\x37\x41\xc6\xbf\x63\x55\xf2"
+  "\x9b\xf3\x57\x85\x7c\xc5\xeb\x8e\x87\x95\x10\x4f\xbe\x70\xa3\x8e";
+
+static void
+argon2_test (void)
+{
+  grub_size_t i;
+  gcry_err_code_t err;
+  grub_uint8_t DK[100];
+  grub_uint64_t start;
+
+  for (i = 0; i < ARRAY_SIZE (vectors); i++)
+    {
+      err = grub_crypto_argon2 (vectors[i].type,
+				(const grub_uint8_t *) vectors[i].P,
+				vectors[i].Plen,
+				(const grub_uint8_t *) vectors[i].S,
+				vectors[i].Slen,
+				vectors[i].t_cost, vectors[i].m_cost,
+				vectors[i].parallelism,
+				DK, vectors[i].dkLen);
+      grub_test_assert (err == 0, "gcry error %d", err);
+      grub_test_assert (grub_memcmp (DK, vectors[i].DK, vectors[i].dkLen) == 0,
+			"Argon2 mismatch in vector %" PRIuGRUB_SIZE, i);
+    }
+
+  start = grub_get_time_ms ();
+  err = grub_crypto_argon2 (GRUB_CRYPTO_ARGON2ID,
+			    (const grub_uint8_t *) "password", 8,
+			    (const grub_uint8_t *) "somesalt", 8,
+			    1, 8192, 1, DK, sizeof (bench_dk));
+  grub_dprintf ("argon2", "8 MiB Argon2id took %llu ms\n",
+		(unsigned long long) (grub_get_time_ms () - start));
+  grub_test_assert (err == 0, "gcry error %d", err);
+  grub_test_assert (grub_memcmp (DK, bench_dk, sizeof (bench_dk)) == 0,
+		    "Argon2 mismatch in 8 MiB vector");
+
+  /* Too little memory for the requested lanes.  */
+  err = grub_crypto_argon2 (GRUB_CRYPTO_ARGON2ID,
+			    (const grub_uint8_t *) "password", 8,
+			    (const grub_uint8_t *) "somesalt", 8,
+			    1, 16, 4, DK, 32);
+  grub_test_assert (err == GPG_ERR_INV_ARG, "invalid memory cost accepted");
+}
+
+/* Register argon2_test method as a functional test.  */
+GRUB_FUNCTIONAL_TEST (argon2_test, argon2_test);
@@ -0,0 +1,94 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/zfs/zfs.h>
+#include <grub/zfs/zio.h>
+#include <grub/zfs/zio_checksum.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Large enough for a typical record, sizes are multiples of 4.  */
+#define MAXLEN 0x20000
+#define ROUNDS 64
+
+static grub_uint32_t seed = 0x2545f491;
+
+static grub_uint32_t
+next (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static void
+fletcher4_test (void)
+{
+  const struct fletcher_4_impl *impl, *ref = NULL;
+  grub_uint8_t *buf;
+  zio_cksum_t want, got;
+  grub_size_t i, size, off;
+  unsigned round;
+  int e;
+
+  buf = grub_malloc (MAXLEN + 16);
+  grub_test_assert (buf != NULL, "out of memory");
+  if (!buf)
+    return;
+
+  for (impl = fletcher_4_impls; impl->name; impl++)
+    ref = impl;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      /* Short buffers exercise the tails, odd offsets unaligned loads.  */
+      size = 4 * (next () % (round < ROUNDS / 2 ? 64 : MAXLEN / 4));
+      off = 4 * (round % 4);
+      for (i = 0; i < size; i++)
+	buf[off + i] = next ();
+
+      for (e = 0; e < 2; e++)
+	{
+	  grub_zfs_endian_t endian = e ? GRUB_ZFS_BIG_ENDIAN
+	    : GRUB_ZFS_LITTLE_ENDIAN;
+
+	  ref->compute (buf + off, size, endian, &want);
+	  for (impl = fletcher_4_impls; impl->name; impl++)
+	    {
+	      if (!impl->is_supported ())
+		continue;
+	      impl->compute (buf + off, size, endian, &got);
+	      grub_test_assert (grub_memcmp (&got, &want, sizeof (got)) == 0,
+				"%s mismatch for %" PRIuGRUB_SIZE " bytes",
+				impl->name, size);
+	    }
+	  fletcher_4 (buf + off, size, endian, &got);
+	  grub_test_assert (grub_memcmp (&got, &want, sizeof (got)) == 0,
+			    "fletcher_4 mismatch for %" PRIuGRUB_SIZE " bytes",
+			    size);
+	}
+    }
+
+  grub_free (buf);
+}
+
+/* Register fletcher4_test method as a functional test.  */
+GRUB_FUNCTIONAL_TEST (fletcher4_test, fletcher4_test);
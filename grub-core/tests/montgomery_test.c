@@ -0,0 +1,147 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/montgomery.h>
+#include <grub/gcrypt/gcrypt.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define MODLEN 256
+
+static grub_uint32_t seed = 0x12345678;
+
+static void
+fill (grub_uint8_t *buf, grub_size_t len)
+{
+  grub_size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      buf[i] = seed >> 16;
+    }
+}
+
+static gcry_mpi_t
+scan (const grub_uint8_t *buf, grub_size_t len)
+{
+  gcry_mpi_t ret = NULL;
+
+  gcry_mpi_scan (&ret, GCRYMPI_FMT_USG, buf, len, 0);
+  return ret;
+}
+
+static int
+equal (grub_mont_ctx_t ctx, const grub_mont_limb_t *x, gcry_mpi_t ref)
+{
+  grub_uint8_t out[MODLEN];
+  gcry_mpi_t v;
+  int ret;
+
+  if (grub_mont_export (ctx, out, sizeof (out), x))
+    return 0;
+  v = scan (out, sizeof (out));
+  ret = gcry_mpi_cmp (v, ref) == 0;
+  gcry_mpi_release (v);
+  return ret;
+}
+
+static void
+montgomery_test (void)
+{
+  grub_uint8_t mod[MODLEN], a[MODLEN], b[MODLEN], e1[32], e2[20];
+  static const grub_uint8_t e65537[3] = { 0x01, 0x00, 0x01 };
+  gcry_mpi_t m, ma, mb, me1, me2, ref, tmp;
+  grub_mont_limb_t *x, *y, *r, *ta, *tb;
+  grub_mont_ctx_t ctx;
+
+  fill (mod, sizeof (mod));
+  mod[0] |= 0x80;
+  mod[MODLEN - 1] |= 1;
+  fill (a, sizeof (a));
+  a[0] &= 0x7f;
+  fill (b, sizeof (b));
+  b[0] &= 0x7f;
+  fill (e1, sizeof (e1));
+  fill (e2, sizeof (e2));
+
+  ctx = grub_mont_ctx_new (mod, sizeof (mod));
+  grub_test_assert (ctx != NULL, "context setup failed");
+  if (!ctx)
+    return;
+
+  m = scan (mod, sizeof (mod));
+  ma = scan (a, sizeof (a));
+  mb = scan (b, sizeof (b));
+  me1 = scan (e1, sizeof (e1));
+  me2 = scan (e2, sizeof (e2));
+  ref = gcry_mpi_new (0);
+  tmp = gcry_mpi_new (0);
+
+  x = grub_mont_alloc (ctx, 1);
+  y = grub_mont_alloc (ctx, 1);
+  r = grub_mont_alloc (ctx, 1);
+  grub_test_assert (grub_mont_import (ctx, x, a, sizeof (a)) == 0,
+		    "import failed");
+  grub_test_assert (grub_mont_import (ctx, y, b, sizeof (b)) == 0,
+		    "import failed");
+  grub_test_assert (grub_mont_import (ctx, r, mod, sizeof (mod)) != 0,
+		    "modulus accepted as input");
+  grub_errno = GRUB_ERR_NONE;
+
+  grub_mont_mul (ctx, r, x, y);
+  gcry_mpi_mulm (ref, ma, mb, m);
+  grub_test_assert (equal (ctx, r, ref), "multiplication mismatch");
+
+  grub_mont_powm (ctx, r, x, e65537, sizeof (e65537));
+  tmp = gcry_mpi_set_ui (tmp, 65537);
+  gcry_mpi_powm (ref, ma, tmp, m);
+  grub_test_assert (equal (ctx, r, ref), "short exponent mismatch");
+
+  grub_mont_powm (ctx, r, x, e1, sizeof (e1));
+  gcry_mpi_powm (ref, ma, me1, m);
+  grub_test_assert (equal (ctx, r, ref), "windowed exponent mismatch");
+
+  ta = grub_mont_table_new (ctx, x);
+  tb = grub_mont_table_new (ctx, y);
+  grub_mont_powm2 (ctx, r, ta, e1, sizeof (e1), tb, e2, sizeof (e2));
+  gcry_mpi_powm (tmp, mb, me2, m);
+  gcry_mpi_mulm (ref, ref, tmp, m);
+  grub_test_assert (equal (ctx, r, ref), "double exponent mismatch");
+
+  grub_free (ta);
+  grub_free (tb);
+  grub_free (x);
+  grub_free (y);
+  grub_free (r);
+  gcry_mpi_release (m);
+  gcry_mpi_release (ma);
+  gcry_mpi_release (mb);
+  gcry_mpi_release (me1);
+  gcry_mpi_release (me2);
+  gcry_mpi_release (ref);
+  gcry_mpi_release (tmp);
+  grub_mont_ctx_free (ctx);
+}
+
+/* Register montgomery_test method as a functional test.  */
+GRUB_FUNCTIONAL_TEST (montgomery_test, montgomery_test);
@@ -71,14 +71,22 @@ static struct
   }
 };
 
+/* RFC7914, PBKDF2-HMAC-SHA256.  */
+static const char sha256_dk[] =
+  "\x55\xac\x04\x6e\x56\xe3\x08\x9f\xec\x16\x91\xc2\x25\x44\xb6\x05"
+  "\xf9\x41\x85\x21\x6d\xde\x04\x65\xe6\x8b\x9d\x57\xc2\x0d\xac\xbc"
+  "\x49\xca\x9c\xcc\xf1\x79\xb6\x45\x99\x16\x64\xb3\x9d\x77\xef\x31"
+  "\x7c\x71\xb8\x45\xb1\xe3\x0b\xd5\x09\x11\x20\x41\xd3\xa1\x97\x83";
+
 static void
 pbkdf2_test (void)
 {
   grub_size_t i;
+  gcry_err_code_t err;
+  grub_uint8_t DK256[64];
 
   for (i = 0; i < ARRAY_SIZE (vectors); i++)
     {
-      gcry_err_code_t err;
       grub_uint8_t DK[32];
       err = grub_crypto_pbkdf2 (GRUB_MD_SHA1,
 				(const grub_uint8_t *) vectors[i].P,
@@ -91,6 +99,13 @@ pbkdf2_test (void)
       grub_test_assert (grub_memcmp (DK, vectors[i].DK, vectors[i].dkLen) == 0,
 			"PBKDF2 mismatch");
     }
+
+  err = grub_crypto_pbkdf2 (GRUB_MD_SHA256, (const grub_uint8_t *) "passwd", 6,
+			    (const grub_uint8_t *) "salt", 4, 1,
+			    DK256, sizeof (DK256));
+  grub_test_assert (err == 0, "gcry error %d", err);
+  grub_test_assert (grub_memcmp (DK256, sha256_dk, sizeof (DK256)) == 0,
+		    "PBKDF2-SHA256 mismatch");
 }
 
 /* Register example_test method as a functional test.  */
@@ -0,0 +1,238 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/disk.h>
+#include <grub/diskfilter.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Lengths around the vector and word sizes, and one block.  */
+static const grub_size_t lengths[] = { 0, 1, 7, 8, 15, 16, 17, 31, 63, 64,
+				       65, 127, 4096 + 13 };
+
+static const grub_uint8_t coefs[] = { 0, 1, 2, 3, 0x1d, 0x80, 0x8e, 0xfe,
+				      0xff };
+
+#define BUFLEN (4096 + 13 + 16)
+
+/* RAID6 with four data disks, P and Q.  */
+#define NDISKS 6
+#define CHUNK 512
+
+/* Multiplication in GF(2^8) modulo x^8+x^4+x^3+x^2+1, bit by bit so that
+   it shares nothing with the tables under test.  */
+static grub_uint8_t
+gf_mul (grub_uint8_t a, grub_uint8_t b)
+{
+  grub_uint8_t r = 0;
+
+  for (; b; b >>= 1)
+    {
+      if (b & 1)
+	r ^= a;
+      a = (a << 1) ^ ((a & 0x80) ? 0x1d : 0);
+    }
+  return r;
+}
+
+static grub_uint8_t
+byte_at (grub_size_t i, unsigned salt)
+{
+  return (i * 167 + salt * 59 + (i >> 8) * 13) ^ (salt << 4);
+}
+
+static void
+check_tables (void)
+{
+  grub_uint8_t v = 0x80;
+  unsigned i;
+
+  /* 2 * 0x80 wraps around to the low part of the polynomial.  */
+  grub_test_assert (gf_mul (2, 0x80) == 0x1d, "reference multiplication");
+  grub_raid_block_mul (2, (char *) &v, (char *) &v, 1);
+  grub_test_assert (v == 0x1d, "2 * 0x80 = 0x%02x, expected 0x1d", v);
+
+  for (i = 0; i < 255; i++)
+    {
+      grub_test_assert (grub_raid_powx[i + 1] == gf_mul (grub_raid_powx[i], 2)
+			&& grub_raid_powx[i + 255] == grub_raid_powx[i],
+			"bad power table at %u", i);
+      grub_test_assert (grub_raid_powx_inv[grub_raid_powx[i]] == i,
+			"bad logarithm table at %u", i);
+    }
+}
+
+static void
+check_impl (const struct grub_raid_gf_impl *impl, char *src, char *dest,
+	    char *want)
+{
+  grub_size_t l, ofs, i;
+  unsigned k;
+
+  for (k = 0; k < ARRAY_SIZE (coefs); k++)
+    for (l = 0; l < ARRAY_SIZE (lengths); l++)
+      {
+	grub_size_t len = lengths[l];
+	grub_uint8_t c = coefs[k];
+
+	/* Source and destination misaligned by different amounts.  */
+	ofs = (k + l) % 16;
+	for (i = 0; i < len; i++)
+	  {
+	    src[i + ofs] = byte_at (i, k);
+	    dest[i] = byte_at (i, l + 100);
+	    want[i] = dest[i] ^ gf_mul (src[i + ofs], c);
+	  }
+	impl->mul_xor (c, dest, src + ofs, len);
+	grub_test_assert (grub_memcmp (dest, want, len) == 0,
+			  "%s: %" PRIuGRUB_SIZE " bytes += 0x%02x * src",
+			  impl->name, len, c);
+
+	for (i = 0; i < len; i++)
+	  want[i] = gf_mul (src[i + ofs], c);
+	impl->mul (c, dest, src + ofs, len);
+	grub_test_assert (grub_memcmp (dest, want, len) == 0,
+			  "%s: %" PRIuGRUB_SIZE " bytes = 0x%02x * src",
+			  impl->name, len, c);
+
+	for (i = 0; i < len; i++)
+	  want[i] ^= src[i + ofs];
+	impl->block_xor (dest, src + ofs, len);
+	grub_test_assert (grub_memcmp (dest, want, len) == 0,
+			  "%s: %" PRIuGRUB_SIZE " bytes ^= src",
+			  impl->name, len);
+      }
+}
+
+struct raid6_array
+{
+  char *disks[NDISKS];
+  int failed;
+};
+
+static grub_err_t
+read_disk (void *data, int disknr, grub_uint64_t sector, void *buf,
+	   grub_size_t size)
+{
+  struct raid6_array *array = data;
+
+  if (disknr == array->failed || sector != 0 || size != CHUNK)
+    return grub_error (GRUB_ERR_READ_ERROR, "disk %d failed", disknr);
+  grub_memcpy (buf, array->disks[disknr], size);
+  return GRUB_ERR_NONE;
+}
+
+/* Lay out a stripe with P on disk P and Q after it, computing the
+   syndromes with gf_mul, then rebuild every data disk with and without
+   a second failure.  */
+static void
+check_raid6 (struct raid6_array *array, char *buf, int p, int layout)
+{
+  int q = (p + 1) % NDISKS, pos, i, bad, other;
+  grub_size_t j;
+
+  grub_memset (array->disks[p], 0, CHUNK);
+  grub_memset (array->disks[q], 0, CHUNK);
+  for (i = 0, pos = (q + 1) % NDISKS; i < NDISKS - 2;
+       i++, pos = (pos + 1) % NDISKS)
+    {
+      int c = (layout & GRUB_RAID_LAYOUT_MUL_FROM_POS) ? pos : i;
+      grub_uint8_t g = 1;
+
+      for (; c; c--)
+	g = gf_mul (g, 2);
+      for (j = 0; j < CHUNK; j++)
+	{
+	  grub_uint8_t d = byte_at (j, pos + 7 * p);
+
+	  array->disks[pos][j] = d;
+	  array->disks[p][j] ^= d;
+	  array->disks[q][j] ^= gf_mul (d, g);
+	}
+    }
+
+  for (bad = 0; bad < NDISKS; bad++)
+    {
+      if (bad == p || bad == q)
+	continue;
+      for (other = -1; other < NDISKS; other++)
+	{
+	  if (other == bad)
+	    continue;
+	  array->failed = other;
+	  grub_memset (buf, 0, CHUNK);
+	  grub_test_assert (grub_raid6_recover_gen (array, NDISKS, bad, p, buf,
+						    0, CHUNK, layout,
+						    read_disk) == GRUB_ERR_NONE,
+			    "recovery of disk %d with disk %d failed",
+			    bad, other);
+	  grub_errno = GRUB_ERR_NONE;
+	  grub_test_assert (grub_memcmp (buf, array->disks[bad], CHUNK) == 0,
+			    "P=%d layout %d: disk %d rebuilt wrong with disk "
+			    "%d failed", p, layout, bad, other);
+	}
+    }
+}
+
+static void
+raid_gf_test (void)
+{
+  const struct grub_raid_gf_impl *impl;
+  struct raid6_array array;
+  char *src, *dest, *want;
+  int i;
+
+  check_tables ();
+
+  src = grub_malloc (BUFLEN);
+  dest = grub_malloc (BUFLEN);
+  want = grub_malloc (BUFLEN);
+  grub_memset (&array, 0, sizeof (array));
+  for (i = 0; i < NDISKS; i++)
+    array.disks[i] = grub_malloc (CHUNK);
+  for (i = 0; i < NDISKS; i++)
+    if (!array.disks[i])
+      break;
+  grub_test_assert (src && dest && want && i == NDISKS, "out of memory");
+  if (!src || !dest || !want || i < NDISKS)
+    goto out;
+
+  for (impl = grub_raid_gf_impls; impl->name; impl++)
+    if (impl->is_supported ())
+      check_impl (impl, src, dest, want);
+
+  for (i = 0; i < NDISKS; i++)
+    {
+      check_raid6 (&array, dest, i, GRUB_RAID_LAYOUT_LEFT_ASYMMETRIC);
+      check_raid6 (&array, dest, i, GRUB_RAID_LAYOUT_MUL_FROM_POS);
+    }
+
+ out:
+  for (i = 0; i < NDISKS; i++)
+    grub_free (array.disks[i]);
+  grub_free (src);
+  grub_free (dest);
+  grub_free (want);
+}
+
+/* Register raid_gf_test method as a functional test.  */
+GRUB_FUNCTIONAL_TEST (raid_gf_test, raid_gf_test);
@@ -47,6 +47,18 @@ struct grub_archelp_ops
 
   void
   (*rewind) (struct grub_archelp_data *data);
+
+  /* Optional.  Archives that can report the offset of the next header,
+     return to a given header and name their disk get a name index built
+     on first use, which later lookups are served from.  */
+  grub_off_t
+  (*tell) (struct grub_archelp_data *data);
+
+  void
+  (*seek) (struct grub_archelp_data *data, grub_off_t hofs);
+
+  grub_disk_t
+  (*get_disk) (struct grub_archelp_data *data);
 };
 
 grub_err_t
@@ -117,6 +117,31 @@ typedef void (*gcry_cipher_stdecrypt_t) (void *c,
 					 const unsigned char *inbuf,
 					 unsigned int n);
 
+/* Type for the optional cipher_ecb_encrypt/cipher_ecb_decrypt functions.
+   They process NBLOCKS consecutive blocks at once.  */
+typedef void (*gcry_cipher_ecb_t) (void *c,
+				   unsigned char *outbuf,
+				   const unsigned char *inbuf,
+				   grub_size_t nblocks);
+
+/* Type for the optional cipher_cbc_decrypt function.  IV is updated to the
+   last ciphertext block.  */
+typedef void (*gcry_cipher_cbc_t) (void *c,
+				   unsigned char *outbuf,
+				   const unsigned char *inbuf,
+				   grub_size_t nblocks,
+				   unsigned char *iv);
+
+/* Type for the optional cipher_xts_encrypt/cipher_xts_decrypt functions.
+   They process NSECTORS consecutive sectors of SECTOR_BLOCKS blocks each.
+   TWEAKS holds the already encrypted initial tweak of every sector.  */
+typedef void (*gcry_cipher_xts_t) (void *c,
+				   unsigned char *outbuf,
+				   const unsigned char *inbuf,
+				   grub_size_t nsectors,
+				   grub_size_t sector_blocks,
+				   const unsigned char *tweaks);
+
 typedef struct gcry_cipher_oid_spec
 {
   const char *oid;
@@ -141,6 +166,13 @@ typedef struct gcry_cipher_spec
   const char *modname;
 #endif
   struct gcry_cipher_spec *next;
+  /* Optional multi-block implementations.  Left NULL by the generic
+     libgcrypt ciphers, in which case the per-block functions are used.  */
+  gcry_cipher_ecb_t ecb_encrypt;
+  gcry_cipher_ecb_t ecb_decrypt;
+  gcry_cipher_cbc_t cbc_decrypt;
+  gcry_cipher_xts_t xts_encrypt;
+  gcry_cipher_xts_t xts_decrypt;
 } gcry_cipher_spec_t;
 
 /* Type for the md_init function.  */
@@ -393,6 +425,26 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
 		    unsigned int c,
 		    grub_uint8_t *DK, grub_size_t dkLen);
 
+typedef enum
+  {
+    GRUB_CRYPTO_ARGON2D = 0,
+    GRUB_CRYPTO_ARGON2I = 1,
+    GRUB_CRYPTO_ARGON2ID = 2
+  } grub_crypto_argon2_type_t;
+
+/* Implement the Argon2 memory-hard function as per RFC 9106, version 0x13.
+   Inputs are the password P of length PLEN, the salt S of length SLEN,
+   the number of passes T_COST, the memory size M_COST in KiB and the
+   number of lanes PARALLELISM.  DKLEN octets of output are written to
+   DK.  */
+gcry_err_code_t
+grub_crypto_argon2 (grub_crypto_argon2_type_t type,
+		    const grub_uint8_t *P, grub_size_t Plen,
+		    const grub_uint8_t *S, grub_size_t Slen,
+		    grub_uint32_t t_cost, grub_uint32_t m_cost,
+		    grub_uint32_t parallelism,
+		    grub_uint8_t *DK, grub_size_t dkLen);
+
 int
 grub_crypto_memcmp (const void *a, const void *b, grub_size_t n);
 
@@ -129,6 +129,8 @@ struct grub_diskfilter_node {
   char *name;
   struct grub_diskfilter_pv *pv;
   struct grub_diskfilter_lv *lv;
+  /* Sector following the last one read, to pick between copies.  */
+  grub_disk_addr_t next_sector;
 };
 
 struct grub_diskfilter_vg *
@@ -198,6 +200,43 @@ grub_raid6_recover_gen (void *data, grub_uint64_t nstripes, int disknr, int p,
 			    char *buf, grub_uint64_t sector, grub_size_t size,
 			    int layout, raid_recover_read_t read_func);
 
+/* GF(2^8) arithmetic with the RAID6 polynomial, provided by raidgf.  */
+
+/* x**y for y up to 2 * 254.  */
+extern grub_uint8_t grub_raid_powx[255 * 2];
+/* Such an s that x**s = y */
+extern unsigned grub_raid_powx_inv[256];
+
+/* DEST ^= SRC.  */
+void
+grub_raid_block_xor (char *dest, const char *src, grub_size_t size);
+
+/* DEST = COEF * SRC.  DEST may be SRC.  */
+void
+grub_raid_block_mul (grub_uint8_t coef, char *dest, const char *src,
+		     grub_size_t size);
+
+/* DEST ^= COEF * SRC.  */
+void
+grub_raid_block_mul_xor (grub_uint8_t coef, char *dest, const char *src,
+			 grub_size_t size);
+
+/* Implementations the functions above pick from at run time, terminated
+   by an entry with a NULL name.  The last real entry is the plain scalar
+   loop.  */
+struct grub_raid_gf_impl
+{
+  const char *name;
+  int (*is_supported) (void);
+  void (*block_xor) (char *dest, const char *src, grub_size_t size);
+  void (*mul) (grub_uint8_t coef, char *dest, const char *src,
+	       grub_size_t size);
+  void (*mul_xor) (grub_uint8_t coef, char *dest, const char *src,
+		   grub_size_t size);
+};
+
+extern const struct grub_raid_gf_impl grub_raid_gf_impls[];
+
 grub_err_t grub_diskfilter_vg_register (struct grub_diskfilter_vg *vg);
 
 grub_err_t
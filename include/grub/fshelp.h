@@ -88,4 +88,22 @@ EXPORT_FUNC(grub_fshelp_read_file) (grub_disk_t disk, grub_fshelp_node_t node,
 				    grub_off_t filesize, int log2blocksize,
 				    grub_disk_addr_t blocks_start);
 
+/* Like grub_fshelp_read_file, but GET_RUN translates the file block
+   BLOCK to a disk block and stores in *COUNT how many file blocks
+   starting at BLOCK follow it contiguously on disk, so that a whole
+   run is read with a single disk request.  A disk block of 0 means
+   *COUNT blocks of zeroes.  */
+grub_ssize_t
+EXPORT_FUNC(grub_fshelp_read_file_runs) (grub_disk_t disk,
+					 grub_fshelp_node_t node,
+					 grub_disk_read_hook_t read_hook,
+					 void *read_hook_data,
+					 grub_off_t pos, grub_size_t len,
+					 char *buf,
+					 grub_disk_addr_t (*get_run) (grub_fshelp_node_t node,
+								      grub_disk_addr_t block,
+								      grub_disk_addr_t *count),
+					 grub_off_t filesize, int log2blocksize,
+					 grub_disk_addr_t blocks_start);
+
 #endif /* ! GRUB_FSHELP_HEADER */
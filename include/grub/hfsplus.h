@@ -75,6 +75,15 @@ struct grub_hfsplus_compress_index
   grub_uint32_t size;
 };
 
+/* A decoded extent: COUNT blocks of the fork starting at FILEBLOCK are
+   stored from block START on.  */
+struct grub_hfsplus_run
+{
+  grub_uint32_t fileblock;
+  grub_uint32_t start;
+  grub_uint32_t count;
+};
+
 struct grub_hfsplus_file
 {
   struct grub_hfsplus_data *data;
@@ -90,6 +99,10 @@ struct grub_hfsplus_file
   struct grub_hfsplus_compress_index *compress_index;
   grub_uint32_t cbuf_block;
   grub_uint32_t compress_index_size;
+  /* All extents of the fork being read, including the ones from the
+     extent overflow file, or NULL to map blocks one by one.  */
+  struct grub_hfsplus_run *runs;
+  grub_size_t nruns;
 };
 
 struct grub_hfsplus_btree
@@ -101,6 +114,17 @@ struct grub_hfsplus_btree
   struct grub_hfsplus_file file;
 };
 
+#define GRUB_HFSPLUS_NODE_CACHE_SIZE 32
+
+/* A B+ tree node kept in memory.  */
+struct grub_hfsplus_node_cache
+{
+  struct grub_hfsplus_btree *tree;
+  grub_uint32_t node;
+  grub_uint32_t last_used;
+  char *buf;
+};
+
 /* Information about a "mounted" HFS+ filesystem.  */
 struct grub_hfsplus_data
 {
@@ -120,6 +144,9 @@ struct grub_hfsplus_data
      filesystem (one inside a plain HFS wrapper).  */
   grub_disk_addr_t embedded_offset;
   int case_sensitive;
+
+  struct grub_hfsplus_node_cache node_cache[GRUB_HFSPLUS_NODE_CACHE_SIZE];
+  grub_uint32_t node_clock;
 };
 
 /* Internal representation of a catalog key.  */
@@ -82,4 +82,31 @@ grub_cpu_is_cpuid_supported (void)
                 : "0" (num))
 #endif
 
+/* Same as grub_cpuid for leaves with subleaves selected by ECX.  */
+#ifdef __PIC__
+#define grub_cpuid_count(num,sub,a,b,c,d) \
+  asm volatile ("xchgl %%ebx, %1; cpuid; xchgl %%ebx, %1" \
+                : "=a" (a), "=r" (b), "=c" (c), "=d" (d)  \
+                : "0" (num), "2" (sub))
+#else
+#define grub_cpuid_count(num,sub,a,b,c,d) \
+  asm volatile ("cpuid" \
+                : "=a" (a), "=b" (b), "=c" (c), "=d" (d)  \
+                : "0" (num), "2" (sub))
+#endif
+
+/* SSE instructions fault unless CR0.EM is clear and CR4.OSFXSR is set.
+   GRUB never sets those up itself, so vector code may only be used when
+   the firmware already did (always the case on x86_64 EFI).  */
+static __inline int
+grub_cpu_is_sse_enabled (void)
+{
+  grub_addr_t cr0, cr4;
+
+  __asm__ __volatile__ ("mov %%cr0, %0" : "=r" (cr0));
+  __asm__ __volatile__ ("mov %%cr4, %0" : "=r" (cr4));
+
+  return !(cr0 & (1 << 2)) && (cr4 & (1 << 9));
+}
+
 #endif
@@ -0,0 +1,89 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_MONTGOMERY_HEADER
+#define GRUB_MONTGOMERY_HEADER 1
+
+#include <grub/types.h>
+#include <grub/err.h>
+
+/* Modular arithmetic in Montgomery form for public key operations.  None
+   of this is constant time, it must only ever see public data.  */
+
+#if defined (__x86_64__) || defined (__aarch64__)
+typedef grub_uint64_t grub_mont_limb_t;
+#else
+typedef grub_uint32_t grub_mont_limb_t;
+#endif
+
+/* Number of entries in a table made by grub_mont_table_new.  */
+#define GRUB_MONT_WINDOW_BITS 4
+#define GRUB_MONT_TABLE_SIZE (1 << GRUB_MONT_WINDOW_BITS)
+
+struct grub_mont_ctx;
+typedef struct grub_mont_ctx *grub_mont_ctx_t;
+
+/* Set up arithmetic modulo the odd big-endian number MOD of MODLEN
+   bytes.  */
+grub_mont_ctx_t
+grub_mont_ctx_new (const grub_uint8_t *mod, grub_size_t modlen);
+
+void
+grub_mont_ctx_free (grub_mont_ctx_t ctx);
+
+/* Allocate room for COUNT numbers modulo CTX.  Free with grub_free.  */
+grub_mont_limb_t *
+grub_mont_alloc (grub_mont_ctx_t ctx, grub_size_t count);
+
+/* Convert the big-endian number IN into Montgomery form.  IN must be
+   smaller than the modulus.  */
+grub_err_t
+grub_mont_import (grub_mont_ctx_t ctx, grub_mont_limb_t *out,
+		  const grub_uint8_t *in, grub_size_t inlen);
+
+/* Convert IN back to a big-endian number of OUTLEN bytes.  */
+grub_err_t
+grub_mont_export (grub_mont_ctx_t ctx, grub_uint8_t *out, grub_size_t outlen,
+		  const grub_mont_limb_t *in);
+
+/* OUT = A * B.  OUT may alias A or B.  */
+void
+grub_mont_mul (grub_mont_ctx_t ctx, grub_mont_limb_t *out,
+	       const grub_mont_limb_t *a, const grub_mont_limb_t *b);
+
+/* Return BASE^0 .. BASE^(GRUB_MONT_TABLE_SIZE - 1) for use with
+   grub_mont_powm2.  Free with grub_free.  */
+grub_mont_limb_t *
+grub_mont_table_new (grub_mont_ctx_t ctx, const grub_mont_limb_t *base);
+
+/* OUT = BASE ^ EXP, EXP being a big-endian number of EXPLEN bytes.  */
+grub_err_t
+grub_mont_powm (grub_mont_ctx_t ctx, grub_mont_limb_t *out,
+		const grub_mont_limb_t *base,
+		const grub_uint8_t *exp, grub_size_t explen);
+
+/* OUT = A ^ EXPA * B ^ EXPB with A and B given as tables.  The squarings
+   are shared between both exponents.  TABLEB may be NULL.  */
+void
+grub_mont_powm2 (grub_mont_ctx_t ctx, grub_mont_limb_t *out,
+		 const grub_mont_limb_t *tablea,
+		 const grub_uint8_t *expa, grub_size_t expalen,
+		 const grub_mont_limb_t *tableb,
+		 const grub_uint8_t *expb, grub_size_t expblen);
+
+#endif
@@ -101,6 +101,16 @@ enum
     GRUB_NTFS_RF_BLNK		= 1
   };
 
+enum
+  {
+    GRUB_NTFS_IE_NODE		= 1,
+    GRUB_NTFS_IE_END		= 2
+  };
+
+#define GRUB_NTFS_COLLATION_FILE_NAME	1
+#define GRUB_NTFS_LARGE_INDEX		1
+#define GRUB_NTFS_MAX_INDEX_DEPTH	16
+
 struct grub_ntfs_bpb
 {
   grub_uint8_t jmp_boot[3];
@@ -127,6 +137,14 @@ struct grub_ntfs_bpb
   grub_uint32_t checksum;
 } GRUB_PACKED;
 
+/* A decoded data run.  LCN is 0 for a sparse run.  */
+struct grub_ntfs_run
+{
+  grub_disk_addr_t vcn;
+  grub_disk_addr_t next_vcn;
+  grub_disk_addr_t lcn;
+};
+
 struct grub_ntfs_attr
 {
   int flags;
@@ -135,6 +153,10 @@ struct grub_ntfs_attr
   grub_uint32_t save_pos;
   grub_uint8_t *sbuf;
   struct grub_ntfs_file *mft;
+  /* Consecutive runs of the attribute of type RUN_TYPE decoded so far.  */
+  struct grub_ntfs_run *runs;
+  grub_size_t nruns, runs_alloc;
+  grub_uint8_t run_type;
 };
 
 struct grub_ntfs_file
@@ -148,6 +170,16 @@ struct grub_ntfs_file
   struct grub_ntfs_attr attr;
 };
 
+#define GRUB_NTFS_MFT_CACHE_SIZE	8
+
+/* A fixed-up MFT record.  */
+struct grub_ntfs_mft_cache
+{
+  grub_uint64_t mftno;
+  grub_uint64_t last_used;
+  grub_uint8_t *buf;
+};
+
 struct grub_ntfs_data
 {
   struct grub_ntfs_file cmft;
@@ -158,6 +190,12 @@ struct grub_ntfs_data
   int log_spc;
   grub_uint64_t mft_start;
   grub_uint64_t uuid;
+  struct grub_ntfs_mft_cache mft_cache[GRUB_NTFS_MFT_CACHE_SIZE];
+  grub_uint64_t mft_cache_clock;
+  /* $UpCase, read on the first index lookup.  */
+  grub_uint16_t *upcase;
+  grub_size_t upcase_len;
+  int upcase_read;
 };
 
 struct grub_ntfs_comp_table_element
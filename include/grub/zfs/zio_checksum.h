@@ -30,4 +30,16 @@ extern void fletcher_2 (const void *, grub_uint64_t, grub_zfs_endian_t endian,
 extern void fletcher_4 (const void *, grub_uint64_t, grub_zfs_endian_t endian,
 			zio_cksum_t *);
 
+/* Implementations fletcher_4 picks from at run time, terminated by an
+   entry with a NULL name.  The last real entry is the plain scalar loop.  */
+struct fletcher_4_impl
+{
+  const char *name;
+  int (*is_supported) (void);
+  void (*compute) (const void *, grub_uint64_t, grub_zfs_endian_t endian,
+		   zio_cksum_t *);
+};
+
+extern const struct fletcher_4_impl fletcher_4_impls[];
+
 #endif	/* _SYS_ZIO_CHECKSUM_H */
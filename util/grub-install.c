@@ -69,6 +69,7 @@ static char *macppcdir = NULL;
 static int force = 0;
 static int have_abstractions = 0;
 static int have_cryptodisk = 0;
+static int have_aesni = 0;
 static char * bootloader_id;
 static int have_load_cfg = 0;
 static FILE * load_cfg_f = NULL;
@@ -411,6 +412,12 @@ push_partmap_module (const char *map, void *data __attribute__ ((unused)))
 static void
 push_cryptodisk_module (const char *mod, void *data __attribute__ ((unused)))
 {
+  /* Only added once the target is known to be x86.  */
+  if (strcmp (mod, "aesni") == 0)
+    {
+      have_aesni = 1;
+      return;
+    }
   grub_install_push_module (mod);
 }
 
@@ -1308,6 +1315,14 @@ main (int argc, char *argv[])
 		       "Set `%s' in file `%s'"), "GRUB_ENABLE_CRYPTODISK=y",
 		     grub_util_get_config_filename ());
 
+  if (have_aesni)
+    {
+      const char *cpu = grub_install_get_platform_cpu (platform);
+
+      if (strcmp (cpu, "i386") == 0 || strcmp (cpu, "x86_64") == 0)
+	grub_install_push_module ("aesni");
+    }
+
   if (disk_module && grub_strcmp (disk_module, "ata") == 0)
     grub_install_push_module ("pata");
   else if (disk_module && grub_strcmp (disk_module, "native") == 0)